@@ -1,6 +1,7 @@
 #include "App.h"
 #include <stdexcept>
 #include <iostream>
+#include <cstring>
 
 #include "external/imgui/imgui.h"
 #include "external/imgui/imgui_impl_win32.h"
@@ -29,6 +30,13 @@ ETestRole g_eTestRole = k_ETestRole_Undefined;
 int g_nVirtualPortLocal = 0;  // Used when listening, and when connecting
 int g_nVirtualPortRemote = 0; // Only used when connecting
 
+// How often the loop wakes to poll the network while it has nothing to draw.  Connected, as often
+// as it used to when it presented every vsync; otherwise only signaling is waited for.
+static constexpr std::chrono::milliseconds k_ConnectedPollInterval{16};
+static constexpr std::chrono::milliseconds k_IdlePollInterval{100};
+// A focused text field is redrawn this often, for its caret to blink.
+static constexpr std::chrono::milliseconds k_CaretBlinkInterval{400};
+
 // std::unique_ptr<TrivialSignalingClient> pSignaling;
 
 void Quit(int rc)
@@ -67,6 +75,8 @@ void SendMessageToPeer(const char *pszMsg)
 // Called when a connection undergoes a state transition.
 void OnSteamNetConnectionStatusChanged(SteamNetConnectionStatusChangedCallback_t *pInfo)
 {
+	App::Get().requestRender();
+
 	const HSteamNetConnection temp = App::Get().GetPeerConnections().GetPeerConnection(pInfo->m_info.m_identityRemote);
 
 	const SteamNetworkingIdentity &remoteIdentity = pInfo->m_info.m_identityRemote;
@@ -201,6 +211,15 @@ App::App(int argc, const char **argv)
 				// Print monitor device name
 				std::wcout << L"  Monitor " << j << L": " << outputDesc.DeviceName << std::endl;
 
+				Output output;
+				output.adapterIndex = i;
+				output.outputIndex = j;
+				output.name.resize(WideCharToMultiByte(CP_UTF8, 0, outputDesc.DeviceName, -1, nullptr, 0, nullptr, nullptr));
+				WideCharToMultiByte(CP_UTF8, 0, outputDesc.DeviceName, -1, output.name.data(), (int)output.name.size(), nullptr, nullptr);
+				output.name.pop_back();
+				output.desktop = outputDesc.DesktopCoordinates;
+				m_Outputs.push_back(output);
+
 				// Now, let's get the current resolution of the monitor
 				// We can get the display mode using EnumDisplaySettingsW
 				DEVMODEW devMode; // Use DEVMODEW (wide-character version)
@@ -268,6 +287,7 @@ App::App(int argc, const char **argv)
 		// const char *pszTrivialSignalingService = "141.148.233.31:6969";
 
 		g_eTestRole = k_ETestRole_Symmetric;
+		float flFakeLossPercent = 0.0f;
 
 		// Parse the command line
 		for (int idxArg = 1; idxArg < argc; ++idxArg)
@@ -298,6 +318,25 @@ App::App(int argc, const char **argv)
 				const char *pszArg = GetArg();
 				TEST_InitLog(pszArg);
 			}
+			else if (!strcmp(pszSwitch, "--fec"))
+			{
+				// none, xor or rs, optionally with the redundancy: xor:0.2
+				const char *pszArg = GetArg();
+				FecConfig fec;
+				if (!strncmp(pszArg, "none", 4))
+					fec.scheme = FecScheme::None;
+				else if (!strncmp(pszArg, "xor", 3))
+					fec.scheme = FecScheme::Xor;
+				else if (!strncmp(pszArg, "rs", 2))
+					fec.scheme = FecScheme::ReedSolomon;
+				else
+					TEST_Fatal("'%s' is not none, xor or rs", pszArg);
+				if (const char *pszRedundancy = strchr(pszArg, ':'))
+					fec.redundancy = (float)atof(pszRedundancy + 1);
+				m_PeerConnections.SetFecConfig(fec);
+			}
+			else if (!strcmp(pszSwitch, "--fake-loss"))
+				flFakeLossPercent = (float)atof(GetArg());
 			else
 				TEST_Fatal("Unexpected command line argument '%s'", pszSwitch);
 		}
@@ -310,6 +349,10 @@ App::App(int argc, const char **argv)
 		// Initialize library, with the desired local identity
 		TEST_Init(&m_identityLocal);
 
+		// Drop our own packets, to see what FEC and resends make of a lossy connection.
+		if (flFakeLossPercent > 0.0f)
+			SteamNetworkingUtils()->SetGlobalConfigValueFloat(k_ESteamNetworkingConfig_FakePacketLoss_Send, flFakeLossPercent);
+
 		// Hardcode STUN servers
 		SteamNetworkingUtils()->SetGlobalConfigValueString(k_ESteamNetworkingConfig_P2P_STUN_ServerList, "stun.l.google.com:19302");
 
@@ -420,6 +463,14 @@ void App::CreateRenderTarget()
 
 void App::CleanupDeviceD3D()
 {
+	for (auto &[identity, screens] : m_RemoteScreens)
+	{
+		for (RemoteScreen &screen : screens)
+		{
+			CleanupRemoteTexture(screen);
+		}
+	}
+	m_RemoteScreens.clear();
 	CleanupRenderTarget();
 	if (m_pSwapChain)
 	{
@@ -447,6 +498,591 @@ void App::CleanupRenderTarget()
 	}
 }
 
+static bool SameCursor(const CursorState &a, const CursorState &b)
+{
+	return a.visible == b.visible && a.x == b.x && a.y == b.y && a.shapeId == b.shapeId && a.frameWidth == b.frameWidth && a.frameHeight == b.frameHeight;
+}
+
+// What of a peer's cursor can be drawn, nothing until its shape arrived.
+static CursorState GetDrawableCursor(const CursorReceiver &receiver)
+{
+	return receiver.GetShape() ? receiver.GetCursor() : CursorState();
+}
+
+// pCursor is drawn over the screen, nullptr for none.
+void App::UpdateRemoteTexture(RemoteScreen &screen, PlayoutBuffer &playout, const CursorReceiver *pCursor)
+{
+	const FrameBuffer &canvas = playout.GetCanvas();
+	if (canvas.width == 0 || canvas.height == 0)
+	{
+		return;
+	}
+	const CursorShape *pShape = pCursor ? pCursor->GetShape() : nullptr;
+	const CursorState cursor = pCursor ? GetDrawableCursor(*pCursor) : CursorState();
+	DirtyRegion &dirty = playout.GetDirtyRegion();
+	if (canvas.width != screen.width || canvas.height != screen.height)
+	{
+		CleanupRemoteTexture(screen);
+		D3D11_TEXTURE2D_DESC desc;
+		ZeroMemory(&desc, sizeof(desc));
+		desc.Width = canvas.width;
+		desc.Height = canvas.height;
+		desc.MipLevels = 1;
+		desc.ArraySize = 1;
+		desc.Format = DXGI_FORMAT_B8G8R8A8_UNORM;
+		desc.SampleDesc.Count = 1;
+		desc.Usage = D3D11_USAGE_DEFAULT;
+		desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+		if (FAILED(m_pd3dDevice->CreateTexture2D(&desc, nullptr, &screen.pTexture)) ||
+			FAILED(m_pd3dDevice->CreateShaderResourceView(screen.pTexture, nullptr, &screen.pTextureView)))
+		{
+			TEST_Printf("Failed to create the remote screen texture\n");
+			CleanupRemoteTexture(screen);
+			return;
+		}
+		screen.width = canvas.width;
+		screen.height = canvas.height;
+		screen.cursorRect = TileRect();
+		dirty.AddAll();
+	}
+	if (dirty.IsEmpty() && SameCursor(cursor, screen.cursor))
+	{
+		return;
+	}
+
+	// Only what changed, the canvas rows are the source rows of each box.  What the cursor covered
+	// is put back first, it is drawn again on top of it all.
+	auto upload = [&](const TileRect &rect, const uint8_t *pixels, UINT stride)
+	{
+		const D3D11_BOX box = {rect.x, rect.y, 0, rect.x + rect.width, rect.y + rect.height, 1};
+		m_pd3dDeviceContext->UpdateSubresource(screen.pTexture, 0, &box, pixels, stride, 0);
+	};
+	if (screen.cursorRect.width != 0)
+	{
+		upload(screen.cursorRect, canvas.Row(screen.cursorRect.y) + (size_t)screen.cursorRect.x * k_BytesPerPixel, canvas.stride);
+	}
+	for (const TileRect &rect : dirty.GetRects())
+	{
+		upload(rect, canvas.Row(rect.y) + (size_t)rect.x * k_BytesPerPixel, canvas.stride);
+	}
+	dirty.Clear();
+
+	screen.cursor = cursor;
+	screen.cursorRect = TileRect();
+	if (!cursor.visible || cursor.frameWidth == 0 || cursor.frameHeight == 0)
+	{
+		return;
+	}
+	// The position is of the full resolution frame, the canvas may be of a smaller layer.
+	const int32_t x = (int32_t)((int64_t)cursor.x * canvas.width / cursor.frameWidth);
+	const int32_t y = (int32_t)((int64_t)cursor.y * canvas.height / cursor.frameHeight);
+	const int32_t left = std::max(0, x - pShape->hotspotX);
+	const int32_t top = std::max(0, y - pShape->hotspotY);
+	const int32_t right = std::min((int32_t)canvas.width, x - pShape->hotspotX + pShape->width);
+	const int32_t bottom = std::min((int32_t)canvas.height, y - pShape->hotspotY + pShape->height);
+	if (left >= right || top >= bottom)
+	{
+		return;
+	}
+	const TileRect rect = {(uint32_t)left, (uint32_t)top, (uint32_t)(right - left), (uint32_t)(bottom - top)};
+	screen.cursorPatch.Resize(rect.width, rect.height);
+	for (uint32_t row = 0; row < rect.height; ++row)
+	{
+		std::memcpy(screen.cursorPatch.Row(row), canvas.Row(rect.y + row) + (size_t)rect.x * k_BytesPerPixel, (size_t)rect.width * k_BytesPerPixel);
+	}
+	DrawCursor(*pShape, x - left, y - top, screen.cursorPatch);
+	upload(rect, screen.cursorPatch.pixels.data(), screen.cursorPatch.stride);
+	screen.cursorRect = rect;
+}
+
+void App::CleanupRemoteTexture(RemoteScreen &screen)
+{
+	if (screen.pTextureView)
+	{
+		screen.pTextureView->Release();
+		screen.pTextureView = nullptr;
+	}
+	if (screen.pTexture)
+	{
+		screen.pTexture->Release();
+		screen.pTexture = nullptr;
+	}
+	screen.width = screen.height = 0;
+	screen.cursor = CursorState();
+	screen.cursorRect = TileRect();
+}
+
+// Of the monitor most of hwnd is on, 0 when Windows doesn't say.
+static uint32_t GetRefreshRate(HWND hwnd)
+{
+	MONITORINFOEXW info = {};
+	info.cbSize = sizeof(info);
+	DEVMODEW mode = {};
+	mode.dmSize = sizeof(mode);
+	if (!GetMonitorInfoW(MonitorFromWindow(hwnd, MONITOR_DEFAULTTONEAREST), &info) || !EnumDisplaySettingsW(info.szDevice, ENUM_CURRENT_SETTINGS, &mode) ||
+		mode.dmDisplayFrequency <= 1)
+	{
+		return 0;
+	}
+	return mode.dmDisplayFrequency;
+}
+
+void App::drawRemoteScreens()
+{
+	// Textures of peers that left or stopped sending first.
+	for (auto it = m_RemoteScreens.begin(); it != m_RemoteScreens.end();)
+	{
+		const auto &peers = m_PeerConnections.GetPeerConnections();
+		const auto peer = peers.find(it->first);
+		const bool connected = peer != peers.end() && peer->second.connectionStatus == ConnectionStatus::Connected;
+		bool any = false;
+		for (uint32_t stream = 0; stream < k_MaxStreams; ++stream)
+		{
+			if (!connected || !peer->second.frameReceivers[stream])
+			{
+				CleanupRemoteTexture(it->second[stream]);
+			}
+			any |= it->second[stream].pTexture != nullptr;
+		}
+		if (!any)
+		{
+			it = m_RemoteScreens.erase(it);
+			continue;
+		}
+		++it;
+	}
+
+	// A window per screen of each peer, each decoded into its own canvas.  Keys go nowhere unless
+	// one of them has focus.
+	m_HasInputTarget = false;
+	const auto now = std::chrono::steady_clock::now();
+	const uint32_t refreshRate = GetRefreshRate(m_Hwnd);
+	for (const auto &[identity, peerData] : m_PeerConnections.GetPeerConnections())
+	{
+		if (peerData.connectionStatus != ConnectionStatus::Connected)
+		{
+			continue;
+		}
+		for (uint32_t stream = 0; stream < k_MaxStreams; ++stream)
+		{
+			if (!peerData.frameReceivers[stream])
+			{
+				continue;
+			}
+			PlayoutBuffer &playout = peerData.frameReceivers[stream]->GetPlayout();
+			playout.Release(now);
+			RemoteScreen &screen = m_RemoteScreens[identity][stream];
+			// The cursor belongs to the first screen, see PeerConnections::SetCursor().
+			UpdateRemoteTexture(screen, playout, stream == 0 ? &peerData.frameReceivers[stream]->GetCursor() : nullptr);
+			if (!screen.pTextureView)
+			{
+				continue;
+			}
+			std::string title = "Remote screen - " + SteamNetworkingIdentityRender(identity);
+			if (stream != 0)
+			{
+				title += " #" + std::to_string(stream);
+			}
+			ImGui::SetNextWindowSize(ImVec2(screen.width / 2.0f, screen.height / 2.0f + ImGui::GetFrameHeight()), ImGuiCond_FirstUseEver);
+			if (ImGui::Begin(title.c_str()))
+			{
+				// Fitted to the window, so the sender picks the layer for the size it is shown at.
+				const ImVec2 available = ImGui::GetContentRegionAvail();
+				const float scale = std::min(available.x / screen.width, available.y / screen.height);
+				const ImVec2 size(std::max(1.0f, screen.width * scale), std::max(1.0f, screen.height * scale));
+				// A button under the image, so clicks on it don't drag the window.
+				const ImVec2 imageMin = ImGui::GetCursorScreenPos();
+				ImGui::InvisibleButton("screen", size, ImGuiButtonFlags_MouseButtonLeft | ImGuiButtonFlags_MouseButtonRight | ImGuiButtonFlags_MouseButtonMiddle);
+				ImGui::GetWindowDrawList()->AddImage((ImTextureID)screen.pTextureView, imageMin, ImVec2(imageMin.x + size.x, imageMin.y + size.y));
+				reportViewport(identity, stream, imageMin, size, refreshRate);
+				// Input positions are of the first screen, as the cursor is.
+				if (stream == 0)
+				{
+					forwardInput(identity, imageMin, size);
+				}
+			}
+			ImGui::End();
+		}
+	}
+}
+
+// Which part of a remote screen drawn at imageMin with size is on our screen, at what size and
+// refresh rate, so the sender only encodes what we see and picks a layer for it.
+void App::reportViewport(const SteamNetworkingIdentity &identity, uint32_t stream, const ImVec2 &imageMin, const ImVec2 &size, uint32_t refreshRate)
+{
+	ImVec2 visibleMin = imageMin;
+	ImVec2 visibleMax(imageMin.x + size.x, imageMin.y + size.y);
+	const ImVec2 windowMin = ImGui::GetWindowPos();
+	const ImVec2 windowMax(windowMin.x + ImGui::GetWindowWidth(), windowMin.y + ImGui::GetWindowHeight());
+	const ImGuiViewport *viewport = ImGui::GetMainViewport();
+	visibleMin.x = std::max({visibleMin.x, windowMin.x, viewport->Pos.x});
+	visibleMin.y = std::max({visibleMin.y, windowMin.y, viewport->Pos.y});
+	visibleMax.x = std::min({visibleMax.x, windowMax.x, viewport->Pos.x + viewport->Size.x});
+	visibleMax.y = std::min({visibleMax.y, windowMax.y, viewport->Pos.y + viewport->Size.y});
+	if (visibleMax.x <= visibleMin.x || visibleMax.y <= visibleMin.y)
+	{
+		return;
+	}
+
+	auto toFrame = [](float offset, float extent)
+	{
+		return (uint16_t)std::clamp(offset / extent * 65535.0f, 0.0f, 65535.0f);
+	};
+	ViewportRect rect;
+	rect.left = toFrame(visibleMin.x - imageMin.x, size.x);
+	rect.top = toFrame(visibleMin.y - imageMin.y, size.y);
+	rect.right = toFrame(visibleMax.x - imageMin.x, size.x);
+	rect.bottom = toFrame(visibleMax.y - imageMin.y, size.y);
+	m_PeerConnections.SetViewport(identity, rect, (uint32_t)(visibleMax.x - visibleMin.x), (uint32_t)(visibleMax.y - visibleMin.y), refreshRate, stream);
+}
+
+// Our input over a peer's first screen, drawn at imageMin with size, goes to the peer.  Keys go to
+// whichever peer's screen has focus, see onKey().
+void App::forwardInput(const SteamNetworkingIdentity &identity, const ImVec2 &imageMin, const ImVec2 &size)
+{
+	if (ImGui::IsWindowFocused())
+	{
+		m_InputTarget = identity;
+		m_HasInputTarget = true;
+	}
+
+	const ImGuiIO &io = ImGui::GetIO();
+	const bool hovered = ImGui::IsItemHovered();
+	InputEvent event;
+	if (hovered && (io.MouseDelta.x != 0.0f || io.MouseDelta.y != 0.0f))
+	{
+		event.type = (uint8_t)InputEventType::MouseMove;
+		event.x = (int32_t)std::clamp((io.MousePos.x - imageMin.x) / size.x * 65535.0f, 0.0f, 65535.0f);
+		event.y = (int32_t)std::clamp((io.MousePos.y - imageMin.y) / size.y * 65535.0f, 0.0f, 65535.0f);
+		m_PeerConnections.SendInput(identity, event);
+	}
+	for (int button = 0; button < 5; ++button)
+	{
+		const uint32_t bit = 1u << button;
+		const bool down = hovered && ImGui::IsMouseClicked(button);
+		const bool up = (m_InputButtons & bit) && ImGui::IsMouseReleased(button);
+		if (!down && !up)
+		{
+			continue;
+		}
+		m_InputButtons = down ? m_InputButtons | bit : m_InputButtons & ~bit;
+		event = InputEvent();
+		event.type = (uint8_t)InputEventType::Button;
+		event.flags = down ? InputEvent::k_FlagDown : 0;
+		event.code = (uint16_t)button;
+		m_PeerConnections.SendInput(identity, event);
+	}
+	if (hovered && (io.MouseWheel != 0.0f || io.MouseWheelH != 0.0f))
+	{
+		// ImGui's horizontal wheel is positive to the left, Windows' to the right.
+		event = InputEvent();
+		event.type = (uint8_t)InputEventType::Wheel;
+		event.x = (int32_t)(-io.MouseWheelH * 120.0f);
+		event.y = (int32_t)(io.MouseWheel * 120.0f);
+		m_PeerConnections.SendInput(identity, event);
+	}
+}
+
+void App::onKey(uint16_t virtualKey, bool down)
+{
+	if (!m_HasInputTarget)
+	{
+		return;
+	}
+	InputEvent event;
+	event.type = (uint8_t)InputEventType::Key;
+	event.flags = down ? InputEvent::k_FlagDown : 0;
+	event.code = virtualKey;
+	m_PeerConnections.SendInput(m_InputTarget, event);
+}
+
+// Where on the virtual desktop our first screen's frames are, false when they aren't of it.
+bool App::getSharedRect(RECT &rect) const
+{
+	const SharedScreen &shared = m_SharedScreens[0];
+	if (m_Outputs.empty() || !shared.capture || shared.mode == ShareMode::Recording)
+	{
+		return false;
+	}
+	const RECT &desktop = m_Outputs[0].desktop;
+	TileRect crop = {0, 0, (uint32_t)(desktop.right - desktop.left), (uint32_t)(desktop.bottom - desktop.top)};
+	if (shared.mode == ShareMode::Region)
+	{
+		crop = {(uint32_t)shared.region[0], (uint32_t)shared.region[1], (uint32_t)shared.region[2], (uint32_t)shared.region[3]};
+	}
+	else if (shared.mode == ShareMode::Window && !WindowCropRegion(shared.window, desktop).GetRect(0, 0, crop))
+	{
+		return false;
+	}
+	rect.left = desktop.left + (LONG)crop.x;
+	rect.top = desktop.top + (LONG)crop.y;
+	rect.right = std::min(rect.left + (LONG)crop.width, desktop.right);
+	rect.bottom = std::min(rect.top + (LONG)crop.height, desktop.bottom);
+	return rect.left < rect.right && rect.top < rect.bottom;
+}
+
+// Plays a viewer's input on our desktop.  Pointer positions are of the first screen's frames.
+void App::applyInput(std::span<const InputEvent> events)
+{
+	static constexpr DWORD k_ButtonDown[] = {MOUSEEVENTF_LEFTDOWN, MOUSEEVENTF_RIGHTDOWN, MOUSEEVENTF_MIDDLEDOWN, MOUSEEVENTF_XDOWN, MOUSEEVENTF_XDOWN};
+	static constexpr DWORD k_ButtonUp[] = {MOUSEEVENTF_LEFTUP, MOUSEEVENTF_RIGHTUP, MOUSEEVENTF_MIDDLEUP, MOUSEEVENTF_XUP, MOUSEEVENTF_XUP};
+
+	RECT shared;
+	const bool hasRect = getSharedRect(shared);
+	const LONG virtualLeft = GetSystemMetrics(SM_XVIRTUALSCREEN);
+	const LONG virtualTop = GetSystemMetrics(SM_YVIRTUALSCREEN);
+	const LONG virtualWidth = std::max(2, GetSystemMetrics(SM_CXVIRTUALSCREEN));
+	const LONG virtualHeight = std::max(2, GetSystemMetrics(SM_CYVIRTUALSCREEN));
+
+	m_Injected.clear();
+	for (const InputEvent &event : events)
+	{
+		INPUT input = {};
+		input.type = INPUT_MOUSE;
+		switch ((InputEventType)event.type)
+		{
+		case InputEventType::Key:
+			input.type = INPUT_KEYBOARD;
+			input.ki.wVk = (WORD)event.code;
+			input.ki.dwFlags = (event.flags & InputEvent::k_FlagDown) ? 0 : KEYEVENTF_KEYUP;
+			break;
+		case InputEventType::Button:
+			if (event.code >= std::size(k_ButtonDown))
+			{
+				continue;
+			}
+			input.mi.dwFlags = (event.flags & InputEvent::k_FlagDown) ? k_ButtonDown[event.code] : k_ButtonUp[event.code];
+			input.mi.mouseData = event.code == 3 ? XBUTTON1 : event.code == 4 ? XBUTTON2 : 0;
+			break;
+		case InputEventType::Wheel:
+			if (event.x != 0)
+			{
+				input.mi.dwFlags = MOUSEEVENTF_HWHEEL;
+				input.mi.mouseData = (DWORD)event.x;
+				m_Injected.push_back(input);
+			}
+			if (event.y == 0)
+			{
+				continue;
+			}
+			input.mi.dwFlags = MOUSEEVENTF_WHEEL;
+			input.mi.mouseData = (DWORD)event.y;
+			break;
+		case InputEventType::MouseMove:
+		{
+			if (!hasRect)
+			{
+				continue;
+			}
+			// To a desktop pixel, and from there to the 0..65535 of the whole virtual desktop.
+			const LONG x = shared.left + (LONG)((int64_t)std::clamp(event.x, 0, 65535) * (shared.right - shared.left - 1) / 65535);
+			const LONG y = shared.top + (LONG)((int64_t)std::clamp(event.y, 0, 65535) * (shared.bottom - shared.top - 1) / 65535);
+			input.mi.dx = (LONG)((int64_t)(x - virtualLeft) * 65535 / (virtualWidth - 1));
+			input.mi.dy = (LONG)((int64_t)(y - virtualTop) * 65535 / (virtualHeight - 1));
+			input.mi.dwFlags = MOUSEEVENTF_MOVE | MOUSEEVENTF_ABSOLUTE | MOUSEEVENTF_VIRTUALDESK;
+			break;
+		}
+		case InputEventType::MouseDelta:
+			input.mi.dx = event.x;
+			input.mi.dy = event.y;
+			input.mi.dwFlags = MOUSEEVENTF_MOVE;
+			break;
+		default:
+			continue;
+		}
+		m_Injected.push_back(input);
+	}
+	if (!m_Injected.empty())
+	{
+		::SendInput((UINT)m_Injected.size(), m_Injected.data(), sizeof(INPUT));
+	}
+}
+
+static BOOL CALLBACK AddShareableWindow(HWND hwnd, LPARAM lParam)
+{
+	wchar_t title[256];
+	if (IsWindowVisible(hwnd) && !(GetWindowLongW(hwnd, GWL_EXSTYLE) & WS_EX_TOOLWINDOW) && GetWindowTextW(hwnd, title, 256) > 0)
+	{
+		reinterpret_cast<std::vector<HWND> *>(lParam)->push_back(hwnd);
+	}
+	return TRUE;
+}
+
+static std::string GetWindowTitle(HWND hwnd)
+{
+	wchar_t title[256];
+	const int length = GetWindowTextW(hwnd, title, 256);
+	std::string utf8(WideCharToMultiByte(CP_UTF8, 0, title, length, nullptr, 0, nullptr, nullptr), '\0');
+	WideCharToMultiByte(CP_UTF8, 0, title, length, utf8.data(), (int)utf8.size(), nullptr, nullptr);
+	return utf8;
+}
+
+void App::startSharing(uint32_t stream)
+{
+	const Output &output = m_Outputs[stream];
+	SharedScreen &shared = m_SharedScreens[stream];
+	// The old capture thread stops before the new one reads the monitor.
+	shared.capture.reset();
+	shared.pRegion = nullptr;
+
+	std::unique_ptr<IFrameSource> source;
+	if (shared.mode == ShareMode::Recording)
+	{
+		source = std::make_unique<ReplayFrameSource>(shared.replayPath, ReplaySpeed::Original, true);
+	}
+	else
+	{
+		source = std::make_unique<DesktopDuplicationSource>(output.adapterIndex, output.outputIndex);
+	}
+	if (shared.mode == ShareMode::Region)
+	{
+		auto region = std::make_unique<FixedCropRegion>(TileRect{(uint32_t)shared.region[0], (uint32_t)shared.region[1], (uint32_t)shared.region[2], (uint32_t)shared.region[3]});
+		shared.pRegion = region.get();
+		source = std::make_unique<CropFrameSource>(std::move(source), std::move(region));
+	}
+	else if (shared.mode == ShareMode::Window)
+	{
+		source = std::make_unique<CropFrameSource>(std::move(source), std::make_unique<WindowCropRegion>(shared.window, output.desktop));
+	}
+	if (shared.record && shared.mode != ShareMode::Recording)
+	{
+		// What the viewers get, after cropping.
+		auto recorder = std::make_unique<FrameRecorder>();
+		const std::string path = "stream" + std::to_string(stream) + ".rec";
+		if (recorder->Open(path.c_str()))
+		{
+			source = std::make_unique<RecordingFrameSource>(std::move(source), std::move(recorder));
+		}
+		else
+		{
+			TEST_Printf("Can't record to %s\n", path.c_str());
+		}
+	}
+	shared.capture = std::make_unique<CaptureStream>(stream, std::move(source), m_EncodePool, m_BlockPool);
+}
+
+void App::drawSharing()
+{
+	static const char *const k_ShareModeNames[] = {"Whole screen", "Region", "Window", "Recording"};
+
+	ImGui::Begin("Sharing");
+	ImGui::Text("Our monitors");
+	ImGui::SameLine();
+	ImGui::Checkbox("Let viewers control the first", &m_AllowControl);
+	for (uint32_t stream = 0; stream < m_Outputs.size() && stream < k_MaxStreams; ++stream)
+	{
+		const Output &output = m_Outputs[stream];
+		SharedScreen &shared = m_SharedScreens[stream];
+		ImGui::PushID((int)stream);
+		bool sharing = shared.capture != nullptr;
+		const std::string label = std::to_string(stream) + ": " + output.name;
+		if (ImGui::Checkbox(label.c_str(), &sharing))
+		{
+			if (sharing)
+			{
+				startSharing(stream);
+			}
+			else
+			{
+				shared.capture.reset();
+				shared.pRegion = nullptr;
+			}
+		}
+		if (shared.capture)
+		{
+			ImGui::SameLine();
+			ImGui::Text(!shared.capture->IsActive() ? "(nobody watching)" : m_PeerConnections.IsStreamIdle(stream) ? "(watched, idle)" : "(watched)");
+		}
+
+		bool restart = false;
+		int mode = (int)shared.mode;
+		if (ImGui::Combo("Share", &mode, k_ShareModeNames, IM_ARRAYSIZE(k_ShareModeNames)))
+		{
+			shared.mode = (ShareMode)mode;
+			restart = true;
+		}
+		if (shared.mode == ShareMode::Region && ImGui::InputInt4("x, y, width, height", shared.region))
+		{
+			for (int &value : shared.region)
+			{
+				value = std::max(value, 0);
+			}
+			// Moving or resizing the region doesn't restart capture.
+			if (shared.pRegion)
+			{
+				shared.pRegion->Set({(uint32_t)shared.region[0], (uint32_t)shared.region[1], (uint32_t)shared.region[2], (uint32_t)shared.region[3]});
+			}
+		}
+		if (shared.mode == ShareMode::Window)
+		{
+			const std::string current = shared.window ? GetWindowTitle(shared.window) : "(pick one)";
+			if (ImGui::BeginCombo("Window", current.c_str()))
+			{
+				std::vector<HWND> windows;
+				EnumWindows(AddShareableWindow, reinterpret_cast<LPARAM>(&windows));
+				for (HWND hwnd : windows)
+				{
+					ImGui::PushID(hwnd);
+					if (ImGui::Selectable(GetWindowTitle(hwnd).c_str(), hwnd == shared.window))
+					{
+						shared.window = hwnd;
+						restart = true;
+					}
+					ImGui::PopID();
+				}
+				ImGui::EndCombo();
+			}
+		}
+		if (shared.mode == ShareMode::Recording && ImGui::InputText("File", shared.replayPath, sizeof(shared.replayPath), ImGuiInputTextFlags_EnterReturnsTrue))
+		{
+			restart = true;
+		}
+		if (shared.mode != ShareMode::Recording && ImGui::Checkbox("Record", &shared.record))
+		{
+			restart = true;
+		}
+		if (restart && shared.capture)
+		{
+			startSharing(stream);
+		}
+		ImGui::PopID();
+	}
+
+	ImGui::Separator();
+	ImGui::Text("Their monitors");
+	for (const auto &[identity, peerData] : m_PeerConnections.GetPeerConnections())
+	{
+		if (peerData.connectionStatus != ConnectionStatus::Connected)
+		{
+			continue;
+		}
+		ImGui::PushID(&peerData);
+		ImGui::Text("%s", identity.GetGenericString());
+		uint32_t wanted = peerData.wantedStreams;
+		for (uint32_t stream = 0; stream < k_MaxStreams; ++stream)
+		{
+			bool subscribed = (wanted & (1u << stream)) != 0;
+			ImGui::SameLine();
+			if (ImGui::Checkbox(std::to_string(stream).c_str(), &subscribed))
+			{
+				wanted ^= 1u << stream;
+			}
+		}
+		if (wanted != peerData.wantedStreams)
+		{
+			m_PeerConnections.Subscribe(identity, wanted);
+		}
+		// Smooth holds frames back by what the path jitters, low latency shows them as they come.
+		bool lowLatency = peerData.playoutMode == PlayoutMode::LowLatency;
+		if (ImGui::Checkbox("Low latency", &lowLatency))
+		{
+			m_PeerConnections.SetPlayoutMode(identity, lowLatency ? PlayoutMode::LowLatency : PlayoutMode::Smooth);
+		}
+		ImGui::PopID();
+	}
+	ImGui::End();
+}
+
 void App::initImGui()
 {
 	// Setup Dear ImGui context
@@ -501,7 +1137,6 @@ void App::initImGui()
 
 void App::run()
 {
-	MSG msg;
 	while (m_Running)
 	{
 		onMessage();
@@ -514,11 +1149,11 @@ void App::run()
 		if (m_SwapChainOccluded && m_pSwapChain->Present(0, DXGI_PRESENT_TEST) == DXGI_STATUS_OCCLUDED)
 		{
 			m_SwapChainOccluded = true;
-			std::cout << "Window is occluded not rendering ui" << std::endl;
 		}
-		else
+		else if (m_SwapChainOccluded)
 		{
 			m_SwapChainOccluded = false;
+			m_RenderScheduler.Invalidate();
 		}
 
 		// Handle window resize (we don't resize directly in the WM_SIZE handler)
@@ -529,25 +1164,89 @@ void App::run()
 			m_pSwapChain->ResizeBuffers(0, m_ResizeWidth, m_ResizeHeight, DXGI_FORMAT_UNKNOWN, 0);
 			m_ResizeWidth = m_ResizeHeight = 0;
 			CreateRenderTarget();
+			m_RenderScheduler.Invalidate();
 			// m_DesktopCapture.reset(m_pd3dDevice, m_pd3dDeviceContext, 0);
 			// m_DesktopCapture.startCapture();
 		}
 
 		onUpdate();
 
-		// Render the frame, but only if the window is not occluded.
-		if (m_SwapChainOccluded == false)
+		// Draw when the next remote frame of any peer's screen is due.
+		for (const auto &[identity, peerData] : m_PeerConnections.GetPeerConnections())
 		{
-			onImGuiRender();
+			if (peerData.connectionStatus != ConnectionStatus::Connected)
+			{
+				continue;
+			}
+			for (const std::shared_ptr<FrameReceiver> &frameReceiver : peerData.frameReceivers)
+			{
+				if (!frameReceiver)
+				{
+					continue;
+				}
+				PlayoutBuffer &playout = frameReceiver->GetPlayout();
+				m_RenderScheduler.RenderAt(playout.GetNextRelease());
+				if (!playout.GetDirtyRegion().IsEmpty())
+				{
+					m_RenderScheduler.Invalidate();
+				}
+			}
+			// The cursor moves on its own lane, without a frame.
+			const auto screens = m_RemoteScreens.find(identity);
+			if (peerData.frameReceivers[0] && screens != m_RemoteScreens.end() && screens->second[0].pTexture &&
+				!SameCursor(GetDrawableCursor(peerData.frameReceivers[0]->GetCursor()), screens->second[0].cursor))
+			{
+				m_RenderScheduler.Invalidate();
+			}
+		}
+
+		// Nothing changed, or the window can't be seen: sleep until a window message arrives or
+		// the network is due to be polled.
+		const auto now = std::chrono::steady_clock::now();
+		if (m_SwapChainOccluded)
+		{
+			waitForWork(m_RenderScheduler.GetPollInterval());
+			continue;
+		}
+		if (!m_RenderScheduler.ShouldRender(now))
+		{
+			waitForWork(m_RenderScheduler.GetWaitTime(now));
+			continue;
 		}
 
+		onImGuiRender();
+
 		// Present
 		HRESULT hr = m_pSwapChain->Present(1, 0); // Present with vsync
 		// HRESULT hr = m_pSwapChain->Present(0, 0); // Present without vsync
 		m_SwapChainOccluded = (hr == DXGI_STATUS_OCCLUDED);
+
+		// With vsync Present() returns once the frame is up, which ends the remote frames' latency.
+		const auto presented = std::chrono::steady_clock::now();
+		for (const auto &[identity, peerData] : m_PeerConnections.GetPeerConnections())
+		{
+			for (const std::shared_ptr<FrameReceiver> &frameReceiver : peerData.frameReceivers)
+			{
+				if (frameReceiver)
+				{
+					frameReceiver->OnPresented(presented);
+				}
+			}
+		}
 	}
 }
 
+void App::waitForWork(std::chrono::steady_clock::duration timeout)
+{
+	// Rounded up, waking early would only spin through the loop again.
+	const auto ms = std::chrono::ceil<std::chrono::milliseconds>(timeout).count();
+	if (ms <= 0)
+	{
+		return;
+	}
+	::MsgWaitForMultipleObjectsEx(0, nullptr, (DWORD)ms, QS_ALLINPUT, MWMO_INPUTAVAILABLE);
+}
+
 void App::onUpdate()
 {
 	// return;
@@ -563,6 +1262,42 @@ void App::onUpdate()
 		log(message);
 	}
 
+	bool connected = false;
+	for (const auto &[identity, peerData] : m_PeerConnections.GetPeerConnections())
+	{
+		connected |= peerData.connectionStatus == ConnectionStatus::Connected;
+	}
+	m_RenderScheduler.SetPollInterval(connected ? k_ConnectedPollInterval : k_IdlePollInterval);
+
+	// Each shared monitor captures only while someone watches it.
+	for (const SharedScreen &shared : m_SharedScreens)
+	{
+		if (shared.capture)
+		{
+			m_PeerConnections.SendStream(*shared.capture);
+		}
+	}
+
+	// Viewers' input, taken every time so it doesn't pile up while we don't act on it.
+	for (const auto &[identity, peerData] : m_PeerConnections.GetPeerConnections())
+	{
+		if (m_PeerConnections.TakeInput(identity, m_Input) && m_AllowControl)
+		{
+			applyInput(m_Input);
+		}
+	}
+
+	// Our cursor goes with the first screen, viewers draw it over that one.
+	const uint32_t shapeId = m_CursorShape.id;
+	if (m_SharedScreens[0].capture && m_SharedScreens[0].capture->GetCursor(m_Cursor, m_CursorShape))
+	{
+		if (m_CursorShape.id != shapeId)
+		{
+			m_PeerConnections.SetCursorShape(m_CursorShape);
+		}
+		m_PeerConnections.SetCursor(m_Cursor);
+	}
+
 	// If we have a connection, then poll it for messages
 	// if (g_hConnection != k_HSteamNetConnection_Invalid)
 	// {
@@ -632,10 +1367,32 @@ void App::onImGuiRender()
 			continue;
 		}
 		ImGui::Text("%s - %s", identity.GetGenericString(), peerData.GetStatusString());
+		for (const std::shared_ptr<FrameReceiver> &frameReceiver : peerData.frameReceivers)
+		{
+			if (!frameReceiver)
+			{
+				continue;
+			}
+			const LatencyTrace &latency = frameReceiver->GetLatency();
+			ImGui::Text("  Screen %u latency p50 %.1f ms, p95 %.1f ms, p99 %.1f ms", frameReceiver->GetStream(),
+						latency.GetPercentile(LatencyStage::Total, 0.50).count() / 1000.0,
+						latency.GetPercentile(LatencyStage::Total, 0.95).count() / 1000.0,
+						latency.GetPercentile(LatencyStage::Total, 0.99).count() / 1000.0);
+		}
+	}
+	if (ImGui::Button("Dump latency"))
+	{
+		if (!m_PeerConnections.DumpLatency("latency.txt"))
+		{
+			log("Failed to write latency.txt");
+		}
 	}
 	ImGui::ShowDebugLogWindow();
 	ImGui::End();
 
+	drawRemoteScreens();
+	drawSharing();
+
 	ImGui::Begin("Logs");
 	for (const auto &log : m_Logs)
 	{
@@ -723,6 +1480,14 @@ void App::onImGuiRender()
 		ImGui::End();
 	}
 
+	// A held button, slider or scrollbar repeats and scrolls with no window message to wake the loop.
+	m_RenderScheduler.SetAnimating(ImGui::IsAnyItemActive() && ImGui::IsAnyMouseDown());
+
+	if (io.WantTextInput)
+	{
+		m_RenderScheduler.RenderAt(std::chrono::steady_clock::now() + k_CaretBlinkInterval);
+	}
+
 	// Rendering
 	ImGui::Render();
 	// const float clear_color_with_alpha[4] = {clear_color.x * clear_color.w, clear_color.y * clear_color.w, clear_color.z * clear_color.w, clear_color.w};
@@ -749,6 +1514,7 @@ void App::onMessage()
 		::DispatchMessage(&msg);
 		if (msg.message == WM_QUIT)
 			m_Running = false;
+		m_RenderScheduler.OnInput();
 	}
 }
 void App::shutdown()
@@ -791,6 +1557,12 @@ LRESULT WINAPI WndProc(HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam)
 		// m_ResizeHeight = (UINT)HIWORD(lParam);
 		app.resize((UINT)LOWORD(lParam), (UINT)HIWORD(lParam));
 		return 0;
+	case WM_KEYDOWN:
+	case WM_SYSKEYDOWN:
+	case WM_KEYUP:
+	case WM_SYSKEYUP:
+		app.onKey((uint16_t)wParam, msg == WM_KEYDOWN || msg == WM_SYSKEYDOWN);
+		break;
 	case WM_SYSCOMMAND:
 		if ((wParam & 0xfff0) == SC_KEYMENU) // Disable ALT application menu
 			return 0;
@@ -16,9 +16,19 @@
 #include <chrono>
 #include <span>
 #include <memory>
+#include <unordered_map>
 
 #include "Networking/TrivialSignalingServer.h"
 #include "Networking/PeerConnections.h"
+#include "Streaming/RenderScheduler.h"
+#include "Streaming/CaptureStream.h"
+#include "Streaming/CropFrameSource.h"
+#include "Streaming/FrameRecording.h"
+#include "Streaming/ReplayFrameSource.h"
+#include "Capture/DesktopDuplicationSource.h"
+#include "Capture/WindowCropRegion.h"
+
+struct ImVec2;
 
 class App
 {
@@ -52,6 +62,16 @@ public:
 	void log(const std::string &msg)
 	{
 		m_Logs.push_back(msg);
+		m_RenderScheduler.Invalidate();
+	}
+
+	// A key went down or up in our window, for the remote screen that has focus if any.
+	void onKey(uint16_t virtualKey, bool down);
+
+	// Something the UI shows changed outside of the loop, e.g. a connection's status.
+	void requestRender()
+	{
+		m_RenderScheduler.Invalidate();
 	}
 
 	static App& Get();
@@ -61,20 +81,72 @@ public:
 	SteamNetworkingIdentity GetRemoteIdentity() const { return m_identityRemote; }
 
 private:
+	// A peer's screen, uploaded a changed region at a time.
+	struct RemoteScreen
+	{
+		ID3D11Texture2D *pTexture = nullptr;
+		ID3D11ShaderResourceView *pTextureView = nullptr;
+		UINT width = 0, height = 0;
+		// The cursor drawn over the texture, the canvas never has it: as it was, where, and the
+		// canvas under it with the cursor blended in.
+		CursorState cursor;
+		TileRect cursorRect;
+		FrameBuffer cursorPatch;
+	};
+
+	// A monitor we can share, stream n is the n-th one found.
+	struct Output
+	{
+		UINT adapterIndex = 0, outputIndex = 0;
+		std::string name;
+		RECT desktop = {}; // where on the virtual desktop
+	};
+
+	enum class ShareMode
+	{
+		Screen = 0,
+		Region,
+		Window,
+		Recording
+	};
+
+	// What of a monitor we share, and the stream capturing it while we do.
+	struct SharedScreen
+	{
+		std::unique_ptr<CaptureStream> capture;
+		ShareMode mode = ShareMode::Screen;
+		int region[4] = {0, 0, 1280, 720}; // x, y, width, height
+		FixedCropRegion *pRegion = nullptr; // owned by capture, in region mode
+		HWND window = nullptr;
+		char replayPath[260] = "";
+		bool record = false; // to stream<n>.rec while sharing
+	};
+
 	void onUpdate();
 	void initImGui();
 	void onMessage();
 	void onImGuiRender();
+	void waitForWork(std::chrono::steady_clock::duration timeout);
 
 	bool CreateDeviceD3D(HWND hWnd);
 	void CreateRenderTarget();
 	void CleanupDeviceD3D();
 	void CleanupRenderTarget();
+	void UpdateRemoteTexture(RemoteScreen &screen, PlayoutBuffer &playout, const CursorReceiver *pCursor);
+	void CleanupRemoteTexture(RemoteScreen &screen);
+	void drawRemoteScreens();
+	void reportViewport(const SteamNetworkingIdentity &identity, uint32_t stream, const ImVec2 &imageMin, const ImVec2 &size, uint32_t refreshRate);
+	void forwardInput(const SteamNetworkingIdentity &identity, const ImVec2 &imageMin, const ImVec2 &size);
+	bool getSharedRect(RECT &rect) const;
+	void applyInput(std::span<const InputEvent> events);
+	void drawSharing();
+	void startSharing(uint32_t stream);
 
 	void initWinsock();
 
 private:
 	bool m_Running = true;
+	RenderScheduler m_RenderScheduler;
 	HWND m_Hwnd = nullptr;
 	WNDCLASSEXW m_Wc;
 	ID3D11Device *m_pd3dDevice = nullptr;
@@ -83,6 +155,26 @@ private:
 	bool m_SwapChainOccluded = false;
 	UINT m_ResizeWidth = 0, m_ResizeHeight = 0;
 	ID3D11RenderTargetView *m_mainRenderTargetView = nullptr;
+	// Of every connected peer that sends us its screens, by stream.
+	std::unordered_map<SteamNetworkingIdentity, std::array<RemoteScreen, k_MaxStreams>> m_RemoteScreens;
+
+	std::vector<Output> m_Outputs;
+	// After the pools they encode with, so capture stops first.
+	WorkStealingPool m_EncodePool;
+	ArenaBlockPool m_BlockPool;
+	std::array<SharedScreen, k_MaxStreams> m_SharedScreens;
+	// Ours, as last handed to m_PeerConnections.
+	CursorState m_Cursor;
+	CursorShape m_CursorShape;
+	// Viewers' input is acted on only while this is set, and dropped otherwise.
+	bool m_AllowControl = false;
+	std::vector<InputEvent> m_Input;
+	std::vector<INPUT> m_Injected;
+
+	// The peer whose first screen has focus gets our keys.
+	SteamNetworkingIdentity m_InputTarget;
+	bool m_HasInputTarget = false;
+	uint32_t m_InputButtons = 0; // went down over its screen, their release goes there too
 
 	static App *s_Instance;
 
@@ -0,0 +1,383 @@
+#include "DesktopDuplicationSource.h"
+
+#include <dwmapi.h>
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+#include "test_common.h"
+
+DesktopDuplicationSource::DesktopDuplicationSource(UINT adapterIndex, UINT outputIndex)
+	: m_AdapterIndex(adapterIndex), m_OutputIndex(outputIndex)
+{
+}
+
+DesktopDuplicationSource::~DesktopDuplicationSource()
+{
+	Cleanup();
+}
+
+bool DesktopDuplicationSource::Initialize()
+{
+	IDXGIFactory1 *pFactory = nullptr;
+	IDXGIAdapter1 *pAdapter = nullptr;
+	IDXGIOutput *pOutput = nullptr;
+	IDXGIOutput1 *pOutput1 = nullptr;
+	bool ok = false;
+
+	if (SUCCEEDED(CreateDXGIFactory1(__uuidof(IDXGIFactory1), (void **)&pFactory)) &&
+		pFactory->EnumAdapters1(m_AdapterIndex, &pAdapter) != DXGI_ERROR_NOT_FOUND &&
+		pAdapter->EnumOutputs(m_OutputIndex, &pOutput) != DXGI_ERROR_NOT_FOUND &&
+		SUCCEEDED(pOutput->QueryInterface(__uuidof(IDXGIOutput1), (void **)&pOutput1)) &&
+		SUCCEEDED(D3D11CreateDevice(pAdapter, D3D_DRIVER_TYPE_UNKNOWN, nullptr, 0, nullptr, 0, D3D11_SDK_VERSION, &m_pDevice, nullptr, &m_pContext)) &&
+		SUCCEEDED(pOutput1->DuplicateOutput(m_pDevice, &m_pDuplication)))
+	{
+		DXGI_OUTDUPL_DESC desc;
+		m_pDuplication->GetDesc(&desc);
+		m_Width = desc.ModeDesc.Width;
+		m_Height = desc.ModeDesc.Height;
+		DXGI_OUTPUT_DESC outputDesc;
+		pOutput->GetDesc(&outputDesc);
+		m_Monitor = outputDesc.DesktopCoordinates;
+		// Duplication reports the pointer again, hidden until it does.
+		m_Cursor = CursorState();
+		m_Cursor.frameWidth = m_Width;
+		m_Cursor.frameHeight = m_Height;
+
+		D3D11_TEXTURE2D_DESC textureDesc;
+		ZeroMemory(&textureDesc, sizeof(textureDesc));
+		textureDesc.Width = m_Width;
+		textureDesc.Height = m_Height;
+		textureDesc.MipLevels = 1;
+		textureDesc.ArraySize = 1;
+		textureDesc.Format = DXGI_FORMAT_B8G8R8A8_UNORM;
+		textureDesc.SampleDesc.Count = 1;
+		textureDesc.Usage = D3D11_USAGE_DEFAULT;
+		ok = SUCCEEDED(m_pDevice->CreateTexture2D(&textureDesc, nullptr, &m_pDesktop));
+		textureDesc.Usage = D3D11_USAGE_STAGING;
+		textureDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+		ok = ok && SUCCEEDED(m_pDevice->CreateTexture2D(&textureDesc, nullptr, &m_pStaging));
+	}
+
+	if (pOutput1)
+		pOutput1->Release();
+	if (pOutput)
+		pOutput->Release();
+	if (pAdapter)
+		pAdapter->Release();
+	if (pFactory)
+		pFactory->Release();
+
+	if (!ok)
+	{
+		TEST_Printf("Failed to duplicate output %u of adapter %u\n", m_OutputIndex, m_AdapterIndex);
+		Cleanup();
+	}
+	return ok;
+}
+
+void DesktopDuplicationSource::Cleanup()
+{
+	if (m_Mapped)
+	{
+		m_pContext->Unmap(m_pStaging, 0);
+		m_Mapped = false;
+	}
+	if (m_pStaging)
+	{
+		m_pStaging->Release();
+		m_pStaging = nullptr;
+	}
+	if (m_pDesktop)
+	{
+		m_pDesktop->Release();
+		m_pDesktop = nullptr;
+	}
+	if (m_pDuplication)
+	{
+		m_pDuplication->Release();
+		m_pDuplication = nullptr;
+	}
+	if (m_pContext)
+	{
+		m_pContext->Release();
+		m_pContext = nullptr;
+	}
+	if (m_pDevice)
+	{
+		m_pDevice->Release();
+		m_pDevice = nullptr;
+	}
+	m_DesktopValid = false;
+	m_StagingValid = false;
+}
+
+bool DesktopDuplicationSource::ReadMetadata(const DXGI_OUTDUPL_FRAME_INFO &info, std::vector<TileRect> &rects)
+{
+	rects.clear();
+	if (info.TotalMetadataBufferSize == 0)
+		return true;
+	m_Metadata.resize(info.TotalMetadataBufferSize);
+
+	// A moved rectangle's destination changed; its source is covered by the dirty rectangles.
+	UINT moveBytes = 0;
+	if (FAILED(m_pDuplication->GetFrameMoveRects((UINT)m_Metadata.size(), (DXGI_OUTDUPL_MOVE_RECT *)m_Metadata.data(), &moveBytes)))
+		return false;
+	const DXGI_OUTDUPL_MOVE_RECT *moves = (const DXGI_OUTDUPL_MOVE_RECT *)m_Metadata.data();
+	for (UINT i = 0; i < moveBytes / sizeof(DXGI_OUTDUPL_MOVE_RECT); ++i)
+	{
+		const RECT &r = moves[i].DestinationRect;
+		rects.push_back({(uint32_t)r.left, (uint32_t)r.top, (uint32_t)(r.right - r.left), (uint32_t)(r.bottom - r.top)});
+	}
+
+	UINT dirtyBytes = 0;
+	if (FAILED(m_pDuplication->GetFrameDirtyRects((UINT)m_Metadata.size() - moveBytes, (RECT *)(m_Metadata.data() + moveBytes), &dirtyBytes)))
+		return false;
+	const RECT *dirty = (const RECT *)(m_Metadata.data() + moveBytes);
+	for (UINT i = 0; i < dirtyBytes / sizeof(RECT); ++i)
+	{
+		const RECT &r = dirty[i];
+		rects.push_back({(uint32_t)r.left, (uint32_t)r.top, (uint32_t)(r.right - r.left), (uint32_t)(r.bottom - r.top)});
+	}
+	return true;
+}
+
+// shape's pixels from a pointer shape as duplication hands it out.  The parts that invert the screen
+// can't be blended, they are drawn in black.
+static void ConvertPointerShape(const DXGI_OUTDUPL_POINTER_SHAPE_INFO &info, const uint8_t *buffer, CursorShape &shape)
+{
+	const bool monochrome = info.Type == DXGI_OUTDUPL_POINTER_SHAPE_TYPE_MONOCHROME;
+	// A monochrome shape is its AND mask over its XOR mask.
+	const UINT height = monochrome ? info.Height / 2 : info.Height;
+	shape.width = (uint16_t)std::min<UINT>(info.Width, k_MaxCursorSize);
+	shape.height = (uint16_t)std::min<UINT>(height, k_MaxCursorSize);
+	shape.hotspotX = (uint16_t)std::min<UINT>(info.HotSpot.x, shape.width);
+	shape.hotspotY = (uint16_t)std::min<UINT>(info.HotSpot.y, shape.height);
+	shape.pixels.resize((size_t)shape.width * shape.height * k_BytesPerPixel);
+
+	for (uint32_t y = 0; y < shape.height; ++y)
+	{
+		uint8_t *dst = shape.pixels.data() + (size_t)y * shape.width * k_BytesPerPixel;
+		for (uint32_t x = 0; x < shape.width; ++x, dst += k_BytesPerPixel)
+		{
+			if (monochrome)
+			{
+				const uint8_t bit = (uint8_t)(0x80 >> (x % 8));
+				const bool andBit = (buffer[y * info.Pitch + x / 8] & bit) != 0;
+				const bool xorBit = (buffer[(y + height) * info.Pitch + x / 8] & bit) != 0;
+				const uint8_t value = !andBit && xorBit ? 0xFF : 0x00;
+				dst[0] = dst[1] = dst[2] = value;
+				dst[3] = andBit && !xorBit ? 0x00 : 0xFF;
+				continue;
+			}
+			const uint8_t *src = buffer + y * info.Pitch + (size_t)x * k_BytesPerPixel;
+			if (info.Type == DXGI_OUTDUPL_POINTER_SHAPE_TYPE_COLOR)
+			{
+				std::memcpy(dst, src, k_BytesPerPixel);
+				continue;
+			}
+			// Masked, a mask of 0 replaces the screen and one of 0xFF XORs it; XOR with 0 leaves it.
+			const bool inverts = src[3] != 0;
+			dst[0] = inverts ? 0x00 : src[0];
+			dst[1] = inverts ? 0x00 : src[1];
+			dst[2] = inverts ? 0x00 : src[2];
+			dst[3] = !inverts || (src[0] | src[1] | src[2]) != 0 ? 0xFF : 0x00;
+		}
+	}
+
+	// Names the bitmap, FNV-1a of it and its hotspot.
+	uint32_t hash = 2166136261u;
+	auto add = [&](uint8_t byte) { hash = (hash ^ byte) * 16777619u; };
+	add((uint8_t)shape.hotspotX);
+	add((uint8_t)shape.hotspotY);
+	add((uint8_t)shape.width);
+	add((uint8_t)shape.height);
+	for (uint8_t byte : shape.pixels)
+		add(byte);
+	shape.id = hash != 0 ? hash : 1;
+}
+
+void DesktopDuplicationSource::ReadPointer(const DXGI_OUTDUPL_FRAME_INFO &info)
+{
+	if (info.LastMouseUpdateTime.QuadPart != 0)
+	{
+		m_Cursor.visible = info.PointerPosition.Visible != FALSE;
+		m_Pointer = info.PointerPosition.Position;
+	}
+	if (info.PointerShapeBufferSize != 0)
+	{
+		m_PointerBuffer.resize(info.PointerShapeBufferSize);
+		UINT size = 0;
+		DXGI_OUTDUPL_POINTER_SHAPE_INFO shapeInfo;
+		if (SUCCEEDED(m_pDuplication->GetFramePointerShape((UINT)m_PointerBuffer.size(), m_PointerBuffer.data(), &size, &shapeInfo)))
+			ConvertPointerShape(shapeInfo, m_PointerBuffer.data(), m_CursorShape);
+	}
+	m_Cursor.x = m_Pointer.x + m_CursorShape.hotspotX;
+	m_Cursor.y = m_Pointer.y + m_CursorShape.hotspotY;
+	m_Cursor.shapeId = m_CursorShape.id;
+}
+
+bool DesktopDuplicationSource::AcquireFrame(std::chrono::milliseconds timeout, CapturedFrame &frame)
+{
+	if (!m_pDuplication && !Initialize())
+	{
+		std::this_thread::sleep_for(timeout);
+		return false;
+	}
+
+	// The region changed, what it covers now is on the GPU already.
+	if (m_DesktopValid && !m_StagingValid)
+	{
+		CopyRegion({0, 0, m_Width, m_Height});
+		frame.hasDirtyRects = false;
+		frame.dirtyRects.clear();
+		return MapFrame(frame);
+	}
+
+	DXGI_OUTDUPL_FRAME_INFO info;
+	IDXGIResource *pResource = nullptr;
+	HRESULT hr = m_pDuplication->AcquireNextFrame((UINT)timeout.count(), &info, &pResource);
+	if (hr == DXGI_ERROR_WAIT_TIMEOUT)
+		return false;
+	if (FAILED(hr))
+	{
+		// Usually DXGI_ERROR_ACCESS_LOST, start over on the next call.
+		Cleanup();
+		return false;
+	}
+
+	ReadPointer(info);
+
+	// Only the cursor moved, nothing on screen changed.
+	if (info.LastPresentTime.QuadPart == 0 && m_DesktopValid)
+	{
+		pResource->Release();
+		m_pDuplication->ReleaseFrame();
+		return false;
+	}
+
+	ID3D11Texture2D *pTexture = nullptr;
+	hr = pResource->QueryInterface(__uuidof(ID3D11Texture2D), (void **)&pTexture);
+	pResource->Release();
+	if (FAILED(hr))
+	{
+		m_pDuplication->ReleaseFrame();
+		return false;
+	}
+
+	// The whole desktop is kept on the GPU, only the region goes to the CPU.
+	frame.hasDirtyRects = m_DesktopValid && ReadMetadata(info, frame.dirtyRects);
+	if (frame.hasDirtyRects)
+	{
+		for (const TileRect &rect : frame.dirtyRects)
+		{
+			const D3D11_BOX box = {rect.x, rect.y, 0, rect.x + rect.width, rect.y + rect.height, 1};
+			m_pContext->CopySubresourceRegion(m_pDesktop, 0, rect.x, rect.y, 0, pTexture, 0, &box);
+		}
+	}
+	else
+	{
+		frame.dirtyRects.clear();
+		m_pContext->CopyResource(m_pDesktop, pTexture);
+	}
+	pTexture->Release();
+	// The copies are queued, the desktop texture can go back to DWM before they are done.
+	m_pDuplication->ReleaseFrame();
+	m_DesktopValid = true;
+
+	if (frame.hasDirtyRects && m_StagingValid)
+	{
+		for (const TileRect &rect : frame.dirtyRects)
+			CopyRegion(rect);
+	}
+	else
+	{
+		frame.hasDirtyRects = false;
+		CopyRegion({0, 0, m_Width, m_Height});
+	}
+	return MapFrame(frame);
+}
+
+bool DesktopDuplicationSource::MapFrame(CapturedFrame &frame)
+{
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	if (FAILED(m_pContext->Map(m_pStaging, 0, D3D11_MAP_READ, 0, &mapped)))
+	{
+		m_StagingValid = false;
+		return false;
+	}
+	m_Mapped = true;
+	m_StagingValid = true;
+
+	frame.view.pixels = (const uint8_t *)mapped.pData;
+	frame.view.width = m_Width;
+	frame.view.height = m_Height;
+	frame.view.stride = mapped.RowPitch;
+	frame.captured = std::chrono::steady_clock::now();
+	frame.focus.hasCursor = m_Cursor.visible;
+	frame.focus.cursorX = m_Cursor.x;
+	frame.focus.cursorY = m_Cursor.y;
+	frame.focus.window = GetForegroundWindow();
+	return true;
+}
+
+TileRect DesktopDuplicationSource::GetForegroundWindow() const
+{
+	const HWND hwnd = ::GetForegroundWindow();
+	RECT window;
+	if (!hwnd || IsIconic(hwnd) ||
+		(FAILED(DwmGetWindowAttribute(hwnd, DWMWA_EXTENDED_FRAME_BOUNDS, &window, sizeof(window))) && !GetWindowRect(hwnd, &window)))
+		return {};
+
+	const LONG left = std::max(window.left, m_Monitor.left);
+	const LONG top = std::max(window.top, m_Monitor.top);
+	const LONG right = std::min(window.right, m_Monitor.right);
+	const LONG bottom = std::min(window.bottom, m_Monitor.bottom);
+	if (left >= right || top >= bottom)
+		return {};
+	return {(uint32_t)(left - m_Monitor.left), (uint32_t)(top - m_Monitor.top), (uint32_t)(right - left), (uint32_t)(bottom - top)};
+}
+
+void DesktopDuplicationSource::CopyRegion(const TileRect &rect)
+{
+	UINT x0 = std::min(rect.x, m_Width), y0 = std::min(rect.y, m_Height);
+	UINT x1 = std::min(rect.x + rect.width, m_Width), y1 = std::min(rect.y + rect.height, m_Height);
+	if (m_Region.width != 0 && m_Region.height != 0)
+	{
+		x0 = std::max(x0, m_Region.x);
+		y0 = std::max(y0, m_Region.y);
+		x1 = std::min(x1, m_Region.x + m_Region.width);
+		y1 = std::min(y1, m_Region.y + m_Region.height);
+	}
+	if (x0 >= x1 || y0 >= y1)
+		return;
+	const D3D11_BOX box = {x0, y0, 0, x1, y1, 1};
+	m_pContext->CopySubresourceRegion(m_pStaging, 0, x0, y0, 0, m_pDesktop, 0, &box);
+}
+
+void DesktopDuplicationSource::SetRegion(const TileRect &region)
+{
+	if (region.x == m_Region.x && region.y == m_Region.y && region.width == m_Region.width && region.height == m_Region.height)
+		return;
+	// What the new region adds was never read back, the next AcquireFrame() does.
+	m_Region = region;
+	m_StagingValid = false;
+}
+
+bool DesktopDuplicationSource::GetCursor(CursorState &cursor, CursorShape &shape)
+{
+	cursor = m_Cursor;
+	if (shape.id != m_CursorShape.id)
+		shape = m_CursorShape;
+	return true;
+}
+
+void DesktopDuplicationSource::ReleaseFrame()
+{
+	if (m_Mapped)
+	{
+		m_pContext->Unmap(m_pStaging, 0);
+		m_Mapped = false;
+	}
+}
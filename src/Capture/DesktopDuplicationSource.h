@@ -0,0 +1,71 @@
+#pragma once
+
+#include <d3d11.h>
+#include <dxgi1_2.h>
+
+#include <vector>
+
+#include "Streaming/FrameSource.h"
+
+// One monitor through DXGI desktop duplication, on a D3D11 device of its own on the monitor's
+// adapter.  What changed is copied into a GPU texture that keeps the whole screen, and from there
+// into a staging texture; the frame is the mapped staging texture, nothing is copied on the CPU.
+// The dirty and moved rectangles duplication reports become the frame's dirty rects.  The cursor
+// isn't drawn in, it goes on its own lane, see GetCursor(); where it is and the foreground window
+// become the frame's focus.
+//
+// With a region set only that part is read back to the CPU.  A new region is read back from the
+// GPU copy right away, without waiting for the screen to change.
+//
+// Duplication is lost on mode changes, desktop switches and the like; the source then starts
+// over, and the first frame after that has everything dirty.
+class DesktopDuplicationSource : public IFrameSource
+{
+public:
+	// Numbered as IDXGIFactory::EnumAdapters() and IDXGIAdapter::EnumOutputs() number them.
+	DesktopDuplicationSource(UINT adapterIndex, UINT outputIndex);
+	~DesktopDuplicationSource() override;
+
+	DesktopDuplicationSource(const DesktopDuplicationSource &) = delete;
+	DesktopDuplicationSource &operator=(const DesktopDuplicationSource &) = delete;
+
+	bool AcquireFrame(std::chrono::milliseconds timeout, CapturedFrame &frame) override;
+	void ReleaseFrame() override;
+	void SetRegion(const TileRect &region) override;
+	bool GetCursor(CursorState &cursor, CursorShape &shape) override;
+
+private:
+	bool Initialize();
+	void Cleanup();
+	// Dirty and move rectangles of the frame just acquired, false when there were too many to
+	// tell and everything has to count as dirty.
+	bool ReadMetadata(const DXGI_OUTDUPL_FRAME_INFO &info, std::vector<TileRect> &rects);
+	// Copies what of rect is inside the region from the desktop copy into the staging texture.
+	void CopyRegion(const TileRect &rect);
+	bool MapFrame(CapturedFrame &frame);
+	// The pointer's position and, when it changed, its shape from the frame just acquired.
+	void ReadPointer(const DXGI_OUTDUPL_FRAME_INFO &info);
+	// The foreground window's part of the monitor, empty when it is elsewhere.
+	TileRect GetForegroundWindow() const;
+
+private:
+	UINT m_AdapterIndex;
+	UINT m_OutputIndex;
+	ID3D11Device *m_pDevice = nullptr;
+	ID3D11DeviceContext *m_pContext = nullptr;
+	IDXGIOutputDuplication *m_pDuplication = nullptr;
+	ID3D11Texture2D *m_pDesktop = nullptr; // all of the screen, on the GPU
+	ID3D11Texture2D *m_pStaging = nullptr; // the region of it, read back
+	UINT m_Width = 0;
+	UINT m_Height = 0;
+	RECT m_Monitor = {}; // in desktop coordinates
+	POINT m_Pointer = {}; // top left of the shape, as duplication reports it
+	CursorState m_Cursor;
+	CursorShape m_CursorShape;
+	std::vector<uint8_t> m_PointerBuffer;
+	TileRect m_Region;			 // empty for all of it
+	bool m_DesktopValid = false; // holds a whole frame, only the changes need copying
+	bool m_StagingValid = false; // holds all of the region
+	bool m_Mapped = false;
+	std::vector<uint8_t> m_Metadata;
+};
@@ -0,0 +1,32 @@
+#include "WindowCropRegion.h"
+
+#include <dwmapi.h>
+
+#include <algorithm>
+
+WindowCropRegion::WindowCropRegion(HWND hwnd, const RECT &monitor)
+	: m_Hwnd(hwnd), m_Monitor(monitor)
+{
+}
+
+bool WindowCropRegion::GetRect(uint32_t frameWidth, uint32_t frameHeight, TileRect &rect)
+{
+	(void)frameWidth;
+	(void)frameHeight;
+	if (!IsWindow(m_Hwnd) || IsIconic(m_Hwnd))
+		return false;
+
+	RECT window;
+	if (FAILED(DwmGetWindowAttribute(m_Hwnd, DWMWA_EXTENDED_FRAME_BOUNDS, &window, sizeof(window))) &&
+		!GetWindowRect(m_Hwnd, &window))
+		return false;
+
+	const LONG left = std::max(window.left, m_Monitor.left);
+	const LONG top = std::max(window.top, m_Monitor.top);
+	const LONG right = std::min(window.right, m_Monitor.right);
+	const LONG bottom = std::min(window.bottom, m_Monitor.bottom);
+	if (left >= right || top >= bottom)
+		return false;
+	rect = {(uint32_t)(left - m_Monitor.left), (uint32_t)(top - m_Monitor.top), (uint32_t)(right - left), (uint32_t)(bottom - top)};
+	return true;
+}
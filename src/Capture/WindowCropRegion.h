@@ -0,0 +1,21 @@
+#pragma once
+
+#include <windows.h>
+
+#include "Streaming/CropFrameSource.h"
+
+// Follows a window on one monitor: its frame as DWM draws it, without the invisible resize
+// borders, relative to the monitor.  Nothing is shown while it is minimized or closed, and only
+// the part on the monitor while it hangs off it.
+class WindowCropRegion : public ICropRegion
+{
+public:
+	// monitor is the output's DXGI_OUTPUT_DESC::DesktopCoordinates.
+	WindowCropRegion(HWND hwnd, const RECT &monitor);
+
+	bool GetRect(uint32_t frameWidth, uint32_t frameHeight, TileRect &rect) override;
+
+private:
+	HWND m_Hwnd;
+	RECT m_Monitor;
+};
@@ -0,0 +1,86 @@
+#include "FrameMessageBuilder.h"
+
+#include "test_common.h"
+
+#include <algorithm>
+
+// Room for the library's packet header and per-message framing inside one MTU sized packet.
+static constexpr int k_cbPacketOverhead = 100;
+
+uint32_t FrameMessageBuilder::GetFragmentSize()
+{
+	int32 mtu = 0;
+	size_t cbMtu = sizeof(mtu);
+	ESteamNetworkingConfigDataType dataType;
+	if (SteamNetworkingUtils()->GetConfigValue(k_ESteamNetworkingConfig_MTU_PacketSize, k_ESteamNetworkingConfig_Global, 0, &dataType, &mtu, &cbMtu) != k_ESteamNetworkingGetConfigValue_OK)
+	{
+		return k_DefaultFragmentSize;
+	}
+	return (uint32_t)std::max(256, mtu - k_cbPacketOverhead - (int)sizeof(FrameUpdateHeader));
+}
+
+void FrameMessageBuilder::AddFrame(const EncodedFrame &frame, HSteamNetConnection connection, int sendFlags, Lane lane)
+{
+	if (frame.fecGroupSize == 0)
+	{
+		for (const EncodedFragment &fragment : frame.fragments)
+			AddFragment(fragment, connection, sendFlags, lane);
+		return;
+	}
+
+	// Each group's parity right behind its data, a burst of loss then only costs the groups it hits.
+	const size_t groupSize = frame.fecGroupSize;
+	for (size_t first = 0, group = 0; first < frame.fragments.size(); first += groupSize, ++group)
+	{
+		const size_t last = std::min(frame.fragments.size(), first + groupSize);
+		for (size_t i = first; i < last; ++i)
+			AddFragment(frame.fragments[i], connection, sendFlags, lane);
+		for (size_t p = 0; p < frame.fecParityCount; ++p)
+			AddFragment(frame.parity[group * frame.fecParityCount + p], connection, sendFlags, lane);
+	}
+}
+
+void FrameMessageBuilder::AddFragment(const EncodedFragment &fragment, HSteamNetConnection connection, int sendFlags, Lane lane)
+{
+	// Zero sized buffer, we provide m_pData ourselves.
+	SteamNetworkingMessage_t *pMessage = SteamNetworkingUtils()->AllocateMessage(0);
+	pMessage->m_conn = connection;
+	pMessage->m_nFlags = sendFlags;
+	pMessage->m_idxLane = (uint16)lane;
+	pMessage->m_pData = fragment.data;
+	pMessage->m_cbSize = (int)fragment.size;
+	pMessage->m_pfnFreeData = &FreeArenaData;
+	pMessage->m_nUserData = (int64)(intptr_t)fragment.block;
+
+	fragment.block->AddRef();
+	m_Pending.push_back(pMessage);
+}
+
+int FrameMessageBuilder::Flush()
+{
+	if (m_Pending.empty())
+		return 0;
+
+	// SendMessages() takes ownership of every message, even the ones it fails to queue.
+	m_Results.resize(m_Pending.size());
+	SteamNetworkingSockets()->SendMessages((int)m_Pending.size(), m_Pending.data(), m_Results.data());
+
+	int failed = 0;
+	for (int64 result : m_Results)
+	{
+		if (result < 0)
+			++failed;
+	}
+	if (failed != 0)
+		TEST_Printf("Failed to queue %d of %d frame messages, first error %d\n", failed, (int)m_Results.size(), (int)-m_Results[0]);
+
+	m_Pending.clear();
+	return failed;
+}
+
+void FrameMessageBuilder::FreeArenaData(SteamNetworkingMessage_t *pMessage)
+{
+	// Called from whatever thread the library frees the message on.
+	ArenaBlock *block = (ArenaBlock *)(intptr_t)pMessage->m_nUserData;
+	block->Release();
+}
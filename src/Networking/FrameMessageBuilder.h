@@ -0,0 +1,38 @@
+#pragma once
+
+#include <GameNetworkingSockets/steam/steamnetworkingsockets.h>
+#include <GameNetworkingSockets/steam/isteamnetworkingutils.h>
+
+#include <vector>
+
+#include "Streaming/ParallelTileEncoder.h"
+#include "Streaming/WireFormat.h"
+
+// Turns encoded fragments into SteamNetworkingMessage_t objects whose m_pData points straight into
+// the encoder's arena blocks.  Each message holds a reference on its block, dropped again in
+// m_pfnFreeData once the library is done with it, so nothing is copied on the way to the wire.
+//
+// The pending list is reused between frames; once it has grown to the largest frame seen,
+// building and flushing a frame does no heap allocation of our own.
+class FrameMessageBuilder
+{
+public:
+	// Largest fragment payload that still goes out as a single packet at the configured MTU.
+	static uint32_t GetFragmentSize();
+
+	// Queues one message per fragment of frame for connection, parity included.
+	void AddFrame(const EncodedFrame &frame, HSteamNetConnection connection, int sendFlags, Lane lane);
+
+	// Hands every queued message to SendMessages().  Returns the number that were rejected.
+	int Flush();
+
+	size_t GetPendingCount() const { return m_Pending.size(); }
+
+private:
+	void AddFragment(const EncodedFragment &fragment, HSteamNetConnection connection, int sendFlags, Lane lane);
+	static void FreeArenaData(SteamNetworkingMessage_t *pMessage);
+
+private:
+	std::vector<SteamNetworkingMessage_t *> m_Pending;
+	std::vector<int64> m_Results;
+};
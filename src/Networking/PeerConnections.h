@@ -6,7 +6,21 @@
 #include <unordered_map>
 #include "test_common.h"
 #include "TrivialSignalingServer.h"
+#include "FrameMessageBuilder.h"
+#include "Streaming/FrameReceiver.h"
+#include "Streaming/SnapshotCanvas.h"
+#include "Streaming/RateController.h"
+#include "Streaming/FrameSendQueue.h"
+#include "Streaming/SimulcastEncoder.h"
+#include "Streaming/Input.h"
+#include "Streaming/StreamDecodePool.h"
+#include "Streaming/CaptureStream.h"
+#include "Streaming/LatencyTrace.h"
 #include <string>
+#include <memory>
+#include <chrono>
+#include <cstring>
+#include <bit>
 
 // namespace std
 // {
@@ -84,10 +98,63 @@ enum class ConnectionStatus : uint8_t
 class PeerConnections
 {
 public:
+	static constexpr uint32_t k_NoSnapshot = 0xFFFFFFFF;
+	// Snapshots go out on the bulk lane no faster than this, and never with more than
+	// k_cbSnapshotMaxQueued bytes waiting on that lane, so they only use spare bandwidth.
+	static constexpr double k_flSnapshotBytesPerSecond = 4.0 * 1024 * 1024;
+	static constexpr uint32_t k_cbSnapshotMessage = 64 * 1024;
+	static constexpr int k_cbSnapshotMaxQueued = 256 * 1024;
+	// Bounds for the connection's own send rate, the rate controller keeps the frames below it.
+	static constexpr int k_nSendRateMin = 512 * 1024;
+	static constexpr int k_nSendRateMax = 64 * 1024 * 1024;
+	// Frames wait in the peer's FrameSendQueue while the video lane is queued up longer than this,
+	// where newer frames can still replace them.
+	static constexpr SteamNetworkingMicroseconds k_usecVideoMaxQueueTime = 20 * 1000;
+	// Input from a peer past this many events that nobody took is dropped.
+	static constexpr size_t k_nMaxReceivedInputEvents = 4096;
+	// Time each poll may spend decoding the screens peers send, what doesn't fit waits for the next.
+	static constexpr std::chrono::milliseconds k_DecodeBudget{8};
+	static constexpr std::chrono::milliseconds k_KeepaliveInterval{1000};
+
+	// One of our streams as sent to one peer.
+	struct OutgoingStream
+	{
+		// Next tile of the snapshot streamed to a peer that just subscribed, k_NoSnapshot when done.
+		uint32_t snapshotNextTile = k_NoSnapshot;
+		double snapshotCredit = 0.0; // bytes
+		std::chrono::steady_clock::time_point snapshotPumped;
+		std::shared_ptr<FrameSendQueue> sendQueue; // created on subscribe
+		// Simulcast layer the peer is sent.  A peer that changes layers is caught up with a
+		// snapshot of the new one, started with that layer's next frame so it is as new as the
+		// frames the peer already has.
+		uint32_t layer = 0;
+		bool snapshotOnNextFrame = false;
+		// What the viewer shows, and the display size the whole frame would have at its zoom;
+		// 0 until it reports one.
+		ViewportRect viewport;
+		uint32_t displayWidth = 0;
+		uint32_t displayHeight = 0;
+	};
+
 	struct PeerData
 	{
 		ConnectionStatus connectionStatus = ConnectionStatus::Disconnected;
 		HSteamNetConnection connection = k_HSteamNetConnection_Invalid;
+		// The peer's streams, each created on its first message.
+		std::shared_ptr<FrameReceiver> frameReceivers[k_MaxStreams];
+		PlayoutMode playoutMode = PlayoutMode::Smooth;
+		// The peer's streams we want, sent whenever it changes, and ours the peer wants.
+		uint32_t wantedStreams = 1;
+		bool wantedStreamsChanged = false;
+		uint32_t streamMask = 0;
+		OutgoingStream streams[k_MaxStreams];
+		RateController rateController;
+		// How often the viewer's display refreshes, in Hz, 0 until it reports it.
+		uint32_t refreshRate = 0;
+		CursorSender cursorSender;
+		// Our input to the peer, sent on the next poll, and the peer's input to us until taken.
+		InputSender inputSender;
+		std::vector<InputEvent> receivedInput;
 		const char *GetStatusString() const
 		{
 			switch (connectionStatus)
@@ -175,6 +242,365 @@ public:
 		}
 	}
 
+	// Fans the same encoded runs out to every connected peer on layer of stream, the messages
+	// share the arena memory.  Peers whose connection is backed up get the frame queued instead,
+	// see SendQueuedFrames().  The arena's block pool must outlive the PeerConnections.
+	void SendFrameToAllPeers(const EncodedFrame &frame, uint32_t layer = 0, uint32_t stream = 0)
+	{
+		m_SnapshotCanvas[stream][layer].Update(frame);
+
+		for (auto &[peerIdentity, peerData] : m_PeerConnections)
+		{
+			OutgoingStream &outgoing = peerData.streams[stream];
+			if (peerData.connectionStatus != ConnectionStatus::Connected || !outgoing.sendQueue || outgoing.layer != layer)
+			{
+				continue;
+			}
+			if (outgoing.snapshotOnNextFrame)
+			{
+				StartSnapshot(outgoing);
+			}
+			outgoing.sendQueue->Push(frame);
+			m_StreamLatency[stream].Record(LatencyStage::Enqueue, std::chrono::microseconds((int32_t)(GetWireTimestamp(std::chrono::steady_clock::now()) - frame.timestamp - frame.encodedAfter)));
+			SendQueuedFrames(peerData, stream);
+			// Whatever had to be evicted goes into the next encode, from the screen as it is then.
+			uint32_t width = 0;
+			uint32_t height = 0;
+			if (outgoing.sendQueue->TakeEvictedTiles(m_EvictedTiles, width, height))
+			{
+				m_TileRefresh[stream][layer].RequestTiles(m_EvictedTiles, width, height);
+			}
+		}
+	}
+
+	// Encodes what changed on a shared screen since the last call, for every layer its viewers are
+	// on, and sends it to them.  Call every poll for every stream shared.  A stream nobody wants
+	// is paused, and it is encoded no faster than its slowest viewer takes frames.
+	//
+	// While nothing changes and the encoder has nothing left to refine or resend the stream is
+	// idle: nothing is encoded, and viewers only get a keepalive every k_KeepaliveInterval.  The
+	// first change is encoded at the next frame time as usual.
+	void SendStream(CaptureStream &capture, uint32_t fragmentSize = k_DefaultFragmentSize)
+	{
+		const uint32_t stream = capture.GetStream();
+		const uint32_t layerMask = GetLayerMask(stream);
+		capture.SetActive(layerMask != 0);
+		if (layerMask == 0)
+		{
+			return;
+		}
+
+		uint32_t framesPerSecond = 0;
+		for (uint32_t layer = 0; layer < k_SimulcastLayerCount; ++layer)
+		{
+			if (layerMask & (1u << layer))
+			{
+				const uint32_t layerRate = GetEncodeTarget(layer, stream).framesPerSecond;
+				framesPerSecond = framesPerSecond == 0 ? layerRate : std::min(framesPerSecond, layerRate);
+			}
+		}
+		const auto now = std::chrono::steady_clock::now();
+		if (framesPerSecond != 0 && now - m_StreamEncoded[stream] < std::chrono::microseconds(1000000 / framesPerSecond))
+		{
+			return;
+		}
+
+		FrameView frame;
+		std::chrono::steady_clock::time_point captured;
+		std::chrono::steady_clock::time_point diffed;
+		if (!capture.AcquireFrame(frame, m_StreamDirtyTiles, captured, diffed))
+		{
+			return;
+		}
+		m_StreamEncoded[stream] = now;
+
+		SimulcastEncoder &encoder = capture.GetEncoder();
+		encoder.SetFocus(capture.GetFocus());
+		uint8_t quality[k_SimulcastLayerCount] = {};
+		for (uint32_t layer = 0; layer < k_SimulcastLayerCount; ++layer)
+		{
+			if (!(layerMask & (1u << layer)))
+			{
+				continue;
+			}
+			const RateTarget target = GetEncodeTarget(layer, stream);
+			quality[layer] = target.quality;
+			encoder.SetByteBudget(layer, target.frameBytesPerSecond > 0.0 ? (size_t)(target.frameBytesPerSecond / target.framesPerSecond) : 0);
+			encoder.GetRefiner(layer).SetRefineRate(target.refreshBytesPerSecond);
+			encoder.SetFecConfig(layer, m_FecConfig);
+			GetViewports(layer, m_StreamViewports, stream);
+			encoder.SetViewports(layer, m_StreamViewports);
+
+			TileRefreshScheduler &tileRefresh = m_TileRefresh[stream][layer];
+			tileRefresh.ApplyCacheMisses(encoder.GetTileCache(layer));
+			m_StreamRefreshTiles.clear();
+			tileRefresh.CollectTiles(encoder.GetLayerWidth(layer), encoder.GetLayerHeight(layer), m_StreamRefreshTiles);
+			encoder.AddDirtyTiles(layer, m_StreamRefreshTiles);
+		}
+
+		m_StreamIdle[stream] = m_StreamDirtyTiles.empty() && encoder.IsIdle(layerMask, quality);
+		if (m_StreamIdle[stream])
+		{
+			capture.ReleaseFrame();
+			// No frame is coming to start their snapshots with, and none needs to: the layers'
+			// canvases hold the screen as it is.
+			for (auto &[peerIdentity, peerData] : m_PeerConnections)
+			{
+				OutgoingStream &outgoing = peerData.streams[stream];
+				if (peerData.connectionStatus == ConnectionStatus::Connected && outgoing.sendQueue && outgoing.snapshotOnNextFrame)
+				{
+					StartSnapshot(outgoing);
+				}
+			}
+			if (now - m_StreamKeepalive[stream] >= k_KeepaliveInterval)
+			{
+				SendKeepalive(stream, now);
+				m_StreamKeepalive[stream] = now;
+			}
+			return;
+		}
+		m_StreamKeepalive[stream] = now;
+		encoder.Encode(captured, diffed, frame, m_StreamDirtyTiles, layerMask, quality, capture.NextFrameId(), fragmentSize);
+		capture.ReleaseFrame();
+
+		bool encoded = false;
+		for (uint32_t layer = 0; layer < k_SimulcastLayerCount; ++layer)
+		{
+			if ((layerMask & (1u << layer)) && !encoder.GetFrame(layer).tiles.empty())
+			{
+				if (!encoded)
+				{
+					const EncodedFrame &encodedFrame = encoder.GetFrame(layer);
+					m_StreamLatency[stream].Record(LatencyStage::Diff, std::chrono::microseconds(encodedFrame.diffedAfter));
+					m_StreamLatency[stream].Record(LatencyStage::Encode, std::chrono::microseconds((int32_t)(encodedFrame.encodedAfter - encodedFrame.diffedAfter)));
+					encoded = true;
+				}
+				SendFrameToAllPeers(encoder.GetFrame(layer), layer, stream);
+			}
+		}
+	}
+
+	// Where the frames of stream went on our side, Diff to Send, see LatencyStage.  What the
+	// viewers traced is on their FrameReceivers.
+	const LatencyTrace &GetStreamLatency(uint32_t stream = 0) const { return m_StreamLatency[stream]; }
+
+	// Appends every trace, ours of the streams we share and the receivers' of every peer's stream
+	// we view, to path, see LatencyTrace::Dump().  False when it can't be opened.
+	bool DumpLatency(const char *path) const
+	{
+		FILE *file = fopen(path, "a");
+		if (!file)
+		{
+			return false;
+		}
+		char label[64];
+		for (uint32_t stream = 0; stream < k_MaxStreams; ++stream)
+		{
+			snprintf(label, sizeof(label), "send/%u", stream);
+			m_StreamLatency[stream].Dump(file, label);
+		}
+		for (const auto &[identity, peerData] : m_PeerConnections)
+		{
+			for (const std::shared_ptr<FrameReceiver> &frameReceiver : peerData.frameReceivers)
+			{
+				if (frameReceiver)
+				{
+					snprintf(label, sizeof(label), "%s/%u", identity.GetGenericString() ? identity.GetGenericString() : "peer", frameReceiver->GetStream());
+					frameReceiver->GetLatency().Dump(file, label);
+				}
+			}
+		}
+		fclose(file);
+		return true;
+	}
+
+	// Whether stream's last SendStream() found nothing to encode.
+	bool IsStreamIdle(uint32_t stream = 0) const { return m_StreamIdle[stream]; }
+
+	// Tiles peers of a layer of stream asked to be sent again.  Whoever encodes the next frame
+	// applies the cache misses to the layer's TileCache and collects the tiles into its dirty list,
+	// so they are re-encoded from the current screen.
+	TileRefreshScheduler &GetTileRefresh(uint32_t layer = 0, uint32_t stream = 0) { return m_TileRefresh[stream][layer]; }
+
+	// Layers of stream with at least one peer, the ones worth encoding.  A peer waiting for its
+	// layer's next frame is counted, so encode these even when nothing on screen changed.
+	uint32_t GetLayerMask(uint32_t stream = 0) const
+	{
+		uint32_t mask = 0;
+		for (const auto &[peerIdentity, peerData] : m_PeerConnections)
+		{
+			if (peerData.connectionStatus == ConnectionStatus::Connected && (peerData.streamMask & (1u << stream)))
+			{
+				mask |= 1u << peerData.streams[stream].layer;
+			}
+		}
+		return mask;
+	}
+
+	// Our streams at least one connected peer wants.
+	uint32_t GetStreamMask() const
+	{
+		uint32_t mask = 0;
+		for (const auto &[peerIdentity, peerData] : m_PeerConnections)
+		{
+			if (peerData.connectionStatus == ConnectionStatus::Connected)
+			{
+				mask |= peerData.streamMask;
+			}
+		}
+		return mask;
+	}
+
+	// Viewports of the peers on layer of stream, for SimulcastEncoder::SetViewports().  Empty when
+	// one of them shows the whole frame.
+	void GetViewports(uint32_t layer, std::vector<ViewportRect> &viewports, uint32_t stream = 0) const
+	{
+		viewports.clear();
+		for (const auto &[peerIdentity, peerData] : m_PeerConnections)
+		{
+			if (peerData.connectionStatus != ConnectionStatus::Connected || !(peerData.streamMask & (1u << stream)) || peerData.streams[stream].layer != layer)
+			{
+				continue;
+			}
+			const ViewportRect &rect = peerData.streams[stream].viewport;
+			if (rect.left == 0 && rect.top == 0 && rect.right == 0xFFFF && rect.bottom == 0xFFFF)
+			{
+				viewports.clear();
+				return;
+			}
+			viewports.push_back(rect);
+		}
+	}
+
+	// Tells the peer we are watching which part of one of its screens we show, at what size and
+	// refresh rate.
+	void SetViewport(const SteamNetworkingIdentity &identityPeer, const ViewportRect &rect, uint32_t displayWidth, uint32_t displayHeight, uint32_t refreshRate = 0, uint32_t stream = 0)
+	{
+		auto it = m_PeerConnections.find(identityPeer);
+		if (it == m_PeerConnections.end() || stream >= k_MaxStreams)
+		{
+			TEST_Printf("Failed to set viewport: connection not found\n");
+			return;
+		}
+		GetFrameReceiver(it->second, stream).SetViewport(rect, displayWidth, displayHeight, refreshRate);
+	}
+
+	// Parity the frames of every stream we share carry, see FecEncoder.  Frames with parity are sent
+	// unreliably, FecScheme::None sends them reliably instead.
+	void SetFecConfig(const FecConfig &config)
+	{
+		m_FecConfig = config;
+	}
+
+	// Whether the peer's frames are smoothed out or shown as soon as they arrive, see PlayoutMode.
+	void SetPlayoutMode(const SteamNetworkingIdentity &identityPeer, PlayoutMode mode)
+	{
+		auto it = m_PeerConnections.find(identityPeer);
+		if (it == m_PeerConnections.end())
+		{
+			TEST_Printf("Failed to set playout mode: connection not found\n");
+			return;
+		}
+		it->second.playoutMode = mode;
+		for (const std::shared_ptr<FrameReceiver> &frameReceiver : it->second.frameReceivers)
+		{
+			if (frameReceiver)
+			{
+				frameReceiver->SetPlayoutMode(mode);
+			}
+		}
+	}
+
+	// Which of the peer's screens we want, bit n for stream n.  Only stream 0 until this is called.
+	// The peer is told on the next poll, and doesn't capture or send the others.
+	void Subscribe(const SteamNetworkingIdentity &identityPeer, uint32_t streamMask)
+	{
+		auto it = m_PeerConnections.find(identityPeer);
+		if (it == m_PeerConnections.end())
+		{
+			TEST_Printf("Failed to subscribe: connection not found\n");
+			return;
+		}
+		streamMask &= (1u << k_MaxStreams) - 1;
+		if (streamMask != it->second.wantedStreams)
+		{
+			it->second.wantedStreams = streamMask;
+			it->second.wantedStreamsChanged = true;
+		}
+	}
+
+	// Where our cursor is.  It goes to every peer on the cursor lane, not into the frames, so
+	// capture should leave it out of them.
+	void SetCursor(const CursorState &cursor)
+	{
+		m_Cursor = cursor;
+	}
+
+	// The bitmap of shape.id, sent to each peer once while it is in use.
+	void SetCursorShape(const CursorShape &shape)
+	{
+		m_CursorShape = shape;
+	}
+
+	// Queues a key, button, wheel or pointer event for the peer whose screen we are viewing.
+	// Events go out together on the next PollMessages(), ahead of everything but chat.
+	void SendInput(const SteamNetworkingIdentity &identityPeer, const InputEvent &event)
+	{
+		auto it = m_PeerConnections.find(identityPeer);
+		if (it == m_PeerConnections.end() || it->second.connectionStatus != ConnectionStatus::Connected)
+		{
+			TEST_Printf("Failed to send input: not connected\n");
+			return;
+		}
+		it->second.inputSender.Add(event);
+	}
+
+	// Moves the input the peer sent since the last call to events, in the order it happened.
+	// Whether to act on it is up to the caller.
+	bool TakeInput(const SteamNetworkingIdentity &identityPeer, std::vector<InputEvent> &events)
+	{
+		events.clear();
+		auto it = m_PeerConnections.find(identityPeer);
+		if (it == m_PeerConnections.end() || it->second.receivedInput.empty())
+		{
+			return false;
+		}
+		events.swap(it->second.receivedInput);
+		return true;
+	}
+
+	// Quality and frame rate for the next encode of layer of stream.  Every peer on a layer gets the
+	// same encoded frame, so the peer with the most constrained path sets them for all of them.  The
+	// frame rate over framesPerSecond is the layer's SimulcastEncoder::SetByteBudget(), the
+	// refresh rate what it can spend on refinements, see ProgressiveRefiner::SetRefineRate().  A
+	// peer's path is split evenly between the streams it wants.
+	RateTarget GetEncodeTarget(uint32_t layer = 0, uint32_t stream = 0) const
+	{
+		RateTarget target;
+		target.layer = layer;
+		bool first = true;
+		for (const auto &[peerIdentity, peerData] : m_PeerConnections)
+		{
+			if (peerData.connectionStatus != ConnectionStatus::Connected || !(peerData.streamMask & (1u << stream)) || peerData.streams[stream].layer != layer)
+			{
+				continue;
+			}
+			RateTarget peerTarget = peerData.rateController.GetTarget();
+			const int streamCount = std::popcount(peerData.streamMask);
+			peerTarget.frameBytesPerSecond /= streamCount;
+			peerTarget.refreshBytesPerSecond /= streamCount;
+			target.quality = std::min(target.quality, peerTarget.quality);
+			target.framesPerSecond = std::min(target.framesPerSecond, peerTarget.framesPerSecond);
+			target.refreshBytesPerSecond = first ? peerTarget.refreshBytesPerSecond : std::min(target.refreshBytesPerSecond, peerTarget.refreshBytesPerSecond);
+			if (peerTarget.frameBytesPerSecond > 0.0 && (target.frameBytesPerSecond == 0.0 || peerTarget.frameBytesPerSecond < target.frameBytesPerSecond))
+			{
+				target.frameBytesPerSecond = peerTarget.frameBytesPerSecond;
+			}
+			first = false;
+		}
+		return target;
+	}
+
 	void SetOutgoingMessage(const std::string &msg)
 	{
 		m_OutgoingMessage = msg;
@@ -190,6 +616,15 @@ public:
 				continue;
 			}
 
+			// Input first, it coalesced while it waited for this poll.
+			if (peerData.connectionStatus == ConnectionStatus::Connected)
+			{
+				while (peerData.inputSender.BuildMessage(m_InputMessage))
+				{
+					SendOnLane(peerData.connection, m_InputMessage.data(), (uint32)m_InputMessage.size(), k_nSteamNetworkingSend_ReliableNoNagle, Lane::Input);
+				}
+			}
+
 			if (m_OutgoingMessage.empty())
 			{
 				continue;
@@ -210,24 +645,146 @@ public:
 				continue;
 			}
 
-			SteamNetworkingMessage_t *pMessage;
-			int r = SteamNetworkingSockets()->ReceiveMessagesOnConnection(peerData.connection, &pMessage, 1);
-			assert(r == 0 || r == 1); // <0 indicates an error
-			if (r == 1)
+			// A frame arrives as hundreds of fragments, drain the connection in batches.
+			SteamNetworkingMessage_t *pMessages[k_nMaxMessagesPerPoll];
+			int r;
+			do
+			{
+				r = SteamNetworkingSockets()->ReceiveMessagesOnConnection(peerData.connection, pMessages, k_nMaxMessagesPerPoll);
+				assert(r >= 0); // <0 indicates an error
+				for (int i = 0; i < r; ++i)
+				{
+					SteamNetworkingMessage_t *pMessage = pMessages[i];
+					// Frames tell their stream by lane, snapshots by header, the cursor belongs to the first.
+					uint32_t stream = k_MaxStreams;
+					if (pMessage->m_idxLane == (uint16)Lane::Cursor)
+					{
+						stream = 0;
+					}
+					else if (pMessage->m_idxLane == (uint16)Lane::Bulk)
+					{
+						stream = pMessage->GetSize() >= (int)sizeof(SnapshotHeader) ? ((const SnapshotHeader *)pMessage->GetData())->stream : k_MaxStreams;
+					}
+					else
+					{
+						stream = GetLaneStream(pMessage->m_idxLane);
+					}
+					if (stream < k_MaxStreams)
+					{
+						// Decoded below with everyone else's, the reassembler then keeps the message until
+						// it has decoded the tiles in it.
+						GetFrameReceiver(peerData, stream).QueueMessage((const uint8_t *)pMessage->GetData(), (uint32_t)pMessage->GetSize(), pMessage, &ReleaseMessage);
+						continue;
+					}
+					if (pMessage->m_idxLane == (uint16)Lane::Control)
+					{
+						const uint8_t *data = (const uint8_t *)pMessage->GetData();
+						if (pMessage->GetSize() > 0 && data[0] == (uint8_t)MessageType::TileNack)
+						{
+							OnNack(data, (uint32_t)pMessage->GetSize());
+						}
+						else if (pMessage->GetSize() > 0 && data[0] == (uint8_t)MessageType::TileCacheMiss)
+						{
+							OnCacheMiss(data, (uint32_t)pMessage->GetSize());
+						}
+						else if (pMessage->GetSize() > 0 && data[0] == (uint8_t)MessageType::Viewport)
+						{
+							OnViewport(peerData, data, (uint32_t)pMessage->GetSize());
+						}
+						else if (pMessage->GetSize() > 0 && data[0] == (uint8_t)MessageType::StreamSubscription)
+						{
+							OnStreamSubscription(peerData, data, (uint32_t)pMessage->GetSize());
+						}
+						pMessage->Release();
+						continue;
+					}
+					if (pMessage->m_idxLane == (uint16)Lane::Input)
+					{
+						if (peerData.receivedInput.size() < k_nMaxReceivedInputEvents &&
+							!ParseInputEvents((const uint8_t *)pMessage->GetData(), (uint32_t)pMessage->GetSize(), peerData.receivedInput))
+						{
+							TEST_Printf("Dropped malformed input message\n");
+						}
+						pMessage->Release();
+						continue;
+					}
+					if (pMessage->m_idxLane != (uint16)Lane::Chat)
+					{
+						pMessage->Release();
+						continue;
+					}
+
+					std::string m = pMessage->m_identityPeer.GetGenericString();
+					// In this example code we will assume all messages are '\0'-terminated strings.
+					// Obviously, this is not secure.
+					TEST_Printf("Received message '%s'\n", pMessage->GetData());
+					// std::string message = reinterpret_cast<char *>(pMessage->GetData());
+					const char *message = reinterpret_cast<const char *>(pMessage->GetData());
+					m = m + ": " + message;
+					// log(m);
+					incomingMessages = m;
+					// log(message);
+
+					// Free message struct and buffer.
+					pMessage->Release();
+				}
+			} while (r == k_nMaxMessagesPerPoll);
+		}
+
+		DecodeStreams();
+
+		for (auto &[peerIdentity, peerData] : m_PeerConnections)
+		{
+			if (peerData.connection == k_HSteamNetConnection_Invalid)
+			{
+				continue;
+			}
+
+			if (peerData.connectionStatus == ConnectionStatus::Connected)
 			{
-				std::string m = pMessage->m_identityPeer.GetGenericString();
-				// In this example code we will assume all messages are '\0'-terminated strings.
-				// Obviously, this is not secure.
-				TEST_Printf("Received message '%s'\n", pMessage->GetData());
-				// std::string message = reinterpret_cast<char *>(pMessage->GetData());
-				const char *message = reinterpret_cast<const char *>(pMessage->GetData());
-				m = m + ": " + message;
-				// log(m);
-				incomingMessages = m;
-				// log(message);
+				SendCursor(peerData);
+				UpdateRateController(peerData);
+				if (peerData.wantedStreamsChanged)
+				{
+					StreamSubscriptionHeader header;
+					header.streamMask = (uint16_t)peerData.wantedStreams;
+					SendOnLane(peerData.connection, &header, sizeof(header), k_nSteamNetworkingSend_ReliableNoNagle, Lane::Control);
+					peerData.wantedStreamsChanged = false;
+				}
+			}
+			for (uint32_t stream = 0; stream < k_MaxStreams; ++stream)
+			{
+				const OutgoingStream &outgoing = peerData.streams[stream];
+				if (outgoing.sendQueue && !outgoing.sendQueue->IsEmpty())
+				{
+					SendQueuedFrames(peerData, stream);
+				}
+				if (outgoing.snapshotNextTile != k_NoSnapshot)
+				{
+					PumpSnapshot(peerData, stream);
+				}
+			}
 
-				// Free message struct and buffer.
-				pMessage->Release();
+			for (const std::shared_ptr<FrameReceiver> &frameReceiver : peerData.frameReceivers)
+			{
+				if (!frameReceiver)
+				{
+					continue;
+				}
+				// Cache misses first, the sender has to drop those slots before it re-encodes the tiles.
+				if (frameReceiver->BuildCacheMiss(m_NackMessage))
+				{
+					SendOnLane(peerData.connection, m_NackMessage.data(), (uint32)m_NackMessage.size(), k_nSteamNetworkingSend_ReliableNoNagle, Lane::Control);
+				}
+				// Ask for whatever FEC could not repair.  The NACK is rate limited by the receiver.
+				if (frameReceiver->BuildNack(std::chrono::steady_clock::now(), m_NackMessage))
+				{
+					SendOnLane(peerData.connection, m_NackMessage.data(), (uint32)m_NackMessage.size(), k_nSteamNetworkingSend_ReliableNoNagle, Lane::Control);
+				}
+				if (peerData.connectionStatus == ConnectionStatus::Connected && frameReceiver->BuildViewport(m_NackMessage))
+				{
+					SendOnLane(peerData.connection, m_NackMessage.data(), (uint32)m_NackMessage.size(), k_nSteamNetworkingSend_ReliableNoNagle, Lane::Control);
+				}
 			}
 		}
 		return incomingMessages;
@@ -246,10 +803,386 @@ public:
 			return;
 		}
 		m_PeerConnections[identityPeer].connectionStatus = status;
+		if (status == ConnectionStatus::Connected)
+		{
+			PeerData &peerData = m_PeerConnections[identityPeer];
+			ConfigureLanes(peerData.connection);
+			SteamNetworkingUtils()->SetConnectionConfigValueInt32(peerData.connection, k_ESteamNetworkingConfig_SendRateMin, k_nSendRateMin);
+			SteamNetworkingUtils()->SetConnectionConfigValueInt32(peerData.connection, k_ESteamNetworkingConfig_SendRateMax, k_nSendRateMax);
+			peerData.rateController = RateController();
+			peerData.cursorSender = CursorSender();
+			peerData.inputSender = InputSender();
+			peerData.receivedInput.clear();
+			peerData.wantedStreamsChanged = peerData.wantedStreams != 1;
+
+			// Every viewer starts out on the first stream, until it says otherwise.
+			SetStreamMask(peerData, 1);
+		}
+		else
+		{
+			SetStreamMask(m_PeerConnections[identityPeer], 0);
+		}
+	}
+
+private:
+	static constexpr int k_nMaxMessagesPerPoll = 64;
+
+	// Every peer's screen at once on the decode pool, started on the first one to arrive.
+	void DecodeStreams()
+	{
+		m_DecodeStreams.clear();
+		for (auto &[peerIdentity, peerData] : m_PeerConnections)
+		{
+			for (const std::shared_ptr<FrameReceiver> &frameReceiver : peerData.frameReceivers)
+			{
+				if (frameReceiver && frameReceiver->HasQueuedMessages())
+				{
+					m_DecodeStreams.push_back(frameReceiver.get());
+				}
+			}
+		}
+		if (m_DecodeStreams.empty())
+		{
+			return;
+		}
+		if (!m_DecodePool)
+		{
+			m_DecodePool = std::make_unique<StreamDecodePool>();
+		}
+		m_DecodePool->Run(m_DecodeStreams, std::chrono::steady_clock::now() + k_DecodeBudget);
+	}
+
+	FrameReceiver &GetFrameReceiver(PeerData &peerData, uint32_t stream)
+	{
+		std::shared_ptr<FrameReceiver> &frameReceiver = peerData.frameReceivers[stream];
+		if (!frameReceiver)
+		{
+			frameReceiver = std::make_shared<FrameReceiver>(stream);
+			frameReceiver->SetPlayoutMode(peerData.playoutMode);
+		}
+		return *frameReceiver;
+	}
+
+	// Starts the streams the peer newly wants, catching it up from what was already sent, the
+	// others keep getting deltas; and stops the ones it no longer does.
+	void SetStreamMask(PeerData &peerData, uint32_t streamMask)
+	{
+		for (uint32_t stream = 0; stream < k_MaxStreams; ++stream)
+		{
+			OutgoingStream &outgoing = peerData.streams[stream];
+			const bool wanted = (streamMask & (1u << stream)) != 0;
+			if (wanted && !(peerData.streamMask & (1u << stream)))
+			{
+				outgoing.sendQueue = std::make_shared<FrameSendQueue>();
+				outgoing.layer = GetDisplayLayer(outgoing, stream);
+				outgoing.snapshotNextTile = k_NoSnapshot;
+				outgoing.snapshotOnNextFrame = true;
+			}
+			else if (!wanted)
+			{
+				outgoing.sendQueue.reset();
+				outgoing.snapshotNextTile = k_NoSnapshot;
+				outgoing.snapshotOnNextFrame = false;
+			}
+		}
+		peerData.streamMask = streamMask;
+	}
+
+	void OnStreamSubscription(PeerData &peerData, const uint8_t *data, uint32_t size)
+	{
+		StreamSubscriptionHeader header;
+		if (size != sizeof(header))
+		{
+			return;
+		}
+		std::memcpy(&header, data, sizeof(header));
+		SetStreamMask(peerData, header.streamMask & ((1u << k_MaxStreams) - 1));
+	}
+
+	static void ReleaseMessage(void *handle)
+	{
+		static_cast<SteamNetworkingMessage_t *>(handle)->Release();
+	}
+
+	// Hands queued frames of stream to the connection while the stream's lane can take them
+	// without delay, one frame per SendMessages() so the lane status is current for the next.
+	void SendQueuedFrames(PeerData &peerData, uint32_t stream)
+	{
+		FrameSendQueue &sendQueue = *peerData.streams[stream].sendQueue;
+		const Lane lane = GetStreamLane(stream);
+		SteamNetConnectionRealTimeStatus_t status;
+		SteamNetConnectionRealTimeLaneStatus_t lanes[k_LaneCount];
+		while (!sendQueue.IsEmpty())
+		{
+			if (SteamNetworkingSockets()->GetConnectionRealTimeStatus(peerData.connection, &status, (int)k_LaneCount, lanes) != k_EResultOK ||
+				lanes[(int)lane].m_usecQueueTime > k_usecVideoMaxQueueTime)
+			{
+				return;
+			}
+
+			// Frames carrying parity go out unreliably, the receiver repairs losses without a round trip.
+			// Without it every fragment is a single packet, so a loss only holds up the tiles behind it.
+			const EncodedFrame &frame = sendQueue.Front();
+			// byteCount has the parity in it.
+			const int sendFlags = frame.fecParityCount != 0 ? k_nSteamNetworkingSend_UnreliableNoNagle : k_nSteamNetworkingSend_Reliable;
+			m_FrameMessageBuilder.AddFrame(frame, peerData.connection, sendFlags, lane);
+			m_FrameMessageBuilder.Flush();
+			peerData.rateController.OnFrameSent((uint32_t)frame.byteCount);
+			m_StreamLatency[stream].Record(LatencyStage::Send, std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - sendQueue.GetFrontPushTime()));
+			sendQueue.Pop();
+		}
+	}
+
+	void UpdateRateController(PeerData &peerData)
+	{
+		SteamNetConnectionRealTimeStatus_t status;
+		if (SteamNetworkingSockets()->GetConnectionRealTimeStatus(peerData.connection, &status, 0, nullptr) != k_EResultOK)
+		{
+			return;
+		}
+		RateSample sample;
+		sample.pingMs = status.m_nPing;
+		sample.deliveryRate = status.m_flConnectionQualityLocal;
+		sample.sendRateBytesPerSecond = status.m_nSendRateBytesPerSecond;
+		// Frames still waiting on our side are as much a queue as the library's.
+		sample.pendingBytes = status.m_cbPendingUnreliable + status.m_cbPendingReliable;
+		for (const OutgoingStream &outgoing : peerData.streams)
+		{
+			if (outgoing.sendQueue)
+			{
+				sample.pendingBytes += (int)outgoing.sendQueue->GetQueuedByteCount();
+			}
+		}
+		sample.queueTimeUs = status.m_usecQueueTime;
+		peerData.rateController.Update(std::chrono::steady_clock::now(), sample);
+		for (const std::shared_ptr<FrameReceiver> &frameReceiver : peerData.frameReceivers)
+		{
+			if (frameReceiver)
+			{
+				frameReceiver->SetPathDelay(std::chrono::milliseconds(status.m_nPing) / 2);
+			}
+		}
+
+		// Whichever wants the smaller layer wins: a small display doesn't need more, a slow path
+		// can't take more.
+		for (uint32_t stream = 0; stream < k_MaxStreams; ++stream)
+		{
+			OutgoingStream &outgoing = peerData.streams[stream];
+			if (!(peerData.streamMask & (1u << stream)))
+			{
+				continue;
+			}
+			const uint32_t layer = std::max(peerData.rateController.GetTarget().layer, GetDisplayLayer(outgoing, stream));
+			if (layer != outgoing.layer)
+			{
+				outgoing.layer = layer;
+				outgoing.snapshotNextTile = k_NoSnapshot;
+				outgoing.snapshotOnNextFrame = true;
+			}
+		}
+	}
+
+	// The shape first, the position that uses it would find nothing to draw otherwise.
+	void SendCursor(PeerData &peerData)
+	{
+		if (m_Cursor.visible && m_CursorShape.id == m_Cursor.shapeId && peerData.cursorSender.BuildShape(m_CursorShape, m_CursorMessage))
+		{
+			SendOnLane(peerData.connection, m_CursorMessage.data(), (uint32)m_CursorMessage.size(), k_nSteamNetworkingSend_Reliable, Lane::Cursor);
+		}
+		if (peerData.cursorSender.BuildPosition(std::chrono::steady_clock::now(), m_Cursor, peerData.refreshRate, m_CursorMessage))
+		{
+			SendOnLane(peerData.connection, m_CursorMessage.data(), (uint32)m_CursorMessage.size(), k_nSteamNetworkingSend_UnreliableNoNagle, Lane::Cursor);
+		}
+	}
+
+	uint32_t GetDisplayLayer(const OutgoingStream &outgoing, uint32_t stream) const
+	{
+		return GetSimulcastLayerForDisplay(m_SnapshotCanvas[stream][0].GetWidth(), m_SnapshotCanvas[stream][0].GetHeight(), outgoing.displayWidth, outgoing.displayHeight);
+	}
+
+	static void StartSnapshot(OutgoingStream &outgoing)
+	{
+		outgoing.snapshotOnNextFrame = false;
+		outgoing.snapshotNextTile = 0;
+		outgoing.snapshotCredit = k_cbSnapshotMessage;
+		outgoing.snapshotPumped = std::chrono::steady_clock::now();
+	}
+
+	static void OnViewport(PeerData &peerData, const uint8_t *data, uint32_t size)
+	{
+		ViewportHeader header;
+		if (size != sizeof(header))
+		{
+			return;
+		}
+		std::memcpy(&header, data, sizeof(header));
+		const ViewportRect &rect = header.rect;
+		if (rect.right <= rect.left || rect.bottom <= rect.top || header.stream >= k_MaxStreams)
+		{
+			return;
+		}
+		OutgoingStream &outgoing = peerData.streams[header.stream];
+		outgoing.viewport = rect;
+		// Zoomed in, the whole frame would take that many times the display.
+		outgoing.displayWidth = (uint32_t)((uint64_t)header.displayWidth * 0xFFFF / (rect.right - rect.left));
+		outgoing.displayHeight = (uint32_t)((uint64_t)header.displayHeight * 0xFFFF / (rect.bottom - rect.top));
+		peerData.refreshRate = header.refreshRate;
+	}
+
+	// NACKs name the frame size they were made against, which tells the layer even when the peer
+	// has moved on to another one since.
+	void OnNack(const uint8_t *data, uint32_t size)
+	{
+		TileNackHeader header;
+		if (size < sizeof(header))
+		{
+			return;
+		}
+		std::memcpy(&header, data, sizeof(header));
+		if (header.stream >= k_MaxStreams)
+		{
+			return;
+		}
+		for (uint32_t layer = 0; layer < k_SimulcastLayerCount; ++layer)
+		{
+			const SnapshotCanvas &canvas = m_SnapshotCanvas[header.stream][layer];
+			if (header.frameWidth == canvas.GetWidth() && header.frameHeight == canvas.GetHeight())
+			{
+				m_TileRefresh[header.stream][layer].OnNack(data, size);
+				return;
+			}
+		}
+	}
+
+	// Same for cache misses: the slots are of the cache of the layer the peer was on.
+	void OnCacheMiss(const uint8_t *data, uint32_t size)
+	{
+		TileCacheMissHeader header;
+		if (size < sizeof(header))
+		{
+			return;
+		}
+		std::memcpy(&header, data, sizeof(header));
+		if (header.stream >= k_MaxStreams)
+		{
+			return;
+		}
+		for (uint32_t layer = 0; layer < k_SimulcastLayerCount; ++layer)
+		{
+			const SnapshotCanvas &canvas = m_SnapshotCanvas[header.stream][layer];
+			if (header.frameWidth == canvas.GetWidth() && header.frameHeight == canvas.GetHeight())
+			{
+				m_TileRefresh[header.stream][layer].OnCacheMiss(data, size);
+				return;
+			}
+		}
+	}
+
+	void PumpSnapshot(PeerData &peerData, uint32_t stream)
+	{
+		OutgoingStream &outgoing = peerData.streams[stream];
+
+		// Snapshots only get what the frames leave of the path.
+		const double bytesPerSecond = std::min(k_flSnapshotBytesPerSecond, peerData.rateController.GetTarget().refreshBytesPerSecond);
+		const auto now = std::chrono::steady_clock::now();
+		const double elapsed = std::chrono::duration<double>(now - outgoing.snapshotPumped).count();
+		outgoing.snapshotPumped = now;
+		outgoing.snapshotCredit = std::min(outgoing.snapshotCredit + elapsed * bytesPerSecond, 2.0 * k_cbSnapshotMessage);
+
+		SteamNetConnectionRealTimeStatus_t status;
+		SteamNetConnectionRealTimeLaneStatus_t lanes[(int)Lane::Count];
+		while (outgoing.snapshotCredit > 0.0)
+		{
+			if (SteamNetworkingSockets()->GetConnectionRealTimeStatus(peerData.connection, &status, (int)Lane::Count, lanes) != k_EResultOK ||
+				lanes[(int)Lane::Bulk].m_cbPendingReliable > k_cbSnapshotMaxQueued)
+			{
+				return;
+			}
+			if (!m_SnapshotCanvas[stream][outgoing.layer].WriteMessage(stream, outgoing.snapshotNextTile, k_cbSnapshotMessage, m_SnapshotMessage))
+			{
+				outgoing.snapshotNextTile = k_NoSnapshot;
+				return;
+			}
+			SendOnLane(peerData.connection, m_SnapshotMessage.data(), (uint32)m_SnapshotMessage.size(), k_nSteamNetworkingSend_Reliable, Lane::Bulk);
+			outgoing.snapshotCredit -= (double)m_SnapshotMessage.size();
+		}
+	}
+
+	// To every viewer of stream with nothing of it queued, see StreamKeepaliveHeader.
+	void SendKeepalive(uint32_t stream, std::chrono::steady_clock::time_point now)
+	{
+		StreamKeepaliveHeader header;
+		header.stream = (uint8_t)stream;
+		header.timestamp = GetWireTimestamp(now);
+		for (auto &[peerIdentity, peerData] : m_PeerConnections)
+		{
+			const OutgoingStream &outgoing = peerData.streams[stream];
+			if (peerData.connectionStatus != ConnectionStatus::Connected || !outgoing.sendQueue || !outgoing.sendQueue->IsEmpty())
+			{
+				continue;
+			}
+			SendOnLane(peerData.connection, &header, sizeof(header), k_nSteamNetworkingSend_UnreliableNoNagle, GetStreamLane(stream));
+		}
+	}
+
+	// SendMessageToConnection() always uses lane 0.
+	static void SendOnLane(HSteamNetConnection connection, const void *data, uint32 size, int sendFlags, Lane lane)
+	{
+		SteamNetworkingMessage_t *pMessage = SteamNetworkingUtils()->AllocateMessage((int)size);
+		std::memcpy(pMessage->m_pData, data, size);
+		pMessage->m_conn = connection;
+		pMessage->m_nFlags = sendFlags;
+		pMessage->m_idxLane = (uint16)lane;
+
+		int64 result;
+		SteamNetworkingSockets()->SendMessages(1, &pMessage, &result);
+		if (result < 0)
+		{
+			TEST_Printf("Failed to send message on lane %d: %d\n", (int)lane, (int)-result);
+		}
+	}
+
+	void ConfigureLanes(HSteamNetConnection connection)
+	{
+		// Strict priority in Lane order, weights only matter between equal priorities.  The lanes
+		// of further streams share the video lane's priority, and the path with it.
+		int priorities[k_LaneCount];
+		uint16 weights[k_LaneCount];
+		for (int i = 0; i < (int)k_LaneCount; ++i)
+		{
+			priorities[i] = i < (int)Lane::Count ? i : (int)Lane::Video;
+			weights[i] = 1;
+		}
+		EResult r = SteamNetworkingSockets()->ConfigureConnectionLanes(connection, (int)k_LaneCount, priorities, weights);
+		if (r != k_EResultOK)
+		{
+			TEST_Printf("Failed to configure connection lanes: %d\n", r);
+		}
 	}
 
 private:
 	std::string m_OutgoingMessage;
+	FrameMessageBuilder m_FrameMessageBuilder;
+	TileRefreshScheduler m_TileRefresh[k_MaxStreams][k_SimulcastLayerCount];
+	std::vector<uint8_t> m_NackMessage;
+	SnapshotCanvas m_SnapshotCanvas[k_MaxStreams][k_SimulcastLayerCount];
+	std::vector<uint8_t> m_SnapshotMessage;
+	std::vector<uint32_t> m_EvictedTiles;
+	CursorState m_Cursor;
+	CursorShape m_CursorShape;
+	std::vector<uint8_t> m_CursorMessage;
+	std::vector<uint8_t> m_InputMessage;
+	FecConfig m_FecConfig;
+	std::unique_ptr<StreamDecodePool> m_DecodePool;
+	std::vector<FrameReceiver *> m_DecodeStreams;
+	// SendStream() scratch, and when each stream was last encoded.
+	std::vector<uint32_t> m_StreamDirtyTiles;
+	std::vector<uint32_t> m_StreamRefreshTiles;
+	std::vector<ViewportRect> m_StreamViewports;
+	std::chrono::steady_clock::time_point m_StreamEncoded[k_MaxStreams];
+	std::chrono::steady_clock::time_point m_StreamKeepalive[k_MaxStreams]; // or last frame
+	bool m_StreamIdle[k_MaxStreams] = {};
+	LatencyTrace m_StreamLatency[k_MaxStreams];
 	// std::unordered_map<HSteamNetConnection, SteamNetworkingIdentity> m_PeerConnections;
 	std::unordered_map<SteamNetworkingIdentity, PeerData> m_PeerConnections;
 	// std::unordered_map<SteamNetworkingIdentity, HSteamNetConnection, SteamNetworkingIdentityHash> m_PeerConnections;
@@ -0,0 +1,17 @@
+#include "Blit.h"
+
+#include <cstring>
+
+// Rows are copied with memcpy, which the C runtimes already vectorise at least as well as an
+// SSE2 loop does for 256 byte tile rows.
+void BlitRect(const uint8_t *src, size_t srcStride, uint8_t *dst, size_t dstStride, uint32_t width, uint32_t height)
+{
+	const size_t rowBytes = (size_t)width * k_BytesPerPixel;
+	if (rowBytes == srcStride && rowBytes == dstStride)
+	{
+		std::memcpy(dst, src, rowBytes * height);
+		return;
+	}
+	for (uint32_t y = 0; y < height; ++y, src += srcStride, dst += dstStride)
+		std::memcpy(dst, src, rowBytes);
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "Frame.h"
+
+// Copies a width x height block of pixels between two strided buffers, in one go when both are
+// packed.
+void BlitRect(const uint8_t *src, size_t srcStride, uint8_t *dst, size_t dstStride, uint32_t width, uint32_t height);
+
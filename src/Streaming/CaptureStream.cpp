@@ -0,0 +1,124 @@
+#include "CaptureStream.h"
+
+#include "Blit.h"
+
+CaptureStream::CaptureStream(uint32_t stream, std::unique_ptr<IFrameSource> source, WorkStealingPool &pool, ArenaBlockPool &blockPool)
+	: m_Stream(stream), m_Source(std::move(source)), m_Encoder(pool, blockPool)
+{
+	m_Thread = std::thread([this]()
+						   { CaptureThreadFunc(); });
+}
+
+CaptureStream::~CaptureStream()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_StateMutex);
+		m_Stop = true;
+	}
+	m_StateCv.notify_all();
+	m_Thread.join();
+}
+
+void CaptureStream::SetActive(bool active)
+{
+	if (m_Active.load() == active)
+		return;
+	{
+		std::lock_guard<std::mutex> lock(m_StateMutex);
+		m_Active.store(active);
+	}
+	m_StateCv.notify_all();
+}
+
+bool CaptureStream::AcquireFrame(FrameView &frame, std::vector<uint32_t> &dirtyTiles, std::chrono::steady_clock::time_point &captured,
+								 std::chrono::steady_clock::time_point &diffed)
+{
+	m_FrameMutex.lock();
+	if (!m_HasFrame)
+	{
+		m_FrameMutex.unlock();
+		return false;
+	}
+
+	dirtyTiles.clear();
+	for (uint32_t tile = 0; m_ChangedCount != 0 && tile < m_Changed.size(); ++tile)
+	{
+		if (m_Changed[tile])
+		{
+			dirtyTiles.push_back(tile);
+			m_Changed[tile] = 0;
+			--m_ChangedCount;
+		}
+	}
+	frame = m_Frame.GetView();
+	captured = m_Captured;
+	diffed = m_Diffed;
+	return true;
+}
+
+void CaptureStream::ReleaseFrame()
+{
+	m_FrameMutex.unlock();
+}
+
+bool CaptureStream::GetCursor(CursorState &cursor, CursorShape &shape) const
+{
+	std::lock_guard<std::mutex> lock(m_CursorMutex);
+	if (!m_HasCursor)
+		return false;
+	cursor = m_Cursor;
+	if (shape.id != m_CursorShape.id)
+		shape = m_CursorShape;
+	return true;
+}
+
+void CaptureStream::CaptureThreadFunc()
+{
+	CapturedFrame captured;
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(m_StateMutex);
+			m_StateCv.wait(lock, [this]()
+						   { return m_Stop || m_Active.load(); });
+			if (m_Stop)
+				break;
+		}
+
+		const bool acquired = m_Source->AcquireFrame(k_AcquireTimeout, captured);
+		{
+			std::lock_guard<std::mutex> lock(m_CursorMutex);
+			m_HasCursor = m_Source->GetCursor(m_Cursor, m_CursorShape);
+		}
+		if (!acquired)
+			continue;
+
+		m_Differ.Diff(captured.view, captured.dirtyRects, !captured.hasDirtyRects, m_Dirty);
+		if (!m_Dirty.empty())
+		{
+			std::lock_guard<std::mutex> lock(m_FrameMutex);
+			if (captured.view.width != m_Frame.width || captured.view.height != m_Frame.height)
+			{
+				m_Frame.Resize(captured.view.width, captured.view.height);
+				m_Grid = TileGrid(captured.view.width, captured.view.height);
+				m_Changed.assign(m_Grid.GetTileCount(), 0);
+				m_ChangedCount = 0;
+			}
+			for (uint32_t tile : m_Dirty)
+			{
+				const TileRect rect = m_Grid.GetTileRect(tile);
+				BlitRect(captured.view.Row(rect.y) + (size_t)rect.x * k_BytesPerPixel, captured.view.stride,
+						 m_Frame.Row(rect.y) + (size_t)rect.x * k_BytesPerPixel, m_Frame.stride, rect.width, rect.height);
+				m_ChangedCount += m_Changed[tile] == 0;
+				m_Changed[tile] = 1;
+			}
+			m_Captured = captured.captured;
+			m_Diffed = std::chrono::steady_clock::now();
+			m_Focus = captured.focus;
+			m_HasFrame = true;
+			m_ChangedTiles.fetch_add(m_Dirty.size());
+		}
+		m_Source->ReleaseFrame();
+		m_CapturedFrames.fetch_add(1);
+	}
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstdint>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "FrameSource.h"
+#include "SimulcastEncoder.h"
+#include "TileDiff.h"
+
+// One shared screen.  Its source is captured and diffed on a thread of its own, and the changed
+// tiles are copied onto the stream's frame, where they wait for the next encode.  The encoder
+// state is the stream's too, but encodes run on whoever calls AcquireFrame(), across the shared
+// pool.  Capture only runs while the stream is active, a monitor nobody watches costs nothing.
+class CaptureStream
+{
+public:
+	// How long the capture thread waits on the source before it looks at SetActive() again.
+	static constexpr std::chrono::milliseconds k_AcquireTimeout{50};
+
+	// stream numbers it on the wire, see k_MaxStreams.  Starts out inactive.
+	CaptureStream(uint32_t stream, std::unique_ptr<IFrameSource> source, WorkStealingPool &pool, ArenaBlockPool &blockPool);
+	~CaptureStream();
+
+	CaptureStream(const CaptureStream &) = delete;
+	CaptureStream &operator=(const CaptureStream &) = delete;
+
+	uint32_t GetStream() const { return m_Stream; }
+
+	// Whether to capture.  A stream that resumes reports what changed meanwhile with its next frame.
+	void SetActive(bool active);
+	bool IsActive() const { return m_Active.load(); }
+
+	// The screen as last captured, when it was and when it was diffed onto the stream's frame, and
+	// the tiles that changed since the last call, ascending.  Capture waits until ReleaseFrame(), so
+	// encode and release right away.  False, with nothing to release, until the first frame arrived.
+	bool AcquireFrame(FrameView &frame, std::vector<uint32_t> &dirtyTiles, std::chrono::steady_clock::time_point &captured,
+					  std::chrono::steady_clock::time_point &diffed);
+	void ReleaseFrame();
+	// Of the frame AcquireFrame() returned, until ReleaseFrame(); for the encoder's SetFocus().
+	const FrameFocus &GetFocus() const { return m_Focus; }
+	// The source's cursor as of the capture thread's last look, see IFrameSource::GetCursor().
+	// From any thread.
+	bool GetCursor(CursorState &cursor, CursorShape &shape) const;
+
+	SimulcastEncoder &GetEncoder() { return m_Encoder; }
+	uint32_t NextFrameId() { return m_NextFrameId++; }
+
+	uint64_t GetCapturedFrameCount() const { return m_CapturedFrames.load(); }
+	uint64_t GetChangedTileCount() const { return m_ChangedTiles.load(); }
+
+private:
+	void CaptureThreadFunc();
+
+private:
+	const uint32_t m_Stream;
+	std::unique_ptr<IFrameSource> m_Source;
+	SimulcastEncoder m_Encoder;
+	uint32_t m_NextFrameId = 0;
+
+	// Capture thread only.
+	TileDiffer m_Differ;
+	std::vector<uint32_t> m_Dirty;
+
+	// Guarded by m_FrameMutex, held from AcquireFrame() to ReleaseFrame().
+	std::mutex m_FrameMutex;
+	FrameBuffer m_Frame;
+	TileGrid m_Grid;
+	std::vector<uint8_t> m_Changed; // per tile, since the last AcquireFrame()
+	uint32_t m_ChangedCount = 0;	// of m_Changed set, a static screen isn't scanned
+	bool m_HasFrame = false;
+	std::chrono::steady_clock::time_point m_Captured;
+	std::chrono::steady_clock::time_point m_Diffed;
+	FrameFocus m_Focus;
+
+	// Guarded by m_CursorMutex.
+	mutable std::mutex m_CursorMutex;
+	CursorState m_Cursor;
+	CursorShape m_CursorShape;
+	bool m_HasCursor = false;
+
+	std::mutex m_StateMutex;
+	std::condition_variable m_StateCv;
+	std::atomic<bool> m_Active = false;
+	bool m_Stop = false;
+
+	std::atomic<uint64_t> m_CapturedFrames = 0;
+	std::atomic<uint64_t> m_ChangedTiles = 0;
+
+	std::thread m_Thread;
+};
@@ -0,0 +1,110 @@
+#include "CropFrameSource.h"
+
+#include <algorithm>
+#include <thread>
+
+// rect clipped to a width x height frame, empty when it doesn't overlap.
+static TileRect ClipRect(const TileRect &rect, uint32_t width, uint32_t height)
+{
+	const uint32_t x0 = std::min(rect.x, width);
+	const uint32_t y0 = std::min(rect.y, height);
+	const uint32_t x1 = (uint32_t)std::min<uint64_t>((uint64_t)rect.x + rect.width, width);
+	const uint32_t y1 = (uint32_t)std::min<uint64_t>((uint64_t)rect.y + rect.height, height);
+	return {x0, y0, x1 - x0, y1 - y0};
+}
+
+CropFrameSource::CropFrameSource(std::unique_ptr<IFrameSource> source, std::unique_ptr<ICropRegion> region)
+	: m_Source(std::move(source)), m_Region(std::move(region))
+{
+}
+
+static bool SameRect(const TileRect &a, const TileRect &b)
+{
+	return a.x == b.x && a.y == b.y && a.width == b.width && a.height == b.height;
+}
+
+bool CropFrameSource::AcquireFrame(std::chrono::milliseconds timeout, CapturedFrame &frame)
+{
+	// Asked before the frame is, so the source already reads the right rectangle.
+	TileRect rect;
+	if (!m_Region->GetRect(m_SourceWidth, m_SourceHeight, rect) || rect.width == 0 || rect.height == 0)
+	{
+		std::this_thread::sleep_for(timeout);
+		return false;
+	}
+	if (!SameRect(rect, m_Requested))
+	{
+		m_Source->SetRegion(rect);
+		m_Requested = rect;
+	}
+
+	if (!m_Source->AcquireFrame(timeout, m_Captured))
+		return false;
+	const FrameView &view = m_Captured.view;
+	m_SourceWidth = view.width;
+	m_SourceHeight = view.height;
+	rect = ClipRect(rect, view.width, view.height);
+	if (rect.width == 0 || rect.height == 0)
+	{
+		m_Source->ReleaseFrame();
+		return false;
+	}
+
+	const bool moved = !SameRect(rect, m_Rect);
+	if (moved && rect.width == m_Rect.width && rect.height == m_Rect.height)
+		++m_Moves;
+
+	frame.dirtyRects.clear();
+	frame.hasDirtyRects = m_Captured.hasDirtyRects && !moved;
+	if (frame.hasDirtyRects)
+	{
+		for (const TileRect &dirty : m_Captured.dirtyRects)
+		{
+			// What of it is inside the rectangle, relative to the rectangle.
+			const uint32_t x0 = std::max(dirty.x, rect.x);
+			const uint32_t y0 = std::max(dirty.y, rect.y);
+			const uint32_t x1 = std::min(dirty.x + dirty.width, rect.x + rect.width);
+			const uint32_t y1 = std::min(dirty.y + dirty.height, rect.y + rect.height);
+			if (x0 < x1 && y0 < y1)
+				frame.dirtyRects.push_back({x0 - rect.x, y0 - rect.y, x1 - x0, y1 - y0});
+		}
+	}
+	m_Rect = rect;
+
+	frame.view.pixels = view.Row(rect.y) + (size_t)rect.x * k_BytesPerPixel;
+	frame.view.width = rect.width;
+	frame.view.height = rect.height;
+	frame.view.stride = view.stride;
+	frame.captured = m_Captured.captured;
+
+	// Relative to the rectangle too, a cursor outside it is no focus of ours.
+	const FrameFocus &focus = m_Captured.focus;
+	frame.focus = FrameFocus();
+	frame.focus.hasCursor = focus.hasCursor && focus.cursorX >= (int32_t)rect.x && focus.cursorY >= (int32_t)rect.y &&
+							focus.cursorX < (int32_t)(rect.x + rect.width) && focus.cursorY < (int32_t)(rect.y + rect.height);
+	if (frame.focus.hasCursor)
+	{
+		frame.focus.cursorX = focus.cursorX - (int32_t)rect.x;
+		frame.focus.cursorY = focus.cursorY - (int32_t)rect.y;
+	}
+	const uint32_t x0 = std::max(focus.window.x, rect.x);
+	const uint32_t y0 = std::max(focus.window.y, rect.y);
+	const uint32_t x1 = std::min(focus.window.x + focus.window.width, rect.x + rect.width);
+	const uint32_t y1 = std::min(focus.window.y + focus.window.height, rect.y + rect.height);
+	if (x0 < x1 && y0 < y1)
+		frame.focus.window = {x0 - rect.x, y0 - rect.y, x1 - x0, y1 - y0};
+	return true;
+}
+
+bool CropFrameSource::GetCursor(CursorState &cursor, CursorShape &shape)
+{
+	if (!m_Source->GetCursor(cursor, shape))
+		return false;
+	cursor.visible = cursor.visible && cursor.x >= (int32_t)m_Rect.x && cursor.y >= (int32_t)m_Rect.y &&
+					 cursor.x < (int32_t)(m_Rect.x + m_Rect.width) && cursor.y < (int32_t)(m_Rect.y + m_Rect.height);
+	cursor.x -= (int32_t)m_Rect.x;
+	cursor.y -= (int32_t)m_Rect.y;
+	cursor.frameWidth = m_Rect.width;
+	cursor.frameHeight = m_Rect.height;
+	return true;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+#include "FrameSource.h"
+
+// Where in its source's frames a crop is.  Asked on the capture thread before every frame.
+class ICropRegion
+{
+public:
+	virtual ~ICropRegion() = default;
+
+	// The rectangle to keep of the source's frames, which were frameWidth x frameHeight last time,
+	// 0 x 0 before the first.  Clipped by the caller.  False when there is nothing to show, e.g.
+	// the window is minimized; no frames are handed out then.
+	virtual bool GetRect(uint32_t frameWidth, uint32_t frameHeight, TileRect &rect) = 0;
+};
+
+// A rectangle set from any thread, e.g. picked in the UI.
+class FixedCropRegion : public ICropRegion
+{
+public:
+	explicit FixedCropRegion(const TileRect &rect) : m_Rect(rect) {}
+
+	void Set(const TileRect &rect)
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Rect = rect;
+	}
+
+	bool GetRect(uint32_t frameWidth, uint32_t frameHeight, TileRect &rect) override
+	{
+		(void)frameWidth;
+		(void)frameHeight;
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		rect = m_Rect;
+		return true;
+	}
+
+private:
+	std::mutex m_Mutex;
+	TileRect m_Rect;
+};
+
+// Hands out only a rectangle of another source's frames, so diff, encode and the tile cache work
+// on the rectangle alone, and tells the source to read no more than that.  The frame is a view
+// into the source's, nothing is copied.
+//
+// The rectangle is asked for before every frame and may move from one to the next, following a window.  A move is taken for the
+// content moving along with it: the whole rectangle is diffed again instead of trusting the
+// source's dirty rects, which are in screen coordinates and would cover everything the window
+// passed over.  Tiles that came along unchanged hash the same and aren't sent again.  A resize
+// starts the stream's tiles over.
+class CropFrameSource : public IFrameSource
+{
+public:
+	CropFrameSource(std::unique_ptr<IFrameSource> source, std::unique_ptr<ICropRegion> region);
+
+	bool AcquireFrame(std::chrono::milliseconds timeout, CapturedFrame &frame) override;
+	void ReleaseFrame() override { m_Source->ReleaseFrame(); }
+	// Relative to the rectangle of the last frame, and only visible inside it.
+	bool GetCursor(CursorState &cursor, CursorShape &shape) override;
+
+	ICropRegion &GetRegion() { return *m_Region; }
+	uint64_t GetMoveCount() const { return m_Moves; }
+
+private:
+	std::unique_ptr<IFrameSource> m_Source;
+	std::unique_ptr<ICropRegion> m_Region;
+	CapturedFrame m_Captured;
+	TileRect m_Requested; // last passed to the source's SetRegion()
+	TileRect m_Rect;	  // of the last frame handed out, empty before the first
+	uint32_t m_SourceWidth = 0;
+	uint32_t m_SourceHeight = 0;
+	uint64_t m_Moves = 0;
+};
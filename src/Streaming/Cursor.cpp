@@ -0,0 +1,147 @@
+#include "Cursor.h"
+
+#include <cstring>
+#include <algorithm>
+
+bool CursorSender::BuildShape(const CursorShape &shape, std::vector<uint8_t> &message)
+{
+	if (shape.id == 0 || shape.width == 0 || shape.height == 0 || shape.width > k_MaxCursorSize || shape.height > k_MaxCursorSize ||
+		shape.pixels.size() != (size_t)shape.width * shape.height * k_BytesPerPixel)
+	{
+		return false;
+	}
+	if (std::find(m_SentShapes.begin(), m_SentShapes.end(), shape.id) != m_SentShapes.end())
+		return false;
+
+	if (m_SentShapes.size() == k_CursorShapeCacheSize)
+		m_SentShapes.erase(m_SentShapes.begin());
+	m_SentShapes.push_back(shape.id);
+	++m_ShapeCount;
+
+	CursorShapeHeader header;
+	header.width = shape.width;
+	header.height = shape.height;
+	header.hotspotX = shape.hotspotX;
+	header.hotspotY = shape.hotspotY;
+	header.shapeId = shape.id;
+	message.resize(sizeof(header) + shape.pixels.size());
+	std::memcpy(message.data(), &header, sizeof(header));
+	std::memcpy(message.data() + sizeof(header), shape.pixels.data(), shape.pixels.size());
+	return true;
+}
+
+bool CursorSender::BuildPosition(std::chrono::steady_clock::time_point now, const CursorState &cursor, uint32_t refreshRate, std::vector<uint8_t> &message)
+{
+	const auto interval = std::chrono::microseconds(1000000 / (refreshRate != 0 ? refreshRate : k_DefaultRefreshRate));
+	const bool changed = !m_HasSent || cursor.visible != m_Sent.visible || cursor.x != m_Sent.x || cursor.y != m_Sent.y ||
+						 cursor.shapeId != m_Sent.shapeId || cursor.frameWidth != m_Sent.frameWidth || cursor.frameHeight != m_Sent.frameHeight;
+	if (m_HasSent && now - m_LastSend < (changed ? interval : std::chrono::microseconds(k_RepeatInterval)))
+		return false;
+
+	m_Sent = cursor;
+	m_HasSent = true;
+	m_LastSend = now;
+	++m_PositionCount;
+
+	CursorPositionHeader header;
+	header.flags = cursor.visible ? CursorPositionHeader::k_FlagVisible : 0;
+	header.sequence = ++m_Sequence;
+	header.shapeId = cursor.shapeId;
+	header.x = (int16_t)std::clamp<int32_t>(cursor.x, INT16_MIN, INT16_MAX);
+	header.y = (int16_t)std::clamp<int32_t>(cursor.y, INT16_MIN, INT16_MAX);
+	header.frameWidth = (uint16_t)cursor.frameWidth;
+	header.frameHeight = (uint16_t)cursor.frameHeight;
+	message.resize(sizeof(header));
+	std::memcpy(message.data(), &header, sizeof(header));
+	return true;
+}
+
+void CursorReceiver::OnMessage(const uint8_t *data, uint32_t size)
+{
+	if (size == 0)
+		return;
+
+	if (data[0] == (uint8_t)MessageType::CursorPosition)
+	{
+		CursorPositionHeader header;
+		if (size != sizeof(header))
+			return;
+		std::memcpy(&header, data, sizeof(header));
+		const int16_t age = (int16_t)(uint16_t)(header.sequence - m_Sequence);
+		if (m_HasPosition && age <= 0 && age >= -k_MaxReorder)
+			return;
+
+		m_HasPosition = true;
+		m_Sequence = header.sequence;
+		m_Cursor.visible = (header.flags & CursorPositionHeader::k_FlagVisible) != 0;
+		m_Cursor.x = header.x;
+		m_Cursor.y = header.y;
+		m_Cursor.shapeId = header.shapeId;
+		m_Cursor.frameWidth = header.frameWidth;
+		m_Cursor.frameHeight = header.frameHeight;
+		return;
+	}
+
+	if (data[0] == (uint8_t)MessageType::CursorShape)
+	{
+		CursorShapeHeader header;
+		if (size < sizeof(header))
+			return;
+		std::memcpy(&header, data, sizeof(header));
+		const size_t pixelBytes = (size_t)header.width * header.height * k_BytesPerPixel;
+		if (header.shapeId == 0 || header.width == 0 || header.height == 0 || header.width > k_MaxCursorSize || header.height > k_MaxCursorSize ||
+			size != sizeof(header) + pixelBytes)
+		{
+			return;
+		}
+
+		// Mirrors CursorSender::BuildShape(), the oldest goes even when it is the one in use.
+		CursorShape shape;
+		if (m_Shapes.size() == k_CursorShapeCacheSize)
+		{
+			shape = std::move(m_Shapes.front());
+			m_Shapes.erase(m_Shapes.begin());
+		}
+		shape.id = header.shapeId;
+		shape.width = header.width;
+		shape.height = header.height;
+		shape.hotspotX = header.hotspotX;
+		shape.hotspotY = header.hotspotY;
+		shape.pixels.assign(data + sizeof(header), data + size);
+		m_Shapes.push_back(std::move(shape));
+	}
+}
+
+const CursorShape *CursorReceiver::GetShape() const
+{
+	for (const CursorShape &shape : m_Shapes)
+	{
+		if (shape.id == m_Cursor.shapeId)
+			return &shape;
+	}
+	return nullptr;
+}
+
+void DrawCursor(const CursorShape &shape, int32_t x, int32_t y, FrameBuffer &target)
+{
+	const int32_t left = x - shape.hotspotX;
+	const int32_t top = y - shape.hotspotY;
+	const int32_t beginX = std::max(0, -left);
+	const int32_t beginY = std::max(0, -top);
+	const int32_t endX = std::min<int32_t>(shape.width, (int32_t)target.width - left);
+	const int32_t endY = std::min<int32_t>(shape.height, (int32_t)target.height - top);
+
+	for (int32_t sy = beginY; sy < endY; ++sy)
+	{
+		const uint8_t *src = shape.pixels.data() + ((size_t)sy * shape.width + beginX) * k_BytesPerPixel;
+		uint8_t *dst = target.Row(top + sy) + (size_t)(left + beginX) * k_BytesPerPixel;
+		for (int32_t sx = beginX; sx < endX; ++sx, src += k_BytesPerPixel, dst += k_BytesPerPixel)
+		{
+			const uint32_t alpha = src[3];
+			if (alpha == 0)
+				continue;
+			for (int channel = 0; channel < 3; ++channel)
+				dst[channel] = (uint8_t)((src[channel] * alpha + dst[channel] * (255 - alpha) + 127) / 255);
+		}
+	}
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstdint>
+#include <chrono>
+#include <vector>
+
+#include "Frame.h"
+#include "WireFormat.h"
+
+// Shapes the viewer keeps.  Both ends add them in the order they go out on the reliable lane and
+// drop the oldest, so with the same size they always agree on which ones the viewer has.
+constexpr uint32_t k_CursorShapeCacheSize = 16;
+// Larger shapes are not sent.
+constexpr uint32_t k_MaxCursorSize = 256;
+
+struct CursorShape
+{
+	uint32_t id = 0; // names the bitmap, e.g. a hash of it; 0 is no shape
+	uint16_t width = 0;
+	uint16_t height = 0;
+	uint16_t hotspotX = 0;
+	uint16_t hotspotY = 0;
+	std::vector<uint8_t> pixels; // BGRA, alpha not premultiplied
+};
+
+struct CursorState
+{
+	bool visible = false;
+	int32_t x = 0; // hotspot, in pixels of the full resolution frame
+	int32_t y = 0;
+	uint32_t shapeId = 0;
+	uint32_t frameWidth = 0;
+	uint32_t frameHeight = 0;
+};
+
+// Send side of one peer's cursor lane.  Positions are coalesced: whatever the cursor did since
+// the last message, only where it is now goes out, and no more often than the viewer's display
+// refreshes.  They are unreliable, so the last one is repeated every k_RepeatInterval while the
+// cursor holds still, in case it was lost.
+class CursorSender
+{
+public:
+	static constexpr std::chrono::milliseconds k_RepeatInterval{250};
+	// Used while the viewer hasn't said how fast its display refreshes.
+	static constexpr uint32_t k_DefaultRefreshRate = 60;
+
+	// Fills message with a CursorShape when the viewer doesn't have shape yet.
+	bool BuildShape(const CursorShape &shape, std::vector<uint8_t> &message);
+
+	// Fills message with a CursorPosition when one is due.  refreshRate is the viewer's, in Hz.
+	bool BuildPosition(std::chrono::steady_clock::time_point now, const CursorState &cursor, uint32_t refreshRate, std::vector<uint8_t> &message);
+
+	uint64_t GetPositionCount() const { return m_PositionCount; }
+	uint64_t GetShapeCount() const { return m_ShapeCount; }
+
+private:
+	std::vector<uint32_t> m_SentShapes; // oldest first
+	CursorState m_Sent;
+	bool m_HasSent = false;
+	uint16_t m_Sequence = 0;
+	std::chrono::steady_clock::time_point m_LastSend;
+
+	uint64_t m_PositionCount = 0;
+	uint64_t m_ShapeCount = 0;
+};
+
+// Receive side.  Keeps the newest position and the shapes, the viewer draws the cursor over the
+// frame when it presents it, see DrawCursor().  The canvas itself never has a cursor in it.
+class CursorReceiver
+{
+public:
+	// Over this many positions behind, a position is taken to be from a sender that started over.
+	static constexpr int k_MaxReorder = 16;
+
+	// Ignores anything that isn't a well formed cursor message.
+	void OnMessage(const uint8_t *data, uint32_t size);
+
+	const CursorState &GetCursor() const { return m_Cursor; }
+	// Shape of the current cursor, nullptr until it arrived.
+	const CursorShape *GetShape() const;
+
+private:
+	CursorState m_Cursor;
+	bool m_HasPosition = false;
+	uint16_t m_Sequence = 0;
+	std::vector<CursorShape> m_Shapes; // oldest first
+};
+
+// Blends shape over target with its hotspot at x, y, in target pixels.  Clipped to target.
+void DrawCursor(const CursorShape &shape, int32_t x, int32_t y, FrameBuffer &target);
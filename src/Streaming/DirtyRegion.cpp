@@ -0,0 +1,113 @@
+#include "DirtyRegion.h"
+
+#include <algorithm>
+
+void DirtyRegion::Reset(uint32_t width, uint32_t height)
+{
+	m_Grid = TileGrid(width, height);
+	m_Tiles.assign(m_Grid.GetTileCount(), 0);
+	m_TileCount = 0;
+	m_Rects.clear();
+	m_RectsValid = true;
+}
+
+void DirtyRegion::AddTile(uint32_t tile)
+{
+	if (tile >= m_Tiles.size() || m_Tiles[tile])
+		return;
+	m_Tiles[tile] = 1;
+	++m_TileCount;
+	m_RectsValid = false;
+}
+
+void DirtyRegion::AddAll()
+{
+	std::fill(m_Tiles.begin(), m_Tiles.end(), 1);
+	m_TileCount = (uint32_t)m_Tiles.size();
+	m_RectsValid = false;
+}
+
+void DirtyRegion::Clear()
+{
+	if (m_TileCount == 0)
+		return;
+	std::fill(m_Tiles.begin(), m_Tiles.end(), 0);
+	m_TileCount = 0;
+	m_Rects.clear();
+	m_RectsValid = true;
+}
+
+const std::vector<TileRect> &DirtyRegion::GetRects()
+{
+	if (m_RectsValid)
+		return m_Rects;
+	m_RectsValid = true;
+
+	Merge(false);
+	if (m_Rects.size() > k_MaxRects)
+		Merge(true);
+	if (m_Rects.size() > k_MaxRects)
+	{
+		uint32_t left = UINT32_MAX, top = UINT32_MAX, right = 0, bottom = 0;
+		for (const TileRect &rect : m_Rects)
+		{
+			left = std::min(left, rect.x);
+			top = std::min(top, rect.y);
+			right = std::max(right, rect.x + rect.width);
+			bottom = std::max(bottom, rect.y + rect.height);
+		}
+		m_Rects.assign(1, {left, top, right - left, bottom - top});
+	}
+	return m_Rects;
+}
+
+void DirtyRegion::Merge(bool spanRows)
+{
+	m_Rects.clear();
+	m_Open.clear();
+	const uint32_t columns = m_Grid.GetColumns();
+	for (uint32_t row = 0; row < m_Grid.GetRows(); ++row)
+	{
+		const uint8_t *tiles = m_Tiles.data() + (size_t)row * columns;
+		m_Above.swap(m_Open);
+		m_Open.clear();
+
+		uint32_t column = 0;
+		while (column < columns)
+		{
+			while (column < columns && !tiles[column])
+				++column;
+			if (column == columns)
+				break;
+			uint32_t end = column + 1;
+			if (spanRows)
+			{
+				end = columns;
+				while (!tiles[end - 1])
+					--end;
+			}
+			else
+			{
+				while (end < columns && tiles[end])
+					++end;
+			}
+
+			const TileRect first = m_Grid.GetTileRect(row * columns + column);
+			const TileRect last = m_Grid.GetTileRect(row * columns + end - 1);
+			const uint32_t width = last.x + last.width - first.x;
+			auto above = std::find_if(m_Above.begin(), m_Above.end(), [&](size_t i)
+									  { return m_Rects[i].x == first.x && m_Rects[i].width == width; });
+			if (above != m_Above.end())
+			{
+				m_Rects[*above].height += first.height;
+				m_Open.push_back(*above);
+			}
+			else
+			{
+				m_Rects.push_back({first.x, first.y, width, first.height});
+				m_Open.push_back(m_Rects.size() - 1);
+			}
+			column = end;
+		}
+	}
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "Frame.h"
+
+// The part of a canvas that changed since it was last uploaded, kept per tile.  GetRects() gives
+// it as rectangles to copy, each a run of tiles along a row, stacked with the same run in the
+// rows below.  A handful of rectangles cost far less to upload than the whole canvas, but every
+// one is a call into the driver, so past k_MaxRects each row becomes one run from its first to
+// its last changed tile, and past that again, the whole region becomes its bounding box.
+class DirtyRegion
+{
+public:
+	static constexpr size_t k_MaxRects = 32;
+
+	// Empties the region and sizes it for a canvas of width x height.
+	void Reset(uint32_t width, uint32_t height);
+
+	void AddTile(uint32_t tile);
+	void AddAll();
+	void Clear();
+
+	bool IsEmpty() const { return m_TileCount == 0; }
+
+	// In canvas pixels, clipped to it, not overlapping.
+	const std::vector<TileRect> &GetRects();
+
+private:
+	void Merge(bool spanRows);
+
+private:
+	TileGrid m_Grid;
+	std::vector<uint8_t> m_Tiles;
+	uint32_t m_TileCount = 0;
+	std::vector<TileRect> m_Rects;
+	std::vector<size_t> m_Open;	 // rectangles reaching down to the current row, by index
+	std::vector<size_t> m_Above; // and to the row above
+	bool m_RectsValid = true;
+};
@@ -0,0 +1,118 @@
+#include "Downscale.h"
+
+#include <cassert>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define DOWNSCALE_SSE2 1
+#endif
+
+// Rounded box average of one destination pixel, clamping at the source edges.
+static void DownscalePixel(const FrameView &src, uint32_t shift, uint32_t x, uint32_t y, uint8_t *out)
+{
+	const uint32_t n = 1u << shift;
+	uint32_t sum[k_BytesPerPixel] = {};
+	for (uint32_t dy = 0; dy < n; ++dy)
+	{
+		const uint8_t *row = src.Row(std::min((y << shift) + dy, src.height - 1));
+		for (uint32_t dx = 0; dx < n; ++dx)
+		{
+			const uint8_t *pixel = row + (size_t)std::min((x << shift) + dx, src.width - 1) * k_BytesPerPixel;
+			for (uint32_t c = 0; c < k_BytesPerPixel; ++c)
+				sum[c] += pixel[c];
+		}
+	}
+	const uint32_t count = n * n;
+	for (uint32_t c = 0; c < k_BytesPerPixel; ++c)
+		out[c] = (uint8_t)((sum[c] + count / 2) / count);
+}
+
+#if DOWNSCALE_SSE2
+
+// Four destination pixels from 8 source pixels of each of two rows.
+static void DownscaleHalf4(const uint8_t *row0, const uint8_t *row1, uint8_t *out)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i pairs[2];
+	for (uint32_t i = 0; i < 2; ++i)
+	{
+		const __m128i a = _mm_loadu_si128((const __m128i *)row0 + i);
+		const __m128i b = _mm_loadu_si128((const __m128i *)row1 + i);
+		// 16 bit per channel, two pixels per register, summed down the column.
+		const __m128i low = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+		const __m128i high = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+		// Then across each pair of neighbours.
+		pairs[i] = _mm_add_epi16(_mm_unpacklo_epi64(low, high), _mm_unpackhi_epi64(low, high));
+	}
+	const __m128i rounding = _mm_set1_epi16(2);
+	const __m128i p0 = _mm_srli_epi16(_mm_add_epi16(pairs[0], rounding), 2);
+	const __m128i p1 = _mm_srli_epi16(_mm_add_epi16(pairs[1], rounding), 2);
+	_mm_storeu_si128((__m128i *)out, _mm_packus_epi16(p0, p1));
+}
+
+// Four destination pixels from 16 source pixels of each of four rows.
+static void DownscaleQuarter4(const uint8_t *const rows[4], uint8_t *out)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i sums[4];
+	for (uint32_t i = 0; i < 4; ++i)
+	{
+		__m128i low = zero;
+		__m128i high = zero;
+		for (uint32_t r = 0; r < 4; ++r)
+		{
+			const __m128i a = _mm_loadu_si128((const __m128i *)rows[r] + i);
+			low = _mm_add_epi16(low, _mm_unpacklo_epi8(a, zero));
+			high = _mm_add_epi16(high, _mm_unpackhi_epi8(a, zero));
+		}
+		const __m128i half = _mm_add_epi16(low, high);
+		sums[i] = _mm_add_epi16(half, _mm_srli_si128(half, 8)); // low 64 bits hold the pixel
+	}
+	const __m128i rounding = _mm_set1_epi16(8);
+	const __m128i p0 = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(sums[0], sums[1]), rounding), 4);
+	const __m128i p1 = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(sums[2], sums[3]), rounding), 4);
+	_mm_storeu_si128((__m128i *)out, _mm_packus_epi16(p0, p1));
+}
+
+#endif
+
+void Downscale(const FrameView &src, uint32_t shift, const TileRect &dstRect, FrameBuffer &dst)
+{
+	assert(shift == 1 || shift == 2);
+	assert(dstRect.x + dstRect.width <= dst.width && dstRect.y + dstRect.height <= dst.height);
+
+	for (uint32_t y = dstRect.y; y < dstRect.y + dstRect.height; ++y)
+	{
+		uint8_t *out = dst.Row(y);
+		uint32_t x = dstRect.x;
+
+#if DOWNSCALE_SSE2
+		// Whole boxes only, the clamped edge goes through the scalar path.
+		if (((y + 1) << shift) <= src.height)
+		{
+			const uint32_t end = dstRect.x + dstRect.width;
+			const uint32_t fullColumns = std::min(end, src.width >> shift);
+			if (shift == 1)
+			{
+				const uint8_t *row0 = src.Row(y * 2);
+				const uint8_t *row1 = src.Row(y * 2 + 1);
+				for (; x + 4 <= fullColumns; x += 4)
+					DownscaleHalf4(row0 + (size_t)x * 2 * k_BytesPerPixel, row1 + (size_t)x * 2 * k_BytesPerPixel, out + (size_t)x * k_BytesPerPixel);
+			}
+			else
+			{
+				const uint8_t *rows[4];
+				for (; x + 4 <= fullColumns; x += 4)
+				{
+					for (uint32_t r = 0; r < 4; ++r)
+						rows[r] = src.Row(y * 4 + r) + (size_t)x * 4 * k_BytesPerPixel;
+					DownscaleQuarter4(rows, out + (size_t)x * k_BytesPerPixel);
+				}
+			}
+		}
+#endif
+
+		for (; x < dstRect.x + dstRect.width; ++x)
+			DownscalePixel(src, shift, x, y, out + (size_t)x * k_BytesPerPixel);
+	}
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstdint>
+
+#include "Frame.h"
+
+// Box filters src down by 2^shift, shift 1 or 2, for the pixels of dstRect, a rectangle of the
+// scaled frame, into dst.  dst must be at least as large as the scaled frame, whose size is
+// GetScaledSize().  Boxes that run past the edge of src repeat its last row and column.  Uses
+// SSE2 where available, with the same rounding as the scalar path.
+void Downscale(const FrameView &src, uint32_t shift, const TileRect &dstRect, FrameBuffer &dst);
+
+inline uint32_t GetScaledSize(uint32_t size, uint32_t shift)
+{
+	return (size + (1u << shift) - 1) >> shift;
+}
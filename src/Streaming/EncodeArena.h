@@ -0,0 +1,182 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <cassert>
+
+class ArenaBlockPool;
+
+// Fixed size chunk of encoder memory.  Refcounted because sent messages point straight into it:
+// the arena holds one reference while encoding, and every in-flight message holds another.
+struct ArenaBlock
+{
+	ArenaBlockPool *pool = nullptr;
+	std::atomic<uint32_t> refs = 0;
+	std::unique_ptr<uint8_t[]> data;
+	size_t capacity = 0;
+	size_t used = 0;
+
+	void AddRef() { refs.fetch_add(1, std::memory_order_relaxed); }
+	void Release();
+};
+
+// Thread safe free list of arena blocks.  Blocks come back from whichever thread drops the last
+// reference, which for sent messages is the networking thread.  Blocks are never freed while the
+// pool lives, so after warm-up acquiring and recycling does not touch the heap.
+//
+// Must outlive every message that still references one of its blocks.
+class ArenaBlockPool
+{
+public:
+	static constexpr size_t k_DefaultBlockSize = 1 << 20;
+
+	explicit ArenaBlockPool(size_t blockSize = k_DefaultBlockSize)
+		: m_BlockSize(blockSize)
+	{
+	}
+
+	ArenaBlockPool(const ArenaBlockPool &) = delete;
+	ArenaBlockPool &operator=(const ArenaBlockPool &) = delete;
+
+	size_t GetBlockSize() const { return m_BlockSize; }
+
+	// Returned block has a single reference owned by the caller.
+	ArenaBlock *Acquire()
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		ArenaBlock *block = nullptr;
+		if (!m_FreeBlocks.empty())
+		{
+			block = m_FreeBlocks.back();
+			m_FreeBlocks.pop_back();
+		}
+		else
+		{
+			block = CreateBlock();
+		}
+		block->used = 0;
+		block->refs.store(1, std::memory_order_relaxed);
+		return block;
+	}
+
+	// Grows the pool until count blocks are free, so what is acquired next doesn't grow it.
+	void Reserve(size_t count)
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		while (m_FreeBlocks.size() < count)
+			m_FreeBlocks.push_back(CreateBlock());
+	}
+
+	size_t GetAllocatedBlockCount()
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		return m_AllBlocks.size();
+	}
+
+private:
+	friend struct ArenaBlock;
+
+	void Recycle(ArenaBlock *block)
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_FreeBlocks.push_back(block);
+	}
+
+	// Caller holds m_Mutex.
+	ArenaBlock *CreateBlock()
+	{
+		m_AllBlocks.push_back(std::make_unique<ArenaBlock>());
+		ArenaBlock *block = m_AllBlocks.back().get();
+		block->pool = this;
+		block->capacity = m_BlockSize;
+		block->data = std::make_unique<uint8_t[]>(m_BlockSize);
+		// Recycle() must never allocate, it runs inside the networking library's free callback.
+		m_FreeBlocks.reserve(m_AllBlocks.size());
+		return block;
+	}
+
+private:
+	size_t m_BlockSize;
+	std::mutex m_Mutex;
+	std::vector<std::unique_ptr<ArenaBlock>> m_AllBlocks;
+	std::vector<ArenaBlock *> m_FreeBlocks;
+};
+
+inline void ArenaBlock::Release()
+{
+	if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		pool->Recycle(this);
+}
+
+// Bump allocator owned by a single encoder worker, carving allocations out of pooled blocks.
+// Pointers stay valid until the next Reset(), and beyond that for as long as someone holds a
+// reference to the block.
+class EncodeArena
+{
+public:
+	explicit EncodeArena(ArenaBlockPool &pool)
+		: m_Pool(&pool)
+	{
+	}
+
+	~EncodeArena() { Reset(); }
+
+	EncodeArena(EncodeArena &&other) noexcept
+		: m_Pool(other.m_Pool), m_Blocks(std::move(other.m_Blocks))
+	{
+		other.m_Blocks.clear();
+	}
+
+	EncodeArena(const EncodeArena &) = delete;
+	EncodeArena &operator=(const EncodeArena &) = delete;
+	EncodeArena &operator=(EncodeArena &&) = delete;
+
+	// Returns size contiguous bytes, size must fit in a block.  Sets startedNewBlock when the
+	// memory is not adjacent to the previous allocation, so callers can tell where a run ends.
+	uint8_t *Allocate(size_t size, bool &startedNewBlock)
+	{
+		assert(size <= m_Pool->GetBlockSize());
+		startedNewBlock = false;
+		if (m_Blocks.empty() || m_Blocks.back()->used + size > m_Blocks.back()->capacity)
+		{
+			m_Blocks.push_back(m_Pool->Acquire());
+			startedNewBlock = true;
+		}
+
+		ArenaBlock &block = *m_Blocks.back();
+		uint8_t *p = block.data.get() + block.used;
+		block.used += size;
+		return p;
+	}
+
+	// Gives back the unused tail of the most recent allocation.
+	void Shrink(uint8_t *allocation, size_t usedSize)
+	{
+		ArenaBlock &block = *m_Blocks.back();
+		assert(allocation >= block.data.get() && allocation + usedSize <= block.data.get() + block.used);
+		block.used = (size_t)(allocation - block.data.get()) + usedSize;
+	}
+
+	// Lets callers size the block list up front so Allocate() never grows it mid-frame.
+	void ReserveBlocks(size_t blockCount) { m_Blocks.reserve(blockCount); }
+
+	// Block holding the most recent allocation.
+	ArenaBlock *GetCurrentBlock() const { return m_Blocks.empty() ? nullptr : m_Blocks.back(); }
+
+	// Drops the arena's references.  Blocks still referenced by queued messages stay alive
+	// until those are freed.
+	void Reset()
+	{
+		for (ArenaBlock *block : m_Blocks)
+			block->Release();
+		m_Blocks.clear();
+	}
+
+private:
+	ArenaBlockPool *m_Pool;
+	std::vector<ArenaBlock *> m_Blocks;
+};
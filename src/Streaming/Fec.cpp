@@ -0,0 +1,424 @@
+#include "Fec.h"
+
+#include <cstring>
+#include <cassert>
+#include <cmath>
+#include <bit>
+#include <algorithm>
+
+// Frames the decoder keeps parity state for.  Parity follows its group closely, so a frame that
+// has fallen this far behind is not going to be recovered anyway.
+static constexpr size_t k_MaxFecFrames = 4;
+
+// GF(2^8) with the 0x11D polynomial.  The full product table is 64KiB and turns every symbol
+// update into one lookup per byte.
+struct GaloisTables
+{
+	uint8_t exp[512];
+	uint8_t log[256];
+	uint8_t mul[256][256];
+};
+
+static GaloisTables BuildGaloisTables()
+{
+	GaloisTables tables = {};
+	uint32_t x = 1;
+	for (uint32_t i = 0; i < 255; ++i)
+	{
+		tables.exp[i] = (uint8_t)x;
+		tables.exp[i + 255] = (uint8_t)x;
+		tables.log[x] = (uint8_t)i;
+		x <<= 1;
+		if (x & 0x100)
+			x ^= 0x11D;
+	}
+	for (uint32_t a = 1; a < 256; ++a)
+	{
+		for (uint32_t b = 1; b < 256; ++b)
+			tables.mul[a][b] = tables.exp[tables.log[a] + tables.log[b]];
+	}
+	return tables;
+}
+
+static const GaloisTables &GetGaloisTables()
+{
+	static const GaloisTables tables = BuildGaloisTables();
+	return tables;
+}
+
+static uint8_t Inverse(uint8_t a)
+{
+	const GaloisTables &gf = GetGaloisTables();
+	return gf.exp[255 - gf.log[a]];
+}
+
+// Weight of data symbol column in parity row.  Reed-Solomon uses a Cauchy matrix, every square
+// submatrix of it is invertible, so any set of parity rows can stand in for the same number of
+// lost data fragments.
+static uint8_t Coefficient(uint8_t scheme, uint32_t row, uint32_t column)
+{
+	if (scheme == (uint8_t)FecScheme::Xor)
+		return 1;
+	return Inverse((uint8_t)((FecEncoder::k_MaxGroupSize + row) ^ column));
+}
+
+// dst ^= c * src
+static void MulAdd(uint8_t *dst, const uint8_t *src, size_t size, uint8_t c)
+{
+	if (c == 1)
+	{
+		size_t i = 0;
+		for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t))
+		{
+			uint64_t a, b;
+			std::memcpy(&a, dst + i, sizeof(a));
+			std::memcpy(&b, src + i, sizeof(b));
+			a ^= b;
+			std::memcpy(dst + i, &a, sizeof(a));
+		}
+		for (; i < size; ++i)
+			dst[i] ^= src[i];
+		return;
+	}
+	const uint8_t *row = GetGaloisTables().mul[c];
+	for (size_t i = 0; i < size; ++i)
+		dst[i] ^= row[src[i]];
+}
+
+static void Scale(uint8_t *data, size_t size, uint8_t c)
+{
+	if (c == 1)
+		return;
+	const uint8_t *row = GetGaloisTables().mul[c];
+	for (size_t i = 0; i < size; ++i)
+		data[i] = row[data[i]];
+}
+
+// Adds the symbol [uint16 size][fragment] to sum.
+static void AddSymbol(uint8_t *sum, const uint8_t *fragment, uint32_t size, uint8_t c)
+{
+	const uint8_t prefix[2] = {(uint8_t)size, (uint8_t)(size >> 8)};
+	MulAdd(sum, prefix, sizeof(prefix), c);
+	MulAdd(sum + sizeof(prefix), fragment, size, c);
+}
+
+FecEncoder::FecEncoder(ArenaBlockPool &pool)
+	: m_Arena(pool)
+{
+}
+
+void FecEncoder::Protect(EncodedFrame &frame, const FecConfig &config)
+{
+	frame.fecGroupSize = 0;
+	frame.fecParityCount = 0;
+	frame.parity.clear();
+	m_Arena.Reset();
+	if (config.scheme == FecScheme::None || config.redundancy <= 0.0f || frame.fragments.empty())
+		return;
+
+	uint32_t groupSize = 0;
+	uint32_t parityCount = 0;
+	if (config.scheme == FecScheme::Xor)
+	{
+		groupSize = std::clamp((uint32_t)std::lround(1.0f / config.redundancy), 1u, k_MaxGroupSize);
+		parityCount = 1;
+	}
+	else
+	{
+		groupSize = std::clamp(config.groupSize, 1u, k_MaxGroupSize);
+		parityCount = std::clamp((uint32_t)std::ceil(groupSize * config.redundancy), 1u, k_MaxParityCount);
+	}
+
+	const uint32_t fragmentCount = (uint32_t)frame.fragments.size();
+	const uint32_t groupCount = (fragmentCount + groupSize - 1) / groupSize;
+	frame.fecGroupSize = (uint8_t)groupSize;
+	frame.fecParityCount = (uint8_t)parityCount;
+	frame.parity.reserve((size_t)groupCount * parityCount);
+	m_Arena.ReserveBlocks((size_t)groupCount * parityCount);
+
+	// The receiver needs the layout before any parity shows up.
+	for (const EncodedFragment &fragment : frame.fragments)
+	{
+		FrameUpdateHeader header;
+		std::memcpy(&header, fragment.data, sizeof(header));
+		header.fecScheme = (uint8_t)config.scheme;
+		header.fecGroupSize = (uint8_t)groupSize;
+		header.fecParityCount = (uint8_t)parityCount;
+		std::memcpy(fragment.data, &header, sizeof(header));
+	}
+
+	for (uint32_t group = 0; group < groupCount; ++group)
+	{
+		const uint32_t first = group * groupSize;
+		const uint32_t count = std::min(groupSize, fragmentCount - first);
+
+		uint32_t symbolSize = 0;
+		for (uint32_t j = 0; j < count; ++j)
+			symbolSize = std::max(symbolSize, frame.fragments[first + j].size);
+		symbolSize += 2;
+		assert(symbolSize <= 0xFFFF);
+
+		for (uint32_t p = 0; p < parityCount; ++p)
+		{
+			bool startedNewBlock = false;
+			uint8_t *data = m_Arena.Allocate(sizeof(FrameParityHeader) + symbolSize, startedNewBlock);
+			uint8_t *sum = data + sizeof(FrameParityHeader);
+			std::memset(sum, 0, symbolSize);
+			for (uint32_t j = 0; j < count; ++j)
+			{
+				const EncodedFragment &fragment = frame.fragments[first + j];
+				AddSymbol(sum, fragment.data, fragment.size, Coefficient((uint8_t)config.scheme, p, j));
+			}
+
+			FrameParityHeader header;
+			header.fecScheme = (uint8_t)config.scheme;
+			header.firstFragment = (uint16_t)first;
+			header.frameId = frame.frameId;
+			header.fragmentCount = (uint16_t)fragmentCount;
+			header.dataCount = (uint8_t)count;
+			header.parityCount = (uint8_t)parityCount;
+			header.parityIndex = (uint8_t)p;
+			header.groupSize = (uint8_t)groupSize;
+			header.symbolSize = (uint16_t)symbolSize;
+			std::memcpy(data, &header, sizeof(header));
+
+			EncodedFragment parity;
+			parity.block = m_Arena.GetCurrentBlock();
+			parity.data = data;
+			parity.size = (uint32_t)sizeof(FrameParityHeader) + symbolSize;
+			parity.firstTile = frame.fragments[first].firstTile;
+			frame.parity.push_back(parity);
+			frame.byteCount += parity.size;
+		}
+	}
+}
+
+FecDecoder::FecDecoder(RecoveredFn recovered, void *context)
+	: m_Recovered(recovered), m_Context(context), m_Frames(k_MaxFecFrames)
+{
+}
+
+void FecDecoder::AddData(const uint8_t *data, uint32_t size)
+{
+	FrameUpdateHeader header;
+	if (size <= sizeof(header))
+		return;
+	std::memcpy(&header, data, sizeof(header));
+	if (header.type != (uint8_t)MessageType::FrameUpdate || header.fecScheme == (uint8_t)FecScheme::None || header.fragmentIndex >= header.fragmentCount)
+		return;
+
+	FrameState *frame = FindOrCreateFrame(header.frameId, header.fragmentCount, header.fecScheme, header.fecGroupSize, header.fecParityCount);
+	if (frame == nullptr)
+		return;
+
+	const uint32_t groupIndex = header.fragmentIndex / frame->groupSize;
+	const uint32_t column = header.fragmentIndex % frame->groupSize;
+	Group &group = frame->groups[groupIndex];
+	if (group.done || (group.receivedData & (1ull << column)))
+		return;
+
+	const uint32_t symbolSize = size + 2;
+	if (group.symbolSize != 0 && symbolSize > group.symbolSize)
+	{
+		// Parity can't have covered it, the group is beyond repair.
+		group.done = true;
+		return;
+	}
+
+	group.receivedData |= 1ull << column;
+	for (uint32_t p = 0; p < frame->parityCount; ++p)
+	{
+		std::vector<uint8_t> &sum = group.sums[p];
+		if (sum.size() < symbolSize)
+			sum.resize(symbolSize, 0);
+		AddSymbol(sum.data(), data, size, Coefficient(frame->scheme, p, column));
+	}
+	TryRecover(*frame, groupIndex);
+}
+
+void FecDecoder::AddParity(const uint8_t *data, uint32_t size)
+{
+	FrameParityHeader header;
+	if (size < sizeof(header))
+		return;
+	std::memcpy(&header, data, sizeof(header));
+	if (header.type != (uint8_t)MessageType::FrameParity || size != sizeof(header) + header.symbolSize || header.symbolSize <= 2 ||
+		header.groupSize == 0 || header.firstFragment % header.groupSize != 0 || header.firstFragment >= header.fragmentCount ||
+		header.dataCount != std::min<uint32_t>(header.groupSize, header.fragmentCount - header.firstFragment) ||
+		header.parityIndex >= header.parityCount)
+	{
+		return;
+	}
+
+	FrameState *frame = FindOrCreateFrame(header.frameId, header.fragmentCount, header.fecScheme, header.groupSize, header.parityCount);
+	if (frame == nullptr)
+		return;
+
+	const uint32_t groupIndex = header.firstFragment / header.groupSize;
+	Group &group = frame->groups[groupIndex];
+	if (group.done || (group.receivedParity & (1u << header.parityIndex)))
+		return;
+
+	if (group.symbolSize == 0)
+	{
+		for (const std::vector<uint8_t> &sum : group.sums)
+		{
+			if (sum.size() > header.symbolSize)
+			{
+				group.done = true;
+				return;
+			}
+		}
+		group.symbolSize = header.symbolSize;
+		for (std::vector<uint8_t> &sum : group.sums)
+			sum.resize(group.symbolSize, 0);
+	}
+	else if (group.symbolSize != header.symbolSize)
+	{
+		return;
+	}
+
+	group.receivedParity |= (uint16_t)(1u << header.parityIndex);
+	MulAdd(group.sums[header.parityIndex].data(), data + sizeof(header), header.symbolSize, 1);
+	TryRecover(*frame, groupIndex);
+}
+
+FecDecoder::FrameState *FecDecoder::FindOrCreateFrame(uint32_t frameId, uint16_t fragmentCount, uint8_t scheme, uint8_t groupSize, uint8_t parityCount)
+{
+	if ((scheme != (uint8_t)FecScheme::Xor && scheme != (uint8_t)FecScheme::ReedSolomon) || fragmentCount == 0 ||
+		groupSize == 0 || groupSize > FecEncoder::k_MaxGroupSize || parityCount == 0 || parityCount > FecEncoder::k_MaxParityCount)
+	{
+		return nullptr;
+	}
+
+	FrameState *slot = nullptr;
+	for (FrameState &frame : m_Frames)
+	{
+		if (frame.used && frame.frameId == frameId)
+		{
+			const bool matches = frame.fragmentCount == fragmentCount && frame.scheme == scheme && frame.groupSize == groupSize && frame.parityCount == parityCount;
+			return matches ? &frame : nullptr;
+		}
+		if (!frame.used)
+		{
+			if (slot == nullptr || slot->used)
+				slot = &frame;
+		}
+		else if (slot == nullptr || (slot->used && (int32_t)(frame.frameId - slot->frameId) < 0))
+		{
+			slot = &frame;
+		}
+	}
+
+	// Everything tracked is newer, this one is too late to bother with.
+	if (slot->used && (int32_t)(frameId - slot->frameId) < 0)
+		return nullptr;
+
+	slot->used = true;
+	slot->frameId = frameId;
+	slot->fragmentCount = fragmentCount;
+	slot->scheme = scheme;
+	slot->groupSize = groupSize;
+	slot->parityCount = parityCount;
+	slot->groups.resize((fragmentCount + groupSize - 1) / groupSize);
+	for (uint32_t g = 0; g < slot->groups.size(); ++g)
+	{
+		Group &group = slot->groups[g];
+		group.receivedData = 0;
+		group.receivedParity = 0;
+		group.dataCount = (uint8_t)std::min<uint32_t>(groupSize, fragmentCount - g * groupSize);
+		group.done = false;
+		group.symbolSize = 0;
+		// Cleared, not freed, so a reused slot doesn't go back to the heap.
+		group.sums.resize(parityCount);
+		for (std::vector<uint8_t> &sum : group.sums)
+			sum.clear();
+	}
+	return slot;
+}
+
+void FecDecoder::TryRecover(FrameState &frame, uint32_t groupIndex)
+{
+	Group &group = frame.groups[groupIndex];
+	const uint32_t received = (uint32_t)std::popcount(group.receivedData);
+	const uint32_t missing = group.dataCount - received;
+	if (missing == 0)
+	{
+		group.done = true;
+		return;
+	}
+	if (missing > (uint32_t)std::popcount(group.receivedParity))
+		return;
+
+	// With every received data symbol already folded in, sum_r = sum over missing j of c_rj * d_j.
+	// Solve that for the missing d_j with Gauss-Jordan, the sums are used as the right hand side.
+	uint32_t columns[FecEncoder::k_MaxParityCount];
+	uint8_t *rows[FecEncoder::k_MaxParityCount];
+	uint8_t matrix[FecEncoder::k_MaxParityCount][FecEncoder::k_MaxParityCount];
+
+	uint32_t e = 0;
+	for (uint32_t j = 0; j < group.dataCount && e < missing; ++j)
+	{
+		if (!(group.receivedData & (1ull << j)))
+			columns[e++] = j;
+	}
+	uint32_t r = 0;
+	for (uint32_t p = 0; p < frame.parityCount && r < missing; ++p)
+	{
+		if (group.receivedParity & (1u << p))
+		{
+			rows[r] = group.sums[p].data();
+			for (uint32_t c = 0; c < missing; ++c)
+				matrix[r][c] = Coefficient(frame.scheme, p, columns[c]);
+			++r;
+		}
+	}
+
+	group.done = true;
+	for (uint32_t c = 0; c < missing; ++c)
+	{
+		uint32_t pivot = c;
+		while (pivot < missing && matrix[pivot][c] == 0)
+			++pivot;
+		if (pivot == missing)
+			return;
+		if (pivot != c)
+		{
+			std::swap(rows[pivot], rows[c]);
+			for (uint32_t k = 0; k < missing; ++k)
+				std::swap(matrix[pivot][k], matrix[c][k]);
+		}
+
+		const uint8_t scale = Inverse(matrix[c][c]);
+		Scale(matrix[c], missing, scale);
+		Scale(rows[c], group.symbolSize, scale);
+		for (uint32_t other = 0; other < missing; ++other)
+		{
+			const uint8_t factor = matrix[other][c];
+			if (other == c || factor == 0)
+				continue;
+			MulAdd(matrix[other], matrix[c], missing, factor);
+			MulAdd(rows[other], rows[c], group.symbolSize, factor);
+		}
+	}
+
+	for (uint32_t c = 0; c < missing; ++c)
+	{
+		const uint8_t *symbol = rows[c];
+		const uint32_t size = symbol[0] | (uint32_t)symbol[1] << 8;
+		if (size <= sizeof(FrameUpdateHeader) || size > group.symbolSize - 2)
+			continue;
+
+		// A corrupt solve would most likely break the header, don't pass that on.
+		FrameUpdateHeader header;
+		std::memcpy(&header, symbol + 2, sizeof(header));
+		const uint32_t fragmentIndex = groupIndex * frame.groupSize + columns[c];
+		if (header.type != (uint8_t)MessageType::FrameUpdate || header.frameId != frame.frameId || header.fragmentIndex != fragmentIndex)
+			continue;
+
+		uint8_t *fragment = new uint8_t[size];
+		std::memcpy(fragment, symbol + 2, size);
+		++m_RecoveredFragments;
+		m_Recovered(m_Context, fragment, size);
+	}
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "EncodeArena.h"
+#include "ParallelTileEncoder.h"
+#include "WireFormat.h"
+
+// Redundancy for fragments sent unreliably.  Data fragments are cut into groups of consecutive
+// fragments, and every group gets parity fragments computed over its data:
+//  - Xor: one parity per group, recovers a single loss per group.  redundancy picks the group
+//    size, 0.1 means one parity for every 10 data fragments.
+//  - ReedSolomon: groupSize data fragments and ceil(groupSize * redundancy) parity fragments,
+//    any that many losses per group are recovered.
+struct FecConfig
+{
+	FecScheme scheme = FecScheme::Xor;
+	float redundancy = 0.1f;
+	uint32_t groupSize = 16; // ReedSolomon only
+};
+
+// Appends parity fragments to encoded frames.  Parity lives in the encoder's own arena and follows
+// the same lifetime rules as the data fragments.
+class FecEncoder
+{
+public:
+	static constexpr uint32_t k_MaxGroupSize = 64;
+	static constexpr uint32_t k_MaxParityCount = 16;
+
+	explicit FecEncoder(ArenaBlockPool &pool);
+
+	// Fills frame.parity and stamps the scheme into every data fragment header.  The parity
+	// stays valid until the next call.
+	void Protect(EncodedFrame &frame, const FecConfig &config);
+
+private:
+	EncodeArena m_Arena;
+};
+
+// Receive side.  Keeps one running sum per expected parity fragment instead of holding on to
+// received data, so fragments can be handed on to the reassembler and freed as usual.  Once a
+// group has received at least as many parity fragments as it is missing data fragments, the
+// missing ones are rebuilt and passed to the recovered callback.
+class FecDecoder
+{
+public:
+	// data was allocated with new[] and is now owned by the callee.
+	using RecoveredFn = void (*)(void *context, uint8_t *data, uint32_t size);
+
+	FecDecoder(RecoveredFn recovered, void *context);
+
+	// Both only read the message, the caller keeps ownership.
+	void AddData(const uint8_t *data, uint32_t size);
+	void AddParity(const uint8_t *data, uint32_t size);
+
+	uint32_t GetRecoveredFragmentCount() const { return m_RecoveredFragments; }
+
+private:
+	struct Group
+	{
+		uint64_t receivedData = 0;
+		uint16_t receivedParity = 0;
+		uint8_t dataCount = 0;
+		bool done = false;
+		uint32_t symbolSize = 0;					 // 0 until the first parity arrives
+		std::vector<std::vector<uint8_t>> sums; // one per parity index
+	};
+
+	struct FrameState
+	{
+		bool used = false;
+		uint32_t frameId = 0;
+		uint16_t fragmentCount = 0;
+		uint8_t scheme = 0;
+		uint8_t groupSize = 0;
+		uint8_t parityCount = 0;
+		std::vector<Group> groups;
+	};
+
+	FrameState *FindOrCreateFrame(uint32_t frameId, uint16_t fragmentCount, uint8_t scheme, uint8_t groupSize, uint8_t parityCount);
+	void TryRecover(FrameState &frame, uint32_t groupIndex);
+
+private:
+	RecoveredFn m_Recovered;
+	void *m_Context;
+
+	std::vector<FrameState> m_Frames; // fixed slots, the oldest frame's is reused
+
+	uint32_t m_RecoveredFragments = 0;
+};
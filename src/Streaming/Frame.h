@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <cassert>
+#include <algorithm>
+
+// All frames are BGRA8, which is what DXGI desktop duplication hands us.
+constexpr uint32_t k_BytesPerPixel = 4;
+
+// Tiles are the unit of diffing, encoding and sending.
+constexpr uint32_t k_TileSize = 64;
+
+struct TileRect
+{
+	uint32_t x = 0;
+	uint32_t y = 0;
+	uint32_t width = 0;
+	uint32_t height = 0;
+};
+
+// Non-owning view of a frame, so capture buffers can be encoded without copying them first.
+struct FrameView
+{
+	const uint8_t *pixels = nullptr;
+	uint32_t width = 0;
+	uint32_t height = 0;
+	uint32_t stride = 0; // bytes per row
+
+	const uint8_t *Row(uint32_t y) const { return pixels + (size_t)y * stride; }
+};
+
+struct FrameBuffer
+{
+	uint32_t width = 0;
+	uint32_t height = 0;
+	uint32_t stride = 0;
+	std::vector<uint8_t> pixels;
+
+	void Resize(uint32_t w, uint32_t h)
+	{
+		width = w;
+		height = h;
+		stride = w * k_BytesPerPixel;
+		pixels.resize((size_t)stride * h);
+	}
+
+	uint8_t *Row(uint32_t y) { return pixels.data() + (size_t)y * stride; }
+	const uint8_t *Row(uint32_t y) const { return pixels.data() + (size_t)y * stride; }
+
+	FrameView GetView() const { return {pixels.data(), width, height, stride}; }
+};
+
+class TileGrid
+{
+public:
+	TileGrid() = default;
+	TileGrid(uint32_t width, uint32_t height)
+		: m_Width(width), m_Height(height),
+		  m_Columns((width + k_TileSize - 1) / k_TileSize),
+		  m_Rows((height + k_TileSize - 1) / k_TileSize)
+	{
+	}
+
+	uint32_t GetWidth() const { return m_Width; }
+	uint32_t GetHeight() const { return m_Height; }
+	uint32_t GetColumns() const { return m_Columns; }
+	uint32_t GetRows() const { return m_Rows; }
+	uint32_t GetTileCount() const { return m_Columns * m_Rows; }
+
+	// Edge tiles are clipped to the frame.
+	TileRect GetTileRect(uint32_t tileIndex) const
+	{
+		assert(tileIndex < GetTileCount());
+		TileRect rect;
+		rect.x = (tileIndex % m_Columns) * k_TileSize;
+		rect.y = (tileIndex / m_Columns) * k_TileSize;
+		rect.width = std::min(k_TileSize, m_Width - rect.x);
+		rect.height = std::min(k_TileSize, m_Height - rect.y);
+		return rect;
+	}
+
+private:
+	uint32_t m_Width = 0;
+	uint32_t m_Height = 0;
+	uint32_t m_Columns = 0;
+	uint32_t m_Rows = 0;
+};
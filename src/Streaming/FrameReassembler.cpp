@@ -0,0 +1,445 @@
+#include "FrameReassembler.h"
+
+#include <cstring>
+#include <cassert>
+#include <algorithm>
+
+#include "Blit.h"
+#include "TileCodec.h"
+
+// Frames still collecting fragments.  Anything older is hopeless on a live stream.
+static constexpr size_t k_MaxPendingFrames = 8;
+
+FrameReassembler::~FrameReassembler()
+{
+	for (PendingFrame &frame : m_Frames)
+		ReleaseFrame(frame);
+}
+
+int64_t FrameReassembler::Unwrap(uint32_t frameId) const
+{
+	if (m_HighestSequence < 0)
+		return frameId;
+	return m_HighestSequence + (int32_t)(frameId - (uint32_t)m_HighestSequence);
+}
+
+void FrameReassembler::AddFragment(const uint8_t *data, uint32_t size, void *handle, ReleaseFn release)
+{
+	FrameUpdateHeader header;
+	if (size <= sizeof(header))
+	{
+		release(handle);
+		return;
+	}
+	std::memcpy(&header, data, sizeof(header));
+
+	const uint32_t payloadSize = size - (uint32_t)sizeof(header);
+	if (header.type != (uint8_t)MessageType::FrameUpdate || header.fragmentIndex >= header.fragmentCount ||
+		header.frameWidth == 0 || header.frameHeight == 0 || (header.tileCount != 0 && header.firstRecordOffset >= payloadSize))
+	{
+		release(handle);
+		return;
+	}
+
+	const int64_t sequence = Unwrap(header.frameId);
+	if (sequence <= m_CompletedSequence)
+	{
+		release(handle);
+		return;
+	}
+
+	if (header.frameWidth != m_Canvas.width || header.frameHeight != m_Canvas.height)
+	{
+		if (sequence < m_HighestSequence)
+		{
+			release(handle);
+			return;
+		}
+		// The sender resized, nothing pending can be shown any more.
+		for (PendingFrame &frame : m_Frames)
+			ReleaseFrame(frame);
+		m_Frames.clear();
+		ResizeCanvas(header.frameWidth, header.frameHeight);
+	}
+	m_HighestSequence = std::max(m_HighestSequence, sequence);
+
+	PendingFrame *frame = FindOrCreateFrame(sequence, header.fragmentCount, header.timestamp);
+	if (frame == nullptr || frame->fragments[header.fragmentIndex].received)
+	{
+		release(handle);
+		return;
+	}
+
+	Fragment &fragment = frame->fragments[header.fragmentIndex];
+	fragment.payload = data + sizeof(header);
+	fragment.size = payloadSize;
+	fragment.handle = handle;
+	fragment.release = release;
+	fragment.received = true;
+	fragment.recordsLeft = header.tileCount;
+	fragment.nextRecordOffset = header.tileCount != 0 ? header.firstRecordOffset : k_NoRecord;
+	if (fragment.recordsLeft == 0)
+		--frame->fragmentsLeft;
+
+	DecodeRecords(*frame, header.fragmentIndex);
+
+	// A record that started in an earlier fragment may have been waiting for this one.  Walk
+	// back over pure continuation fragments to the one it started in.
+	for (uint32_t i = header.fragmentIndex; i-- > 0;)
+	{
+		const Fragment &previous = frame->fragments[i];
+		if (!previous.received)
+			break;
+		if (previous.recordsLeft != 0)
+		{
+			DecodeRecords(*frame, i);
+			break;
+		}
+		// Its last record ended inside it, nothing can be spanning past.
+		if (previous.nextRecordOffset != k_NoRecord)
+			break;
+	}
+
+	if (frame->fragmentsLeft == 0)
+		CompleteFrame((size_t)(frame - m_Frames.data()));
+}
+
+void FrameReassembler::ResizeCanvas(uint32_t width, uint32_t height)
+{
+	m_Canvas.Resize(width, height);
+	m_Grid = TileGrid(width, height);
+	m_TileSequence.assign(m_Grid.GetTileCount(), -1);
+	m_PaintedTiles = 0;
+	// Misses of the old size are of another layer's cache, which no longer sends to us.
+	m_CacheMisses.clear();
+}
+
+void FrameReassembler::AddSnapshot(const uint8_t *data, uint32_t size)
+{
+	SnapshotHeader header;
+	if (size < sizeof(header))
+		return;
+	std::memcpy(&header, data, sizeof(header));
+	if (header.type != (uint8_t)MessageType::Snapshot || header.frameWidth == 0 || header.frameHeight == 0)
+		return;
+
+	if (header.frameWidth != m_Canvas.width || header.frameHeight != m_Canvas.height)
+	{
+		// Same as a live frame of that size: only a newer one replaces the canvas.
+		const int64_t sequence = Unwrap(header.frameId);
+		if (sequence < m_HighestSequence)
+			return;
+		for (PendingFrame &frame : m_Frames)
+			ReleaseFrame(frame);
+		m_Frames.clear();
+		ResizeCanvas(header.frameWidth, header.frameHeight);
+		m_HighestSequence = sequence;
+	}
+
+	const uint32_t maxPayload = (uint32_t)TileCodec::GetMaxRecordSize({0, 0, k_TileSize, k_TileSize});
+	uint32_t offset = sizeof(header);
+	for (uint16_t i = 0; i < header.recordCount; ++i)
+	{
+		uint32_t frameId;
+		TileRecordHeader record;
+		if (size - offset < sizeof(frameId) + sizeof(record))
+			return;
+		std::memcpy(&frameId, data + offset, sizeof(frameId));
+		std::memcpy(&record, data + offset + sizeof(frameId), sizeof(record));
+		offset += sizeof(frameId) + sizeof(record);
+
+		if (record.payloadSize > maxPayload || size - offset < record.payloadSize || record.codec == (uint8_t)TileCodecId::CacheRef)
+			return;
+		record.cacheSlot = k_NoCacheSlot;
+		ApplyRecord(Unwrap(frameId), record, data + offset);
+		offset += record.payloadSize;
+	}
+}
+
+FrameReassembler::PendingFrame *FrameReassembler::FindOrCreateFrame(int64_t sequence, uint16_t fragmentCount, uint32_t timestamp)
+{
+	for (PendingFrame &frame : m_Frames)
+	{
+		if (frame.sequence == sequence)
+			return frame.fragments.size() == fragmentCount ? &frame : nullptr;
+	}
+
+	if (m_Frames.size() == k_MaxPendingFrames)
+	{
+		if (sequence < m_Frames.front().sequence)
+			return nullptr;
+		DropFrame(m_Frames.front());
+		m_Frames.erase(m_Frames.begin());
+	}
+
+	PendingFrame frame;
+	frame.sequence = sequence;
+	frame.timestamp = timestamp;
+	frame.fragmentsLeft = fragmentCount;
+	frame.created = std::chrono::steady_clock::now();
+	frame.fragments.resize(fragmentCount);
+
+	auto it = std::find_if(m_Frames.begin(), m_Frames.end(), [sequence](const PendingFrame &other)
+						   { return other.sequence > sequence; });
+	return &*m_Frames.insert(it, std::move(frame));
+}
+
+void FrameReassembler::DecodeRecords(PendingFrame &frame, uint32_t fragmentIndex)
+{
+	Fragment &fragment = frame.fragments[fragmentIndex];
+	if (fragment.recordsLeft == 0)
+		return;
+
+	const uint32_t maxPayload = (uint32_t)TileCodec::GetMaxRecordSize({0, 0, k_TileSize, k_TileSize});
+
+	while (fragment.recordsLeft != 0)
+	{
+		uint32_t index = fragmentIndex;
+		uint32_t offset = fragment.nextRecordOffset;
+
+		TileRecordHeader header;
+		if (!Gather(frame, index, offset, sizeof(header), (uint8_t *)&header))
+			return;
+
+		const bool malformed = header.payloadSize == 0 || header.payloadSize > maxPayload;
+		const uint8_t *payload = nullptr;
+		const Fragment &current = frame.fragments[index];
+		if (!malformed && offset + header.payloadSize <= current.size)
+		{
+			payload = current.payload + offset;
+			offset += header.payloadSize;
+		}
+		else if (!malformed)
+		{
+			m_Scratch.resize(header.payloadSize);
+			if (!Gather(frame, index, offset, header.payloadSize, m_Scratch.data()))
+				return;
+			payload = m_Scratch.data();
+		}
+
+		if (payload != nullptr)
+		{
+			ApplyRecord(frame.sequence, header, payload);
+			if (header.tileIndex < m_Grid.GetTileCount())
+			{
+				if (fragment.firstTile == k_NoTile)
+					fragment.firstTile = header.tileIndex;
+				fragment.lastTile = header.tileIndex;
+			}
+		}
+
+		--fragment.recordsLeft;
+		fragment.nextRecordOffset = index == fragmentIndex ? offset : k_NoRecord;
+
+		// Nothing after a split record starts in this fragment, and nothing after a bad one can
+		// be found at all.
+		if (malformed || (fragment.recordsLeft != 0 && fragment.nextRecordOffset == k_NoRecord))
+			fragment.recordsLeft = 0;
+	}
+	--frame.fragmentsLeft;
+}
+
+bool FrameReassembler::Gather(PendingFrame &frame, uint32_t &fragmentIndex, uint32_t &offset, uint32_t size, uint8_t *dst) const
+{
+	while (size > 0)
+	{
+		const Fragment &fragment = frame.fragments[fragmentIndex];
+		if (!fragment.received)
+			return false;
+		if (offset == fragment.size)
+		{
+			if (++fragmentIndex == frame.fragments.size())
+				return false;
+			offset = 0;
+			continue;
+		}
+		uint32_t n = std::min(size, fragment.size - offset);
+		std::memcpy(dst, fragment.payload + offset, n);
+		offset += n;
+		dst += n;
+		size -= n;
+	}
+	return true;
+}
+
+void FrameReassembler::ApplyRecord(int64_t sequence, const TileRecordHeader &header, const uint8_t *payload)
+{
+	if (header.tileIndex >= m_Grid.GetTileCount())
+		return;
+
+	if (header.codec == (uint8_t)TileCodecId::CacheRef)
+	{
+		ApplyCacheRef(sequence, header, payload);
+		return;
+	}
+
+	if (header.cacheSlot != k_NoCacheSlot && header.cacheSlot >= k_MaxCacheSlots)
+		return;
+
+	const bool newer = m_TileSequence[header.tileIndex] > sequence;
+	const TileRect rect = m_Grid.GetTileRect(header.tileIndex);
+	uint8_t *dst = m_Canvas.Row(rect.y) + (size_t)rect.x * k_BytesPerPixel;
+
+	// Stores from an older frame than the slot's current content arrived late, skip them.  Even a
+	// tile a newer frame already painted is stored, later references may rely on it.
+	if (header.cacheSlot != k_NoCacheSlot && (header.cacheSlot >= m_CacheSlots.size() || m_CacheSlots[header.cacheSlot].sequence <= sequence))
+	{
+		const uint32_t cacheStride = k_TileSize * k_BytesPerPixel;
+		uint8_t *pixels = GetCachePixels(header.cacheSlot);
+		if (!TileCodec::Decode(header, payload, rect, pixels, cacheStride))
+			return;
+
+		CacheSlot &slot = m_CacheSlots[header.cacheSlot];
+		slot.sequence = sequence;
+		slot.width = rect.width;
+		slot.height = rect.height;
+		if (newer)
+			return;
+
+		BlitRect(pixels, cacheStride, dst, m_Canvas.stride, rect.width, rect.height);
+		MarkPainted(header.tileIndex, sequence);
+		return;
+	}
+
+	// A newer frame already painted this tile.
+	if (newer)
+		return;
+
+	if (!TileCodec::Decode(header, payload, rect, dst, m_Canvas.stride))
+		return;
+
+	MarkPainted(header.tileIndex, sequence);
+}
+
+void FrameReassembler::ApplyCacheRef(int64_t sequence, const TileRecordHeader &header, const uint8_t *payload)
+{
+	if (m_TileSequence[header.tileIndex] > sequence)
+		return;
+
+	// Anything but the store's frame id is malformed, and may be shorter than one.
+	uint32_t storeFrameId = 0;
+	const bool sized = header.payloadSize == sizeof(storeFrameId);
+	if (sized)
+		std::memcpy(&storeFrameId, payload, sizeof(storeFrameId));
+
+	const TileRect rect = m_Grid.GetTileRect(header.tileIndex);
+	const CacheSlot *slot = header.cacheSlot < m_CacheSlots.size() ? &m_CacheSlots[header.cacheSlot] : nullptr;
+	if (!sized || slot == nullptr || slot->sequence != Unwrap(storeFrameId) ||
+		slot->width != rect.width || slot->height != rect.height)
+	{
+		// Missed the store, or it was overwritten by one we did get.  Ask for the tile again and
+		// tell the sender to stop relying on the slot.
+		if (header.cacheSlot < k_MaxCacheSlots)
+			m_CacheMisses.push_back(header.cacheSlot);
+		m_LostTiles.push_back(header.tileIndex);
+		return;
+	}
+
+	const uint32_t cacheStride = k_TileSize * k_BytesPerPixel;
+	const uint8_t *pixels = GetCachePixels(header.cacheSlot);
+	uint8_t *dst = m_Canvas.Row(rect.y) + (size_t)rect.x * k_BytesPerPixel;
+	BlitRect(pixels, cacheStride, dst, m_Canvas.stride, rect.width, rect.height);
+	MarkPainted(header.tileIndex, sequence);
+}
+
+void FrameReassembler::MarkPainted(uint32_t tileIndex, int64_t sequence)
+{
+	if (m_TileSequence[tileIndex] < 0)
+		++m_PaintedTiles;
+	m_TileSequence[tileIndex] = sequence;
+	m_UpdatedTiles.push_back(tileIndex);
+}
+
+uint8_t *FrameReassembler::GetCachePixels(uint16_t slot)
+{
+	assert(slot < k_MaxCacheSlots);
+	const size_t slotSize = (size_t)k_TileSize * k_TileSize * k_BytesPerPixel;
+	if (slot >= m_CacheSlots.size())
+	{
+		m_CacheSlots.resize((size_t)slot + 1);
+		m_CachePixels.resize(m_CacheSlots.size() * slotSize);
+	}
+	return m_CachePixels.data() + (size_t)slot * slotSize;
+}
+
+void FrameReassembler::CompleteFrame(size_t frameSlot)
+{
+	m_CompletedSequence = m_Frames[frameSlot].sequence;
+	++m_CompletedFrames;
+	m_CompletedFrameList.push_back({m_Frames[frameSlot].sequence, m_Frames[frameSlot].timestamp});
+
+	// Frames are sorted, everything up to and including this one is done with.
+	for (size_t i = 0; i < frameSlot; ++i)
+		DropFrame(m_Frames[i]);
+	ReleaseFrame(m_Frames[frameSlot]);
+	m_Frames.erase(m_Frames.begin(), m_Frames.begin() + frameSlot + 1);
+}
+
+void FrameReassembler::ExpireFrames(std::chrono::steady_clock::time_point cutoff)
+{
+	for (size_t i = 0; i < m_Frames.size();)
+	{
+		if (m_Frames[i].created < cutoff)
+		{
+			DropFrame(m_Frames[i]);
+			m_Frames.erase(m_Frames.begin() + i);
+		}
+		else
+		{
+			++i;
+		}
+	}
+}
+
+void FrameReassembler::DropFrame(PendingFrame &frame)
+{
+	++m_DroppedFrames;
+
+	// Records are in ascending tile order.  A gap runs from just past the last tile decoded before
+	// it to just before the first tile decoded after it.
+	uint32_t lower = 0;
+	bool inGap = false;
+	for (const Fragment &fragment : frame.fragments)
+	{
+		if (!fragment.received)
+		{
+			inGap = true;
+			continue;
+		}
+		if (fragment.firstTile != k_NoTile)
+		{
+			if (inGap)
+				AddLostRange(frame, lower, fragment.firstTile);
+			inGap = false;
+			lower = fragment.lastTile + 1;
+		}
+		// Records still waiting on missing bytes.
+		if (fragment.recordsLeft != 0)
+			inGap = true;
+	}
+	if (inGap)
+		AddLostRange(frame, lower, m_Grid.GetTileCount());
+
+	ReleaseFrame(frame);
+}
+
+void FrameReassembler::AddLostRange(const PendingFrame &frame, uint32_t begin, uint32_t end)
+{
+	end = std::min(end, m_Grid.GetTileCount());
+	for (uint32_t tile = begin; tile < end; ++tile)
+	{
+		// Painted by this frame or a newer one, nothing to ask for.
+		if (m_TileSequence[tile] < frame.sequence)
+			m_LostTiles.push_back(tile);
+	}
+}
+
+void FrameReassembler::ReleaseFrame(PendingFrame &frame)
+{
+	for (Fragment &fragment : frame.fragments)
+	{
+		if (fragment.received)
+			fragment.release(fragment.handle);
+		fragment.received = false;
+	}
+}
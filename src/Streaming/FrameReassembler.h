@@ -0,0 +1,149 @@
+#pragma once
+
+#include <cstdint>
+#include <chrono>
+#include <vector>
+
+#include "Frame.h"
+#include "TileCache.h"
+#include "WireFormat.h"
+
+// Receive side of the fragment stream.  Fragments may arrive in any order; every tile record is
+// decoded into the canvas as soon as all the bytes it spans are in, so a frame shows up
+// progressively instead of all at once.  When a frame completes, older frames still waiting for
+// fragments are dropped, and a late tile from an older frame never overwrites a newer one.
+//
+// Tiles a dropped frame should have carried, and that no newer frame has painted since, are
+// reported as lost.  Lost fragments hide which tiles they held, so the tiles between the last
+// record before a gap and the first one after it are all reported.
+//
+// Fragment memory is borrowed, not copied: each fragment comes with a handle and a release function
+// that is called once the reassembler no longer needs the bytes.
+class FrameReassembler
+{
+public:
+	using ReleaseFn = void (*)(void *handle);
+
+	FrameReassembler() = default;
+	~FrameReassembler();
+
+	FrameReassembler(const FrameReassembler &) = delete;
+	FrameReassembler &operator=(const FrameReassembler &) = delete;
+
+	// Takes ownership of handle.  data starts with a FrameUpdateHeader.  Malformed or stale
+	// fragments are released straight away.
+	void AddFragment(const uint8_t *data, uint32_t size, void *handle, ReleaseFn release);
+
+	const FrameBuffer &GetCanvas() const { return m_Canvas; }
+
+	// Paints the tiles of a Snapshot message, unless a newer version of a tile is already on the
+	// canvas.  Only reads data.
+	void AddSnapshot(const uint8_t *data, uint32_t size);
+
+	// Drops frames that started arriving before cutoff, a stream that goes quiet would otherwise
+	// never report the tiles its last frame lost.
+	void ExpireFrames(std::chrono::steady_clock::time_point cutoff);
+
+	struct CompletedFrame
+	{
+		int64_t sequence = 0; // unwrapped frame id
+		uint32_t timestamp = 0; // see FrameUpdateHeader
+	};
+
+	// Frames whose every fragment arrived since the last ClearCompletedFrames(), oldest first.
+	const std::vector<CompletedFrame> &GetCompletedFrames() const { return m_CompletedFrameList; }
+	void ClearCompletedFrames() { m_CompletedFrameList.clear(); }
+
+	// Whether a frame is still collecting fragments, its tiles so far are on the canvas already.
+	bool HasPendingFrames() const { return !m_Frames.empty(); }
+
+	// Tiles written to the canvas since the last ClearUpdatedTiles().
+	const std::vector<uint32_t> &GetUpdatedTiles() const { return m_UpdatedTiles; }
+	void ClearUpdatedTiles() { m_UpdatedTiles.clear(); }
+
+	// Tiles of dropped frames, in canvas tile indices, since the last ClearLostTiles().  May
+	// contain duplicates.  Cache references that missed count as lost too.
+	const std::vector<uint32_t> &GetLostTiles() const { return m_LostTiles; }
+	void ClearLostTiles() { m_LostTiles.clear(); }
+
+	// Cache slots a reference found empty or stale, to be reported to the sender.  Of the
+	// canvas' size, a resize drops them.
+	const std::vector<uint16_t> &GetCacheMisses() const { return m_CacheMisses; }
+	void ClearCacheMisses() { m_CacheMisses.clear(); }
+
+	// Tiles painted at least once since the canvas was last resized.
+	uint32_t GetPaintedTileCount() const { return m_PaintedTiles; }
+	uint32_t GetCompletedFrameCount() const { return m_CompletedFrames; }
+	uint32_t GetDroppedFrameCount() const { return m_DroppedFrames; }
+
+private:
+	static constexpr uint32_t k_NoRecord = 0xFFFFFFFF;
+	static constexpr uint32_t k_NoTile = 0xFFFFFFFF;
+	// Slots the sender's TileCache can have, records naming others are malformed.
+	static constexpr uint32_t k_MaxCacheSlots = TileCache::k_DefaultSlotCount;
+
+	struct Fragment
+	{
+		const uint8_t *payload = nullptr;
+		uint32_t size = 0;
+		void *handle = nullptr;
+		ReleaseFn release = nullptr;
+		uint32_t nextRecordOffset = k_NoRecord; // next undecoded record starting in this fragment
+		uint32_t firstTile = k_NoTile; // first and last tile decoded from records starting here
+		uint32_t lastTile = k_NoTile;
+		uint16_t recordsLeft = 0;
+		bool received = false;
+	};
+
+	// Receiver half of the sender's TileCache, see TileCache.h.
+	struct CacheSlot
+	{
+		int64_t sequence = -1; // frame that stored it
+		uint32_t width = 0;
+		uint32_t height = 0;
+	};
+
+	struct PendingFrame
+	{
+		int64_t sequence = 0; // unwrapped frame id
+		uint32_t timestamp = 0;
+		uint32_t fragmentsLeft = 0;
+		std::chrono::steady_clock::time_point created;
+		std::vector<Fragment> fragments;
+	};
+
+	int64_t Unwrap(uint32_t frameId) const;
+	void ResizeCanvas(uint32_t width, uint32_t height);
+	PendingFrame *FindOrCreateFrame(int64_t sequence, uint16_t fragmentCount, uint32_t timestamp);
+	void DecodeRecords(PendingFrame &frame, uint32_t fragmentIndex);
+	bool Gather(PendingFrame &frame, uint32_t &fragmentIndex, uint32_t &offset, uint32_t size, uint8_t *dst) const;
+	void ApplyRecord(int64_t sequence, const TileRecordHeader &header, const uint8_t *payload);
+	void ApplyCacheRef(int64_t sequence, const TileRecordHeader &header, const uint8_t *payload);
+	void MarkPainted(uint32_t tileIndex, int64_t sequence);
+	uint8_t *GetCachePixels(uint16_t slot);
+	void CompleteFrame(size_t frameSlot);
+	void DropFrame(PendingFrame &frame);
+	void AddLostRange(const PendingFrame &frame, uint32_t begin, uint32_t end);
+	void ReleaseFrame(PendingFrame &frame);
+
+private:
+	std::vector<PendingFrame> m_Frames; // a handful at most, newest last
+	int64_t m_HighestSequence = -1;
+	int64_t m_CompletedSequence = -1;
+
+	FrameBuffer m_Canvas;
+	TileGrid m_Grid;
+	std::vector<int64_t> m_TileSequence; // frame the tile on the canvas came from
+	std::vector<uint32_t> m_UpdatedTiles;
+	std::vector<uint32_t> m_LostTiles;
+	std::vector<CompletedFrame> m_CompletedFrameList;
+
+	std::vector<CacheSlot> m_CacheSlots; // grown on demand up to k_MaxCacheSlots
+	std::vector<uint8_t> m_CachePixels;	 // k_TileSize x k_TileSize per slot
+	std::vector<uint16_t> m_CacheMisses;
+	std::vector<uint8_t> m_Scratch; // for records split across fragments
+
+	uint32_t m_PaintedTiles = 0;
+	uint32_t m_CompletedFrames = 0;
+	uint32_t m_DroppedFrames = 0;
+};
@@ -0,0 +1,266 @@
+#include "FrameReceiver.h"
+
+#include <cstring>
+#include <algorithm>
+
+FrameReceiver::FrameReceiver(uint32_t stream)
+	: m_Stream(stream), m_FecDecoder(&FrameReceiver::OnRecovered, this)
+{
+}
+
+FrameReceiver::~FrameReceiver()
+{
+	for (size_t i = m_QueueHead; i < m_Queue.size(); ++i)
+		m_Queue[i].release(m_Queue[i].handle);
+}
+
+void FrameReceiver::QueueMessage(const uint8_t *data, uint32_t size, void *handle, FrameReassembler::ReleaseFn release)
+{
+	if (m_QueueHead == m_Queue.size())
+	{
+		m_Queue.clear();
+		m_QueueHead = 0;
+	}
+	m_Queue.push_back({data, size, handle, release, std::chrono::steady_clock::now()});
+}
+
+bool FrameReceiver::DecodeQueued(uint32_t credit)
+{
+	m_QueueCredit += credit;
+	while (m_QueueHead != m_Queue.size() && m_Queue[m_QueueHead].size <= m_QueueCredit)
+	{
+		const QueuedMessage message = m_Queue[m_QueueHead++];
+		m_QueueCredit -= message.size;
+		m_DecodedBytes += message.size;
+		HandleMessage(message.data, message.size, message.handle, message.release, message.arrived);
+	}
+	if (m_QueueHead != m_Queue.size())
+		return true;
+	m_Queue.clear();
+	m_QueueHead = 0;
+	m_QueueCredit = 0;
+	return false;
+}
+
+void FrameReceiver::OnMessage(const uint8_t *data, uint32_t size, void *handle, FrameReassembler::ReleaseFn release)
+{
+	HandleMessage(data, size, handle, release, std::chrono::steady_clock::now());
+}
+
+void FrameReceiver::HandleMessage(const uint8_t *data, uint32_t size, void *handle, FrameReassembler::ReleaseFn release,
+								  std::chrono::steady_clock::time_point arrived)
+{
+	if (size == 0)
+	{
+		release(handle);
+		return;
+	}
+
+	switch ((MessageType)data[0])
+	{
+	case MessageType::FrameParity:
+		if (size >= sizeof(FrameParityHeader))
+		{
+			FrameParityHeader header;
+			std::memcpy(&header, data, sizeof(header));
+			NoteArrival(header.frameId, arrived, nullptr);
+		}
+		m_FecDecoder.AddParity(data, size);
+		release(handle);
+		CapturePlayout(std::chrono::steady_clock::now());
+		break;
+	case MessageType::Snapshot:
+		m_Reassembler.AddSnapshot(data, size);
+		release(handle);
+		CapturePlayout(std::chrono::steady_clock::now());
+		break;
+	case MessageType::FrameUpdate:
+		if (size >= sizeof(FrameUpdateHeader))
+		{
+			FrameUpdateHeader header;
+			std::memcpy(&header, data, sizeof(header));
+			NoteArrival(header.frameId, arrived, &header);
+		}
+		// The decoder reads it first, the reassembler may release it straight away.
+		m_FecDecoder.AddData(data, size);
+		m_Reassembler.AddFragment(data, size, handle, release);
+		CapturePlayout(std::chrono::steady_clock::now());
+		break;
+	case MessageType::StreamKeepalive:
+		if (size >= sizeof(StreamKeepaliveHeader))
+		{
+			StreamKeepaliveHeader header;
+			std::memcpy(&header, data, sizeof(header));
+			m_Playout.AddKeepalive(std::chrono::steady_clock::now(), header.timestamp);
+			++m_Keepalives;
+		}
+		release(handle);
+		break;
+	case MessageType::CursorPosition:
+	case MessageType::CursorShape:
+		m_Cursor.OnMessage(data, size);
+		release(handle);
+		break;
+	default:
+		release(handle);
+		break;
+	}
+}
+
+bool FrameReceiver::BuildNack(std::chrono::steady_clock::time_point now, std::vector<uint8_t> &message)
+{
+	m_Reassembler.ExpireFrames(now - k_FrameTimeout);
+	CapturePlayout(now);
+
+	const FrameBuffer &canvas = m_Reassembler.GetCanvas();
+	m_NackGenerator.AddLostTiles(m_Reassembler.GetLostTiles(), canvas.width, canvas.height);
+	m_Reassembler.ClearLostTiles();
+
+	return m_NackGenerator.BuildMessage(now, m_Stream, message);
+}
+
+void FrameReceiver::NoteArrival(uint32_t frameId, std::chrono::steady_clock::time_point arrived, const FrameUpdateHeader *header)
+{
+	auto it = std::find_if(m_Arrivals.begin(), m_Arrivals.end(), [frameId](const FrameArrival &arrival)
+						   { return arrival.frameId == frameId; });
+	if (it == m_Arrivals.end())
+	{
+		// Frames given up on never complete, the oldest makes room.
+		if (m_Arrivals.size() >= k_MaxTracedFrames)
+			m_Arrivals.erase(m_Arrivals.begin());
+		FrameArrival arrival;
+		arrival.frameId = frameId;
+		arrival.first = arrived;
+		arrival.last = arrived;
+		m_Arrivals.push_back(arrival);
+		it = m_Arrivals.end() - 1;
+	}
+	it->first = std::min(it->first, arrived);
+	it->last = std::max(it->last, arrived);
+	if (header && !it->hasHeader)
+	{
+		it->diffedAfter = header->diffedAfter;
+		it->encodedAfter = header->encodedAfter;
+		it->hasHeader = true;
+	}
+}
+
+void FrameReceiver::CapturePlayout(std::chrono::steady_clock::time_point now)
+{
+	using std::chrono::microseconds;
+	using std::chrono::duration_cast;
+
+	uint64_t sequence = m_Playout.GetCompletedFrameCount();
+	for (const FrameReassembler::CompletedFrame &frame : m_Reassembler.GetCompletedFrames())
+	{
+		++sequence;
+		auto it = std::find_if(m_Arrivals.begin(), m_Arrivals.end(), [&frame](const FrameArrival &arrival)
+							   { return arrival.frameId == (uint32_t)frame.sequence; });
+		if (it == m_Arrivals.end())
+			continue;
+		const FrameArrival arrival = *it;
+		m_Arrivals.erase(it);
+		if (!arrival.hasHeader)
+			continue;
+
+		m_Latency.Record(LatencyStage::Diff, microseconds(arrival.diffedAfter));
+		m_Latency.Record(LatencyStage::Encode, microseconds((int32_t)(arrival.encodedAfter - arrival.diffedAfter)));
+
+		// Transit from when the frame was encoded until its first fragment arrived, up to the
+		// offset between the clocks, which the fastest transit cancels.
+		const uint32_t encoded = frame.timestamp + arrival.encodedAfter;
+		m_Encoded = m_HasEncoded ? m_Encoded + (int32_t)(encoded - (uint32_t)m_Encoded) : encoded;
+		m_HasEncoded = true;
+		const int64_t transit = duration_cast<microseconds>(arrival.first.time_since_epoch()).count() - m_Encoded;
+		if (m_Transits.size() < k_TransitHistory)
+			m_Transits.push_back(transit);
+		else
+			m_Transits[m_TransitNext] = transit;
+		m_TransitNext = (m_TransitNext + 1) % k_TransitHistory;
+		const int64_t fastest = *std::min_element(m_Transits.begin(), m_Transits.end());
+		const microseconds receive = microseconds(transit - fastest) + m_PathDelay;
+
+		m_Latency.Record(LatencyStage::Receive, receive);
+		m_Latency.Record(LatencyStage::Reassemble, duration_cast<microseconds>(arrival.last - arrival.first));
+		m_Latency.Record(LatencyStage::Decode, duration_cast<microseconds>(now - arrival.last));
+
+		if (m_Traced.size() >= k_MaxTracedFrames)
+			m_Traced.erase(m_Traced.begin());
+		m_Traced.push_back({sequence, now, arrival.first - receive - microseconds(arrival.encodedAfter)});
+	}
+	m_Playout.Capture(now, m_Reassembler);
+}
+
+void FrameReceiver::OnPresented(std::chrono::steady_clock::time_point now)
+{
+	using std::chrono::microseconds;
+	using std::chrono::duration_cast;
+
+	const uint64_t released = m_Playout.GetReleasedFrameCount();
+	size_t presented = 0;
+	while (presented < m_Traced.size() && m_Traced[presented].sequence <= released)
+	{
+		const TracedFrame &frame = m_Traced[presented++];
+		m_Latency.Record(LatencyStage::Present, duration_cast<microseconds>(now - frame.completed));
+		m_Latency.Record(LatencyStage::Total, duration_cast<microseconds>(now - frame.captured));
+	}
+	m_Traced.erase(m_Traced.begin(), m_Traced.begin() + presented);
+}
+
+bool FrameReceiver::BuildCacheMiss(std::vector<uint8_t> &message)
+{
+	if (m_Reassembler.GetCacheMisses().empty())
+		return false;
+
+	std::vector<uint16_t> &slots = m_CacheMissSlots;
+	slots.assign(m_Reassembler.GetCacheMisses().begin(), m_Reassembler.GetCacheMisses().end());
+	m_Reassembler.ClearCacheMisses();
+	std::sort(slots.begin(), slots.end());
+	slots.erase(std::unique(slots.begin(), slots.end()), slots.end());
+
+	TileCacheMissHeader header;
+	header.stream = (uint8_t)m_Stream;
+	header.slotCount = (uint16_t)slots.size();
+	header.frameWidth = (uint16_t)m_Reassembler.GetCanvas().width;
+	header.frameHeight = (uint16_t)m_Reassembler.GetCanvas().height;
+	message.resize(sizeof(header) + slots.size() * sizeof(uint16_t));
+	std::memcpy(message.data(), &header, sizeof(header));
+	std::memcpy(message.data() + sizeof(header), slots.data(), slots.size() * sizeof(uint16_t));
+	return true;
+}
+
+void FrameReceiver::SetViewport(const ViewportRect &rect, uint32_t displayWidth, uint32_t displayHeight, uint32_t refreshRate)
+{
+	ViewportHeader viewport;
+	viewport.stream = (uint8_t)m_Stream;
+	viewport.displayWidth = (uint16_t)std::min<uint32_t>(displayWidth, 0xFFFF);
+	viewport.displayHeight = (uint16_t)std::min<uint32_t>(displayHeight, 0xFFFF);
+	viewport.refreshRate = (uint16_t)std::min<uint32_t>(refreshRate, 0xFFFF);
+	viewport.rect = rect;
+	if (std::memcmp(&viewport, &m_Viewport, sizeof(viewport)) == 0)
+		return;
+	m_Viewport = viewport;
+	m_ViewportChanged = true;
+}
+
+bool FrameReceiver::BuildViewport(std::vector<uint8_t> &message)
+{
+	if (!m_ViewportChanged)
+		return false;
+	m_ViewportChanged = false;
+
+	message.resize(sizeof(m_Viewport));
+	std::memcpy(message.data(), &m_Viewport, sizeof(m_Viewport));
+	return true;
+}
+
+void FrameReceiver::OnRecovered(void *context, uint8_t *data, uint32_t size)
+{
+	FrameReceiver &receiver = *static_cast<FrameReceiver *>(context);
+	receiver.m_Reassembler.AddFragment(data, size, data, &FrameReceiver::FreeRecovered);
+}
+
+void FrameReceiver::FreeRecovered(void *handle)
+{
+	delete[] static_cast<uint8_t *>(handle);
+}
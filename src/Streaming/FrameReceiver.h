@@ -0,0 +1,154 @@
+#pragma once
+
+#include <cstdint>
+#include <chrono>
+#include <vector>
+
+#include "Cursor.h"
+#include "Fec.h"
+#include "FrameReassembler.h"
+#include "LatencyTrace.h"
+#include "Playout.h"
+#include "TileRefresh.h"
+
+// Everything arriving on the video, bulk and cursor lanes of one peer.  Data fragments go to the
+// reassembler, parity only feeds the FEC decoder, and fragments the decoder rebuilds are handed to
+// the reassembler as if they had arrived.  Whatever FEC could not repair is asked for again.
+// Cursor messages go to a CursorReceiver of their own.  What is shown is the playout buffer's
+// canvas, which gets the reassembled frames at a smoothed pace, see PlayoutBuffer.
+//
+// Messages can also be queued and handled later, on another thread, see StreamDecodePool.  Only one
+// thread may touch a receiver at a time.
+class FrameReceiver
+{
+public:
+	// A frame still missing fragments this long after its first one arrived is given up on.
+	static constexpr std::chrono::milliseconds k_FrameTimeout{100};
+
+	// Of one stream of the peer, which the messages it builds name.  See k_MaxStreams.
+	explicit FrameReceiver(uint32_t stream = 0);
+	~FrameReceiver();
+
+	FrameReceiver(const FrameReceiver &) = delete;
+	FrameReceiver &operator=(const FrameReceiver &) = delete;
+
+	// Takes ownership of handle, see FrameReassembler::AddFragment().
+	void OnMessage(const uint8_t *data, uint32_t size, void *handle, FrameReassembler::ReleaseFn release);
+
+	// Like OnMessage(), but only keeps the message until DecodeQueued() gets to it.
+	void QueueMessage(const uint8_t *data, uint32_t size, void *handle, FrameReassembler::ReleaseFn release);
+
+	// Deficit round robin: adds credit bytes to what the last call left over and handles queued
+	// messages, oldest first, while the next one fits in it.  An empty queue keeps no credit.  True
+	// while messages are left.
+	bool DecodeQueued(uint32_t credit);
+	bool HasQueuedMessages() const { return m_QueueHead != m_Queue.size(); }
+	uint64_t GetDecodedBytes() const { return m_DecodedBytes; }
+	// Heard while the sender's screen stood still, see StreamKeepaliveHeader.
+	uint64_t GetKeepaliveCount() const { return m_Keepalives; }
+
+	FrameReassembler &GetReassembler() { return m_Reassembler; }
+	const FrameReassembler &GetReassembler() const { return m_Reassembler; }
+
+	// Fills message with a TileNack for the sender's control lane when one is due.
+	bool BuildNack(std::chrono::steady_clock::time_point now, std::vector<uint8_t> &message);
+
+	// Fills message with a TileCacheMiss when cache references missed since the last call.
+	bool BuildCacheMiss(std::vector<uint8_t> &message);
+
+	// The renderer calls GetPlayout().Release() before it draws GetPlayout().GetCanvas().
+	PlayoutBuffer &GetPlayout() { return m_Playout; }
+	const PlayoutBuffer &GetPlayout() const { return m_Playout; }
+	void SetPlayoutMode(PlayoutMode mode) { m_Playout.SetMode(mode); }
+
+	const CursorReceiver &GetCursor() const { return m_Cursor; }
+
+	// Where the frames' latency went, see LatencyStage.  The sender's clock is only known up to an
+	// offset, so the fastest transit of the last k_TransitHistory frames counts as pathDelay, one
+	// way across the path without queueing; half the round trip is a fair guess.  Receive is
+	// measured from there.
+	const LatencyTrace &GetLatency() const { return m_Latency; }
+	void ResetLatency() { m_Latency.Reset(); }
+	void SetPathDelay(std::chrono::microseconds pathDelay) { m_PathDelay = pathDelay; }
+
+	// The renderer calls this once what it drew is on screen, which traces Present and Total of
+	// the frames released to the canvas since.
+	void OnPresented(std::chrono::steady_clock::time_point now);
+
+	// What the viewer shows of the frame, the size it is drawn at in display pixels, and how often
+	// the display refreshes, which paces the cursor.
+	void SetViewport(const ViewportRect &rect, uint32_t displayWidth, uint32_t displayHeight, uint32_t refreshRate = 0);
+
+	// Fills message with a Viewport when it changed since the last one was built.
+	bool BuildViewport(std::vector<uint8_t> &message);
+
+	uint32_t GetStream() const { return m_Stream; }
+	uint32_t GetRecoveredFragmentCount() const { return m_FecDecoder.GetRecoveredFragmentCount(); }
+	const NackGenerator &GetNackGenerator() const { return m_NackGenerator; }
+
+private:
+	static constexpr size_t k_MaxTracedFrames = 16;
+	static constexpr uint32_t k_TransitHistory = 128;
+
+	static void OnRecovered(void *context, uint8_t *data, uint32_t size);
+	static void FreeRecovered(void *handle);
+
+	void HandleMessage(const uint8_t *data, uint32_t size, void *handle, FrameReassembler::ReleaseFn release, std::chrono::steady_clock::time_point arrived);
+	void NoteArrival(uint32_t frameId, std::chrono::steady_clock::time_point arrived, const FrameUpdateHeader *header);
+	// Traces the frames the reassembler completed, then hands them to the playout buffer.
+	void CapturePlayout(std::chrono::steady_clock::time_point now);
+
+	struct QueuedMessage
+	{
+		const uint8_t *data = nullptr;
+		uint32_t size = 0;
+		void *handle = nullptr;
+		FrameReassembler::ReleaseFn release = nullptr;
+		std::chrono::steady_clock::time_point arrived;
+	};
+
+	// A frame still collecting fragments.
+	struct FrameArrival
+	{
+		uint32_t frameId = 0;
+		uint32_t diffedAfter = 0;
+		uint32_t encodedAfter = 0;
+		bool hasHeader = false; // a data fragment arrived, not only parity
+		std::chrono::steady_clock::time_point first;
+		std::chrono::steady_clock::time_point last;
+	};
+
+	// A completed frame waiting to be shown.
+	struct TracedFrame
+	{
+		uint64_t sequence = 0; // see PlayoutBuffer::GetCompletedFrameCount()
+		std::chrono::steady_clock::time_point completed;
+		std::chrono::steady_clock::time_point captured; // in our clock, as far as it can be told
+	};
+
+private:
+	uint32_t m_Stream;
+	FrameReassembler m_Reassembler;
+	FecDecoder m_FecDecoder;
+	NackGenerator m_NackGenerator;
+	std::vector<uint16_t> m_CacheMissSlots;
+	PlayoutBuffer m_Playout;
+	CursorReceiver m_Cursor;
+	ViewportHeader m_Viewport;
+	bool m_ViewportChanged = false;
+
+	std::vector<QueuedMessage> m_Queue; // [m_QueueHead, size()) are waiting
+	size_t m_QueueHead = 0;
+	uint64_t m_QueueCredit = 0;
+	uint64_t m_DecodedBytes = 0;
+	uint64_t m_Keepalives = 0;
+
+	LatencyTrace m_Latency;
+	std::chrono::microseconds m_PathDelay{0};
+	std::vector<FrameArrival> m_Arrivals; // oldest first, at most k_MaxTracedFrames
+	std::vector<TracedFrame> m_Traced;	  // oldest first, at most k_MaxTracedFrames
+	std::vector<int64_t> m_Transits;	  // a ring of k_TransitHistory
+	uint32_t m_TransitNext = 0;
+	int64_t m_Encoded = 0; // unwrapped timestamp + encodedAfter of the last frame
+	bool m_HasEncoded = false;
+};
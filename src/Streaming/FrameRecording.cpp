@@ -0,0 +1,111 @@
+#include "FrameRecording.h"
+
+#include <algorithm>
+
+#include "TileCodec.h"
+
+TileRect ClipRecordedRect(const TileRect &rect, uint32_t width, uint32_t height)
+{
+	const uint32_t x = std::min(rect.x, width);
+	const uint32_t y = std::min(rect.y, height);
+	return {x, y, std::min(rect.width, width - x), std::min(rect.height, height - y)};
+}
+
+bool FrameRecorder::Open(const char *path)
+{
+	Close();
+	m_File = std::fopen(path, "wb");
+	if (!m_File)
+		return false;
+	m_Offset = 0;
+	m_Index.clear();
+	m_Width = m_Height = 0;
+	m_Failed = false;
+	const RecordingHeader header;
+	return WriteBytes(&header, sizeof(header));
+}
+
+bool FrameRecorder::WriteBytes(const void *data, size_t size)
+{
+	if (m_Failed || std::fwrite(data, 1, size, m_File) != size)
+	{
+		m_Failed = true;
+		return false;
+	}
+	m_Offset += size;
+	return true;
+}
+
+bool FrameRecorder::Pad()
+{
+	static const uint8_t k_Zeros[k_RecordingAlignment] = {};
+	return WriteBytes(k_Zeros, (size_t)((k_RecordingAlignment - m_Offset % k_RecordingAlignment) % k_RecordingAlignment));
+}
+
+bool FrameRecorder::Write(const CapturedFrame &frame)
+{
+	if (!m_File || m_Failed)
+		return false;
+
+	const FrameView &view = frame.view;
+	if (m_Index.empty())
+		m_First = frame.captured;
+	const bool keyframe = !frame.hasDirtyRects || view.width != m_Width || view.height != m_Height;
+	m_Width = view.width;
+	m_Height = view.height;
+
+	RecordedFrameHeader header;
+	header.timestamp = (uint64_t)std::max<int64_t>(std::chrono::duration_cast<std::chrono::microseconds>(frame.captured - m_First).count(), 0);
+	header.width = view.width;
+	header.height = view.height;
+	header.keyframe = keyframe ? 1 : 0;
+	header.rectCount = keyframe ? 0 : (uint32_t)frame.dirtyRects.size();
+
+	// Deltas are coded up front, the header has their size.
+	m_Data.clear();
+	for (uint32_t i = 0; i < header.rectCount; ++i)
+	{
+		const TileRect rect = ClipRecordedRect(frame.dirtyRects[i], view.width, view.height);
+		const size_t size = m_Data.size();
+		m_Data.resize(size + TileCodec::GetMaxRecordSize(rect));
+		m_Data.resize(size + TileCodec::Encode(view, rect, i, k_TileQualityLossless, m_Data.data() + size));
+	}
+
+	Pad();
+	m_Index.push_back(m_Offset);
+	const uint64_t rectsEnd = m_Offset + sizeof(header) + (uint64_t)header.rectCount * sizeof(TileRect);
+	header.dataOffset = (rectsEnd + k_RecordingAlignment - 1) / k_RecordingAlignment * k_RecordingAlignment;
+	header.dataSize = keyframe ? (uint64_t)view.width * view.height * k_BytesPerPixel : m_Data.size();
+	WriteBytes(&header, sizeof(header));
+	if (!keyframe)
+		WriteBytes(frame.dirtyRects.data(), frame.dirtyRects.size() * sizeof(TileRect));
+	Pad();
+
+	if (keyframe)
+	{
+		for (uint32_t y = 0; y < view.height; ++y)
+			WriteBytes(view.Row(y), (size_t)view.width * k_BytesPerPixel);
+	}
+	else
+	{
+		WriteBytes(m_Data.data(), m_Data.size());
+	}
+	return !m_Failed;
+}
+
+bool FrameRecorder::Close()
+{
+	if (!m_File)
+		return false;
+
+	RecordingHeader header;
+	header.frameCount = (uint32_t)m_Index.size();
+	Pad();
+	header.indexOffset = m_Offset;
+	WriteBytes(m_Index.data(), m_Index.size() * sizeof(uint64_t));
+	if (!m_Failed && (std::fseek(m_File, 0, SEEK_SET) != 0 || std::fwrite(&header, 1, sizeof(header), m_File) != sizeof(header)))
+		m_Failed = true;
+	const bool ok = std::fclose(m_File) == 0 && !m_Failed;
+	m_File = nullptr;
+	return ok;
+}
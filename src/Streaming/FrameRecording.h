@@ -0,0 +1,115 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+#include "FrameSource.h"
+
+// A recorded session on disk, little endian, for replaying the same screen every run:
+//
+//   RecordingHeader
+//   a record per frame at k_RecordingAlignment: RecordedFrameHeader, its TileRect[rectCount],
+//     its data at k_RecordingAlignment
+//   uint64_t file offset of every record, at RecordingHeader::indexOffset
+//
+// A keyframe has no rects, its data is all of the frame's pixels with packed rows, so they can be
+// used where they lie.  A delta's data is a lossless TileCodec record per rect, clipped to the
+// frame, one after the other; screens are mostly runs.  A frame its source knew nothing about is
+// a keyframe, so is every change of size; the first frame always is.  Moves are recorded as the
+// dirty rects of their destinations, the way sources report them.  Deltas come back with opaque
+// alpha, like everything TileCodec decodes.
+#pragma pack(push, 1)
+
+struct RecordingHeader
+{
+	char magic[4] = {'S', 'R', 'E', 'C'};
+	uint32_t version = 1;
+	uint32_t frameCount = 0;
+	uint32_t reserved = 0;
+	uint64_t indexOffset = 0; // 0 while recording, a file that wasn't closed has no index
+};
+
+struct RecordedFrameHeader
+{
+	uint64_t timestamp = 0; // microseconds since the first frame was captured
+	uint32_t width = 0;
+	uint32_t height = 0;
+	uint32_t rectCount = 0;
+	uint8_t keyframe = 0;
+	uint8_t reserved[3] = {};
+	uint64_t dataOffset = 0; // file offset, a multiple of k_RecordingAlignment
+	uint64_t dataSize = 0;
+};
+
+#pragma pack(pop)
+
+static_assert(sizeof(RecordingHeader) == 24);
+static_assert(sizeof(RecordedFrameHeader) == 40);
+
+constexpr uint32_t k_RecordingAlignment = 64;
+
+// rect clipped to a width x height frame, the way delta rects are stored.
+TileRect ClipRecordedRect(const TileRect &rect, uint32_t width, uint32_t height);
+
+// Writes frames as they come into a recording.
+class FrameRecorder
+{
+public:
+	~FrameRecorder() { Close(); }
+
+	// Truncates path.  False when it can't be written.
+	bool Open(const char *path);
+	// Appends frame.  False, and nothing more is recorded, once writing failed.
+	bool Write(const CapturedFrame &frame);
+	// Writes the index, the recording can be replayed from then on.
+	bool Close();
+
+	bool IsOpen() const { return m_File != nullptr; }
+	uint32_t GetFrameCount() const { return (uint32_t)m_Index.size(); }
+	uint64_t GetByteCount() const { return m_Offset; }
+
+private:
+	bool WriteBytes(const void *data, size_t size);
+	bool Pad();
+
+private:
+	FILE *m_File = nullptr;
+	uint64_t m_Offset = 0;
+	std::vector<uint64_t> m_Index;
+	std::chrono::steady_clock::time_point m_First;
+	uint32_t m_Width = 0;
+	uint32_t m_Height = 0;
+	bool m_Failed = false;
+	std::vector<uint8_t> m_Data; // a delta's TileCodec records
+};
+
+// Records every frame of another source as it passes, e.g. the screen while it is shared.
+class RecordingFrameSource : public IFrameSource
+{
+public:
+	RecordingFrameSource(std::unique_ptr<IFrameSource> source, std::unique_ptr<FrameRecorder> recorder)
+		: m_Source(std::move(source)), m_Recorder(std::move(recorder))
+	{
+	}
+
+	bool AcquireFrame(std::chrono::milliseconds timeout, CapturedFrame &frame) override
+	{
+		if (!m_Source->AcquireFrame(timeout, frame))
+			return false;
+		m_Recorder->Write(frame);
+		return true;
+	}
+	void ReleaseFrame() override { m_Source->ReleaseFrame(); }
+	// The recording has what the source read, stale pixels outside the region included.
+	void SetRegion(const TileRect &region) override { m_Source->SetRegion(region); }
+	// Not recorded, a replay has no cursor of its own.
+	bool GetCursor(CursorState &cursor, CursorShape &shape) override { return m_Source->GetCursor(cursor, shape); }
+
+	FrameRecorder &GetRecorder() { return *m_Recorder; }
+
+private:
+	std::unique_ptr<IFrameSource> m_Source;
+	std::unique_ptr<FrameRecorder> m_Recorder;
+};
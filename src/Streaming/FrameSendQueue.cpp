@@ -0,0 +1,133 @@
+#include "FrameSendQueue.h"
+
+#include <algorithm>
+
+#include "Frame.h"
+
+FrameSendQueue::~FrameSendQueue()
+{
+	Clear();
+}
+
+void FrameSendQueue::Push(const EncodedFrame &frame)
+{
+	if (frame.width != m_Width || frame.height != m_Height)
+	{
+		// The receiver starts over at a new size, frames of the old one only get in the way.
+		Clear();
+		m_Width = frame.width;
+		m_Height = frame.height;
+		m_NewestPush.assign(TileGrid(frame.width, frame.height).GetTileCount(), 0);
+		m_Evicted.assign(m_NewestPush.size(), 0);
+		m_EvictedCount = 0;
+	}
+
+	if (m_Spare.empty())
+		m_Spare.emplace_back();
+	m_Frames.push_back(std::move(m_Spare.back()));
+	m_Spare.pop_back();
+
+	QueuedFrame &queued = m_Frames.back();
+	queued.push = ++m_PushCount;
+	queued.pushed = std::chrono::steady_clock::now();
+	EncodedFrame &copy = queued.frame;
+	copy.frameId = frame.frameId;
+	copy.timestamp = frame.timestamp;
+	copy.diffedAfter = frame.diffedAfter;
+	copy.encodedAfter = frame.encodedAfter;
+	copy.width = frame.width;
+	copy.height = frame.height;
+	copy.fragments.assign(frame.fragments.begin(), frame.fragments.end());
+	copy.byteCount = frame.byteCount;
+	m_QueuedBytes += frame.byteCount;
+	copy.tiles.assign(frame.tiles.begin(), frame.tiles.end());
+	copy.fecGroupSize = frame.fecGroupSize;
+	copy.fecParityCount = frame.fecParityCount;
+	copy.parity.assign(frame.parity.begin(), frame.parity.end());
+	for (const EncodedFragment &fragment : copy.fragments)
+		fragment.block->AddRef();
+	for (const EncodedFragment &fragment : copy.parity)
+		fragment.block->AddRef();
+
+	for (uint32_t tile : copy.tiles)
+	{
+		m_NewestPush[tile] = queued.push;
+		if (m_Evicted[tile])
+		{
+			// The new frame has a newer version anyway.
+			m_Evicted[tile] = 0;
+			--m_EvictedCount;
+		}
+	}
+
+	// Only the frames before the new one can have been made obsolete by it.
+	for (size_t i = m_Frames.size() - 1; i-- > 0;)
+	{
+		const QueuedFrame &older = m_Frames[i];
+		const bool obsolete = std::all_of(older.frame.tiles.begin(), older.frame.tiles.end(), [&](uint32_t tile)
+										  { return m_NewestPush[tile] > older.push; });
+		if (!obsolete)
+			continue;
+		++m_DroppedFrames;
+		m_DroppedBytes += older.frame.byteCount;
+		Release(i);
+	}
+
+	while (m_Frames.size() > k_MaxQueuedFrames)
+	{
+		const QueuedFrame &oldest = m_Frames.front();
+		for (uint32_t tile : oldest.frame.tiles)
+		{
+			if (m_NewestPush[tile] == oldest.push && !m_Evicted[tile])
+			{
+				m_Evicted[tile] = 1;
+				++m_EvictedCount;
+			}
+		}
+		++m_EvictedFrames;
+		m_DroppedBytes += oldest.frame.byteCount;
+		Release(0);
+	}
+}
+
+bool FrameSendQueue::TakeEvictedTiles(std::vector<uint32_t> &tiles, uint32_t &width, uint32_t &height)
+{
+	tiles.clear();
+	if (m_EvictedCount == 0)
+		return false;
+
+	for (uint32_t tile = 0; tile < m_Evicted.size(); ++tile)
+	{
+		if (m_Evicted[tile])
+			tiles.push_back(tile);
+	}
+	std::fill(m_Evicted.begin(), m_Evicted.end(), 0);
+	m_EvictedCount = 0;
+	width = m_Width;
+	height = m_Height;
+	return true;
+}
+
+void FrameSendQueue::Pop()
+{
+	Release(0);
+}
+
+void FrameSendQueue::Clear()
+{
+	while (!m_Frames.empty())
+		Release(m_Frames.size() - 1);
+}
+
+void FrameSendQueue::Release(size_t index)
+{
+	QueuedFrame &queued = m_Frames[index];
+	m_QueuedBytes -= queued.frame.byteCount;
+	for (const EncodedFragment &fragment : queued.frame.fragments)
+		fragment.block->Release();
+	for (const EncodedFragment &fragment : queued.frame.parity)
+		fragment.block->Release();
+
+	m_Spare.push_back(std::move(queued));
+	m_Frames.erase(m_Frames.begin() + index);
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+#include <chrono>
+#include <vector>
+
+#include "ParallelTileEncoder.h"
+
+// Frames waiting to be handed to one peer's connection, held back while its queue is full.
+// Screen updates are latest-wins per tile: once every tile of a waiting frame is also in a newer
+// waiting frame, nothing in it would survive on the receiver, and it is dropped instead of sent.
+// A frame that only partly overlaps newer ones can't be cut apart, its fragments are numbered.
+// So at most k_MaxQueuedFrames wait; past that the oldest is evicted, and its tiles that no newer
+// frame covers are handed back through TakeEvictedTiles() to be encoded again from the screen.
+//
+// Dropped frames may have stored cache slots that later frames refer to; the receiver reports
+// those as misses and they are resent like any other lost tile.
+//
+// Queued frames hold a reference on their arena blocks until popped or dropped.  Their vectors are
+// recycled, after warm-up pushing and popping does not allocate.
+class FrameSendQueue
+{
+public:
+	static constexpr uint32_t k_MaxQueuedFrames = 2;
+
+	FrameSendQueue() = default;
+	FrameSendQueue(const FrameSendQueue &) = delete;
+	FrameSendQueue &operator=(const FrameSendQueue &) = delete;
+	~FrameSendQueue();
+
+	// Queues frame behind the others, then drops whatever it made obsolete.
+	void Push(const EncodedFrame &frame);
+
+	// Tiles of evicted frames that still have to reach the receiver, ascending, of a width x height
+	// frame.  Clears them.  Returns false when there are none.
+	bool TakeEvictedTiles(std::vector<uint32_t> &tiles, uint32_t &width, uint32_t &height);
+
+	bool IsEmpty() const { return m_Frames.empty(); }
+	const EncodedFrame &Front() const { return m_Frames.front().frame; }
+	// When Front() was pushed.
+	std::chrono::steady_clock::time_point GetFrontPushTime() const { return m_Frames.front().pushed; }
+	void Pop();
+	void Clear();
+
+	size_t GetQueuedCount() const { return m_Frames.size(); }
+	uint64_t GetQueuedByteCount() const { return m_QueuedBytes; }
+	uint32_t GetDroppedFrameCount() const { return m_DroppedFrames; }
+	uint32_t GetEvictedFrameCount() const { return m_EvictedFrames; }
+	uint64_t GetDroppedByteCount() const { return m_DroppedBytes; }
+
+private:
+	struct QueuedFrame
+	{
+		uint64_t push = 0;
+		std::chrono::steady_clock::time_point pushed;
+		EncodedFrame frame;
+	};
+
+	void Release(size_t index);
+
+private:
+	std::vector<QueuedFrame> m_Frames; // oldest first
+	std::vector<QueuedFrame> m_Spare;
+	uint64_t m_PushCount = 0;
+	uint64_t m_QueuedBytes = 0;
+
+	// Push number of the newest queued frame per tile, of a m_Width x m_Height frame.
+	uint32_t m_Width = 0;
+	uint32_t m_Height = 0;
+	std::vector<uint64_t> m_NewestPush;
+	std::vector<uint8_t> m_Evicted; // per tile
+	uint32_t m_EvictedCount = 0;
+
+	uint32_t m_DroppedFrames = 0;
+	uint32_t m_EvictedFrames = 0;
+	uint64_t m_DroppedBytes = 0;
+};
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <chrono>
+#include <vector>
+
+#include "Cursor.h"
+#include "Frame.h"
+#include "TilePriority.h"
+
+// A frame as a source hands it out, valid until the source's ReleaseFrame().
+struct CapturedFrame
+{
+	FrameView view;
+	std::chrono::steady_clock::time_point captured;
+	// What the source knows changed since the frame it handed out before.  Without that, e.g. on
+	// the first frame, anything may have.
+	bool hasDirtyRects = false;
+	std::vector<TileRect> dirtyRects;
+	// Cursor and foreground window when the frame was captured, what the source knows of them.
+	FrameFocus focus;
+};
+
+// Where a stream's frames come from: a monitor, a recording, a generator.  Only used by one
+// thread at a time, the stream's capture thread.
+class IFrameSource
+{
+public:
+	virtual ~IFrameSource() = default;
+
+	// Waits up to timeout for a frame that differs from the last one.  False when none came,
+	// also after the source failed for good; it still waits out the timeout then, so callers can
+	// simply loop.  A frame acquired must be released before the next one.
+	virtual bool AcquireFrame(std::chrono::milliseconds timeout, CapturedFrame &frame) = 0;
+	virtual void ReleaseFrame() = 0;
+
+	// Only region of the frames is looked at from now on, a source may skip reading the rest.
+	// Pixels outside it can be stale, and dirty rects may leave out changes there.  An empty
+	// region is the whole frame again.
+	virtual void SetRegion(const TileRect &region) { (void)region; }
+
+	// Where the cursor is, in frame pixels, as of the last AcquireFrame() whether that handed out a
+	// frame or not; the cursor moves without the screen changing.  shape is filled in when its id
+	// isn't the cursor's shape already.  False when the source doesn't know, its frames have the
+	// cursor in them if anything.
+	virtual bool GetCursor(CursorState &cursor, CursorShape &shape)
+	{
+		(void)cursor;
+		(void)shape;
+		return false;
+	}
+};
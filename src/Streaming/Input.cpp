@@ -0,0 +1,72 @@
+#include "Input.h"
+
+#include <cstring>
+#include <algorithm>
+
+static bool IsMotion(uint8_t type)
+{
+	return type == (uint8_t)InputEventType::Wheel || type == (uint8_t)InputEventType::MouseMove || type == (uint8_t)InputEventType::MouseDelta;
+}
+
+void InputSender::Add(const InputEvent &event)
+{
+	++m_EventCount;
+
+	// Only into the event right before it, merging across a key, a button or other motion would
+	// move those to where the pointer ends up.
+	if (IsMotion(event.type) && !m_Pending.empty() && m_Pending.back().type == event.type)
+	{
+		InputEvent &last = m_Pending.back();
+		if (event.type == (uint8_t)InputEventType::MouseMove)
+		{
+			last.x = event.x;
+			last.y = event.y;
+		}
+		else
+		{
+			last.x += event.x;
+			last.y += event.y;
+		}
+		++m_CoalescedCount;
+		return;
+	}
+	m_Pending.push_back(event);
+}
+
+bool InputSender::BuildMessage(std::vector<uint8_t> &message)
+{
+	if (m_Pending.empty())
+		return false;
+
+	const size_t count = std::min<size_t>(m_Pending.size(), k_MaxInputEventsPerMessage);
+	InputEventsHeader header;
+	header.eventCount = (uint16_t)count;
+	message.resize(sizeof(header) + count * sizeof(InputEvent));
+	std::memcpy(message.data(), &header, sizeof(header));
+	std::memcpy(message.data() + sizeof(header), m_Pending.data(), count * sizeof(InputEvent));
+	m_Pending.erase(m_Pending.begin(), m_Pending.begin() + count);
+	return true;
+}
+
+bool ParseInputEvents(const uint8_t *data, uint32_t size, std::vector<InputEvent> &events)
+{
+	InputEventsHeader header;
+	if (size < sizeof(header) || data[0] != (uint8_t)MessageType::InputEvents)
+		return false;
+	std::memcpy(&header, data, sizeof(header));
+	if (header.eventCount == 0 || size != sizeof(header) + (size_t)header.eventCount * sizeof(InputEvent))
+		return false;
+
+	const size_t first = events.size();
+	events.resize(first + header.eventCount);
+	std::memcpy(events.data() + first, data + sizeof(header), (size_t)header.eventCount * sizeof(InputEvent));
+	for (size_t i = first; i < events.size(); ++i)
+	{
+		if (events[i].type > (uint8_t)InputEventType::MouseDelta)
+		{
+			events.resize(first);
+			return false;
+		}
+	}
+	return true;
+}
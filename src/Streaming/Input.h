@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "WireFormat.h"
+
+// Events past this many wait for the next message.
+constexpr uint32_t k_MaxInputEventsPerMessage = 1024;
+
+// Send side of one peer's input lane.  Events are batched until the next BuildMessage().  Motion
+// coalesces on the way in: a pointer that moved several times in a row since the last send only
+// goes out at where it is now, relative motion and wheel turns in a row are summed.  Nothing is
+// reordered and keys and buttons are never merged, so a click still lands where the pointer was
+// when it happened.
+class InputSender
+{
+public:
+	void Add(const InputEvent &event);
+
+	// Fills message with an InputEvents for what was added since the last call, oldest first.
+	bool BuildMessage(std::vector<uint8_t> &message);
+
+	uint64_t GetEventCount() const { return m_EventCount; }
+	uint64_t GetCoalescedCount() const { return m_CoalescedCount; }
+
+private:
+	std::vector<InputEvent> m_Pending;
+
+	uint64_t m_EventCount = 0;
+	uint64_t m_CoalescedCount = 0;
+};
+
+// Appends the events of an InputEvents message to events.  False, and nothing appended, for
+// anything that isn't a well formed one.
+bool ParseInputEvents(const uint8_t *data, uint32_t size, std::vector<InputEvent> &events);
@@ -0,0 +1,114 @@
+#include "LatencyTrace.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+const char *GetLatencyStageName(LatencyStage stage)
+{
+	switch (stage)
+	{
+	case LatencyStage::Diff:
+		return "Diff";
+	case LatencyStage::Encode:
+		return "Encode";
+	case LatencyStage::Enqueue:
+		return "Enqueue";
+	case LatencyStage::Send:
+		return "Send";
+	case LatencyStage::Receive:
+		return "Receive";
+	case LatencyStage::Reassemble:
+		return "Reassemble";
+	case LatencyStage::Decode:
+		return "Decode";
+	case LatencyStage::Present:
+		return "Present";
+	case LatencyStage::Total:
+		return "Total";
+	default:
+		return "Unknown";
+	}
+}
+
+// Below 2 * k_SubBucketCount a bucket per value, above it k_SubBucketCount per power of two.
+uint32_t LatencyHistogram::GetBucket(int64_t latency)
+{
+	const uint64_t value = (uint64_t)latency;
+	if (value < k_SubBucketCount)
+		return (uint32_t)value;
+	const uint32_t shift = (uint32_t)std::bit_width(value) - (k_SubBucketBits + 1);
+	return (shift + 1) * k_SubBucketCount + (uint32_t)(value >> shift) - k_SubBucketCount;
+}
+
+int64_t LatencyHistogram::GetBucketEnd(uint32_t bucket)
+{
+	if (bucket < k_SubBucketCount)
+		return bucket;
+	const uint32_t shift = bucket / k_SubBucketCount - 1;
+	const int64_t subBucket = bucket % k_SubBucketCount + k_SubBucketCount;
+	return ((subBucket + 1) << shift) - 1;
+}
+
+void LatencyHistogram::Record(std::chrono::microseconds latency)
+{
+	const int64_t value = std::clamp<int64_t>(latency.count(), 0, k_MaxLatency);
+	++m_Counts[GetBucket(value)];
+	++m_Count;
+	m_Max = std::max(m_Max, value);
+}
+
+void LatencyHistogram::Add(const LatencyHistogram &other)
+{
+	for (uint32_t bucket = 0; bucket < k_BucketCount; ++bucket)
+		m_Counts[bucket] += other.m_Counts[bucket];
+	m_Count += other.m_Count;
+	m_Max = std::max(m_Max, other.m_Max);
+}
+
+void LatencyHistogram::Reset()
+{
+	m_Counts.fill(0);
+	m_Count = 0;
+	m_Max = 0;
+}
+
+std::chrono::microseconds LatencyHistogram::GetPercentile(double percentile) const
+{
+	if (m_Count == 0)
+		return std::chrono::microseconds(0);
+	const uint64_t rank = std::clamp<uint64_t>((uint64_t)std::ceil(percentile * (double)m_Count), 1, m_Count);
+	uint64_t seen = 0;
+	for (uint32_t bucket = 0; bucket < k_BucketCount; ++bucket)
+	{
+		seen += m_Counts[bucket];
+		if (seen >= rank)
+			return std::chrono::microseconds(std::min(GetBucketEnd(bucket), m_Max));
+	}
+	return std::chrono::microseconds(m_Max);
+}
+
+void LatencyTrace::Add(const LatencyTrace &other)
+{
+	for (size_t stage = 0; stage < m_Stages.size(); ++stage)
+		m_Stages[stage].Add(other.m_Stages[stage]);
+}
+
+void LatencyTrace::Reset()
+{
+	for (LatencyHistogram &histogram : m_Stages)
+		histogram.Reset();
+}
+
+void LatencyTrace::Dump(FILE *file, const char *label) const
+{
+	for (size_t stage = 0; stage < m_Stages.size(); ++stage)
+	{
+		const LatencyHistogram &histogram = m_Stages[stage];
+		if (histogram.GetCount() == 0)
+			continue;
+		fprintf(file, "%s %s %llu %lld %lld %lld %lld\n", label, GetLatencyStageName((LatencyStage)stage), (unsigned long long)histogram.GetCount(),
+				(long long)histogram.GetPercentile(0.50).count(), (long long)histogram.GetPercentile(0.95).count(),
+				(long long)histogram.GetPercentile(0.99).count(), (long long)histogram.GetMax().count());
+	}
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <chrono>
+
+// Where a frame's latency goes, from when it was captured until it was on the viewer's screen.
+// Each stage is the time since the stage before it, so together they add up to Total.  The
+// sender traces Diff to Send.  The viewer takes Diff and Encode from the frame's header and
+// traces Receive on; it isn't told when the frame was sent, so its Receive starts at Encode and
+// includes the sender's queue.
+enum class LatencyStage : uint8_t
+{
+	Diff = 0,	// captured until diffed onto the stream's frame
+	Encode,		// until encoded, the wait for the stream's frame time included
+	Enqueue,	// until queued for a peer
+	Send,		// until handed to the connection
+	Receive,	// until its first fragment came off the viewer's connection
+	Reassemble, // until its last one did
+	Decode,		// until the frame was complete on the canvas, the decode queue included
+	Present,	// until it was on screen, the playout delay included
+	Total,		// captured until on screen
+	Count
+};
+
+const char *GetLatencyStageName(LatencyStage stage);
+
+// Latencies counted in buckets of about 3% of their value, the way an HDR histogram does: exact
+// up to 64 microseconds, then 32 buckets per power of two up to k_MaxLatency.  Longer ones count
+// as k_MaxLatency, negative ones as 0.  Recording doesn't allocate.
+class LatencyHistogram
+{
+public:
+	static constexpr uint32_t k_MaxLatencyBits = 24;
+	static constexpr int64_t k_MaxLatency = (int64_t(1) << k_MaxLatencyBits) - 1; // microseconds, about 17 seconds
+
+	void Record(std::chrono::microseconds latency);
+	void Add(const LatencyHistogram &other);
+	void Reset();
+
+	// What percentile (0 to 1) of the latencies recorded are at or below, rounded up to the end of
+	// its bucket.  0 while empty.
+	std::chrono::microseconds GetPercentile(double percentile) const;
+	std::chrono::microseconds GetMax() const { return std::chrono::microseconds(m_Max); }
+	uint64_t GetCount() const { return m_Count; }
+
+private:
+	static constexpr uint32_t k_SubBucketBits = 5;
+	static constexpr uint32_t k_SubBucketCount = 1u << k_SubBucketBits;
+	static constexpr uint32_t k_BucketCount = (k_MaxLatencyBits - k_SubBucketBits + 1) * k_SubBucketCount;
+
+	static uint32_t GetBucket(int64_t latency);
+	static int64_t GetBucketEnd(uint32_t bucket);
+
+private:
+	std::array<uint64_t, k_BucketCount> m_Counts = {};
+	uint64_t m_Count = 0;
+	int64_t m_Max = 0;
+};
+
+// A histogram per stage, of one stream on one side.
+class LatencyTrace
+{
+public:
+	void Record(LatencyStage stage, std::chrono::microseconds latency) { m_Stages[(size_t)stage].Record(latency); }
+	void Add(const LatencyTrace &other);
+	void Reset();
+
+	const LatencyHistogram &GetHistogram(LatencyStage stage) const { return m_Stages[(size_t)stage]; }
+	std::chrono::microseconds GetPercentile(LatencyStage stage, double percentile) const { return m_Stages[(size_t)stage].GetPercentile(percentile); }
+
+	// A line per stage with latencies: label, stage, count, then p50, p95, p99 and the maximum in
+	// microseconds.
+	void Dump(FILE *file, const char *label) const;
+
+private:
+	std::array<LatencyHistogram, (size_t)LatencyStage::Count> m_Stages;
+};
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// A whole file mapped read only.
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	~MappedFile() { Close(); }
+
+	MappedFile(const MappedFile &) = delete;
+	MappedFile &operator=(const MappedFile &) = delete;
+
+	// False when path can't be opened or is empty.
+	bool Open(const char *path);
+	void Close();
+
+	const uint8_t *GetData() const { return m_Data; }
+	size_t GetSize() const { return m_Size; }
+
+private:
+	const uint8_t *m_Data = nullptr;
+	size_t m_Size = 0;
+#ifdef _WIN32
+	void *m_File = nullptr;
+	void *m_Mapping = nullptr;
+#endif
+};
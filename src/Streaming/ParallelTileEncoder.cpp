@@ -0,0 +1,278 @@
+#include "ParallelTileEncoder.h"
+
+#include <algorithm>
+#include <cstring>
+#include <cassert>
+#include <chrono>
+
+#include "TileCodec.h"
+#include "TileHash.h"
+#include "WireFormat.h"
+
+// A record starting this close to the end of a fragment would just leave a sliver behind, start
+// it in a fresh fragment instead.
+static constexpr uint32_t k_MinSplitRecordStart = 64;
+
+// Cuts one chunk's records into fragments inside a worker's arena.  Every fragment gets its
+// header gap up front, so records are written exactly once, straight into their final place.
+struct FragmentWriter
+{
+	EncodeArena &arena;
+	std::vector<EncodedFragment> &fragments;
+	uint32_t fragmentSize;
+	uint32_t count = 0;
+	TileOutput output;
+
+	FragmentWriter(EncodeArena &arena, std::vector<EncodedFragment> &fragments, uint32_t fragmentSize)
+		: arena(arena), fragments(fragments), fragmentSize(fragmentSize)
+	{
+		output.context = this;
+		output.next = &FragmentWriter::Next;
+	}
+
+	bool IsOpen() const { return output.cursor != nullptr; }
+	uint32_t GetRemaining() const { return (uint32_t)(output.end - output.cursor); }
+
+	void Open(uint32_t firstTile)
+	{
+		bool startedNewBlock = false;
+		uint8_t *p = arena.Allocate(sizeof(FrameUpdateHeader) + fragmentSize, startedNewBlock);
+
+		EncodedFragment fragment;
+		fragment.block = arena.GetCurrentBlock();
+		fragment.data = p;
+		fragment.firstTile = firstTile;
+		fragments.push_back(fragment);
+		++count;
+
+		output.cursor = p + sizeof(FrameUpdateHeader);
+		output.end = output.cursor + fragmentSize;
+	}
+
+	void Close()
+	{
+		EncodedFragment &fragment = fragments.back();
+		fragment.size = (uint32_t)(output.cursor - fragment.data);
+		arena.Shrink(fragment.data, fragment.size);
+		output.cursor = output.end = nullptr;
+	}
+
+	// Called by the codec when a record runs past the end of the fragment.
+	static void Next(TileOutput &output)
+	{
+		FragmentWriter &writer = *static_cast<FragmentWriter *>(output.context);
+		const uint32_t nextTile = writer.fragments.back().firstTile + writer.fragments.back().tileCount;
+		writer.Close();
+		writer.Open(nextTile);
+	}
+
+	// Records where the next record starts.
+	void BeginRecord()
+	{
+		EncodedFragment &fragment = fragments.back();
+		if (fragment.tileCount == 0)
+			fragment.firstRecordOffset = (uint16_t)(output.cursor - (fragment.data + sizeof(FrameUpdateHeader)));
+		++fragment.tileCount;
+	}
+};
+
+ParallelTileEncoder::ParallelTileEncoder(WorkStealingPool &pool, ArenaBlockPool &blockPool)
+	: m_Pool(pool), m_BlockPool(blockPool), m_BlockSize(blockPool.GetBlockSize()), m_WorkerFragments(pool.GetWorkerCount())
+{
+	m_Arenas.reserve(pool.GetWorkerCount());
+	for (uint32_t i = 0; i < pool.GetWorkerCount(); ++i)
+		m_Arenas.emplace_back(blockPool);
+}
+
+bool ParallelTileEncoder::Encode(const FrameView &frame, std::span<const uint32_t> dirtyTiles, uint8_t quality, uint32_t frameId, uint32_t timestamp, uint32_t diffedAfter, uint32_t fragmentSize, EncodedFrame &out)
+{
+	m_TileQuality.assign(dirtyTiles.size(), quality);
+	return Encode(frame, dirtyTiles, m_TileQuality, frameId, timestamp, diffedAfter, fragmentSize, out);
+}
+
+bool ParallelTileEncoder::Encode(const FrameView &frame, std::span<const uint32_t> dirtyTiles, std::span<const uint8_t> tileQuality, uint32_t frameId, uint32_t timestamp, uint32_t diffedAfter, uint32_t fragmentSize, EncodedFrame &out)
+{
+	assert(tileQuality.size() == dirtyTiles.size());
+	assert(fragmentSize > k_MinSplitRecordStart && fragmentSize <= GetMaxFragmentSize());
+	assert(sizeof(FrameUpdateHeader) + fragmentSize <= m_BlockSize);
+
+	const TileGrid grid(frame.width, frame.height);
+	const uint32_t chunkCount = (uint32_t)((dirtyTiles.size() + k_TilesPerTask - 1) / k_TilesPerTask);
+
+	// Stealing decides which worker ends up with how much, so size every per-worker list for the
+	// worst case.  Capacity only ever grows, steady state frames never reach the heap.
+	// A fragment is either full or was closed early by a record boundary, which bounds the count.
+	const size_t maxPayload = dirtyTiles.size() * TileCodec::GetMaxRecordSize({0, 0, k_TileSize, k_TileSize});
+	size_t maxFragments = maxPayload / fragmentSize + dirtyTiles.size() + chunkCount;
+
+	// Fragments are numbered in 16 bits.  A frame that could need more of them gets larger ones, the
+	// connection splits those up like any large message.  One that could need more even then isn't
+	// encoded.
+	if (maxFragments > k_MaxFragments)
+	{
+		const size_t closedEarly = dirtyTiles.size() + chunkCount;
+		const size_t maxFragmentSize = std::min<size_t>(GetMaxFragmentSize(), m_BlockSize - sizeof(FrameUpdateHeader));
+		const size_t neededSize = closedEarly < k_MaxFragments ? (maxPayload + k_MaxFragments - closedEarly - 1) / (k_MaxFragments - closedEarly) : SIZE_MAX;
+		if (neededSize > maxFragmentSize)
+		{
+			out.frameId = frameId;
+			out.fragments.clear();
+			out.byteCount = 0;
+			out.tiles.clear();
+			out.tileBytes.clear();
+			out.fecGroupSize = 0;
+			out.fecParityCount = 0;
+			out.parity.clear();
+			return false;
+		}
+		fragmentSize = std::max(fragmentSize, (uint32_t)neededSize);
+		maxFragments = maxPayload / fragmentSize + closedEarly;
+	}
+	const size_t fragmentsPerBlock = m_BlockSize / (sizeof(FrameUpdateHeader) + fragmentSize);
+	const size_t maxBlocks = maxFragments / fragmentsPerBlock + chunkCount + 1;
+	for (EncodeArena &arena : m_Arenas)
+	{
+		arena.Reset();
+		arena.ReserveBlocks(maxBlocks);
+	}
+	// Every worker that picks up a chunk starts a block of its own, and how many do is up to the
+	// scheduler.  Room for all of them up front, or the pool grows the first time more workers
+	// than ever share a frame, however long after warm-up that is.
+	m_BlockPool.Reserve(m_LastFrameBlocks + std::min<size_t>(m_Arenas.size(), chunkCount));
+	for (std::vector<EncodedFragment> &fragments : m_WorkerFragments)
+	{
+		fragments.clear();
+		fragments.reserve(maxFragments);
+	}
+	m_Chunks.resize(chunkCount);
+	m_RecordSizes.resize(dirtyTiles.size());
+
+	m_CacheOps.clear();
+	if (m_Cache != nullptr)
+		PlanCache(frame, grid, dirtyTiles, tileQuality, frameId);
+
+	m_Pool.ParallelFor(chunkCount, [&](uint32_t chunk, uint32_t worker)
+					   { EncodeChunk(frame, grid, dirtyTiles, tileQuality, fragmentSize, chunk, worker); });
+
+	//? stitch: chunks are in tile order, and so are the fragments inside each chunk
+	out.frameId = frameId;
+	out.timestamp = timestamp;
+	out.diffedAfter = diffedAfter;
+	out.encodedAfter = GetWireTimestamp(std::chrono::steady_clock::now()) - timestamp;
+	out.width = frame.width;
+	out.height = frame.height;
+	out.fragments.clear();
+	out.fragments.reserve(maxFragments);
+	out.byteCount = 0;
+	out.fecGroupSize = 0;
+	out.fecParityCount = 0;
+	out.parity.clear();
+	out.tiles.assign(dirtyTiles.begin(), dirtyTiles.end());
+	out.tileBytes.assign(m_RecordSizes.begin(), m_RecordSizes.end());
+	for (const ChunkFragments &chunk : m_Chunks)
+	{
+		const std::vector<EncodedFragment> &fragments = m_WorkerFragments[chunk.worker];
+		for (uint32_t i = 0; i < chunk.count; ++i)
+		{
+			out.fragments.push_back(fragments[chunk.first + i]);
+			out.byteCount += fragments[chunk.first + i].size;
+		}
+	}
+	assert(out.fragments.size() <= k_MaxFragments);
+	m_LastFrameBlocks = out.byteCount / m_BlockSize;
+
+	// Headers were reserved in front of every fragment, fill them in place.
+	for (size_t i = 0; i < out.fragments.size(); ++i)
+	{
+		const EncodedFragment &fragment = out.fragments[i];
+		FrameUpdateHeader header;
+		header.tileCount = fragment.tileCount;
+		header.frameId = frameId;
+		header.timestamp = timestamp;
+		header.diffedAfter = out.diffedAfter;
+		header.encodedAfter = out.encodedAfter;
+		header.fragmentIndex = (uint16_t)i;
+		header.fragmentCount = (uint16_t)out.fragments.size();
+		header.frameWidth = (uint16_t)frame.width;
+		header.frameHeight = (uint16_t)frame.height;
+		header.firstRecordOffset = fragment.firstRecordOffset;
+		std::memcpy(fragment.data, &header, sizeof(header));
+	}
+	return true;
+}
+
+void ParallelTileEncoder::PlanCache(const FrameView &frame, const TileGrid &grid, std::span<const uint32_t> dirtyTiles, std::span<const uint8_t> tileQuality, uint32_t frameId)
+{
+	// Hashing reads every pixel and runs across the pool.  The cache decisions that follow have to
+	// be made in tile order, so both ends agree on them.
+	m_Hashes.resize(dirtyTiles.size());
+	m_Pool.ParallelFor((uint32_t)dirtyTiles.size(), [&](uint32_t i, uint32_t)
+					   { m_Hashes[i] = HashTile(frame, grid.GetTileRect(dirtyTiles[i]), tileQuality[i]); });
+
+	m_CacheOps.resize(dirtyTiles.size());
+	for (size_t i = 0; i < dirtyTiles.size(); ++i)
+		m_CacheOps[i] = m_Cache->Use(m_Hashes[i], frameId);
+}
+
+void ParallelTileEncoder::EncodeChunk(const FrameView &frame, const TileGrid &grid, std::span<const uint32_t> dirtyTiles, std::span<const uint8_t> tileQuality, uint32_t fragmentSize, uint32_t chunk, uint32_t worker)
+{
+	std::vector<EncodedFragment> &fragments = m_WorkerFragments[worker];
+	FragmentWriter writer(m_Arenas[worker], fragments, fragmentSize);
+
+	ChunkFragments &chunkFragments = m_Chunks[chunk];
+	chunkFragments.worker = worker;
+	chunkFragments.first = (uint32_t)fragments.size();
+
+	const uint32_t begin = chunk * k_TilesPerTask;
+	const uint32_t end = std::min<uint32_t>((uint32_t)dirtyTiles.size(), begin + k_TilesPerTask);
+	for (uint32_t i = begin; i < end; ++i)
+	{
+		const uint32_t tileIndex = dirtyTiles[i];
+		const TileRect rect = grid.GetTileRect(tileIndex);
+		const TileCacheOp op = m_CacheOps.empty() ? TileCacheOp() : m_CacheOps[i];
+		const uint8_t quality = tileQuality[i];
+
+		TileRecordHeader header;
+		if (op.reference)
+		{
+			header.tileIndex = tileIndex;
+			header.codec = (uint8_t)TileCodecId::CacheRef;
+			header.quality = quality;
+			header.payloadSize = sizeof(op.storeFrameId);
+		}
+		else
+		{
+			header = TileCodec::Measure(frame, rect, tileIndex, quality);
+		}
+		header.cacheSlot = op.slot;
+		const uint32_t recordSize = (uint32_t)sizeof(header) + header.payloadSize;
+		m_RecordSizes[i] = recordSize;
+
+		// Keep fragments tile aligned: a record that fits a fragment never straddles two.
+		// Larger records fill up what is left and continue in the following fragments.
+		if (!writer.IsOpen())
+		{
+			writer.Open(i);
+		}
+		else if (recordSize > writer.GetRemaining() && (recordSize <= fragmentSize || writer.GetRemaining() < k_MinSplitRecordStart))
+		{
+			writer.Close();
+			writer.Open(i);
+		}
+
+		writer.BeginRecord();
+		if (op.reference)
+		{
+			writer.output.Write(&header, sizeof(header));
+			writer.output.Write(&op.storeFrameId, sizeof(op.storeFrameId));
+		}
+		else
+		{
+			TileCodec::Write(frame, rect, header, writer.output);
+		}
+	}
+	if (writer.IsOpen())
+		writer.Close();
+
+	chunkFragments.count = writer.count;
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "Frame.h"
+#include "EncodeArena.h"
+#include "TileCache.h"
+#include "WireFormat.h"
+#include "WorkStealingPool.h"
+
+// Fragment payload used when the caller has no path MTU to go by.  Fits the library's default
+// 1300 byte MTU_PacketSize with room for its packet and message framing.
+constexpr uint32_t k_DefaultFragmentSize = 1180;
+
+// Contiguous arena memory holding a FrameUpdateHeader followed by up to fragmentSize bytes of
+// the frame's record stream.  One fragment is sent as one message.
+struct EncodedFragment
+{
+	ArenaBlock *block = nullptr; // owns data, AddRef() it to keep the fragment alive past the next Encode()
+	uint8_t *data = nullptr;
+	uint32_t size = 0;		// including the header
+	uint32_t firstTile = 0; // position in the dirty tile list of the first record starting here
+	uint16_t tileCount = 0; // records starting here
+	uint16_t firstRecordOffset = 0;
+};
+
+struct EncodedFrame
+{
+	uint32_t frameId = 0;
+	uint32_t timestamp = 0; // see FrameUpdateHeader
+	uint32_t diffedAfter = 0;
+	uint32_t encodedAfter = 0;
+	uint32_t width = 0;
+	uint32_t height = 0;
+	std::vector<EncodedFragment> fragments; // in tile order
+	size_t byteCount = 0;
+	std::vector<uint32_t> tiles; // the dirty tiles this frame updates, ascending
+	std::vector<uint32_t> tileBytes; // record size of each of tiles
+
+	// Filled in by FecEncoder::Protect().  Group g's parity is parity[g * fecParityCount ...].
+	uint8_t fecGroupSize = 0;
+	uint8_t fecParityCount = 0;
+	std::vector<EncodedFragment> parity;
+};
+
+// Encodes the dirty tiles of a frame across a WorkStealingPool.  Each worker writes fragments
+// into its own arena, and the per-chunk fragments are then stitched in tile order by pointer,
+// never by copying.
+class ParallelTileEncoder
+{
+public:
+	// Tiles handed to a worker per task.  Small enough to balance, large enough to fill fragments.
+	static constexpr uint32_t k_TilesPerTask = 8;
+	// FrameUpdateHeader::fragmentIndex and fragmentCount are 16 bits.
+	static constexpr uint32_t k_MaxFragments = 0xFFFF;
+
+	// The largest fragmentSize: a fragment's offsets are 16 bits, and so is its size in a FEC
+	// symbol, which adds two bytes.
+	static constexpr uint32_t GetMaxFragmentSize() { return 0xFFFF - 2 - (uint32_t)sizeof(FrameUpdateHeader); }
+
+	ParallelTileEncoder(WorkStealingPool &pool, ArenaBlockPool &blockPool);
+
+	// Tiles already in cache go out as references.  The cache must only ever be used by this
+	// encoder, nullptr turns it off.
+	void SetTileCache(TileCache *cache) { m_Cache = cache; }
+
+	// dirtyTiles must be in ascending order.  timestamp is the capture time and diffedAfter how
+	// long after it the frame was diffed, see FrameUpdateHeader; the encode is stamped when done.
+	// fragmentSize is the payload budget of one fragment, not counting its header, raised for
+	// frames that might otherwise need more than k_MaxFragments.  The output points into this
+	// encoder's arenas and stays valid until the next call, or longer for fragments whose block
+	// was referenced.  False, with no fragments and no tiles in out, for a frame so large that
+	// even fragments of GetMaxFragmentSize() could run out of fragment numbers.
+	bool Encode(const FrameView &frame, std::span<const uint32_t> dirtyTiles, uint8_t quality, uint32_t frameId, uint32_t timestamp, uint32_t diffedAfter, uint32_t fragmentSize, EncodedFrame &out);
+	// Same, with a quality per dirty tile.
+	bool Encode(const FrameView &frame, std::span<const uint32_t> dirtyTiles, std::span<const uint8_t> tileQuality, uint32_t frameId, uint32_t timestamp, uint32_t diffedAfter, uint32_t fragmentSize, EncodedFrame &out);
+
+private:
+	struct ChunkFragments
+	{
+		uint32_t worker = 0;
+		uint32_t first = 0;
+		uint32_t count = 0;
+	};
+
+	void PlanCache(const FrameView &frame, const TileGrid &grid, std::span<const uint32_t> dirtyTiles, std::span<const uint8_t> tileQuality, uint32_t frameId);
+	void EncodeChunk(const FrameView &frame, const TileGrid &grid, std::span<const uint32_t> dirtyTiles, std::span<const uint8_t> tileQuality, uint32_t fragmentSize, uint32_t chunk, uint32_t worker);
+
+private:
+	WorkStealingPool &m_Pool;
+	ArenaBlockPool &m_BlockPool;
+	size_t m_BlockSize;
+	size_t m_LastFrameBlocks = 0; // the last frame's bytes in whole blocks
+	std::vector<EncodeArena> m_Arenas;						   // one per worker
+	std::vector<std::vector<EncodedFragment>> m_WorkerFragments; // one per worker
+	std::vector<ChunkFragments> m_Chunks;
+
+	TileCache *m_Cache = nullptr;
+	std::vector<uint64_t> m_Hashes;		// per dirty tile
+	std::vector<TileCacheOp> m_CacheOps; // per dirty tile, empty without a cache
+	std::vector<uint8_t> m_TileQuality;	 // per dirty tile, when encoding at one quality
+	std::vector<uint32_t> m_RecordSizes; // per dirty tile
+};
@@ -0,0 +1,182 @@
+#include "Playout.h"
+
+#include <cmath>
+#include <algorithm>
+
+#include "Blit.h"
+
+int64_t PlayoutScheduler::AddTransit(std::chrono::steady_clock::time_point arrived, uint32_t timestamp)
+{
+	const int64_t now = std::chrono::duration_cast<std::chrono::microseconds>(arrived.time_since_epoch()).count();
+	const int64_t captured = m_HasTimestamp ? m_Timestamp + (int32_t)(timestamp - (uint32_t)m_Timestamp) : timestamp;
+	const int64_t transit = now - captured;
+	m_Timestamp = captured;
+	m_HasTimestamp = true;
+
+	if (m_History.size() < k_HistoryFrames)
+		m_History.push_back(transit);
+	else
+		m_History[m_HistoryNext] = transit;
+	m_HistoryNext = (m_HistoryNext + 1) % k_HistoryFrames;
+	return transit;
+}
+
+std::chrono::steady_clock::time_point PlayoutScheduler::Schedule(std::chrono::steady_clock::time_point arrived, uint32_t timestamp)
+{
+	const int64_t transit = AddTransit(arrived, timestamp);
+
+	const double elapsed = m_HasFrame ? std::chrono::duration<double>(arrived - m_LastArrival).count() : 0.0;
+	if (m_HasFrame)
+		m_Jitter += ((double)std::abs(transit - m_Transit) - m_Jitter) / 16.0;
+	m_Transit = transit;
+	m_HasFrame = true;
+	m_LastArrival = arrived;
+
+	const int64_t fastest = *std::min_element(m_History.begin(), m_History.end());
+	m_Scratch.assign(m_History.begin(), m_History.end());
+	const size_t rank = (size_t)(k_DelayPercentile * (double)(m_Scratch.size() - 1));
+	std::nth_element(m_Scratch.begin(), m_Scratch.begin() + rank, m_Scratch.end());
+	const double wanted = std::min((double)(m_Scratch[rank] - fastest), (double)std::chrono::microseconds(k_MaxDelay).count());
+	if (wanted > m_TargetDelay)
+		m_TargetDelay = wanted;
+	else
+		m_TargetDelay = std::max(wanted, m_TargetDelay - elapsed * k_DelayDecay * 1e6);
+
+	auto release = arrived;
+	if (m_Mode == PlayoutMode::Smooth)
+	{
+		// How much sooner than the fastest frames this one would have to have come.
+		const int64_t wait = fastest + (int64_t)m_TargetDelay - transit;
+		if (wait < 0)
+			++m_LateFrames;
+		else
+			release += std::chrono::microseconds(wait);
+	}
+	release = std::max(release, m_LastScheduled);
+	m_LastScheduled = release;
+	return release;
+}
+
+void PlayoutBuffer::Capture(std::chrono::steady_clock::time_point now, FrameReassembler &reassembler)
+{
+	const FrameBuffer &source = reassembler.GetCanvas();
+	if (source.width != m_Canvas.width || source.height != m_Canvas.height)
+	{
+		// Nothing queued fits any more.  The canvas starts out blank like the reassembler's.
+		for (QueuedFrame &frame : m_Queue)
+			m_Free.push_back(std::move(frame));
+		m_Queue.clear();
+		m_ReleasedFrames = m_CompletedFrames;
+		m_Canvas = FrameBuffer();
+		m_Canvas.Resize(source.width, source.height);
+		m_Grid = TileGrid(source.width, source.height);
+		m_TileTaken.assign(m_Grid.GetTileCount(), 0);
+		m_Tiles.clear();
+		m_Dirty.Reset(source.width, source.height);
+		m_Dirty.AddAll();
+		m_Resized = true;
+	}
+
+	for (uint32_t tile : reassembler.GetUpdatedTiles())
+	{
+		if (tile < m_TileTaken.size() && !m_TileTaken[tile])
+		{
+			m_TileTaken[tile] = 1;
+			m_Tiles.push_back(tile);
+		}
+	}
+	reassembler.ClearUpdatedTiles();
+
+	// Every frame is scheduled, only the newest has its tiles still on the canvas.
+	const std::vector<FrameReassembler::CompletedFrame> &completed = reassembler.GetCompletedFrames();
+	if (!completed.empty())
+	{
+		std::chrono::steady_clock::time_point release;
+		for (const FrameReassembler::CompletedFrame &frame : completed)
+			release = m_Scheduler.Schedule(now, frame.timestamp);
+		m_CompletedFrames += completed.size();
+		reassembler.ClearCompletedFrames();
+		if (!m_Tiles.empty())
+			Enqueue(release, source);
+		else if (!m_Queue.empty())
+			m_Queue.back().completed = m_CompletedFrames;
+		else
+			m_ReleasedFrames = m_CompletedFrames;
+	}
+	else if (!m_Tiles.empty() && !reassembler.HasPendingFrames())
+	{
+		Enqueue(m_Queue.empty() ? now : m_Queue.back().release, source);
+	}
+
+	while (m_Queue.size() > k_MaxQueuedFrames)
+	{
+		Apply(m_Queue.front());
+		m_Free.push_back(std::move(m_Queue.front()));
+		m_Queue.erase(m_Queue.begin());
+	}
+}
+
+void PlayoutBuffer::Enqueue(std::chrono::steady_clock::time_point release, const FrameBuffer &source)
+{
+	QueuedFrame frame;
+	if (!m_Free.empty())
+	{
+		frame = std::move(m_Free.back());
+		m_Free.pop_back();
+	}
+	frame.release = release;
+	frame.completed = m_CompletedFrames;
+	frame.tiles.swap(m_Tiles);
+	m_Tiles.clear();
+
+	size_t bytes = 0;
+	for (uint32_t tile : frame.tiles)
+	{
+		const TileRect rect = m_Grid.GetTileRect(tile);
+		bytes += (size_t)rect.width * rect.height * k_BytesPerPixel;
+	}
+	frame.pixels.resize(bytes);
+
+	uint8_t *dst = frame.pixels.data();
+	for (uint32_t tile : frame.tiles)
+	{
+		m_TileTaken[tile] = 0;
+		const TileRect rect = m_Grid.GetTileRect(tile);
+		const size_t rowBytes = (size_t)rect.width * k_BytesPerPixel;
+		BlitRect(source.Row(rect.y) + (size_t)rect.x * k_BytesPerPixel, source.stride, dst, rowBytes, rect.width, rect.height);
+		dst += rowBytes * rect.height;
+	}
+	m_Queue.push_back(std::move(frame));
+}
+
+void PlayoutBuffer::Apply(QueuedFrame &frame)
+{
+	const uint8_t *src = frame.pixels.data();
+	for (uint32_t tile : frame.tiles)
+	{
+		const TileRect rect = m_Grid.GetTileRect(tile);
+		const size_t rowBytes = (size_t)rect.width * k_BytesPerPixel;
+		BlitRect(src, rowBytes, m_Canvas.Row(rect.y) + (size_t)rect.x * k_BytesPerPixel, m_Canvas.stride, rect.width, rect.height);
+		src += rowBytes * rect.height;
+		m_Dirty.AddTile(tile);
+	}
+	m_ReleasedFrames = std::max(m_ReleasedFrames, frame.completed);
+}
+
+bool PlayoutBuffer::Release(std::chrono::steady_clock::time_point now)
+{
+	size_t due = 0;
+	while (due < m_Queue.size() && m_Queue[due].release <= now)
+		Apply(m_Queue[due++]);
+	for (size_t i = 0; i < due; ++i)
+		m_Free.push_back(std::move(m_Queue[i]));
+	m_Queue.erase(m_Queue.begin(), m_Queue.begin() + due);
+	const bool resized = m_Resized;
+	m_Resized = false;
+	return due != 0 || resized;
+}
+
+std::chrono::steady_clock::time_point PlayoutBuffer::GetNextRelease() const
+{
+	return m_Queue.empty() ? std::chrono::steady_clock::time_point::max() : m_Queue.front().release;
+}
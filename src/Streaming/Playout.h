@@ -0,0 +1,138 @@
+#pragma once
+
+#include <cstdint>
+#include <chrono>
+#include <vector>
+
+#include "DirtyRegion.h"
+#include "Frame.h"
+#include "FrameReassembler.h"
+
+enum class PlayoutMode : uint8_t
+{
+	Smooth = 0, // held back by what the path jitters, shown at the pace they were captured
+	LowLatency, // shown as soon as they complete, however bursty
+};
+
+// Decides when a completed frame is shown.  Each frame carries the sender's clock at capture; the
+// difference to when it completed here is its transit time, up to an unknown clock offset.  The
+// fastest transit of the last k_HistoryFrames is what the path does without queueing, and a frame
+// is shown that long plus the target delay after it was captured.  The target delay covers
+// k_DelayPercentile of the recent transits, so all but the worst frames are shown at the pace they
+// were captured at, however they arrived.
+//
+// The target rises as soon as the path gets worse and falls by at most k_DelayDecay of wall time,
+// so one quiet moment doesn't undo it.  Taking the minimum over a window also follows the drift
+// between the two clocks.
+class PlayoutScheduler
+{
+public:
+	static constexpr uint32_t k_HistoryFrames = 128;
+	static constexpr double k_DelayPercentile = 0.95;
+	static constexpr std::chrono::milliseconds k_MaxDelay{200};
+	static constexpr double k_DelayDecay = 0.05; // seconds of delay shed per second
+
+	void SetMode(PlayoutMode mode) { m_Mode = mode; }
+	PlayoutMode GetMode() const { return m_Mode; }
+
+	// When the frame captured at timestamp, see FrameUpdateHeader, and complete at arrived should
+	// be shown.  Never earlier than arrived or than the frame scheduled before it.
+	std::chrono::steady_clock::time_point Schedule(std::chrono::steady_clock::time_point arrived, uint32_t timestamp);
+
+	// The sender's clock at timestamp, heard at arrived without a frame, see StreamKeepaliveHeader.
+	// Only its transit is taken in.
+	void AddKeepalive(std::chrono::steady_clock::time_point arrived, uint32_t timestamp) { AddTransit(arrived, timestamp); }
+
+	std::chrono::microseconds GetTargetDelay() const { return std::chrono::microseconds((int64_t)m_TargetDelay); }
+	// Mean difference in transit between consecutive frames, as RTP computes it.
+	std::chrono::microseconds GetJitter() const { return std::chrono::microseconds((int64_t)m_Jitter); }
+	// Frames that arrived after the time they should have been shown at.
+	uint64_t GetLateFrameCount() const { return m_LateFrames; }
+
+private:
+	// Unwraps timestamp and puts the transit into the history.
+	int64_t AddTransit(std::chrono::steady_clock::time_point arrived, uint32_t timestamp);
+
+private:
+	PlayoutMode m_Mode = PlayoutMode::Smooth;
+
+	int64_t m_Timestamp = 0; // unwrapped, of the last frame or keepalive
+	bool m_HasTimestamp = false;
+	int64_t m_Transit = 0; // of the last frame
+	bool m_HasFrame = false;
+	std::vector<int64_t> m_History; // transits, a ring of k_HistoryFrames
+	uint32_t m_HistoryNext = 0;
+	std::vector<int64_t> m_Scratch;
+
+	double m_Jitter = 0.0;		 // microseconds
+	double m_TargetDelay = 0.0; // microseconds
+	std::chrono::steady_clock::time_point m_LastArrival;
+	std::chrono::steady_clock::time_point m_LastScheduled;
+
+	uint64_t m_LateFrames = 0;
+};
+
+// Receive side jitter buffer.  The reassembler paints tiles as they arrive, so the tiles a
+// completed frame changed are copied out of its canvas right away and held until the
+// PlayoutScheduler says the frame is due; then they go onto a canvas of our own, the one that is
+// shown.  Tiles painted outside of a frame, by snapshots or by frames that were given up on, go
+// out with the next frame, or straight away when none is on its way.
+class PlayoutBuffer
+{
+public:
+	// Past this many frames waiting, the oldest is shown early.
+	static constexpr size_t k_MaxQueuedFrames = 32;
+
+	void SetMode(PlayoutMode mode) { m_Scheduler.SetMode(mode); }
+	const PlayoutScheduler &GetScheduler() const { return m_Scheduler; }
+	void AddKeepalive(std::chrono::steady_clock::time_point arrived, uint32_t timestamp) { m_Scheduler.AddKeepalive(arrived, timestamp); }
+
+	// Takes the frames reassembler completed and the tiles it painted since the last call.  Call
+	// after every message that may have painted something, before the next one paints over it.
+	void Capture(std::chrono::steady_clock::time_point now, FrameReassembler &reassembler);
+
+	// Puts the frames due by now onto the canvas.  True when that changed it, or when the canvas
+	// was resized since.
+	bool Release(std::chrono::steady_clock::time_point now);
+
+	// When Release() next has something to do, time_point::max() while nothing is waiting.
+	std::chrono::steady_clock::time_point GetNextRelease() const;
+
+	const FrameBuffer &GetCanvas() const { return m_Canvas; }
+
+	// What Release() changed on the canvas since the renderer last took it; all of it after a resize.
+	DirtyRegion &GetDirtyRegion() { return m_Dirty; }
+
+	size_t GetQueuedFrameCount() const { return m_Queue.size(); }
+
+	// Frames Capture() took from the reassembler so far, and how many of them made it onto the
+	// canvas.  A frame that changed no tiles is on it with the one before.
+	uint64_t GetCompletedFrameCount() const { return m_CompletedFrames; }
+	uint64_t GetReleasedFrameCount() const { return m_ReleasedFrames; }
+
+private:
+	struct QueuedFrame
+	{
+		std::chrono::steady_clock::time_point release;
+		uint64_t completed = 0; // m_CompletedFrames when it was queued
+		std::vector<uint32_t> tiles;
+		std::vector<uint8_t> pixels; // the tiles' rows, one after the other
+	};
+
+	void Enqueue(std::chrono::steady_clock::time_point release, const FrameBuffer &source);
+	void Apply(QueuedFrame &frame);
+
+private:
+	PlayoutScheduler m_Scheduler;
+	FrameBuffer m_Canvas;
+	TileGrid m_Grid;
+
+	std::vector<QueuedFrame> m_Queue; // in release order
+	std::vector<QueuedFrame> m_Free;  // for their buffers
+	std::vector<uint32_t> m_Tiles;	  // painted since the last frame was queued
+	std::vector<uint8_t> m_TileTaken;
+	DirtyRegion m_Dirty;
+	bool m_Resized = false;
+	uint64_t m_CompletedFrames = 0;
+	uint64_t m_ReleasedFrames = 0;
+};
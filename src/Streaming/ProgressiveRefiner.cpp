@@ -0,0 +1,121 @@
+#include "ProgressiveRefiner.h"
+
+#include <cassert>
+#include <cmath>
+#include <algorithm>
+
+#include "ParallelTileEncoder.h"
+
+void ProgressiveRefiner::SetRefineRate(double bytesPerSecond)
+{
+	m_RefineRate = bytesPerSecond;
+	if (m_RefineRate >= 0.0)
+		m_Credit = std::min(m_Credit, m_RefineRate * std::chrono::duration<double>(k_MaxBurst).count());
+}
+
+void ProgressiveRefiner::Reset(uint32_t tileCount)
+{
+	m_SentQuality.assign(tileCount, 0);
+	m_ChangedAt.assign(tileCount, std::chrono::steady_clock::time_point());
+	m_Refining.assign(tileCount, 0);
+	m_Candidates.reserve(tileCount);
+	m_Merged.reserve(tileCount);
+	m_Settled = false;
+}
+
+void ProgressiveRefiner::Plan(std::chrono::steady_clock::time_point now, std::vector<uint32_t> &changedTiles, std::span<const uint8_t> visible, std::span<const uint8_t> priority, uint8_t quality, std::vector<uint8_t> &tileQuality)
+{
+	const uint8_t changeQuality = std::min(m_ChangeQuality, quality);
+	const double elapsed = m_LastPlan == std::chrono::steady_clock::time_point() ? 0.0 : std::chrono::duration<double>(now - m_LastPlan).count();
+	m_LastPlan = now;
+	if (m_RefineRate >= 0.0)
+		m_Credit = std::min(m_Credit + m_RefineRate * elapsed, m_RefineRate * std::chrono::duration<double>(k_MaxBurst).count());
+
+	// Tiles sent below what the frame may use that have held still long enough, minus the ones
+	// changing right now.  Without credit to look for them, don't claim there are none.
+	m_Candidates.clear();
+	m_Settled = (m_RefineRate < 0.0 || m_Credit > 0.0) && (changedTiles.empty() || changeQuality >= quality);
+	if (m_RefineRate < 0.0 || m_Credit > 0.0)
+	{
+		size_t changed = 0;
+		for (uint32_t tile = 0; tile < m_SentQuality.size(); ++tile)
+		{
+			while (changed < changedTiles.size() && changedTiles[changed] < tile)
+				++changed;
+			if (m_SentQuality[tile] == 0 || m_SentQuality[tile] >= quality)
+				continue;
+			if ((changed < changedTiles.size() && changedTiles[changed] == tile) || (!visible.empty() && !visible[tile]))
+				continue;
+			if (now - m_ChangedAt[tile] < m_StaticTime)
+			{
+				m_Settled = false;
+				continue;
+			}
+			m_Candidates.push_back(tile);
+		}
+	}
+
+	if (m_RefineRate >= 0.0)
+	{
+		// The last one may overshoot, OnEncoded() takes it out of the next ones.
+		const size_t affordable = (size_t)std::ceil(m_Credit / m_BytesPerRefinement);
+		if (affordable < m_Candidates.size())
+		{
+			std::nth_element(m_Candidates.begin(), m_Candidates.begin() + affordable, m_Candidates.end(), [&](uint32_t a, uint32_t b)
+							 {
+								 if (!priority.empty() && priority[a] != priority[b])
+									 return priority[a] > priority[b];
+								 return m_ChangedAt[a] < m_ChangedAt[b];
+							 });
+			m_Candidates.resize(affordable);
+			std::sort(m_Candidates.begin(), m_Candidates.end());
+			m_Settled = false;
+		}
+	}
+
+	for (uint32_t tile : changedTiles)
+	{
+		assert(tile < m_SentQuality.size());
+		m_SentQuality[tile] = changeQuality;
+		m_ChangedAt[tile] = now;
+	}
+	for (uint32_t tile : m_Candidates)
+	{
+		m_SentQuality[tile] = quality;
+		m_Refining[tile] = 1;
+	}
+
+	// Not inplace_merge(), which allocates a buffer every call.
+	if (!m_Candidates.empty())
+	{
+		m_Merged.resize(changedTiles.size() + m_Candidates.size());
+		std::merge(changedTiles.begin(), changedTiles.end(), m_Candidates.begin(), m_Candidates.end(), m_Merged.begin());
+		changedTiles.assign(m_Merged.begin(), m_Merged.end());
+	}
+
+	tileQuality.resize(changedTiles.size());
+	for (size_t i = 0; i < changedTiles.size(); ++i)
+		tileQuality[i] = m_SentQuality[changedTiles[i]];
+}
+
+void ProgressiveRefiner::OnEncoded(const EncodedFrame &frame)
+{
+	uint64_t bytes = 0;
+	uint32_t count = 0;
+	for (size_t i = 0; i < frame.tiles.size(); ++i)
+	{
+		const uint32_t tile = frame.tiles[i];
+		if (tile >= m_Refining.size() || !m_Refining[tile])
+			continue;
+		m_Refining[tile] = 0;
+		bytes += frame.tileBytes[i];
+		++count;
+	}
+	if (count == 0)
+		return;
+
+	m_RefinedTiles += count;
+	if (m_RefineRate >= 0.0)
+		m_Credit -= (double)bytes;
+	m_BytesPerRefinement += 0.25 * ((double)bytes / count - m_BytesPerRefinement);
+}
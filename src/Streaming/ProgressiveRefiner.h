@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <chrono>
+#include <span>
+#include <vector>
+
+#include "TileCodec.h"
+
+struct EncodedFrame;
+
+// Two pass tile quality for one tile grid.  A tile that changes goes out at a cheap quality, so
+// what the user just did shows up as soon as possible, and is sent again at full quality once it
+// hasn't changed for the static time.  Refinements only use the bandwidth they are given; higher
+// priority tiles go first, then the ones static the longest.  A tile that changes again before
+// its turn simply starts over.
+class ProgressiveRefiner
+{
+public:
+	static constexpr std::chrono::milliseconds k_DefaultStaticTime{250};
+	static constexpr uint8_t k_DefaultChangeQuality = 4;
+	// Unused refine rate piles up for at most this long.
+	static constexpr std::chrono::milliseconds k_MaxBurst{100};
+
+	void SetStaticTime(std::chrono::milliseconds staticTime) { m_StaticTime = staticTime; }
+	// k_TileQualityLossless sends changes at full quality and never refines.
+	void SetChangeQuality(uint8_t quality) { m_ChangeQuality = quality; }
+	// Idle bandwidth refinements may use.  Negative, the default, doesn't limit them.
+	void SetRefineRate(double bytesPerSecond);
+
+	// Forgets every tile, e.g. for a new frame size.
+	void Reset(uint32_t tileCount);
+
+	// changedTiles, ascending, are about to be encoded.  Adds the refinements that are due to them,
+	// keeping them sorted, and fills tileQuality with the quality of each.  quality is the most the
+	// frame may use, refinements go up to it.  visible is per tile, empty when all are.  When not
+	// all refinements fit, higher priority ones go first, see TilePriority.h; empty is all equal.
+	void Plan(std::chrono::steady_clock::time_point now, std::vector<uint32_t> &changedTiles, std::span<const uint8_t> visible, std::span<const uint8_t> priority, uint8_t quality, std::vector<uint8_t> &tileQuality);
+
+	// Charges the refinements of frame, the encode of what Plan() returned, to the refine rate.
+	void OnEncoded(const EncodedFrame &frame);
+
+	// tile is part of the frame being encoded as a refinement, between Plan() and OnEncoded().
+	bool IsRefining(uint32_t tile) const { return m_Refining[tile] != 0; }
+
+	// After the last Plan() every visible tile is at its quality, or is being refined to it.  Until
+	// something changes, or the quality or what is visible does, there is nothing left to plan.
+	bool IsSettled() const { return m_Settled; }
+
+	uint64_t GetRefinedTileCount() const { return m_RefinedTiles; }
+
+private:
+	std::chrono::milliseconds m_StaticTime = k_DefaultStaticTime;
+	uint8_t m_ChangeQuality = k_DefaultChangeQuality;
+	double m_RefineRate = -1.0;
+	double m_Credit = 0.0; // bytes
+	double m_BytesPerRefinement = (double)(k_TileSize * k_TileSize); // guess until the first one
+	std::chrono::steady_clock::time_point m_LastPlan;
+	bool m_Settled = false;
+
+	std::vector<uint8_t> m_SentQuality; // per tile, 0 until it is sent
+	std::vector<std::chrono::steady_clock::time_point> m_ChangedAt; // per tile
+	std::vector<uint8_t> m_Refining; // per tile, part of the frame being encoded as a refinement
+	std::vector<uint32_t> m_Candidates;
+	std::vector<uint32_t> m_Merged; // changed tiles and candidates, scratch
+
+	uint64_t m_RefinedTiles = 0;
+};
@@ -0,0 +1,131 @@
+#include "RateController.h"
+
+#include <algorithm>
+#include <iterator>
+
+struct RateLevel
+{
+	uint32_t framesPerSecond;
+	uint8_t quality;
+	uint32_t layer;
+};
+
+// Frame rate goes first, down to where motion still reads as motion, then quality down to where
+// text is still legible.  A layer down is a quarter of the pixels, it starts out lossless again.
+static constexpr RateLevel k_Levels[] = {
+	{60, k_TileQualityLossless, 0},
+	{30, k_TileQualityLossless, 0},
+	{20, k_TileQualityLossless, 0},
+	{15, k_TileQualityLossless, 0},
+	{15, 7, 0},
+	{15, 6, 0},
+	{15, k_TileQualityLossless, 1},
+	{15, 7, 1},
+	{15, 6, 1},
+	{15, 5, 1},
+	{15, 6, 2},
+	{10, 5, 2},
+	{5, 4, 2},
+	{5, 3, 2},
+	{5, k_TileQualityMin, 2},
+};
+static constexpr uint32_t k_LevelCount = (uint32_t)std::size(k_Levels);
+
+// How fast the lowest seen ping is allowed to drift up, in milliseconds per second.
+static constexpr float k_BasePingDrift = 2.0f;
+// Seconds GetOfferedBytesPerSecond() averages over.
+static constexpr double k_OfferedWindow = 1.0;
+
+void RateController::Update(std::chrono::steady_clock::time_point now, const RateSample &sample)
+{
+	if (!m_Started)
+	{
+		m_Started = true;
+		m_LastUpdate = now;
+		m_LastStep = now;
+		ApplyLevel(m_Level);
+	}
+
+	// A frame on a slow path queues behind itself for a moment, only a queue that never empties
+	// over a whole interval is congestion.  Same for the ping.
+	int64_t queueDelayUs = sample.queueTimeUs;
+	if (sample.sendRateBytesPerSecond > 0)
+		queueDelayUs = std::max(queueDelayUs, (int64_t)sample.pendingBytes * 1000000 / sample.sendRateBytesPerSecond);
+	if (m_MinQueueDelayUs < 0 || queueDelayUs < m_MinQueueDelayUs)
+		m_MinQueueDelayUs = queueDelayUs;
+	if (sample.pingMs > 0 && (m_MinPingMs <= 0 || sample.pingMs < m_MinPingMs))
+		m_MinPingMs = sample.pingMs;
+
+	if (now - m_LastUpdate < k_UpdateInterval)
+		return;
+	const double elapsed = std::chrono::duration<double>(now - m_LastUpdate).count();
+	m_LastUpdate = now;
+	m_Offered += std::min(1.0, elapsed / k_OfferedWindow) * ((double)m_SentBytes / elapsed - m_Offered);
+	m_SentBytes = 0;
+
+	const int64_t standingQueueUs = m_MinQueueDelayUs;
+	const int64_t lastStandingQueueUs = m_LastStandingQueueUs;
+	const int pingMs = m_MinPingMs;
+	m_LastStandingQueueUs = standingQueueUs;
+	m_MinQueueDelayUs = -1;
+	m_MinPingMs = 0;
+
+	if (pingMs > 0)
+	{
+		if (m_BasePingMs < 0.0f || (float)pingMs < m_BasePingMs)
+			m_BasePingMs = (float)pingMs;
+		else
+			m_BasePingMs = std::min((float)pingMs, m_BasePingMs + k_BasePingDrift * (float)elapsed);
+	}
+
+	const double usable = k_Headroom * sample.sendRateBytesPerSecond;
+	m_Target.frameBytesPerSecond = usable;
+
+	const int64_t maxQueueDelayUs = std::chrono::microseconds(k_MaxQueueDelay).count();
+	const bool queueing = standingQueueUs > maxQueueDelayUs;
+	const bool pingRising = pingMs > 0 && (float)pingMs > m_BasePingMs + (float)k_MaxQueueDelay.count();
+	const bool losing = sample.deliveryRate >= 0.0f && sample.deliveryRate < k_MinDeliveryRate;
+
+	if (queueing || pingRising)
+	{
+		// Once the queue drains, the last step was enough, it just takes a moment to empty.
+		const bool draining = standingQueueUs < lastStandingQueueUs;
+		if (!draining && now - m_LastStep >= k_StepDownInterval)
+		{
+			// A queue several times over the limit won't drain a rung at a time.
+			const uint32_t steps = standingQueueUs > 4 * maxQueueDelayUs ? 2 : 1;
+			ApplyLevel(std::min(m_Level + steps, k_LevelCount - 1));
+			// A probe that failed right away will fail again, try less often.
+			if (m_Probing && now - m_LastStep < 2 * m_ProbeHold)
+				m_ProbeHold = std::min(2 * m_ProbeHold, k_MaxProbeInterval);
+			m_Probing = false;
+			m_LastStep = now;
+		}
+		m_Target.refreshBytesPerSecond = 0.0;
+		return;
+	}
+
+	// A higher frame rate scales what we send by about as much, don't step into a rate the path
+	// is already known not to carry.  What quality does depends on the content, that one is probed.
+	const double predicted = m_Level > 0 ? m_Offered * k_Levels[m_Level - 1].framesPerSecond / k_Levels[m_Level].framesPerSecond : m_Offered;
+	if (m_Probing && now - m_LastStep >= 2 * m_ProbeHold)
+	{
+		m_Probing = false;
+		m_ProbeHold = k_ProbeInterval;
+	}
+	if (m_Level > 0 && !losing && standingQueueUs < maxQueueDelayUs / 4 && predicted < usable && now - m_LastStep >= m_ProbeHold)
+	{
+		ApplyLevel(m_Level - 1);
+		m_Probing = true;
+		m_LastStep = now;
+	}
+	m_Target.refreshBytesPerSecond = std::max(0.0, usable - m_Offered);
+}
+
+void RateController::ApplyLevel(uint32_t level)
+{
+	m_Level = level;
+	m_Target.framesPerSecond = k_Levels[level].framesPerSecond;
+	m_Target.quality = k_Levels[level].quality;
+	m_Target.layer = k_Levels[level].layer;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstdint>
+#include <chrono>
+
+#include "TileCodec.h"
+
+// What the transport reports about one connection, see SteamNetConnectionRealTimeStatus_t.
+struct RateSample
+{
+	int pingMs = 0;
+	float deliveryRate = -1.0f; // share of packets delivered, < 0 while unknown
+	int sendRateBytesPerSecond = 0;
+	int pendingBytes = 0;		// queued locally, not sent yet
+	int64_t queueTimeUs = 0;	// how long a message sent now would wait
+};
+
+// Settings the sender should use for one peer.
+struct RateTarget
+{
+	uint8_t quality = k_TileQualityLossless;
+	uint32_t framesPerSecond = 60;
+	uint32_t layer = 0; // simulcast layer, see SimulcastEncoder
+	double frameBytesPerSecond = 0.0;	// what frames may use, 0 while unknown
+	double refreshBytesPerSecond = 0.0; // room left for snapshots and other catch up traffic
+};
+
+// Keeps what we send to one peer within what its path carries.  Congestion shows up as data
+// queueing in front of the connection or as the ping climbing above the lowest seen; either steps
+// the peer one rung down a ladder of frame rate, tile quality and resolution layer.  Once the path
+// has been clear for a while, it tries one rung up again.  Loss alone only stops it from stepping
+// up, random loss is what FEC and NACKs are for and shouldn't cost the peer its frame rate.  The
+// ladder gives up frame rate before quality, text that is readable but updates slowly beats
+// smooth but smeared text, and drops to a smaller layer before smearing it further.
+//
+// Call Update() every poll; it acts at most once per k_UpdateInterval.
+class RateController
+{
+public:
+	static constexpr std::chrono::milliseconds k_UpdateInterval{100};
+	// More queueing than this is congestion.
+	static constexpr std::chrono::milliseconds k_MaxQueueDelay{40};
+	// A step down needs this long to show in the queue before the next one.
+	static constexpr std::chrono::milliseconds k_StepDownInterval{300};
+	// Clear path needed before stepping up, and after any step down.
+	static constexpr std::chrono::milliseconds k_ProbeInterval{1000};
+	// Every probe that fails doubles the wait before the next one, up to this.
+	static constexpr std::chrono::milliseconds k_MaxProbeInterval{8000};
+	// Delivery below this holds the peer where it is.
+	static constexpr float k_MinDeliveryRate = 0.9f;
+	// Share of the send rate the frames may use before stepping up stops.
+	static constexpr double k_Headroom = 0.8;
+
+	void OnFrameSent(uint32_t bytes) { m_SentBytes += bytes; }
+
+	void Update(std::chrono::steady_clock::time_point now, const RateSample &sample);
+
+	const RateTarget &GetTarget() const { return m_Target; }
+	uint32_t GetLevel() const { return m_Level; }
+	// Bytes per second handed to OnFrameSent(), averaged over about a second.
+	double GetOfferedBytesPerSecond() const { return m_Offered; }
+
+private:
+	void ApplyLevel(uint32_t level);
+
+private:
+	uint32_t m_Level = 0;
+	RateTarget m_Target;
+
+	uint64_t m_SentBytes = 0;
+	double m_Offered = 0.0;
+	int64_t m_MinQueueDelayUs = -1; // over the current interval
+	int64_t m_LastStandingQueueUs = 0;
+	int m_MinPingMs = 0;
+	float m_BasePingMs = -1.0f; // lowest ping seen, creeps up so a route change is picked up
+	bool m_Started = false;
+	std::chrono::steady_clock::time_point m_LastUpdate;
+	std::chrono::steady_clock::time_point m_LastStep;
+	std::chrono::milliseconds m_ProbeHold = k_ProbeInterval;
+	bool m_Probing = false; // last step was up and hasn't held for long yet
+};
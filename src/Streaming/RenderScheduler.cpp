@@ -0,0 +1,35 @@
+#include "RenderScheduler.h"
+
+#include <algorithm>
+
+void RenderScheduler::RenderAt(std::chrono::steady_clock::time_point at)
+{
+	m_RenderAt = std::min(m_RenderAt, at);
+}
+
+bool RenderScheduler::ShouldRender(std::chrono::steady_clock::time_point now)
+{
+	bool render = m_Animating;
+	if (m_FramesLeft != 0)
+	{
+		--m_FramesLeft;
+		render = true;
+	}
+	if (m_RenderAt <= now)
+	{
+		m_RenderAt = std::chrono::steady_clock::time_point::max();
+		render = true;
+	}
+	if (render)
+		++m_RenderedFrames;
+	return render;
+}
+
+std::chrono::steady_clock::duration RenderScheduler::GetWaitTime(std::chrono::steady_clock::time_point now) const
+{
+	if (m_Animating || m_FramesLeft != 0 || m_RenderAt <= now)
+		return std::chrono::steady_clock::duration::zero();
+	if (m_RenderAt - now < m_PollInterval)
+		return m_RenderAt - now;
+	return m_PollInterval;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+#include <chrono>
+
+// Decides when the app's loop draws and presents a frame, and how long it may sleep otherwise.
+// A frame is drawn for input, for anything shown that changed, at times asked for in advance,
+// and every time while something animates.  In between the loop only wakes to poll the network,
+// every poll interval, or sooner when woken by a window message.
+class RenderScheduler
+{
+public:
+	// ImGui settles hover and focus a frame or two after the event that changed them.
+	static constexpr uint32_t k_FramesAfterInput = 3;
+	static constexpr std::chrono::milliseconds k_DefaultPollInterval{16};
+
+	// A window message arrived.
+	void OnInput() { m_FramesLeft = k_FramesAfterInput; }
+	// Something shown changed, draw it.
+	void Invalidate() { m_FramesLeft = m_FramesLeft != 0 ? m_FramesLeft : 1; }
+	// Draw no later than at, e.g. when the next remote frame is due.  time_point::max() is never.
+	void RenderAt(std::chrono::steady_clock::time_point at);
+	// Draw every frame while true.
+	void SetAnimating(bool animating) { m_Animating = animating; }
+	void SetPollInterval(std::chrono::steady_clock::duration interval) { m_PollInterval = interval; }
+	std::chrono::steady_clock::duration GetPollInterval() const { return m_PollInterval; }
+
+	// Whether to draw now.  Counts the frame as drawn when it says so.
+	bool ShouldRender(std::chrono::steady_clock::time_point now);
+
+	// How long the loop may sleep from now when ShouldRender() said no.
+	std::chrono::steady_clock::duration GetWaitTime(std::chrono::steady_clock::time_point now) const;
+
+	uint64_t GetRenderedFrameCount() const { return m_RenderedFrames; }
+
+private:
+	uint32_t m_FramesLeft = 1;
+	bool m_Animating = false;
+	std::chrono::steady_clock::time_point m_RenderAt = std::chrono::steady_clock::time_point::max();
+	std::chrono::steady_clock::duration m_PollInterval = k_DefaultPollInterval;
+
+	uint64_t m_RenderedFrames = 0;
+};
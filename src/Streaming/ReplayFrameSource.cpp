@@ -0,0 +1,143 @@
+#include "ReplayFrameSource.h"
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+#include "Blit.h"
+#include "TileCodec.h"
+
+ReplayFrameSource::ReplayFrameSource(const char *path, ReplaySpeed speed, bool loop)
+	: m_Speed(speed), m_Loop(loop)
+{
+	RecordingHeader header;
+	if (!m_File.Open(path) || m_File.GetSize() < sizeof(header))
+		return;
+	std::memcpy(&header, m_File.GetData(), sizeof(header));
+	if (std::memcmp(header.magic, RecordingHeader().magic, sizeof(header.magic)) != 0 || header.version != RecordingHeader().version ||
+		header.indexOffset == 0 || header.indexOffset % sizeof(uint64_t) != 0 ||
+		header.indexOffset > m_File.GetSize() || (m_File.GetSize() - header.indexOffset) / sizeof(uint64_t) < header.frameCount)
+	{
+		return;
+	}
+	m_Index = (const uint64_t *)(m_File.GetData() + header.indexOffset);
+
+	// Every record is checked once, the first has to be a keyframe to start from and a delta is
+	// painted onto a canvas the size of the keyframe before it.
+	m_FrameCount = header.frameCount;
+	uint32_t width = 0;
+	uint32_t height = 0;
+	for (uint32_t i = 0; i < header.frameCount; ++i)
+	{
+		const RecordedFrameHeader *record = GetRecord(i);
+		if (!record || (i == 0 && !record->keyframe) || (!record->keyframe && (record->width != width || record->height != height)))
+		{
+			m_FrameCount = 0;
+			return;
+		}
+		if (record->keyframe)
+		{
+			width = record->width;
+			height = record->height;
+		}
+	}
+}
+
+const RecordedFrameHeader *ReplayFrameSource::GetRecord(uint32_t index) const
+{
+	const uint64_t size = m_File.GetSize();
+	const uint64_t offset = m_Index[index];
+	if (offset % k_RecordingAlignment != 0 || offset > size || size - offset < sizeof(RecordedFrameHeader))
+		return nullptr;
+	const RecordedFrameHeader *record = (const RecordedFrameHeader *)(m_File.GetData() + offset);
+	if ((uint64_t)record->rectCount * sizeof(TileRect) > size - offset - sizeof(RecordedFrameHeader) ||
+		record->dataOffset % k_RecordingAlignment != 0 || record->dataOffset > size || record->dataSize > size - record->dataOffset)
+	{
+		return nullptr;
+	}
+	if (record->keyframe)
+		return record->dataSize == (uint64_t)record->width * record->height * k_BytesPerPixel ? record : nullptr;
+
+	// A TileCodec record per rect, filling the data exactly.
+	const uint8_t *data = m_File.GetData() + record->dataOffset;
+	uint64_t used = 0;
+	for (uint32_t i = 0; i < record->rectCount; ++i)
+	{
+		TileRecordHeader header;
+		if (record->dataSize - used < sizeof(header))
+			return nullptr;
+		std::memcpy(&header, data + used, sizeof(header));
+		used += sizeof(header);
+		if (header.payloadSize > record->dataSize - used)
+			return nullptr;
+		used += header.payloadSize;
+	}
+	return used == record->dataSize ? record : nullptr;
+}
+
+bool ReplayFrameSource::AcquireFrame(std::chrono::milliseconds timeout, CapturedFrame &frame)
+{
+	if (m_FrameCount == 0 || (m_Next == m_FrameCount && !m_Loop))
+	{
+		std::this_thread::sleep_for(timeout);
+		return false;
+	}
+	if (m_Next == m_FrameCount || m_Played == 0)
+	{
+		m_Next = 0;
+		m_Start = std::chrono::steady_clock::now();
+	}
+
+	const RecordedFrameHeader &record = *GetRecord(m_Next);
+	if (m_Speed == ReplaySpeed::Original)
+	{
+		const auto due = m_Start + std::chrono::microseconds(record.timestamp);
+		if (due - std::chrono::steady_clock::now() > timeout)
+		{
+			std::this_thread::sleep_for(timeout);
+			return false;
+		}
+		std::this_thread::sleep_until(due);
+	}
+	++m_Next;
+	++m_Played;
+
+	const uint8_t *data = m_File.GetData() + record.dataOffset;
+	frame.dirtyRects.clear();
+	frame.captured = std::chrono::steady_clock::now();
+	if (record.keyframe)
+	{
+		// Only copied should a delta follow.
+		m_Keyframe = data;
+		if (m_Canvas.width != record.width || m_Canvas.height != record.height)
+			m_Canvas.Resize(record.width, record.height);
+		frame.hasDirtyRects = false;
+		frame.view = {data, record.width, record.height, record.width * k_BytesPerPixel};
+		return true;
+	}
+
+	if (m_Keyframe)
+	{
+		BlitRect(m_Keyframe, m_Canvas.stride, m_Canvas.Row(0), m_Canvas.stride, m_Canvas.width, m_Canvas.height);
+		m_Keyframe = nullptr;
+	}
+	const TileRect *rects = (const TileRect *)(&record + 1);
+	for (uint32_t i = 0; i < record.rectCount; ++i)
+	{
+		const TileRect rect = ClipRecordedRect(rects[i], record.width, record.height);
+		TileRecordHeader header;
+		std::memcpy(&header, data, sizeof(header));
+		data += sizeof(header);
+		if (!TileCodec::Decode(header, data, rect, m_Canvas.Row(rect.y) + (size_t)rect.x * k_BytesPerPixel, m_Canvas.stride))
+		{
+			// Sizes were checked on open, the codec data wasn't.
+			m_FrameCount = 0;
+			return false;
+		}
+		data += header.payloadSize;
+		frame.dirtyRects.push_back(rect);
+	}
+	frame.hasDirtyRects = true;
+	frame.view = m_Canvas.GetView();
+	return true;
+}
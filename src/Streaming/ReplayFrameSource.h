@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <chrono>
+
+#include "FrameRecording.h"
+#include "MappedFile.h"
+
+enum class ReplaySpeed : uint8_t
+{
+	Original = 0, // each frame as long after the first as it was captured
+	Maximum,	  // as fast as frames are asked for
+};
+
+// Plays back a recording made by FrameRecorder, the same frames and dirty rects every run.  The
+// file is mapped: a keyframe is handed out where it lies, a delta is copied onto a canvas, only
+// its rects.  With loop set the recording starts over after its last frame, otherwise the source
+// has nothing more to give from then on.
+class ReplayFrameSource : public IFrameSource
+{
+public:
+	ReplayFrameSource(const char *path, ReplaySpeed speed, bool loop);
+
+	// False when the file isn't a complete recording, AcquireFrame() never has a frame then.
+	bool IsOpen() const { return m_FrameCount != 0; }
+
+	bool AcquireFrame(std::chrono::milliseconds timeout, CapturedFrame &frame) override;
+	void ReleaseFrame() override {}
+
+	uint32_t GetFrameCount() const { return m_FrameCount; }
+	// Frames handed out, over all loops.
+	uint64_t GetPlayedFrameCount() const { return m_Played; }
+
+private:
+	// The record of frame index, nullptr when it doesn't fit the file.
+	const RecordedFrameHeader *GetRecord(uint32_t index) const;
+
+private:
+	MappedFile m_File;
+	ReplaySpeed m_Speed;
+	bool m_Loop;
+	uint32_t m_FrameCount = 0;
+	const uint64_t *m_Index = nullptr;
+
+	uint32_t m_Next = 0;
+	std::chrono::steady_clock::time_point m_Start; // of the current loop
+	uint64_t m_Played = 0;
+
+	FrameBuffer m_Canvas;
+	const uint8_t *m_Keyframe = nullptr; // mapped pixels of the last keyframe, not yet on the canvas
+};
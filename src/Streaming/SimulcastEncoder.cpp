@@ -0,0 +1,253 @@
+#include "SimulcastEncoder.h"
+
+#include <cassert>
+#include <cstring>
+#include <algorithm>
+
+#include "Downscale.h"
+
+// A held back tile gains one priority level per this many frames.
+static constexpr uint32_t k_FramesPerPriorityLevel = 8;
+
+uint32_t GetSimulcastLayerForDisplay(uint32_t frameWidth, uint32_t frameHeight, uint32_t displayWidth, uint32_t displayHeight)
+{
+	if (displayWidth == 0 || displayHeight == 0)
+		return 0;
+
+	uint32_t layer = 0;
+	while (layer + 1 < k_SimulcastLayerCount && GetScaledSize(frameWidth, layer + 1) >= displayWidth && GetScaledSize(frameHeight, layer + 1) >= displayHeight)
+		++layer;
+	return layer;
+}
+
+SimulcastEncoder::SimulcastEncoder(WorkStealingPool &pool, ArenaBlockPool &blockPool)
+	: m_Pool(pool)
+{
+	for (uint32_t layer = 0; layer < k_SimulcastLayerCount; ++layer)
+		m_Layers.push_back(std::make_unique<Layer>(pool, blockPool));
+}
+
+void SimulcastEncoder::Resize(uint32_t width, uint32_t height)
+{
+	m_Width = width;
+	m_Height = height;
+	for (uint32_t layer = 0; layer < k_SimulcastLayerCount; ++layer)
+	{
+		Layer &l = *m_Layers[layer];
+		l.grid = TileGrid(GetScaledSize(width, layer), GetScaledSize(height, layer));
+		if (layer != 0)
+			l.buffer.Resize(l.grid.GetWidth(), l.grid.GetHeight());
+		// Nothing of the new size has been sent yet.
+		l.pending.assign(l.grid.GetTileCount(), 1);
+		l.refiner.Reset(l.grid.GetTileCount());
+		l.settled = false;
+		// Records are about packed lossless size until a tile has been encoded.
+		l.recordSize.assign(l.grid.GetTileCount(), k_TileSize * k_TileSize * 3);
+		l.waited.assign(l.grid.GetTileCount(), 0);
+		l.dirtyTiles.reserve(l.grid.GetTileCount());
+		l.tileQuality.reserve(l.grid.GetTileCount());
+		UpdateVisibleTiles(l);
+	}
+	m_FocusChanged = true;
+}
+
+void SimulcastEncoder::SetFocus(const FrameFocus &focus)
+{
+	// Not memcmp(), the padding after hasCursor is anything.
+	if (focus.hasCursor == m_Focus.hasCursor && focus.cursorX == m_Focus.cursorX && focus.cursorY == m_Focus.cursorY && focus.window.x == m_Focus.window.x &&
+		focus.window.y == m_Focus.window.y && focus.window.width == m_Focus.window.width && focus.window.height == m_Focus.window.height)
+		return;
+	m_Focus = focus;
+	m_FocusChanged = true;
+}
+
+void SimulcastEncoder::SetViewports(uint32_t layer, std::span<const ViewportRect> viewports)
+{
+	Layer &l = *m_Layers[layer];
+	if (viewports.size() == l.viewports.size() && std::equal(viewports.begin(), viewports.end(), l.viewports.begin(), [](const ViewportRect &a, const ViewportRect &b)
+																 { return std::memcmp(&a, &b, sizeof(a)) == 0; }))
+	{
+		return;
+	}
+	l.viewports.assign(viewports.begin(), viewports.end());
+	UpdateVisibleTiles(l);
+	l.settled = false;
+}
+
+void SimulcastEncoder::UpdateVisibleTiles(Layer &layer)
+{
+	const TileGrid &grid = layer.grid;
+	if (layer.viewports.empty() || grid.GetTileCount() == 0)
+	{
+		layer.visible.clear();
+		return;
+	}
+
+	layer.visible.assign(grid.GetTileCount(), 0);
+	for (const ViewportRect &rect : layer.viewports)
+	{
+		// Any tile the rectangle touches, rounding outwards.
+		const uint32_t left = (uint32_t)((uint64_t)rect.left * grid.GetWidth() / 0xFFFF);
+		const uint32_t top = (uint32_t)((uint64_t)rect.top * grid.GetHeight() / 0xFFFF);
+		const uint32_t right = (uint32_t)(((uint64_t)rect.right * grid.GetWidth() + 0xFFFE) / 0xFFFF);
+		const uint32_t bottom = (uint32_t)(((uint64_t)rect.bottom * grid.GetHeight() + 0xFFFE) / 0xFFFF);
+		if (right <= left || bottom <= top)
+			continue;
+
+		const uint32_t lastColumn = std::min(grid.GetColumns() - 1, (right - 1) / k_TileSize);
+		const uint32_t lastRow = std::min(grid.GetRows() - 1, (bottom - 1) / k_TileSize);
+		for (uint32_t row = top / k_TileSize; row <= lastRow; ++row)
+		{
+			for (uint32_t column = left / k_TileSize; column <= lastColumn; ++column)
+				layer.visible[row * grid.GetColumns() + column] = 1;
+		}
+	}
+}
+
+void SimulcastEncoder::ApplyByteBudget(Layer &layer)
+{
+	std::vector<uint32_t> &tiles = layer.dirtyTiles;
+	size_t total = 0;
+	for (uint32_t tile : tiles)
+		total += layer.recordSize[tile];
+	if (total <= layer.byteBudget)
+	{
+		for (uint32_t tile : tiles)
+			layer.waited[tile] = 0;
+		return;
+	}
+
+	// Tiles under the cursor go no matter what, so they go first.  The others are ranked by
+	// priority plus how long they have waited, which lets held back tiles catch up.
+	const auto rank = [&](uint32_t tile)
+	{
+		if (layer.priority[tile] >= k_TilePriorityCursor)
+			return UINT32_MAX;
+		return layer.priority[tile] * k_FramesPerPriorityLevel + layer.waited[tile];
+	};
+	// Ties in tile order, as stable_sort() would have them, without the buffer it allocates.
+	std::sort(tiles.begin(), tiles.end(), [&](uint32_t a, uint32_t b)
+			  {
+				  if (rank(a) != rank(b))
+					  return rank(a) > rank(b);
+				  if (layer.priority[a] != layer.priority[b])
+					  return layer.priority[a] > layer.priority[b];
+				  return a < b;
+			  });
+
+	// Held back tiles stay pending for the next frame.
+	size_t used = 0;
+	size_t kept = 0;
+	for (uint32_t tile : tiles)
+	{
+		if (kept != 0 && layer.priority[tile] < k_TilePriorityCursor && used + layer.recordSize[tile] > layer.byteBudget)
+		{
+			layer.waited[tile] = (uint16_t)std::min<uint32_t>(layer.waited[tile] + 1, 0xFFFF);
+			++layer.deferredTiles;
+			continue;
+		}
+		used += layer.recordSize[tile];
+		layer.waited[tile] = 0;
+		tiles[kept++] = tile;
+	}
+	tiles.resize(kept);
+	std::sort(tiles.begin(), tiles.end());
+}
+
+void SimulcastEncoder::AddDirtyTiles(uint32_t layer, std::span<const uint32_t> tiles)
+{
+	std::vector<uint8_t> &pending = m_Layers[layer]->pending;
+	for (uint32_t tile : tiles)
+	{
+		if (tile < pending.size())
+		{
+			pending[tile] = 1;
+			m_Layers[layer]->settled = false;
+		}
+	}
+}
+
+bool SimulcastEncoder::IsIdle(uint32_t layerMask, std::span<const uint8_t, k_SimulcastLayerCount> quality) const
+{
+	for (uint32_t layer = 0; layer < k_SimulcastLayerCount; ++layer)
+	{
+		const Layer &l = *m_Layers[layer];
+		if ((layerMask & (1u << layer)) && (!l.settled || l.settledQuality != quality[layer]))
+			return false;
+	}
+	return true;
+}
+
+void SimulcastEncoder::Encode(std::chrono::steady_clock::time_point now, std::chrono::steady_clock::time_point diffed, const FrameView &frame, std::span<const uint32_t> dirtyTiles, uint32_t layerMask, std::span<const uint8_t, k_SimulcastLayerCount> quality, uint32_t frameId, uint32_t fragmentSize)
+{
+	if (frame.width != m_Width || frame.height != m_Height)
+		Resize(frame.width, frame.height);
+	if (m_FocusChanged)
+	{
+		for (uint32_t layer = 0; layer < k_SimulcastLayerCount; ++layer)
+			BuildTilePriorities(m_Layers[layer]->grid, layer, m_Focus, m_Layers[layer]->priority);
+		m_FocusChanged = false;
+	}
+
+	const uint32_t timestamp = GetWireTimestamp(now);
+	const uint32_t diffedAfter = GetWireTimestamp(diffed) - timestamp;
+
+	// A source tile lands in exactly one tile of every layer, layer tiles cover 2^n source tiles a side.
+	const TileGrid grid(frame.width, frame.height);
+	for (uint32_t layer = 0; layer < k_SimulcastLayerCount; ++layer)
+	{
+		Layer &l = *m_Layers[layer];
+		l.settled = l.settled && dirtyTiles.empty();
+		for (uint32_t tile : dirtyTiles)
+		{
+			const uint32_t column = (tile % grid.GetColumns()) >> layer;
+			const uint32_t row = (tile / grid.GetColumns()) >> layer;
+			l.pending[row * l.grid.GetColumns() + column] = 1;
+		}
+	}
+
+	for (uint32_t layer = 0; layer < k_SimulcastLayerCount; ++layer)
+	{
+		if (!(layerMask & (1u << layer)))
+			continue;
+
+		Layer &l = *m_Layers[layer];
+		l.dirtyTiles.clear();
+		for (uint32_t tile = 0; tile < l.pending.size(); ++tile)
+		{
+			if (l.pending[tile] && (l.visible.empty() || l.visible[tile]))
+				l.dirtyTiles.push_back(tile);
+		}
+		const size_t wanted = l.dirtyTiles.size();
+		if (l.byteBudget != 0)
+			ApplyByteBudget(l);
+		const bool deferred = l.dirtyTiles.size() < wanted;
+		for (uint32_t tile : l.dirtyTiles)
+			l.pending[tile] = 0;
+		l.refiner.Plan(now, l.dirtyTiles, l.visible, l.priority, quality[layer], l.tileQuality);
+		l.settled = !deferred && l.refiner.IsSettled();
+		l.settledQuality = quality[layer];
+
+		if (layer != 0)
+		{
+			// Refinements are of tiles that haven't changed since, the buffer still has them.
+			m_Pool.ParallelFor((uint32_t)l.dirtyTiles.size(), [&](uint32_t i, uint32_t)
+							   { if (!l.refiner.IsRefining(l.dirtyTiles[i])) Downscale(frame, layer, l.grid.GetTileRect(l.dirtyTiles[i]), l.buffer); });
+		}
+		// A frame with too many tiles to number its fragments sends the first half of them, the
+		// rest wait for the next.
+		while (!l.encoder.Encode(layer == 0 ? frame : l.buffer.GetView(), l.dirtyTiles, l.tileQuality, frameId, timestamp, diffedAfter, fragmentSize, l.frame))
+		{
+			const size_t kept = l.dirtyTiles.size() / 2;
+			for (size_t i = kept; i < l.dirtyTiles.size(); ++i)
+				l.pending[l.dirtyTiles[i]] = 1;
+			l.dirtyTiles.resize(kept);
+			l.tileQuality.resize(kept);
+			l.settled = false;
+		}
+		l.refiner.OnEncoded(l.frame);
+		for (size_t i = 0; i < l.frame.tiles.size(); ++i)
+			l.recordSize[l.frame.tiles[i]] = l.frame.tileBytes[i];
+		l.fec.Protect(l.frame, l.fecConfig);
+	}
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <cstdint>
+#include <chrono>
+#include <memory>
+#include <span>
+#include <vector>
+
+#include "Fec.h"
+#include "Frame.h"
+#include "ParallelTileEncoder.h"
+#include "ProgressiveRefiner.h"
+#include "TilePriority.h"
+#include "TileCache.h"
+#include "WireFormat.h"
+
+// Full, half and quarter resolution.
+constexpr uint32_t k_SimulcastLayerCount = 3;
+
+// Lowest resolution layer that still has at least the pixels of a width x height display, for a
+// frameWidth x frameHeight frame.  0 while the display size is unknown.
+uint32_t GetSimulcastLayerForDisplay(uint32_t frameWidth, uint32_t frameHeight, uint32_t displayWidth, uint32_t displayHeight);
+
+// Encodes a frame once per resolution layer that has viewers.  Layer n is the frame box filtered
+// down by 2^n and has its own tile grid, TileCache and encoder, so a layer's stream stands on its
+// own.  Tiles a layer doesn't encode are remembered for it and go into its next encode, downscaled
+// from the screen as it is then; a layer nobody watched for a while catches up in one frame and
+// never does any work in between.  The same goes for tiles outside every viewport of a layer,
+// they are encoded once they scroll into view.  Every layer refines its tiles on its own, see
+// ProgressiveRefiner.
+//
+// A layer can be given a byte budget per frame.  When its changed tiles don't fit, the ones near
+// the cursor and in the foreground window go first and the rest wait for a later frame, so the
+// clock in the corner is what ends up late.  Waiting raises a tile's priority, nothing starves.
+class SimulcastEncoder
+{
+public:
+	SimulcastEncoder(WorkStealingPool &pool, ArenaBlockPool &blockPool);
+
+	// More tiles for one layer's next encode, of its own grid, e.g. from its TileRefreshScheduler.
+	void AddDirtyTiles(uint32_t layer, std::span<const uint32_t> tiles);
+
+	// Limits layer's encodes to the tiles under viewports.  Empty, the default, is the whole frame.
+	void SetViewports(uint32_t layer, std::span<const ViewportRect> viewports);
+
+	// Cursor and foreground window of the frames that follow, they set the tile priorities.
+	void SetFocus(const FrameFocus &focus);
+
+	// Parity layer's frames carry, see FecEncoder.  FecScheme::None, the default, adds none.
+	void SetFecConfig(uint32_t layer, const FecConfig &config) { m_Layers[layer]->fecConfig = config; }
+
+	// Bytes of changed tiles layer's encodes may use per frame, refinements are budgeted by their
+	// ProgressiveRefiner.  Tiles under the cursor always go.  0, the default, doesn't limit them.
+	void SetByteBudget(uint32_t layer, size_t bytesPerFrame) { m_Layers[layer]->byteBudget = bytesPerFrame; }
+
+	// dirtyTiles of frame, ascending.  Only layers in layerMask are encoded, each at most at its
+	// quality; changed tiles start lower and are refined up to it later.  now should be when frame
+	// was captured, the frames carry it for the viewers' playout, and diffed when it was diffed.
+	void Encode(std::chrono::steady_clock::time_point now, std::chrono::steady_clock::time_point diffed, const FrameView &frame, std::span<const uint32_t> dirtyTiles, uint32_t layerMask, std::span<const uint8_t, k_SimulcastLayerCount> quality, uint32_t frameId, uint32_t fragmentSize);
+
+	// Whether an Encode() of no changed tiles would send nothing on the layers in layerMask at
+	// quality: nothing waits to be encoded in view, nothing is held back by the byte budget and
+	// nothing is left to refine.  A static screen is then not worth encoding at all.
+	bool IsIdle(uint32_t layerMask, std::span<const uint8_t, k_SimulcastLayerCount> quality) const;
+
+	// Valid after an Encode() that included layer, until the next one.  Its parity included.
+	EncodedFrame &GetFrame(uint32_t layer) { return m_Layers[layer]->frame; }
+	TileCache &GetTileCache(uint32_t layer) { return m_Layers[layer]->cache; }
+	ProgressiveRefiner &GetRefiner(uint32_t layer) { return m_Layers[layer]->refiner; }
+	// Changed tiles held back by the byte budget so far.
+	uint64_t GetDeferredTileCount(uint32_t layer) const { return m_Layers[layer]->deferredTiles; }
+	uint32_t GetLayerWidth(uint32_t layer) const { return m_Layers[layer]->grid.GetWidth(); }
+	uint32_t GetLayerHeight(uint32_t layer) const { return m_Layers[layer]->grid.GetHeight(); }
+
+private:
+	struct Layer
+	{
+		Layer(WorkStealingPool &pool, ArenaBlockPool &blockPool)
+			: encoder(pool, blockPool), fec(blockPool)
+		{
+			encoder.SetTileCache(&cache);
+			fecConfig.scheme = FecScheme::None;
+		}
+
+		FrameBuffer buffer; // downscaled screen, layers above 0 only
+		TileGrid grid;
+		TileCache cache;
+		ParallelTileEncoder encoder;
+		EncodedFrame frame;
+		FecEncoder fec;
+		FecConfig fecConfig;
+		std::vector<uint8_t> pending; // per tile
+		std::vector<ViewportRect> viewports;
+		std::vector<uint8_t> visible; // per tile, empty when all are
+		ProgressiveRefiner refiner;
+		std::vector<uint32_t> dirtyTiles;
+		std::vector<uint8_t> tileQuality; // per dirty tile
+
+		size_t byteBudget = 0;
+		std::vector<uint8_t> priority;	   // per tile
+		std::vector<uint32_t> recordSize; // per tile, of its last encode
+		std::vector<uint16_t> waited;	   // per tile, frames it was held back
+		uint64_t deferredTiles = 0;
+
+		// Nothing in view was left pending by the last encode, at settledQuality, see IsIdle().
+		bool settled = false;
+		uint8_t settledQuality = 0;
+	};
+
+	void Resize(uint32_t width, uint32_t height);
+	static void UpdateVisibleTiles(Layer &layer);
+	// Cuts layer.dirtyTiles down to its byte budget, by priority.
+	static void ApplyByteBudget(Layer &layer);
+
+private:
+	WorkStealingPool &m_Pool;
+	std::vector<std::unique_ptr<Layer>> m_Layers;
+	uint32_t m_Width = 0;
+	uint32_t m_Height = 0;
+	FrameFocus m_Focus;
+	bool m_FocusChanged = false;
+};
@@ -0,0 +1,108 @@
+#include "SnapshotCanvas.h"
+
+#include <cstring>
+
+#include "Frame.h"
+
+void SnapshotCanvas::Update(const EncodedFrame &frame)
+{
+	if (frame.width != m_Width || frame.height != m_Height)
+	{
+		m_Width = frame.width;
+		m_Height = frame.height;
+		m_Tiles.clear();
+		m_Tiles.resize(TileGrid(frame.width, frame.height).GetTileCount());
+	}
+
+	m_FrameId = frame.frameId;
+
+	// Fragments hold nothing but records, back to back.
+	m_Stream.clear();
+	for (const EncodedFragment &fragment : frame.fragments)
+		m_Stream.insert(m_Stream.end(), fragment.data + sizeof(FrameUpdateHeader), fragment.data + fragment.size);
+
+	size_t offset = 0;
+	while (m_Stream.size() - offset >= sizeof(TileRecordHeader))
+	{
+		TileRecordHeader header;
+		std::memcpy(&header, m_Stream.data() + offset, sizeof(header));
+		offset += sizeof(header);
+		if (m_Stream.size() - offset < header.payloadSize)
+			break;
+		const uint8_t *payload = m_Stream.data() + offset;
+		offset += header.payloadSize;
+
+		if (header.tileIndex >= m_Tiles.size())
+			continue;
+
+		if (header.codec != (uint8_t)TileCodecId::CacheRef)
+		{
+			Store(frame.frameId, header, payload);
+			continue;
+		}
+
+		// Same content as the record that stored the slot.
+		if (header.cacheSlot >= m_CacheSlots.size() || !m_CacheSlots[header.cacheSlot].valid)
+		{
+			m_Tiles[header.tileIndex].valid = false;
+			continue;
+		}
+		const Record &stored = m_CacheSlots[header.cacheSlot];
+		TileRecordHeader resolved = stored.header;
+		resolved.tileIndex = header.tileIndex;
+		Store(frame.frameId, resolved, stored.payload.data());
+	}
+}
+
+void SnapshotCanvas::Store(uint32_t frameId, const TileRecordHeader &header, const uint8_t *payload)
+{
+	Record &tile = m_Tiles[header.tileIndex];
+	tile.valid = true;
+	tile.frameId = frameId;
+	tile.header = header;
+	tile.header.cacheSlot = k_NoCacheSlot;
+	tile.payload.assign(payload, payload + header.payloadSize);
+
+	if (header.cacheSlot == k_NoCacheSlot)
+		return;
+	if (header.cacheSlot >= m_CacheSlots.size())
+		m_CacheSlots.resize((size_t)header.cacheSlot + 1);
+	Record &slot = m_CacheSlots[header.cacheSlot];
+	slot.valid = true;
+	slot.frameId = frameId;
+	slot.header = tile.header;
+	slot.payload.assign(payload, payload + header.payloadSize);
+}
+
+bool SnapshotCanvas::WriteMessage(uint32_t stream, uint32_t &nextTile, uint32_t maxBytes, std::vector<uint8_t> &message) const
+{
+	SnapshotHeader header;
+	header.stream = (uint8_t)stream;
+	header.frameWidth = (uint16_t)m_Width;
+	header.frameHeight = (uint16_t)m_Height;
+	header.frameId = m_FrameId;
+	message.resize(sizeof(header));
+
+	for (; nextTile < m_Tiles.size() && header.recordCount < 0xFFFF; ++nextTile)
+	{
+		const Record &tile = m_Tiles[nextTile];
+		if (!tile.valid)
+			continue;
+
+		const size_t recordSize = sizeof(tile.frameId) + sizeof(tile.header) + tile.payload.size();
+		if (header.recordCount != 0 && message.size() + recordSize > maxBytes)
+			break;
+
+		const size_t offset = message.size();
+		message.resize(offset + recordSize);
+		std::memcpy(message.data() + offset, &tile.frameId, sizeof(tile.frameId));
+		std::memcpy(message.data() + offset + sizeof(tile.frameId), &tile.header, sizeof(tile.header));
+		std::memcpy(message.data() + offset + sizeof(tile.frameId) + sizeof(tile.header), tile.payload.data(), tile.payload.size());
+		++header.recordCount;
+	}
+
+	if (header.recordCount == 0)
+		return false;
+	std::memcpy(message.data(), &header, sizeof(header));
+	return true;
+}
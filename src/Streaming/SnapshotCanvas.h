@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "ParallelTileEncoder.h"
+#include "WireFormat.h"
+
+// The last encoded record of every tile position, kept by the sender so a viewer that joins late
+// can be sent the current screen without encoding anything, and without touching the stream the
+// other viewers get.  Cache references are resolved to the record they stand for.
+//
+// Per tile and per cache slot buffers keep their capacity, after warm-up Update() only copies.
+class SnapshotCanvas
+{
+public:
+	// Call with every frame that goes out, in order, after FEC has stamped the headers.
+	void Update(const EncodedFrame &frame);
+
+	uint32_t GetWidth() const { return m_Width; }
+	uint32_t GetHeight() const { return m_Height; }
+	uint32_t GetTileCount() const { return (uint32_t)m_Tiles.size(); }
+
+	// Fills message with a Snapshot of the tiles from nextTile on, up to about maxBytes but at
+	// least one record, and advances nextTile.  Returns false once nextTile reached the end.
+	bool WriteMessage(uint32_t stream, uint32_t &nextTile, uint32_t maxBytes, std::vector<uint8_t> &message) const;
+
+private:
+	struct Record
+	{
+		bool valid = false;
+		uint32_t frameId = 0;
+		TileRecordHeader header;
+		std::vector<uint8_t> payload;
+	};
+
+	void Store(uint32_t frameId, const TileRecordHeader &header, const uint8_t *payload);
+
+private:
+	uint32_t m_Width = 0;
+	uint32_t m_Height = 0;
+	uint32_t m_FrameId = 0;
+	std::vector<Record> m_Tiles;
+	std::vector<Record> m_CacheSlots;
+	std::vector<uint8_t> m_Stream; // one frame's records, stitched back together
+};
@@ -0,0 +1,34 @@
+#include "StreamDecodePool.h"
+
+StreamDecodePool::StreamDecodePool(uint32_t threadCount)
+	: m_Pool(threadCount)
+{
+}
+
+void StreamDecodePool::Run(const std::vector<FrameReceiver *> &streams, std::chrono::steady_clock::time_point deadline)
+{
+	m_Active.clear();
+	for (FrameReceiver *stream : streams)
+	{
+		if (stream->HasQueuedMessages())
+			m_Active.push_back(stream);
+	}
+
+	while (!m_Active.empty())
+	{
+		m_Pool.ParallelFor((uint32_t)m_Active.size(), [this](uint32_t taskIndex, uint32_t)
+						   { m_Active[taskIndex]->DecodeQueued(k_QuantumBytes); });
+		++m_Rounds;
+
+		size_t kept = 0;
+		for (FrameReceiver *stream : m_Active)
+		{
+			if (stream->HasQueuedMessages())
+				m_Active[kept++] = stream;
+		}
+		m_Active.resize(kept);
+
+		if (std::chrono::steady_clock::now() >= deadline)
+			break;
+	}
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "FrameReceiver.h"
+#include "WorkStealingPool.h"
+
+// Decodes the screens of several peers side by side.  Their messages are queued on each
+// FrameReceiver as they are received, and Run() hands every stream with messages waiting to the
+// pool as one task per round.  A task decodes k_QuantumBytes of its stream's messages, deficit
+// round robin, so a round takes about as long as the largest quantum and a stream sending a lot,
+// like a 4K desktop that is scrolling, can't hold back one that sends little: its backlog waits
+// for the next call instead.  Each stream paints its own canvas, so tasks never share one.
+class StreamDecodePool
+{
+public:
+	// About a hundred fragments, enough that a round isn't all scheduling.
+	static constexpr uint32_t k_QuantumBytes = 128 * 1024;
+
+	explicit StreamDecodePool(uint32_t threadCount = std::thread::hardware_concurrency());
+
+	// Runs rounds until no stream has messages queued or deadline has passed.  Every stream gets
+	// at least one round.
+	void Run(const std::vector<FrameReceiver *> &streams, std::chrono::steady_clock::time_point deadline);
+
+	uint32_t GetWorkerCount() const { return m_Pool.GetWorkerCount(); }
+	uint64_t GetRoundCount() const { return m_Rounds; }
+
+private:
+	WorkStealingPool m_Pool;
+	std::vector<FrameReceiver *> m_Active;
+	uint64_t m_Rounds = 0;
+};
@@ -0,0 +1,459 @@
+#include "SyntheticFrameSource.h"
+
+#include <cmath>
+#include <utility>
+#include <thread>
+
+static constexpr uint32_t k_BandHeight = 48;
+static constexpr uint32_t k_CounterWidth = 64;
+static constexpr uint32_t k_CounterHeight = 16;
+
+static constexpr uint32_t k_GlyphWidth = 8;
+static constexpr uint32_t k_GlyphHeight = 16;
+static constexpr uint32_t k_TitleHeight = 24;
+static constexpr uint32_t k_WindowMargin = 8;
+static constexpr uint32_t k_CaretWidth = 2;
+static constexpr uint32_t k_CaretBlinkFrames = 32; // about half a second at 60 frames per second
+static constexpr uint32_t k_ScrollStep = 4;		   // pixels per frame
+static constexpr uint32_t k_DragStepX = 12;
+static constexpr uint32_t k_DragStepY = 6;
+
+static constexpr uint32_t k_BorderColour = 0xFF505050u;
+static constexpr uint32_t k_PaperColour = 0xFFFFFFFFu;
+static constexpr uint32_t k_InkColour = 0xFF1E1E1Eu;
+static constexpr uint32_t k_TerminalColour = 0xFF101010u;
+static constexpr uint32_t k_TerminalInkColour = 0xFFD0D0D0u;
+
+static uint32_t Mix(uint32_t x)
+{
+	x ^= x >> 16;
+	x *= 0x7FEB352Du;
+	x ^= x >> 15;
+	x *= 0x846CA68Bu;
+	x ^= x >> 16;
+	return x;
+}
+
+static uint32_t XorShift(uint32_t &state)
+{
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state;
+}
+
+// Back and forth over [0, range].
+static uint32_t Bounce(uint64_t position, uint32_t range)
+{
+	if (range == 0)
+		return 0;
+	const uint32_t phase = (uint32_t)(position % (2ull * range));
+	return phase <= range ? phase : 2 * range - phase;
+}
+
+static void SetPixel(uint8_t *row, uint32_t x, uint32_t pixel)
+{
+	std::memcpy(row + (size_t)x * k_BytesPerPixel, &pixel, sizeof(pixel));
+}
+
+static uint32_t GetTextColumns(uint32_t windowWidth)
+{
+	return windowWidth > 2 * k_WindowMargin ? (windowWidth - 2 * k_WindowMargin) / k_GlyphWidth : 0;
+}
+
+static uint32_t GetTextLines(uint32_t windowHeight)
+{
+	return windowHeight > k_TitleHeight + 2 * k_WindowMargin ? (windowHeight - k_TitleHeight - 2 * k_WindowMargin) / k_GlyphHeight : 0;
+}
+
+// Not a font, but strokes of about the size and density of one; every seventh code is a space.
+static bool IsGlyphPixel(uint32_t code, uint32_t x, uint32_t y)
+{
+	if (code % 7 == 0 || x < 1 || x >= 7 || y < 2 || y >= 14)
+		return false;
+	return (code >> (((y - 2) / 2) * 3 + (x - 1) / 2)) & 1;
+}
+
+// x, y within a width x height window whose text comes from textSeed.  Only the first glyphCount
+// glyphs are shown, lines full; with all of them shown lines end at random.
+static uint32_t GetWindowPixel(uint32_t x, uint32_t y, uint32_t width, uint32_t height, uint32_t textSeed, uint32_t glyphCount)
+{
+	if (x == 0 || y == 0 || x + 1 == width || y + 1 == height)
+		return k_BorderColour;
+	if (y < k_TitleHeight)
+		return (Mix(textSeed) & 0x7F7F7Fu) | 0xFF000000u;
+	if (x < k_WindowMargin || y < k_TitleHeight + k_WindowMargin)
+		return k_PaperColour;
+
+	const uint32_t columns = GetTextColumns(width);
+	const uint32_t column = (x - k_WindowMargin) / k_GlyphWidth;
+	const uint32_t line = (y - k_TitleHeight - k_WindowMargin) / k_GlyphHeight;
+	if (column >= columns || line >= GetTextLines(height))
+		return k_PaperColour;
+	const uint32_t index = line * columns + column;
+	if (index >= glyphCount || (glyphCount == UINT32_MAX && column >= Mix(textSeed ^ (line * 0x9E3779B9u)) % (columns + 1)))
+		return k_PaperColour;
+	return IsGlyphPixel(Mix(textSeed + index), (x - k_WindowMargin) % k_GlyphWidth, (y - k_TitleHeight - k_WindowMargin) % k_GlyphHeight) ? k_InkColour : k_PaperColour;
+}
+
+const char *GetSyntheticWorkloadName(SyntheticWorkload workload)
+{
+	switch (workload)
+	{
+	case SyntheticWorkload::SlidingBlock:
+		return "Sliding block";
+	case SyntheticWorkload::Caret:
+		return "Caret";
+	case SyntheticWorkload::Scrolling:
+		return "Scrolling text";
+	case SyntheticWorkload::WindowDrag:
+		return "Window drag";
+	case SyntheticWorkload::Video:
+		return "Video";
+	case SyntheticWorkload::Noise:
+		return "Noise";
+	case SyntheticWorkload::Typing:
+		return "Typing";
+	default:
+		return "Unknown";
+	}
+}
+
+std::vector<SyntheticWorkloadConfig> GetSyntheticCorpus(uint32_t width, uint32_t height, uint32_t seed)
+{
+	static const std::pair<SyntheticWorkload, double> k_Corpus[] = {
+		{SyntheticWorkload::Caret, 0.0},
+		{SyntheticWorkload::Scrolling, 0.5},
+		{SyntheticWorkload::WindowDrag, 0.25},
+		{SyntheticWorkload::Video, 0.25},
+		{SyntheticWorkload::Noise, 1.0},
+		{SyntheticWorkload::Typing, 0.0},
+	};
+
+	std::vector<SyntheticWorkloadConfig> corpus;
+	for (const auto &[workload, changeRatio] : k_Corpus)
+	{
+		SyntheticWorkloadConfig config;
+		config.workload = workload;
+		config.width = width;
+		config.height = height;
+		config.seed = seed;
+		config.changeRatio = changeRatio;
+		corpus.push_back(config);
+	}
+	return corpus;
+}
+
+SyntheticFrameSource::SyntheticFrameSource(const SyntheticWorkloadConfig &config)
+	: m_Workload(config.workload), m_Seed(config.seed),
+	  m_Interval(config.framesPerSecond != 0 ? std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::seconds(1)) / config.framesPerSecond : std::chrono::steady_clock::duration::zero()),
+	  m_NextFrame(std::chrono::steady_clock::now())
+{
+	m_Frame.Resize(config.width, config.height);
+
+	const double ratio = std::clamp(config.changeRatio, 0.0, 1.0);
+	if (m_Workload == SyntheticWorkload::Scrolling)
+	{
+		m_Region.width = m_Frame.width;
+		m_Region.height = std::min(m_Frame.height, std::max(k_GlyphHeight, (uint32_t)(m_Frame.height * ratio)));
+	}
+	else
+	{
+		const double side = std::sqrt(ratio);
+		m_Region.width = std::min(m_Frame.width, std::max((uint32_t)(m_Frame.width * side), 1u));
+		m_Region.height = std::min(m_Frame.height, std::max((uint32_t)(m_Frame.height * side), 1u));
+	}
+	m_Region.x = Mix(m_Seed) % (m_Frame.width - m_Region.width + 1);
+	m_Region.y = Mix(m_Seed + 1) % (m_Frame.height - m_Region.height + 1);
+
+	m_Window.width = m_Frame.width * 3 / 5;
+	m_Window.height = m_Frame.height * 3 / 5;
+	m_Window.x = Mix(m_Seed + 2) % (m_Frame.width - m_Window.width + 1);
+	m_Window.y = Mix(m_Seed + 3) % (m_Frame.height - m_Window.height + 1);
+	m_Capacity = GetTextColumns(m_Window.width) * GetTextLines(m_Window.height);
+
+	// What doesn't change is drawn once.  Typing changes the desktop, it's drawn as it goes.
+	if (m_Workload != SyntheticWorkload::SlidingBlock && m_Workload != SyntheticWorkload::Typing)
+	{
+		m_Desktop.Resize(m_Frame.width, m_Frame.height);
+		for (uint32_t y = 0; y < m_Frame.height; ++y)
+			DrawDesktop(m_Desktop.Row(y), y, 0, m_Frame.width);
+	}
+	if (m_Workload == SyntheticWorkload::WindowDrag)
+	{
+		m_DraggedWindow.Resize(m_Region.width, m_Region.height);
+		for (uint32_t y = 0; y < m_Region.height; ++y)
+		{
+			for (uint32_t x = 0; x < m_Region.width; ++x)
+				SetPixel(m_DraggedWindow.Row(y), x, GetWindowPixel(x, y, m_Region.width, m_Region.height, m_Seed + 8, UINT32_MAX));
+		}
+	}
+}
+
+SyntheticFrameSource::SyntheticFrameSource(uint32_t width, uint32_t height, uint32_t framesPerSecond, uint32_t seed)
+	: SyntheticFrameSource(SyntheticWorkloadConfig{SyntheticWorkload::SlidingBlock, width, height, framesPerSecond, seed, 1.0 / 16.0})
+{
+}
+
+uint32_t SyntheticFrameSource::GetTypedCount(uint64_t frameIndex) const
+{
+	// A full window starts over on an empty one.
+	return m_Capacity != 0 ? (uint32_t)(frameIndex % m_Capacity) : 0;
+}
+
+TileRect SyntheticFrameSource::GetCaretRect(uint64_t frameIndex) const
+{
+	const uint32_t columns = GetTextColumns(m_Window.width);
+	if (m_Capacity == 0)
+		return {};
+	const uint32_t index = m_Workload == SyntheticWorkload::Typing ? GetTypedCount(frameIndex) : Mix(m_Seed + 4) % m_Capacity;
+	return {m_Window.x + k_WindowMargin + index % columns * k_GlyphWidth, m_Window.y + k_TitleHeight + k_WindowMargin + index / columns * k_GlyphHeight, k_CaretWidth, k_GlyphHeight};
+}
+
+// What the workload draws over the background on frameIndex, empty for nothing.
+TileRect SyntheticFrameSource::GetOverlayRect(uint64_t frameIndex) const
+{
+	TileRect rect = m_Region;
+	switch (m_Workload)
+	{
+	case SyntheticWorkload::SlidingBlock:
+	{
+		const uint32_t travel = m_Frame.width - rect.width + 1;
+		rect.x = (uint32_t)((frameIndex * 8 + m_Region.x) % travel);
+		return rect;
+	}
+	case SyntheticWorkload::Caret:
+		return (frameIndex / k_CaretBlinkFrames) % 2 == 0 ? GetCaretRect(frameIndex) : TileRect{};
+	case SyntheticWorkload::Typing:
+		return GetCaretRect(frameIndex);
+	case SyntheticWorkload::WindowDrag:
+		rect.x = Bounce(m_Region.x + frameIndex * k_DragStepX, m_Frame.width - rect.width);
+		rect.y = Bounce(m_Region.y + frameIndex * k_DragStepY, m_Frame.height - rect.height);
+		return rect;
+	default:
+		return rect;
+	}
+}
+
+// What changed from the frame before, the way a capture source would report it.
+void SyntheticFrameSource::AddDirtyRects(std::vector<TileRect> &rects) const
+{
+	switch (m_Workload)
+	{
+	case SyntheticWorkload::SlidingBlock:
+		rects.push_back(GetOverlayRect(m_FrameCount - 1));
+		rects.push_back(GetOverlayRect(m_FrameCount));
+		rects.push_back({0, 0, std::min(k_CounterWidth, m_Frame.width), std::min(k_CounterHeight, m_Frame.height)});
+		break;
+	case SyntheticWorkload::Caret:
+		if (m_FrameCount % k_CaretBlinkFrames == 0 && m_Capacity != 0)
+			rects.push_back(GetCaretRect(m_FrameCount));
+		break;
+	case SyntheticWorkload::Typing:
+		if (m_Capacity == 0)
+			break;
+		if (GetTypedCount(m_FrameCount) == 0)
+		{
+			rects.push_back(m_Window);
+		}
+		else
+		{
+			// The glyph typed where the caret was, and the caret after it.
+			TileRect typed = GetCaretRect(m_FrameCount - 1);
+			typed.width = k_GlyphWidth;
+			rects.push_back(typed);
+			rects.push_back(GetCaretRect(m_FrameCount));
+		}
+		break;
+	case SyntheticWorkload::WindowDrag:
+		rects.push_back(GetOverlayRect(m_FrameCount - 1));
+		rects.push_back(GetOverlayRect(m_FrameCount));
+		break;
+	default:
+		rects.push_back(m_Region);
+		break;
+	}
+}
+
+void SyntheticFrameSource::FillBackground(uint8_t *row, uint32_t y, uint32_t x0, uint32_t x1) const
+{
+	if (m_Workload == SyntheticWorkload::SlidingBlock)
+	{
+		const uint32_t band = Mix(m_Seed ^ (y / k_BandHeight)) | 0xFF000000u;
+		for (uint32_t x = x0; x < x1; ++x)
+			SetPixel(row, x, band);
+	}
+	else if (!m_Desktop.pixels.empty() && x0 < x1)
+	{
+		std::memcpy(row + (size_t)x0 * k_BytesPerPixel, m_Desktop.Row(y) + (size_t)x0 * k_BytesPerPixel, (size_t)(x1 - x0) * k_BytesPerPixel);
+	}
+	else
+	{
+		DrawDesktop(row, y, x0, x1);
+	}
+}
+
+void SyntheticFrameSource::DrawDesktop(uint8_t *row, uint32_t y, uint32_t x0, uint32_t x1) const
+{
+	// A vertical gradient between two colours of the seed.
+	const uint32_t top = Mix(m_Seed + 6), bottom = Mix(m_Seed + 7);
+	uint32_t wallpaper = 0xFF000000u;
+	for (uint32_t shift = 0; shift < 24; shift += 8)
+	{
+		const uint64_t a = (top >> shift) & 0xFF, b = (bottom >> shift) & 0xFF;
+		wallpaper |= (uint32_t)((a * (m_Frame.height - y) + b * y) / m_Frame.height) << shift;
+	}
+
+	const bool inWindowRows = y >= m_Window.y && y < m_Window.y + m_Window.height;
+	const uint32_t glyphCount = m_Workload == SyntheticWorkload::Typing ? GetTypedCount(m_FrameCount) : UINT32_MAX;
+	for (uint32_t x = x0; x < x1; ++x)
+	{
+		if (inWindowRows && x >= m_Window.x && x < m_Window.x + m_Window.width)
+			SetPixel(row, x, GetWindowPixel(x - m_Window.x, y - m_Window.y, m_Window.width, m_Window.height, m_Seed + 5, glyphCount));
+		else
+			SetPixel(row, x, wallpaper);
+	}
+}
+
+// [x0, x1) of row y, all of it within GetOverlayRect(m_FrameCount).
+void SyntheticFrameSource::FillOverlay(uint8_t *row, uint32_t y, uint32_t x0, uint32_t x1) const
+{
+	const TileRect overlay = GetOverlayRect(m_FrameCount);
+	const uint32_t frame = (uint32_t)m_FrameCount;
+	switch (m_Workload)
+	{
+	case SyntheticWorkload::SlidingBlock:
+		for (uint32_t x = x0; x < x1; ++x)
+			SetPixel(row, x, ((x - overlay.x) / 8 + (y - overlay.y) / 16) % 5 == 0 ? 0xFF202020u : 0xFFF0F0F0u);
+		break;
+	case SyntheticWorkload::Caret:
+	case SyntheticWorkload::Typing:
+		for (uint32_t x = x0; x < x1; ++x)
+			SetPixel(row, x, k_InkColour);
+		break;
+	case SyntheticWorkload::Scrolling:
+	{
+		// A terminal full of text, scrolled up by k_ScrollStep more every frame.
+		const uint32_t columns = m_Frame.width / k_GlyphWidth;
+		const uint64_t scrolled = (uint64_t)(y - overlay.y) + m_FrameCount * k_ScrollStep;
+		const uint32_t line = (uint32_t)(scrolled / k_GlyphHeight);
+		const uint32_t length = Mix(m_Seed ^ (line * 0x9E3779B9u)) % (columns + 1);
+		uint32_t code = 0;
+		for (uint32_t x = x0; x < x1; ++x)
+		{
+			const uint32_t column = x / k_GlyphWidth;
+			if (x == x0 || x % k_GlyphWidth == 0)
+				code = Mix(m_Seed * 31 + line * columns + column);
+			const bool ink = column < length && IsGlyphPixel(code, x % k_GlyphWidth, (uint32_t)(scrolled % k_GlyphHeight));
+			SetPixel(row, x, ink ? k_TerminalInkColour : k_TerminalColour);
+		}
+		break;
+	}
+	case SyntheticWorkload::WindowDrag:
+		if (x0 < x1)
+			std::memcpy(row + (size_t)x0 * k_BytesPerPixel, m_DraggedWindow.Row(y - overlay.y) + (size_t)(x0 - overlay.x) * k_BytesPerPixel, (size_t)(x1 - x0) * k_BytesPerPixel);
+		break;
+	case SyntheticWorkload::Video:
+	{
+		// Gradients drifting at different speeds, with grain so no two tiles are alike.
+		const uint32_t v = y - overlay.y;
+		uint32_t state = Mix(m_Seed ^ Mix(frame * 0x9E3779B9u + y)) | 1;
+		for (uint32_t x = overlay.x; x < x0; ++x)
+			XorShift(state);
+		for (uint32_t x = x0; x < x1; ++x)
+		{
+			const uint32_t u = x - overlay.x;
+			const uint32_t grain = XorShift(state) & 15;
+			const uint32_t r = ((u + v) / 2 + frame * 5 + grain) & 0xFF;
+			const uint32_t g = (v + frame * 2 + (u >> 4 & 15) + grain) & 0xFF;
+			const uint32_t b = (u + frame * 3 + grain) & 0xFF;
+			SetPixel(row, x, 0xFF000000u | r << 16 | g << 8 | b);
+		}
+		break;
+	}
+	case SyntheticWorkload::Noise:
+	{
+		// A generator per row and frame, so any part of the region comes out the same.
+		uint32_t state = Mix(m_Seed ^ Mix(frame * 0x9E3779B9u + y)) | 1;
+		for (uint32_t x = overlay.x; x < x0; ++x)
+			XorShift(state);
+		for (uint32_t x = x0; x < x1; ++x)
+			SetPixel(row, x, XorShift(state) | 0xFF000000u);
+		break;
+	}
+	default:
+		break;
+	}
+}
+
+void SyntheticFrameSource::FillRect(const TileRect &rect)
+{
+	const TileRect overlay = GetOverlayRect(m_FrameCount);
+	const uint32_t x1 = rect.x + rect.width;
+	for (uint32_t y = rect.y; y < rect.y + rect.height; ++y)
+	{
+		uint8_t *row = m_Frame.Row(y);
+		if (overlay.width != 0 && y >= overlay.y && y < overlay.y + overlay.height)
+		{
+			const uint32_t overlayX0 = std::clamp(overlay.x, rect.x, x1);
+			const uint32_t overlayX1 = std::clamp(overlay.x + overlay.width, rect.x, x1);
+			FillBackground(row, y, rect.x, overlayX0);
+			FillOverlay(row, y, overlayX0, overlayX1);
+			FillBackground(row, y, overlayX1, x1);
+		}
+		else
+		{
+			FillBackground(row, y, rect.x, x1);
+		}
+
+		// The counter goes over everything.
+		if (m_Workload == SyntheticWorkload::SlidingBlock && y < k_CounterHeight)
+		{
+			for (uint32_t x = rect.x; x < std::min(x1, k_CounterWidth); ++x)
+				SetPixel(row, x, (m_FrameCount >> (x / 4)) & 1 ? 0xFFFFFFFFu : 0xFF000000u);
+		}
+	}
+}
+
+bool SyntheticFrameSource::AcquireFrame(std::chrono::milliseconds timeout, CapturedFrame &frame)
+{
+	if (m_Frame.width == 0 || m_Frame.height == 0)
+	{
+		std::this_thread::sleep_for(timeout);
+		return false;
+	}
+
+	if (m_Interval != std::chrono::steady_clock::duration::zero())
+	{
+		const auto now = std::chrono::steady_clock::now();
+		if (m_NextFrame - now > timeout)
+		{
+			std::this_thread::sleep_for(timeout);
+			return false;
+		}
+		std::this_thread::sleep_until(m_NextFrame);
+		// A caller that fell behind gets the next frame, not a burst of missed ones.
+		m_NextFrame = std::max(m_NextFrame + m_Interval, now);
+	}
+
+	frame.dirtyRects.clear();
+	if (m_FrameCount == 0)
+	{
+		FillRect({0, 0, m_Frame.width, m_Frame.height});
+		frame.hasDirtyRects = false;
+	}
+	else
+	{
+		AddDirtyRects(frame.dirtyRects);
+		for (const TileRect &rect : frame.dirtyRects)
+			FillRect(rect);
+		frame.hasDirtyRects = true;
+	}
+	++m_FrameCount;
+	if (frame.hasDirtyRects && frame.dirtyRects.empty())
+		return false;
+
+	frame.view = m_Frame.GetView();
+	frame.captured = std::chrono::steady_clock::now();
+	return true;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdint>
+#include <chrono>
+#include <vector>
+
+#include "FrameSource.h"
+
+// What a SyntheticFrameSource draws.  All but SlidingBlock start from the same desktop: a
+// gradient wallpaper and a window of text, both placed and coloured from the seed.
+enum class SyntheticWorkload : uint8_t
+{
+	SlidingBlock = 0, // banded background, a block sliding across it, a strip in the corner counting frames
+	Caret,			  // the desktop standing still but for a blinking caret
+	Scrolling,		  // a full width band of text scrolling up a few pixels every frame
+	WindowDrag,		  // a window of text dragged across the desktop
+	Video,			  // a region where every pixel changes every frame, smoothly, like a video
+	Noise,			  // a region of random pixels every frame, the worst case for diff, codecs and the cache
+	Typing,			  // a character typed into the window every frame, the caret following it
+	Count
+};
+
+struct SyntheticWorkloadConfig
+{
+	SyntheticWorkload workload = SyntheticWorkload::SlidingBlock;
+	uint32_t width = 1920;
+	uint32_t height = 1080;
+	uint32_t framesPerSecond = 0; // 0 is as fast as frames are asked for
+	uint32_t seed = 1;
+	// The share of the frame a frame changes: the block, the dragged window, the video and noise
+	// regions cover it, the scrolling band is that share of the height.  A caret or a character
+	// is the size it is, Caret and Typing don't use it.
+	double changeRatio = 1.0 / 16.0;
+};
+
+const char *GetSyntheticWorkloadName(SyntheticWorkload workload);
+
+// The standard benchmark corpus at width x height: every workload but SlidingBlock, with the
+// change ratio it is measured at, for diff, codec, cache and end to end numbers that compare
+// across changes.
+std::vector<SyntheticWorkloadConfig> GetSyntheticCorpus(uint32_t width, uint32_t height, uint32_t seed = 1);
+
+// Stands in for a monitor where there is none, e.g. to run several streams on Linux, and feeds
+// benchmarks a known workload.  The same config gives the same frames and the same dirty rects,
+// the n-th frame depends on nothing but n.  Frames come at framesPerSecond of the steady clock, or
+// as fast as they are asked for with 0; a tick where nothing changes, e.g. between two blinks of
+// the caret, has no frame.
+class SyntheticFrameSource : public IFrameSource
+{
+public:
+	explicit SyntheticFrameSource(const SyntheticWorkloadConfig &config);
+	// SlidingBlock.
+	SyntheticFrameSource(uint32_t width, uint32_t height, uint32_t framesPerSecond, uint32_t seed);
+
+	bool AcquireFrame(std::chrono::milliseconds timeout, CapturedFrame &frame) override;
+	void ReleaseFrame() override {}
+
+	// Ticks so far, including those without a frame.
+	uint64_t GetFrameCount() const { return m_FrameCount; }
+
+private:
+	void AddDirtyRects(std::vector<TileRect> &rects) const;
+	void FillRect(const TileRect &rect);
+	void FillBackground(uint8_t *row, uint32_t y, uint32_t x0, uint32_t x1) const;
+	void DrawDesktop(uint8_t *row, uint32_t y, uint32_t x0, uint32_t x1) const;
+	void FillOverlay(uint8_t *row, uint32_t y, uint32_t x0, uint32_t x1) const;
+	TileRect GetOverlayRect(uint64_t frameIndex) const;
+	TileRect GetCaretRect(uint64_t frameIndex) const;
+	uint32_t GetTypedCount(uint64_t frameIndex) const;
+
+private:
+	FrameBuffer m_Frame;
+	FrameBuffer m_Desktop;		 // the background, drawn once unless typing changes it
+	FrameBuffer m_DraggedWindow; // drawn once, copied to where it is
+	SyntheticWorkload m_Workload;
+	uint32_t m_Seed;
+	TileRect m_Region; // the block, dragged window, video or noise region, or scrolling band
+	TileRect m_Window; // the desktop's window of text
+	uint32_t m_Capacity = 0; // glyphs the window's text fits
+	std::chrono::steady_clock::duration m_Interval;
+	std::chrono::steady_clock::time_point m_NextFrame;
+	uint64_t m_FrameCount = 0;
+};
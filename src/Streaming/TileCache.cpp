@@ -0,0 +1,144 @@
+#include "TileCache.h"
+
+#include <cassert>
+#include <algorithm>
+
+TileCache::TileCache(uint32_t slotCount)
+{
+	slotCount = std::clamp<uint32_t>(slotCount, 1, k_NoCacheSlot);
+	m_Slots.resize(slotCount);
+
+	// At most half full, so probe sequences stay short.
+	uint32_t bucketCount = 1;
+	while (bucketCount < slotCount * 2)
+		bucketCount <<= 1;
+	m_Buckets.assign(bucketCount, k_EmptyBucket);
+	m_BucketMask = bucketCount - 1;
+
+	// Every slot starts out on the LRU list, unused ones are the oldest.
+	for (uint32_t i = 0; i < slotCount; ++i)
+		PushNewest(i);
+}
+
+TileCacheOp TileCache::Use(uint64_t hash, uint32_t frameId)
+{
+	TileCacheOp op;
+
+	const uint32_t bucket = FindBucket(hash);
+	if (m_Buckets[bucket] != k_EmptyBucket)
+	{
+		const uint32_t slot = m_Buckets[bucket];
+		Slot &entry = m_Slots[slot];
+		entry.lastUseFrameId = frameId;
+		Unlink(slot);
+		PushNewest(slot);
+		++m_Hits;
+
+		op.slot = (uint16_t)slot;
+		op.reference = true;
+		op.storeFrameId = entry.storeFrameId;
+		return op;
+	}
+
+	// Keep what this frame relies on, a slot is only ever stored once per frame.
+	const uint32_t slot = m_Oldest;
+	Slot &entry = m_Slots[slot];
+	if (entry.used && entry.lastUseFrameId == frameId)
+		return op;
+
+	if (entry.used)
+		RemoveFromIndex(slot);
+	entry.hash = hash;
+	entry.storeFrameId = frameId;
+	entry.lastUseFrameId = frameId;
+	entry.used = true;
+	// Removing may have shifted buckets, look the spot up again.
+	m_Buckets[FindBucket(hash)] = (uint16_t)slot;
+	Unlink(slot);
+	PushNewest(slot);
+	++m_Stores;
+
+	op.slot = (uint16_t)slot;
+	return op;
+}
+
+void TileCache::Invalidate(uint16_t slot)
+{
+	if (slot >= m_Slots.size() || !m_Slots[slot].used)
+		return;
+
+	RemoveFromIndex(slot);
+	m_Slots[slot].used = false;
+
+	// Free slots get reused first.
+	Unlink(slot);
+	Slot &entry = m_Slots[slot];
+	entry.newer = m_Oldest;
+	entry.older = k_NoLink;
+	if (m_Oldest != k_NoLink)
+		m_Slots[m_Oldest].older = slot;
+	m_Oldest = slot;
+	if (m_Newest == k_NoLink)
+		m_Newest = slot;
+}
+
+uint32_t TileCache::FindBucket(uint64_t hash) const
+{
+	uint32_t bucket = (uint32_t)hash & m_BucketMask;
+	while (m_Buckets[bucket] != k_EmptyBucket && m_Slots[m_Buckets[bucket]].hash != hash)
+		bucket = (bucket + 1) & m_BucketMask;
+	return bucket;
+}
+
+void TileCache::RemoveFromIndex(uint32_t slot)
+{
+	uint32_t bucket = FindBucket(m_Slots[slot].hash);
+	assert(m_Buckets[bucket] == slot);
+
+	// Backward shift deletion: pull later entries of the probe sequence into the hole, so lookups
+	// never need tombstones.
+	uint32_t next = bucket;
+	for (;;)
+	{
+		m_Buckets[bucket] = k_EmptyBucket;
+		for (;;)
+		{
+			next = (next + 1) & m_BucketMask;
+			if (m_Buckets[next] == k_EmptyBucket)
+				return;
+			const uint32_t home = (uint32_t)m_Slots[m_Buckets[next]].hash & m_BucketMask;
+			// Leave it if its home lies cyclically in (bucket, next].
+			if (bucket <= next ? (bucket < home && home <= next) : (bucket < home || home <= next))
+				continue;
+			break;
+		}
+		m_Buckets[bucket] = m_Buckets[next];
+		bucket = next;
+	}
+}
+
+void TileCache::Unlink(uint32_t slot)
+{
+	Slot &entry = m_Slots[slot];
+	if (entry.newer != k_NoLink)
+		m_Slots[entry.newer].older = entry.older;
+	else
+		m_Newest = entry.older;
+	if (entry.older != k_NoLink)
+		m_Slots[entry.older].newer = entry.newer;
+	else
+		m_Oldest = entry.newer;
+	entry.newer = entry.older = k_NoLink;
+}
+
+void TileCache::PushNewest(uint32_t slot)
+{
+	Slot &entry = m_Slots[slot];
+	entry.older = m_Newest;
+	entry.newer = k_NoLink;
+	if (m_Newest != k_NoLink)
+		m_Slots[m_Newest].newer = slot;
+	m_Newest = slot;
+	if (m_Oldest == k_NoLink)
+		m_Oldest = slot;
+}
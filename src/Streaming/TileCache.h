@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "WireFormat.h"
+
+// What to do with one dirty tile.
+struct TileCacheOp
+{
+	uint16_t slot = k_NoCacheSlot;
+	bool reference = false;	  // draw cached slot instead of sending the tile
+	uint32_t storeFrameId = 0; // frame that stored slot, for reference
+};
+
+// Sender half of the tile cache, keyed by content hash.  The sender alone decides which slot a
+// tile goes into and what gets evicted; records carry the slot number, so the receiver's cache is
+// a plain array that ends up holding exactly what the sender thinks it holds, as long as the
+// records arrive.  A reference also names the frame that stored the slot, which is how the
+// receiver notices a store it missed and reports the slot back (see TileCacheMissHeader).
+//
+// Fixed size, steady state use does not allocate.
+class TileCache
+{
+public:
+	static constexpr uint32_t k_DefaultSlotCount = 2048; // four 1080p screens, 32MiB on the receiver
+
+	explicit TileCache(uint32_t slotCount = k_DefaultSlotCount);
+
+	// Call once per frame, in tile order, for every dirty tile.  A slot stored during frameId is
+	// never evicted again during the same frame.
+	TileCacheOp Use(uint64_t hash, uint32_t frameId);
+
+	// The receiver lost the slot's content.
+	void Invalidate(uint16_t slot);
+
+	uint32_t GetSlotCount() const { return (uint32_t)m_Slots.size(); }
+	uint64_t GetHitCount() const { return m_Hits; }
+	uint64_t GetStoreCount() const { return m_Stores; }
+
+private:
+	static constexpr uint32_t k_NoLink = 0xFFFFFFFF;
+	static constexpr uint16_t k_EmptyBucket = 0xFFFF;
+
+	struct Slot
+	{
+		uint64_t hash = 0;
+		uint32_t storeFrameId = 0;
+		uint32_t lastUseFrameId = 0;
+		uint32_t newer = k_NoLink; // LRU links
+		uint32_t older = k_NoLink;
+		bool used = false;
+	};
+
+	uint32_t FindBucket(uint64_t hash) const;
+	void RemoveFromIndex(uint32_t slot);
+	void Unlink(uint32_t slot);
+	void PushNewest(uint32_t slot);
+
+private:
+	std::vector<Slot> m_Slots;
+	std::vector<uint16_t> m_Buckets; // open addressing, hash -> slot
+	uint32_t m_BucketMask = 0;
+	uint32_t m_Newest = k_NoLink;
+	uint32_t m_Oldest = k_NoLink;
+
+	uint64_t m_Hits = 0;
+	uint64_t m_Stores = 0;
+};
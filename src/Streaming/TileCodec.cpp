@@ -0,0 +1,270 @@
+#include "TileCodec.h"
+
+#include <cstring>
+#include <cassert>
+#include <algorithm>
+
+static constexpr size_t k_RleTokenSize = sizeof(uint16_t) + sizeof(uint32_t);
+static constexpr uint32_t k_MaxRunLength = 0xFFFF;
+
+static uint32_t GetQualityMask(uint8_t quality)
+{
+	assert(quality >= 1 && quality <= k_TileQualityLossless);
+	uint32_t channel = (0xFFu << (k_TileQualityLossless - quality)) & 0xFFu;
+	// Alpha carries nothing for desktop capture, force it opaque so it never breaks a run.
+	return channel | (channel << 8) | (channel << 16);
+}
+
+static uint32_t LoadPixel(const uint8_t *p, uint32_t mask)
+{
+	uint32_t pixel;
+	std::memcpy(&pixel, p, sizeof(pixel));
+	return (pixel & mask) | 0xFF000000u;
+}
+
+static size_t CountRuns(const FrameView &frame, const TileRect &rect, uint32_t mask)
+{
+	size_t runs = 0;
+	uint32_t current = 0;
+	uint32_t length = 0;
+	for (uint32_t y = 0; y < rect.height; ++y)
+	{
+		const uint8_t *row = frame.Row(rect.y + y) + (size_t)rect.x * k_BytesPerPixel;
+		for (uint32_t x = 0; x < rect.width; ++x)
+		{
+			uint32_t pixel = LoadPixel(row + (size_t)x * k_BytesPerPixel, mask);
+			if (length != 0 && pixel == current && length < k_MaxRunLength)
+			{
+				++length;
+				continue;
+			}
+			++runs;
+			current = pixel;
+			length = 1;
+		}
+	}
+	return runs;
+}
+
+static size_t GetPackedSize(const TileRect &rect, uint8_t quality)
+{
+	return ((size_t)rect.width * rect.height * 3 * quality + 7) / 8;
+}
+
+static void WritePacked(const FrameView &frame, const TileRect &rect, uint8_t quality, TileOutput &output)
+{
+	const uint32_t shift = k_TileQualityLossless - quality;
+	uint8_t buffer[256];
+	size_t used = 0;
+	uint64_t bits = 0;
+	uint32_t bitCount = 0;
+	for (uint32_t y = 0; y < rect.height; ++y)
+	{
+		const uint8_t *row = frame.Row(rect.y + y) + (size_t)rect.x * k_BytesPerPixel;
+		for (uint32_t x = 0; x < rect.width; ++x)
+		{
+			const uint8_t *pixel = row + (size_t)x * k_BytesPerPixel;
+			for (uint32_t channel = 0; channel < 3; ++channel)
+			{
+				bits |= (uint64_t)(pixel[channel] >> shift) << bitCount;
+				bitCount += quality;
+			}
+			while (bitCount >= 8)
+			{
+				buffer[used++] = (uint8_t)bits;
+				bits >>= 8;
+				bitCount -= 8;
+			}
+			// A pixel adds at most three bytes.
+			if (used > sizeof(buffer) - 3)
+			{
+				output.Write(buffer, used);
+				used = 0;
+			}
+		}
+	}
+	if (bitCount != 0)
+		buffer[used++] = (uint8_t)bits;
+	output.Write(buffer, used);
+}
+
+static void WriteToken(TileOutput &output, uint16_t length, uint32_t pixel)
+{
+	uint8_t token[k_RleTokenSize];
+	std::memcpy(token, &length, sizeof(length));
+	std::memcpy(token + sizeof(length), &pixel, sizeof(pixel));
+	output.Write(token, sizeof(token));
+}
+
+static void FailNext(TileOutput &output)
+{
+	(void)output;
+	assert(!"TileOutput overflow");
+}
+
+void TileOutput::WriteSplit(const uint8_t *data, size_t size)
+{
+	while (size > 0)
+	{
+		if (cursor == end)
+			next(*this);
+		size_t n = std::min(size, (size_t)(end - cursor));
+		std::memcpy(cursor, data, n);
+		cursor += n;
+		data += n;
+		size -= n;
+	}
+}
+
+size_t TileCodec::GetMaxRecordSize(const TileRect &rect)
+{
+	// Measure() never picks anything larger than raw.
+	return sizeof(TileRecordHeader) + (size_t)rect.width * rect.height * k_BytesPerPixel;
+}
+
+TileRecordHeader TileCodec::Measure(const FrameView &frame, const TileRect &rect, uint32_t tileIndex, uint8_t quality)
+{
+	const size_t packedSize = GetPackedSize(rect, quality);
+	const size_t rleSize = CountRuns(frame, rect, GetQualityMask(quality)) * k_RleTokenSize;
+
+	TileRecordHeader header;
+	header.tileIndex = tileIndex;
+	header.quality = quality;
+	header.codec = (uint8_t)(rleSize < packedSize ? TileCodecId::Rle : TileCodecId::Packed);
+	header.payloadSize = (uint32_t)(rleSize < packedSize ? rleSize : packedSize);
+	return header;
+}
+
+void TileCodec::Write(const FrameView &frame, const TileRect &rect, const TileRecordHeader &header, TileOutput &output)
+{
+	const uint32_t mask = GetQualityMask(header.quality);
+	output.Write(&header, sizeof(header));
+
+	if (header.codec == (uint8_t)TileCodecId::Raw)
+	{
+		for (uint32_t y = 0; y < rect.height; ++y)
+		{
+			const uint8_t *row = frame.Row(rect.y + y) + (size_t)rect.x * k_BytesPerPixel;
+			for (uint32_t x = 0; x < rect.width; ++x)
+			{
+				uint32_t pixel = LoadPixel(row + (size_t)x * k_BytesPerPixel, mask);
+				output.Write(&pixel, sizeof(pixel));
+			}
+		}
+		return;
+	}
+
+	if (header.codec == (uint8_t)TileCodecId::Packed)
+	{
+		WritePacked(frame, rect, header.quality, output);
+		return;
+	}
+
+	uint32_t current = 0;
+	uint32_t length = 0;
+	for (uint32_t y = 0; y < rect.height; ++y)
+	{
+		const uint8_t *row = frame.Row(rect.y + y) + (size_t)rect.x * k_BytesPerPixel;
+		for (uint32_t x = 0; x < rect.width; ++x)
+		{
+			uint32_t pixel = LoadPixel(row + (size_t)x * k_BytesPerPixel, mask);
+			if (length != 0 && pixel == current && length < k_MaxRunLength)
+			{
+				++length;
+				continue;
+			}
+			if (length != 0)
+				WriteToken(output, (uint16_t)length, current);
+			current = pixel;
+			length = 1;
+		}
+	}
+	if (length != 0)
+		WriteToken(output, (uint16_t)length, current);
+}
+
+size_t TileCodec::Encode(const FrameView &frame, const TileRect &rect, uint32_t tileIndex, uint8_t quality, uint8_t *out)
+{
+	const TileRecordHeader header = Measure(frame, rect, tileIndex, quality);
+	const size_t recordSize = sizeof(header) + header.payloadSize;
+
+	TileOutput output;
+	output.cursor = out;
+	output.end = out + recordSize;
+	output.next = &FailNext;
+	Write(frame, rect, header, output);
+	assert(output.cursor == output.end);
+	return recordSize;
+}
+
+bool TileCodec::Decode(const TileRecordHeader &header, const uint8_t *payload, const TileRect &rect, uint8_t *dst, uint32_t dstStride)
+{
+	const size_t rowBytes = (size_t)rect.width * k_BytesPerPixel;
+
+	if (header.codec == (uint8_t)TileCodecId::Raw)
+	{
+		if (header.payloadSize != rowBytes * rect.height)
+			return false;
+		for (uint32_t y = 0; y < rect.height; ++y)
+			std::memcpy(dst + (size_t)y * dstStride, payload + y * rowBytes, rowBytes);
+		return true;
+	}
+
+	if (header.codec == (uint8_t)TileCodecId::Packed)
+	{
+		if (header.quality < 1 || header.quality > k_TileQualityLossless || header.payloadSize != GetPackedSize(rect, header.quality))
+			return false;
+		const uint32_t shift = k_TileQualityLossless - header.quality;
+		const uint32_t valueMask = (1u << header.quality) - 1;
+		const uint8_t *p = payload;
+		uint64_t bits = 0;
+		uint32_t bitCount = 0;
+		for (uint32_t y = 0; y < rect.height; ++y)
+		{
+			uint8_t *row = dst + (size_t)y * dstStride;
+			for (uint32_t x = 0; x < rect.width; ++x)
+			{
+				while (bitCount < 3 * header.quality)
+				{
+					bits |= (uint64_t)*p++ << bitCount;
+					bitCount += 8;
+				}
+				uint8_t *pixel = row + (size_t)x * k_BytesPerPixel;
+				for (uint32_t channel = 0; channel < 3; ++channel)
+				{
+					pixel[channel] = (uint8_t)((bits & valueMask) << shift);
+					bits >>= header.quality;
+				}
+				pixel[3] = 0xFF;
+				bitCount -= 3 * header.quality;
+			}
+		}
+		return true;
+	}
+
+	if (header.codec != (uint8_t)TileCodecId::Rle || header.payloadSize % k_RleTokenSize != 0)
+		return false;
+
+	const uint8_t *end = payload + header.payloadSize;
+	uint32_t x = 0;
+	uint32_t y = 0;
+	for (const uint8_t *p = payload; p < end; p += k_RleTokenSize)
+	{
+		uint16_t length;
+		uint32_t pixel;
+		std::memcpy(&length, p, sizeof(length));
+		std::memcpy(&pixel, p + sizeof(length), sizeof(pixel));
+		for (; length > 0; --length)
+		{
+			if (y >= rect.height)
+				return false;
+			std::memcpy(dst + (size_t)y * dstStride + (size_t)x * k_BytesPerPixel, &pixel, sizeof(pixel));
+			if (++x == rect.width)
+			{
+				x = 0;
+				++y;
+			}
+		}
+	}
+	return y == rect.height && x == 0;
+}
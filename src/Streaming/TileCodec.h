@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+#include "Frame.h"
+#include "WireFormat.h"
+
+// Lossless quality; anything lower keeps only that many high bits per channel, which makes runs
+// longer and packed pixels smaller.
+constexpr uint8_t k_TileQualityLossless = 8;
+constexpr uint8_t k_TileQualityMin = 2;
+
+// Cursor the codec writes through.  When the current span fills up, next() has to move it to
+// fresh memory, so a record can end up split at any byte; the receiver stitches it back together.
+struct TileOutput
+{
+	uint8_t *cursor = nullptr;
+	uint8_t *end = nullptr;
+	void (*next)(TileOutput &output) = nullptr;
+	void *context = nullptr;
+
+	void Write(const void *data, size_t size)
+	{
+		if ((size_t)(end - cursor) >= size)
+		{
+			std::memcpy(cursor, data, size);
+			cursor += size;
+			return;
+		}
+		WriteSplit((const uint8_t *)data, size);
+	}
+
+private:
+	void WriteSplit(const uint8_t *data, size_t size);
+};
+
+class TileCodec
+{
+public:
+	// Upper bound for a tile record (header + payload), used to reserve arena space.
+	static size_t GetMaxRecordSize(const TileRect &rect);
+
+	// Picks the codec and works out the payload size without writing anything.  Falls back to
+	// packed pixels when run-length coding would not be smaller.
+	static TileRecordHeader Measure(const FrameView &frame, const TileRect &rect, uint32_t tileIndex, uint8_t quality);
+
+	// Writes the header and payload planned by Measure().
+	static void Write(const FrameView &frame, const TileRect &rect, const TileRecordHeader &header, TileOutput &output);
+
+	// Measure() and Write() into contiguous memory, returns the bytes written.
+	static size_t Encode(const FrameView &frame, const TileRect &rect, uint32_t tileIndex, uint8_t quality, uint8_t *out);
+
+	// Decodes a record payload into dst, which points at the tile's top left pixel.
+	static bool Decode(const TileRecordHeader &header, const uint8_t *payload, const TileRect &rect, uint8_t *dst, uint32_t dstStride);
+};
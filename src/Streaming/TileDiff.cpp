@@ -0,0 +1,59 @@
+#include "TileDiff.h"
+
+#include "TileHash.h"
+
+void TileDiffer::Diff(const FrameView &frame, std::span<const TileRect> rects, bool wholeFrame, std::vector<uint32_t> &dirtyTiles)
+{
+	dirtyTiles.clear();
+	if (frame.width != m_Grid.GetWidth() || frame.height != m_Grid.GetHeight())
+	{
+		m_Grid = TileGrid(frame.width, frame.height);
+		m_Hashes.clear();
+	}
+	const bool reset = m_Hashes.empty();
+	if (reset)
+		m_Hashes.assign(m_Grid.GetTileCount(), 0);
+
+	// The source says nothing changed, e.g. a static screen: not a single tile to hash.
+	if (!reset && !wholeFrame && rects.empty())
+		return;
+
+	const uint32_t tileCount = m_Grid.GetTileCount();
+	if (reset || wholeFrame)
+	{
+		for (uint32_t tile = 0; tile < tileCount; ++tile)
+		{
+			const uint64_t hash = HashTile(frame, m_Grid.GetTileRect(tile), 0);
+			if (reset || hash != m_Hashes[tile])
+				dirtyTiles.push_back(tile);
+			m_Hashes[tile] = hash;
+		}
+		m_HashedTiles += tileCount;
+		return;
+	}
+
+	m_Marked.assign(tileCount, 0);
+	const uint32_t columns = m_Grid.GetColumns();
+	for (const TileRect &rect : rects)
+	{
+		if (rect.width == 0 || rect.height == 0 || rect.x >= frame.width || rect.y >= frame.height)
+			continue;
+		const uint32_t right = std::min(rect.x + rect.width, frame.width) - 1;
+		const uint32_t bottom = std::min(rect.y + rect.height, frame.height) - 1;
+		for (uint32_t row = rect.y / k_TileSize; row <= bottom / k_TileSize; ++row)
+			std::fill(m_Marked.begin() + row * columns + rect.x / k_TileSize, m_Marked.begin() + row * columns + right / k_TileSize + 1, 1);
+	}
+
+	for (uint32_t tile = 0; tile < tileCount; ++tile)
+	{
+		if (!m_Marked[tile])
+			continue;
+		const uint64_t hash = HashTile(frame, m_Grid.GetTileRect(tile), 0);
+		if (hash != m_Hashes[tile])
+		{
+			dirtyTiles.push_back(tile);
+			m_Hashes[tile] = hash;
+		}
+		++m_HashedTiles;
+	}
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "Frame.h"
+
+// Diff state of one stream: a content hash per tile of the last frame, no pixels.  A tile is
+// dirty when its hash changed.  Sources that report what changed only get the tiles under their
+// rectangles hashed; those are often coarse, a blinking caret can dirty a whole line, and the
+// hashes cut them down to the tiles that really differ.
+class TileDiffer
+{
+public:
+	// Tiles of frame that differ from the last frame diffed, ascending.  Only tiles touching rects
+	// are looked at unless wholeFrame.  Every tile is dirty after a size change.
+	void Diff(const FrameView &frame, std::span<const TileRect> rects, bool wholeFrame, std::vector<uint32_t> &dirtyTiles);
+
+	// The next Diff() reports every tile.
+	void Reset() { m_Hashes.clear(); }
+
+	uint64_t GetHashedTileCount() const { return m_HashedTiles; }
+
+private:
+	TileGrid m_Grid;
+	std::vector<uint64_t> m_Hashes; // per tile, empty until the first frame
+	std::vector<uint8_t> m_Marked;	// per tile, scratch
+	uint64_t m_HashedTiles = 0;
+};
@@ -0,0 +1,155 @@
+#include "TileHash.h"
+
+#include <cstring>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define TILE_HASH_SSE2 1
+#endif
+
+static constexpr uint32_t k_StripeSize = 64;
+static constexpr uint32_t k_Lanes = k_StripeSize / sizeof(uint64_t);
+static constexpr uint32_t k_MaxStripes = k_TileSize * k_BytesPerPixel / k_StripeSize;
+
+static constexpr uint64_t k_Prime32_1 = 0x9E3779B1u;
+static constexpr uint64_t k_Prime64_1 = 0x9E3779B185EBCA87ull;
+static constexpr uint64_t k_Prime64_2 = 0xC2B2AE3D27D4EB4Full;
+static constexpr uint64_t k_Prime64_3 = 0x165667B19E3779F9ull;
+
+// One key per stripe position and lane, so equal stripes in different places don't cancel.
+struct HashKeys
+{
+	alignas(16) uint64_t stripe[k_MaxStripes][k_Lanes];
+	alignas(16) uint64_t scramble[k_Lanes];
+};
+
+static HashKeys BuildHashKeys()
+{
+	HashKeys keys = {};
+	uint64_t x = k_Prime64_3;
+	auto next = [&x]()
+	{
+		// splitmix64
+		x += 0x9E3779B97F4A7C15ull;
+		uint64_t z = x;
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+		return z ^ (z >> 31);
+	};
+	for (uint32_t s = 0; s < k_MaxStripes; ++s)
+	{
+		for (uint32_t i = 0; i < k_Lanes; ++i)
+			keys.stripe[s][i] = next();
+	}
+	for (uint32_t i = 0; i < k_Lanes; ++i)
+		keys.scramble[i] = next();
+	return keys;
+}
+
+static const HashKeys &GetHashKeys()
+{
+	static const HashKeys keys = BuildHashKeys();
+	return keys;
+}
+
+#if TILE_HASH_SSE2
+
+static void AccumulateStripe(__m128i *acc, const uint8_t *data, const uint64_t *key)
+{
+	for (uint32_t i = 0; i < k_Lanes / 2; ++i)
+	{
+		const __m128i d = _mm_loadu_si128((const __m128i *)data + i);
+		const __m128i dk = _mm_xor_si128(d, _mm_load_si128((const __m128i *)key + i));
+		const __m128i product = _mm_mul_epu32(dk, _mm_shuffle_epi32(dk, _MM_SHUFFLE(0, 3, 0, 1)));
+		const __m128i swapped = _mm_shuffle_epi32(d, _MM_SHUFFLE(1, 0, 3, 2));
+		acc[i] = _mm_add_epi64(acc[i], _mm_add_epi64(product, swapped));
+	}
+}
+
+static void ScrambleLanes(__m128i *acc, const uint64_t *key)
+{
+	const __m128i prime = _mm_set1_epi32((int)k_Prime32_1);
+	for (uint32_t i = 0; i < k_Lanes / 2; ++i)
+	{
+		__m128i a = _mm_xor_si128(acc[i], _mm_srli_epi64(acc[i], 47));
+		a = _mm_xor_si128(a, _mm_load_si128((const __m128i *)key + i));
+		const __m128i low = _mm_mul_epu32(a, prime);
+		const __m128i high = _mm_mul_epu32(_mm_shuffle_epi32(a, _MM_SHUFFLE(2, 3, 0, 1)), prime);
+		acc[i] = _mm_add_epi64(low, _mm_slli_epi64(high, 32));
+	}
+}
+
+#else
+
+static void AccumulateStripe(uint64_t *acc, const uint8_t *data, const uint64_t *key)
+{
+	for (uint32_t i = 0; i < k_Lanes; ++i)
+	{
+		uint64_t d;
+		std::memcpy(&d, data + i * sizeof(d), sizeof(d));
+		const uint64_t dk = d ^ key[i];
+		acc[i ^ 1] += d;
+		acc[i] += (dk & 0xFFFFFFFF) * (dk >> 32);
+	}
+}
+
+static void ScrambleLanes(uint64_t *acc, const uint64_t *key)
+{
+	for (uint32_t i = 0; i < k_Lanes; ++i)
+		acc[i] = ((acc[i] ^ (acc[i] >> 47) ^ key[i]) * k_Prime32_1);
+}
+
+#endif
+
+static uint64_t Avalanche(uint64_t h)
+{
+	h ^= h >> 37;
+	h *= 0x165667919E3779F9ull;
+	return h ^ (h >> 32);
+}
+
+uint64_t HashTile(const FrameView &frame, const TileRect &rect, uint64_t seed)
+{
+	const HashKeys &keys = GetHashKeys();
+	const uint32_t rowSize = rect.width * k_BytesPerPixel;
+	const uint32_t fullStripes = rowSize / k_StripeSize;
+	const uint32_t tail = rowSize % k_StripeSize;
+
+	alignas(16) uint64_t lanes[k_Lanes];
+	for (uint32_t i = 0; i < k_Lanes; ++i)
+		lanes[i] = seed + keys.scramble[i];
+
+#if TILE_HASH_SSE2
+	__m128i acc[k_Lanes / 2];
+	for (uint32_t i = 0; i < k_Lanes / 2; ++i)
+		acc[i] = _mm_load_si128((const __m128i *)lanes + i);
+#else
+	uint64_t *acc = lanes;
+#endif
+
+	alignas(16) uint8_t padded[k_StripeSize] = {};
+	for (uint32_t y = 0; y < rect.height; ++y)
+	{
+		const uint8_t *row = frame.Row(rect.y + y) + (size_t)rect.x * k_BytesPerPixel;
+		for (uint32_t s = 0; s < fullStripes; ++s)
+			AccumulateStripe(acc, row + s * k_StripeSize, keys.stripe[s]);
+		if (tail != 0)
+		{
+			// Edge tiles only, the zero padding is fine since the width goes into the final mix.
+			std::memcpy(padded, row + fullStripes * k_StripeSize, tail);
+			AccumulateStripe(acc, padded, keys.stripe[fullStripes]);
+		}
+		ScrambleLanes(acc, keys.scramble);
+	}
+
+#if TILE_HASH_SSE2
+	for (uint32_t i = 0; i < k_Lanes / 2; ++i)
+		_mm_store_si128((__m128i *)lanes + i, acc[i]);
+#endif
+
+	uint64_t h = ((uint64_t)rect.width << 32 | rect.height) * k_Prime64_1 ^ seed;
+	for (uint32_t i = 0; i < k_Lanes; i += 2)
+		h += ((lanes[i] ^ keys.stripe[0][i]) * ((lanes[i + 1] ^ keys.stripe[0][i + 1]) | 1)) ^ (lanes[i] >> 29);
+	h = (h ^ (h >> 33)) * k_Prime64_2;
+	return Avalanche(h);
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cstdint>
+
+#include "Frame.h"
+
+// 64 bit content hash of the pixels in rect, in the style of XXH3: eight 64 bit lanes take a
+// 64 byte stripe at a time with a 32x32 multiply each, and the lanes are scrambled after every
+// row so rows and stripes can't trade places.  Uses SSE2 where available.
+//
+// Not meant to be stable across versions or platforms, only the sender ever computes it.
+uint64_t HashTile(const FrameView &frame, const TileRect &rect, uint64_t seed);
@@ -0,0 +1,43 @@
+#include "TilePriority.h"
+
+#include <algorithm>
+
+// Raises every tile of grid that a frame rectangle, in pixels before scaling, touches to priority.
+static void RaiseRect(const TileGrid &grid, uint32_t shift, int64_t left, int64_t top, int64_t right, int64_t bottom, uint8_t priority, std::vector<uint8_t> &priorities)
+{
+	const int64_t frameWidth = (int64_t)grid.GetWidth() << shift;
+	const int64_t frameHeight = (int64_t)grid.GetHeight() << shift;
+	left = std::max<int64_t>(left, 0);
+	top = std::max<int64_t>(top, 0);
+	right = std::min(right, frameWidth);
+	bottom = std::min(bottom, frameHeight);
+	if (right <= left || bottom <= top)
+		return;
+
+	const uint32_t tileSize = k_TileSize << shift;
+	const uint32_t lastColumn = std::min(grid.GetColumns() - 1, (uint32_t)((right - 1) / tileSize));
+	const uint32_t lastRow = std::min(grid.GetRows() - 1, (uint32_t)((bottom - 1) / tileSize));
+	for (uint32_t row = (uint32_t)(top / tileSize); row <= lastRow; ++row)
+	{
+		for (uint32_t column = (uint32_t)(left / tileSize); column <= lastColumn; ++column)
+		{
+			uint8_t &tile = priorities[row * grid.GetColumns() + column];
+			tile = std::max(tile, priority);
+		}
+	}
+}
+
+void BuildTilePriorities(const TileGrid &grid, uint32_t shift, const FrameFocus &focus, std::vector<uint8_t> &priorities)
+{
+	priorities.assign(grid.GetTileCount(), k_TilePriorityNormal);
+	if (grid.GetTileCount() == 0)
+		return;
+
+	const TileRect &window = focus.window;
+	RaiseRect(grid, shift, window.x, window.y, (int64_t)window.x + window.width, (int64_t)window.y + window.height, k_TilePriorityWindow, priorities);
+	if (focus.hasCursor)
+	{
+		const int64_t radius = k_CursorPriorityRadius;
+		RaiseRect(grid, shift, focus.cursorX - radius, focus.cursorY - radius, focus.cursorX + radius + 1, focus.cursorY + radius + 1, k_TilePriorityCursor, priorities);
+	}
+}
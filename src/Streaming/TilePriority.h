@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "Frame.h"
+
+// Where the user is looking, as far as the capture source knows, in frame pixels.
+struct FrameFocus
+{
+	bool hasCursor = false;
+	int32_t cursorX = 0;
+	int32_t cursorY = 0;
+	TileRect window; // the foreground window, empty while unknown
+};
+
+// Higher goes first.
+constexpr uint8_t k_TilePriorityNormal = 0;
+constexpr uint8_t k_TilePriorityWindow = 1;
+constexpr uint8_t k_TilePriorityCursor = 2;
+
+// Tiles within this many frame pixels of the cursor count as under it.  Roughly what a caret,
+// a tooltip or the control being dragged covers.
+constexpr uint32_t k_CursorPriorityRadius = 96;
+
+// Priority of every tile of grid, which covers the frame focus describes scaled down by 2^shift.
+void BuildTilePriorities(const TileGrid &grid, uint32_t shift, const FrameFocus &focus, std::vector<uint8_t> &priorities);
@@ -0,0 +1,195 @@
+#include "TileRefresh.h"
+
+#include <cstring>
+#include <algorithm>
+
+#include "Frame.h"
+#include "TileCache.h"
+#include "WireFormat.h"
+
+void NackGenerator::AddLostTiles(std::span<const uint32_t> tiles, uint32_t width, uint32_t height)
+{
+	if (tiles.empty())
+		return;
+
+	if (width != m_Width || height != m_Height)
+	{
+		m_Width = width;
+		m_Height = height;
+		m_Lost.assign(TileGrid(width, height).GetTileCount(), 0);
+		m_LostCount = 0;
+	}
+
+	for (uint32_t tile : tiles)
+	{
+		if (tile >= m_Lost.size() || m_Lost[tile])
+			continue;
+		if (m_LostCount == 0 || tile < m_FirstLost)
+			m_FirstLost = tile;
+		if (m_LostCount == 0 || tile > m_LastLost)
+			m_LastLost = tile;
+		m_Lost[tile] = 1;
+		++m_LostCount;
+	}
+}
+
+bool NackGenerator::BuildMessage(std::chrono::steady_clock::time_point now, uint32_t stream, std::vector<uint8_t> &message)
+{
+	if (m_LostCount == 0 || now - m_LastNack < k_NackInterval)
+		return false;
+
+	TileNackHeader header;
+	header.stream = (uint8_t)stream;
+	header.frameWidth = (uint16_t)m_Width;
+	header.frameHeight = (uint16_t)m_Height;
+
+	if (m_LostCount * k_FullRefreshShare > m_Lost.size())
+	{
+		// Keep collecting until the next full refresh is allowed, it covers all of them anyway.
+		if (now - m_LastFullRefresh < k_FullRefreshInterval)
+			return false;
+		m_LastFullRefresh = now;
+		++m_FullRefreshCount;
+
+		header.flags = TileNackHeader::k_FlagFullRefresh;
+		message.resize(sizeof(header));
+		std::memcpy(message.data(), &header, sizeof(header));
+	}
+	else
+	{
+		header.firstTile = m_FirstLost;
+		header.tileSpan = m_LastLost - m_FirstLost + 1;
+		message.assign(sizeof(header) + (header.tileSpan + 7) / 8, 0);
+		std::memcpy(message.data(), &header, sizeof(header));
+
+		uint8_t *bitmap = message.data() + sizeof(header);
+		for (uint32_t i = 0; i < header.tileSpan; ++i)
+		{
+			if (m_Lost[m_FirstLost + i])
+				bitmap[i / 8] |= (uint8_t)(1 << (i % 8));
+		}
+		++m_NackCount;
+	}
+
+	m_LastNack = now;
+	std::fill(m_Lost.begin(), m_Lost.end(), 0);
+	m_LostCount = 0;
+	return true;
+}
+
+void TileRefreshScheduler::OnNack(const uint8_t *data, uint32_t size)
+{
+	TileNackHeader header;
+	if (size < sizeof(header))
+		return;
+	std::memcpy(&header, data, sizeof(header));
+	if (header.type != (uint8_t)MessageType::TileNack || header.frameWidth == 0 || header.frameHeight == 0)
+		return;
+
+	SetFrameSize(header.frameWidth, header.frameHeight);
+
+	if (header.flags & TileNackHeader::k_FlagFullRefresh)
+	{
+		m_FullRefresh = true;
+		return;
+	}
+
+	const uint64_t bitmapSize = ((uint64_t)header.tileSpan + 7) / 8;
+	if (size != sizeof(header) + bitmapSize || (uint64_t)header.firstTile + header.tileSpan > m_Requested.size())
+		return;
+
+	const uint8_t *bitmap = data + sizeof(header);
+	for (uint32_t i = 0; i < header.tileSpan; ++i)
+	{
+		if (bitmap[i / 8] & (1 << (i % 8)))
+			Request(header.firstTile + i);
+	}
+}
+
+void TileRefreshScheduler::RequestTiles(std::span<const uint32_t> tiles, uint32_t width, uint32_t height)
+{
+	if (width == 0 || height == 0)
+		return;
+
+	SetFrameSize(width, height);
+	for (uint32_t tile : tiles)
+	{
+		if (tile < m_Requested.size())
+			Request(tile);
+	}
+}
+
+void TileRefreshScheduler::SetFrameSize(uint32_t width, uint32_t height)
+{
+	if (width == m_Width && height == m_Height)
+		return;
+
+	m_Width = width;
+	m_Height = height;
+	m_Requested.assign(TileGrid(m_Width, m_Height).GetTileCount(), 0);
+	m_RequestedCount = 0;
+	m_FullRefresh = false;
+}
+
+void TileRefreshScheduler::Request(uint32_t tile)
+{
+	if (!m_Requested[tile])
+	{
+		m_Requested[tile] = 1;
+		++m_RequestedCount;
+	}
+}
+
+void TileRefreshScheduler::OnCacheMiss(const uint8_t *data, uint32_t size)
+{
+	TileCacheMissHeader header;
+	if (size < sizeof(header))
+		return;
+	std::memcpy(&header, data, sizeof(header));
+	if (header.type != (uint8_t)MessageType::TileCacheMiss || size != sizeof(header) + header.slotCount * sizeof(uint16_t))
+		return;
+
+	const size_t count = m_CacheMisses.size();
+	m_CacheMisses.resize(count + header.slotCount);
+	std::memcpy(m_CacheMisses.data() + count, data + sizeof(header), header.slotCount * sizeof(uint16_t));
+}
+
+void TileRefreshScheduler::ApplyCacheMisses(TileCache &cache)
+{
+	for (uint16_t slot : m_CacheMisses)
+		cache.Invalidate(slot);
+	m_CacheMisses.clear();
+}
+
+void TileRefreshScheduler::CollectTiles(uint32_t width, uint32_t height, std::vector<uint32_t> &dirtyTiles)
+{
+	if (!HasPendingTiles())
+		return;
+
+	if (width != m_Width || height != m_Height)
+	{
+		// Asked for against a frame we no longer send, the new size goes out whole anyway.
+		std::fill(m_Requested.begin(), m_Requested.end(), 0);
+		m_RequestedCount = 0;
+		m_FullRefresh = false;
+		return;
+	}
+
+	if (m_FullRefresh)
+		std::fill(m_Requested.begin(), m_Requested.end(), 1);
+	for (uint32_t tile : dirtyTiles)
+		m_Requested[tile] = 0;
+
+	const size_t dirtyCount = dirtyTiles.size();
+	for (uint32_t tile = 0; tile < m_Requested.size(); ++tile)
+	{
+		if (m_Requested[tile])
+			dirtyTiles.push_back(tile);
+	}
+	m_RefreshedTiles += dirtyTiles.size() - dirtyCount;
+	std::inplace_merge(dirtyTiles.begin(), dirtyTiles.begin() + dirtyCount, dirtyTiles.end());
+
+	std::fill(m_Requested.begin(), m_Requested.end(), 0);
+	m_RequestedCount = 0;
+	m_FullRefresh = false;
+}
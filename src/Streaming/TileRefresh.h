@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdint>
+#include <chrono>
+#include <span>
+#include <vector>
+
+class TileCache;
+
+// Receive side of selective refresh.  Collects lost tiles and turns them into TileNack messages,
+// at most one every k_NackInterval.  When a large share of the screen is lost, a NACK would cost
+// about as much as the frame itself, so it asks for a full refresh instead, and no more often
+// than k_FullRefreshInterval.  Under heavy loss that turns a storm of NACKs into a periodic
+// full refresh.
+class NackGenerator
+{
+public:
+	static constexpr std::chrono::milliseconds k_NackInterval{10};
+	static constexpr std::chrono::milliseconds k_FullRefreshInterval{500};
+	// Lost tiles past 1 / k_FullRefreshShare of the grid ask for a full refresh.
+	static constexpr uint32_t k_FullRefreshShare = 4;
+
+	// Tiles of a width x height frame.  Tiles of an earlier size are forgotten.
+	void AddLostTiles(std::span<const uint32_t> tiles, uint32_t width, uint32_t height);
+
+	// Fills message with a TileNack for stream when one is due.
+	bool BuildMessage(std::chrono::steady_clock::time_point now, uint32_t stream, std::vector<uint8_t> &message);
+
+	uint32_t GetNackCount() const { return m_NackCount; }
+	uint32_t GetFullRefreshCount() const { return m_FullRefreshCount; }
+
+private:
+	uint32_t m_Width = 0;
+	uint32_t m_Height = 0;
+	std::vector<uint8_t> m_Lost; // per tile
+	uint32_t m_LostCount = 0;
+	uint32_t m_FirstLost = 0;
+	uint32_t m_LastLost = 0;
+
+	std::chrono::steady_clock::time_point m_LastNack;
+	std::chrono::steady_clock::time_point m_LastFullRefresh;
+	uint32_t m_NackCount = 0;
+	uint32_t m_FullRefreshCount = 0;
+};
+
+// Send side.  Merges NACKs from every peer and hands the requested tiles to the next encode, so
+// they are re-encoded from the current frame rather than resent as they were.  Cache misses are
+// collected here too, they have to reach the TileCache before that encode.
+class TileRefreshScheduler
+{
+public:
+	// Ignores anything that isn't a well formed TileNack.
+	void OnNack(const uint8_t *data, uint32_t size);
+
+	// Tiles of a width x height frame the sender itself wants sent again.
+	void RequestTiles(std::span<const uint32_t> tiles, uint32_t width, uint32_t height);
+
+	// Adds the requested tiles of a width x height frame to dirtyTiles, which is sorted and
+	// stays sorted and unique.  Requests made against another frame size are dropped.
+	void CollectTiles(uint32_t width, uint32_t height, std::vector<uint32_t> &dirtyTiles);
+
+	// Ignores anything that isn't a well formed TileCacheMiss.
+	void OnCacheMiss(const uint8_t *data, uint32_t size);
+
+	// Invalidates the slots peers reported.  Call before CollectTiles() and the encode.
+	void ApplyCacheMisses(TileCache &cache);
+
+	bool HasPendingTiles() const { return m_FullRefresh || m_RequestedCount != 0; }
+
+	uint64_t GetRefreshedTileCount() const { return m_RefreshedTiles; }
+
+private:
+	// Requests made against another size are forgotten.
+	void SetFrameSize(uint32_t width, uint32_t height);
+	void Request(uint32_t tile);
+
+private:
+	uint32_t m_Width = 0;
+	uint32_t m_Height = 0;
+	std::vector<uint8_t> m_Requested; // per tile
+	uint32_t m_RequestedCount = 0;
+	bool m_FullRefresh = false;
+	std::vector<uint16_t> m_CacheMisses;
+
+	uint64_t m_RefreshedTiles = 0;
+};
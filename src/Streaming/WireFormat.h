@@ -0,0 +1,292 @@
+#pragma once
+
+#include <cstdint>
+#include <chrono>
+
+// Binary messages sent between peers.  Every message starts with a one byte type.
+enum class MessageType : uint8_t
+{
+	Invalid = 0,
+	FrameUpdate,
+	FrameParity,
+	TileNack,
+	TileCacheMiss,
+	Snapshot,
+	Viewport,
+	CursorPosition,
+	CursorShape,
+	InputEvents,
+	StreamSubscription,
+	StreamKeepalive,
+};
+
+enum class FecScheme : uint8_t
+{
+	None = 0,
+	Xor,
+	ReedSolomon,
+};
+
+// Lanes configured on every peer connection by PeerConnections.  Lower numbers are drained
+// first, so a chat line or a refresh request never waits behind a full screen of tiles, and
+// neither does the cursor or the viewer's input.  Chat has to stay lane 0, see SendOnLane().
+enum class Lane : uint16_t
+{
+	Chat = 0,
+	Input,
+	Control,
+	Cursor,
+	Video,
+	Bulk, // snapshots for viewers that just joined
+	Count
+};
+
+// A peer can share several screens, each one an independent stream with its own frame ids, tile
+// grid and cache.  Stream 0's frames and parity go on the video lane, stream n's on a lane of its
+// own past Lane::Count with the video lane's priority, so streams share the path evenly and the
+// receiver tells them apart by lane.  Control messages and snapshots name their stream instead.
+constexpr uint32_t k_MaxStreams = 4;
+constexpr uint32_t k_LaneCount = (uint32_t)Lane::Count + k_MaxStreams - 1;
+
+inline Lane GetStreamLane(uint32_t stream)
+{
+	return stream == 0 ? Lane::Video : (Lane)((uint32_t)Lane::Count + stream - 1);
+}
+
+// The stream whose frames travel on lane, k_MaxStreams when it carries none.
+inline uint32_t GetLaneStream(uint16_t lane)
+{
+	if (lane == (uint16_t)Lane::Video)
+		return 0;
+	if (lane >= (uint16_t)Lane::Count && lane < k_LaneCount)
+		return lane - (uint32_t)Lane::Count + 1;
+	return k_MaxStreams;
+}
+
+// The sender's clock as messages carry it, see FrameUpdateHeader::timestamp.
+inline uint32_t GetWireTimestamp(std::chrono::steady_clock::time_point time)
+{
+	return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(time.time_since_epoch()).count();
+}
+
+#pragma pack(push, 1)
+
+// Prefix of every frame update fragment.  The encoder reserves room for it in front of each
+// fragment, and it is filled in once the frame has been stitched, so the tile data never moves.
+//
+// A frame's tile records form one byte stream cut into fragments.  Fragments start on a record
+// boundary whenever the record fits, only records larger than a fragment continue into the next.
+struct FrameUpdateHeader
+{
+	uint8_t type = (uint8_t)MessageType::FrameUpdate;
+	uint8_t fecScheme = (uint8_t)FecScheme::None;
+	uint16_t tileCount = 0; // tile records starting in this fragment
+	uint32_t frameId = 0;
+	uint16_t fragmentIndex = 0;
+	uint16_t fragmentCount = 0;
+	uint16_t frameWidth = 0;
+	uint16_t frameHeight = 0;
+	uint16_t firstRecordOffset = 0; // payload offset of the first record starting here, if tileCount != 0
+	uint8_t fecGroupSize = 0;		// data fragments per parity group, the last group may be short
+	uint8_t fecParityCount = 0;		// parity fragments per group
+	uint32_t timestamp = 0;			// sender's clock at capture, in microseconds; wraps, only differences count
+	uint32_t diffedAfter = 0;		// microseconds after timestamp the capture was diffed,
+	uint32_t encodedAfter = 0;		// and the frame encoded, see LatencyStage
+};
+
+// Parity over a group of consecutive data fragments of one frame.  Each data fragment counts as
+// a symbol of [uint16 size][whole fragment message][zero padding up to symbolSize].
+struct FrameParityHeader
+{
+	uint8_t type = (uint8_t)MessageType::FrameParity;
+	uint8_t fecScheme = (uint8_t)FecScheme::None;
+	uint16_t firstFragment = 0;
+	uint32_t frameId = 0;
+	uint16_t fragmentCount = 0; // data fragments in the frame
+	uint8_t dataCount = 0;		// data fragments in this group
+	uint8_t parityCount = 0;
+	uint8_t parityIndex = 0;
+	uint8_t groupSize = 0; // data fragments per group, firstFragment is a multiple of it
+	uint16_t symbolSize = 0; // parity bytes following the header
+};
+
+// Receiver to sender, asks for tiles to be sent again from the sender's current frame.  Followed
+// by a bitmap of (tileSpan + 7) / 8 bytes, bit i set for tile firstTile + i.
+struct TileNackHeader
+{
+	static constexpr uint8_t k_FlagFullRefresh = 1 << 0; // every tile, no bitmap follows
+
+	uint8_t type = (uint8_t)MessageType::TileNack;
+	uint8_t flags = 0;
+	uint8_t stream = 0;
+	uint8_t reserved = 0;
+	uint16_t frameWidth = 0; // tile indices are only meaningful for this size
+	uint16_t frameHeight = 0;
+	uint32_t firstTile = 0;
+	uint32_t tileSpan = 0;
+};
+
+// Receiver to sender, cache slots a CacheRef record found empty or holding something else.  The
+// sender must not reference them again before storing into them.  Followed by slotCount uint16
+// slot numbers.
+struct TileCacheMissHeader
+{
+	uint8_t type = (uint8_t)MessageType::TileCacheMiss;
+	uint8_t stream = 0;
+	uint16_t slotCount = 0;
+	uint16_t frameWidth = 0; // the slots are of the cache of the layer sending this size
+	uint16_t frameHeight = 0;
+};
+
+// Sender to a viewer that just joined or changed layers, the current screen as the sender last
+// encoded it.  Followed by recordCount whole records, each [uint32 frame id the tile was encoded
+// in][TileRecordHeader][payload].  Never a CacheRef, and never with a cacheSlot.
+struct SnapshotHeader
+{
+	uint8_t type = (uint8_t)MessageType::Snapshot;
+	uint8_t stream = 0;
+	uint16_t recordCount = 0;
+	uint16_t frameWidth = 0;
+	uint16_t frameHeight = 0;
+	uint32_t frameId = 0; // the last frame encoded into the snapshot, it is as new as that frame
+};
+
+enum class TileCodecId : uint8_t
+{
+	Raw = 0,
+	Rle,
+	CacheRef, // payload is the uint32 frame id that stored cacheSlot
+	Packed,	  // the top quality bits of each colour channel, packed low bit first, no alpha
+};
+
+constexpr uint16_t k_NoCacheSlot = 0xFFFF;
+
+// Followed by payloadSize bytes of codec data.  A coded record with a cacheSlot also asks the
+// receiver to keep the decoded tile in that slot of its tile cache.
+struct TileRecordHeader
+{
+	uint32_t tileIndex = 0;
+	uint8_t codec = (uint8_t)TileCodecId::Raw;
+	uint8_t quality = 0;
+	uint16_t cacheSlot = k_NoCacheSlot;
+	uint32_t payloadSize = 0;
+};
+
+// Part of the frame, in 1/65535ths of its width and height, right and bottom included.  Means
+// the same on every simulcast layer.
+struct ViewportRect
+{
+	uint16_t left = 0;
+	uint16_t top = 0;
+	uint16_t right = 0xFFFF;
+	uint16_t bottom = 0xFFFF;
+};
+
+// Viewer to sender, what part of the screen it shows and how many display pixels that takes.
+// Sent on the control lane whenever it changes.  Tiles outside are only sent once they scroll in.
+struct ViewportHeader
+{
+	uint8_t type = (uint8_t)MessageType::Viewport;
+	uint8_t stream = 0;
+	uint16_t displayWidth = 0; // 0 when the viewer doesn't know
+	uint16_t displayHeight = 0;
+	uint16_t refreshRate = 0; // Hz, 0 when the viewer doesn't know
+	ViewportRect rect;
+};
+
+// Sender to viewer, on the cursor lane and unreliable: where the cursor is, at most once per
+// display refresh.  Only the newest position matters, older ones that arrive late are ignored.
+struct CursorPositionHeader
+{
+	static constexpr uint8_t k_FlagVisible = 1;
+
+	uint8_t type = (uint8_t)MessageType::CursorPosition;
+	uint8_t flags = 0;
+	uint16_t sequence = 0; // wraps
+	uint32_t shapeId = 0;  // see CursorShapeHeader
+	int16_t x = 0;		   // hotspot, in pixels of the full resolution frame; may be off it
+	int16_t y = 0;
+	uint16_t frameWidth = 0;
+	uint16_t frameHeight = 0;
+};
+
+// Sender to viewer, on the cursor lane and reliable, ahead of the first position that uses it.
+// Followed by width * height BGRA pixels, alpha not premultiplied.  The viewer keeps the last
+// k_CursorShapeCacheSize shapes, so each one only goes out once while it stays in use.
+struct CursorShapeHeader
+{
+	uint8_t type = (uint8_t)MessageType::CursorShape;
+	uint8_t reserved = 0;
+	uint16_t width = 0;
+	uint16_t height = 0;
+	uint16_t hotspotX = 0;
+	uint16_t hotspotY = 0;
+	uint16_t reserved2 = 0;
+	uint32_t shapeId = 0;
+};
+
+enum class InputEventType : uint8_t
+{
+	Key = 0,	// code is a Windows virtual key
+	Button,		// code 0 left, 1 right, 2 middle, 3 and 4 the side buttons
+	Wheel,		// x and y in 1/120ths of a notch, y positive away from the user
+	MouseMove,	// x and y in 1/65535ths of the frame, like ViewportRect
+	MouseDelta, // x and y in mickeys, for captured relative motion
+};
+
+struct InputEvent
+{
+	static constexpr uint8_t k_FlagDown = 1;
+
+	uint8_t type = (uint8_t)InputEventType::Key;
+	uint8_t flags = 0; // k_FlagDown for keys and buttons going down
+	uint16_t code = 0;
+	int32_t x = 0;
+	int32_t y = 0;
+};
+
+// Viewer to sender, on the input lane, reliable and without Nagle.  Followed by eventCount
+// InputEvents in the order they happened.
+struct InputEventsHeader
+{
+	uint8_t type = (uint8_t)MessageType::InputEvents;
+	uint8_t reserved = 0;
+	uint16_t eventCount = 0;
+};
+
+// Viewer to sender, on the control lane and reliable: bit n set for every stream it wants.  A
+// viewer that never sends one gets stream 0.  Streams nobody wants aren't captured or encoded.
+struct StreamSubscriptionHeader
+{
+	uint8_t type = (uint8_t)MessageType::StreamSubscription;
+	uint8_t reserved = 0;
+	uint16_t streamMask = 1;
+};
+
+// Sender to viewer, unreliable on the stream's lane, about once a second while the stream's
+// screen doesn't change and no frames are sent.  Carries the clock frames would, so the viewer's
+// playout keeps following the sender's clock across a long still: timestamps wrap after 71
+// minutes, and the transits it measured are long gone by then.
+struct StreamKeepaliveHeader
+{
+	uint8_t type = (uint8_t)MessageType::StreamKeepalive;
+	uint8_t stream = 0;
+	uint16_t reserved = 0;
+	uint32_t timestamp = 0; // as FrameUpdateHeader's, sender's clock when sent
+};
+
+#pragma pack(pop)
+
+static_assert(sizeof(FrameUpdateHeader) == 32);
+static_assert(sizeof(FrameParityHeader) == 16);
+static_assert(sizeof(TileNackHeader) == 16);
+static_assert(sizeof(TileCacheMissHeader) == 8);
+static_assert(sizeof(SnapshotHeader) == 12);
+static_assert(sizeof(TileRecordHeader) == 12);
+static_assert(sizeof(ViewportHeader) == 16);
+static_assert(sizeof(CursorPositionHeader) == 16);
+static_assert(sizeof(CursorShapeHeader) == 16);
+static_assert(sizeof(InputEvent) == 12);
+static_assert(sizeof(InputEventsHeader) == 4);
+static_assert(sizeof(StreamSubscriptionHeader) == 4);
+static_assert(sizeof(StreamKeepaliveHeader) == 8);
@@ -0,0 +1,147 @@
+#include "WorkStealingPool.h"
+
+#include <cassert>
+#include <algorithm>
+
+WorkStealingPool::WorkStealingPool(uint32_t threadCount)
+{
+	if (threadCount == 0)
+		threadCount = 1;
+
+	for (uint32_t i = 0; i < threadCount; ++i)
+		m_Queues.push_back(std::make_unique<WorkerQueue>());
+
+	//? the last queue belongs to whoever calls ParallelFor()
+	for (uint32_t i = 0; i + 1 < threadCount; ++i)
+		m_Threads.emplace_back([this, i]()
+							   { WorkerThreadFunc(i); });
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_WakeMutex);
+		m_Stop.store(true);
+	}
+	m_WakeCv.notify_all();
+	for (std::thread &thread : m_Threads)
+		thread.join();
+}
+
+void WorkStealingPool::Run(Job &job, uint32_t taskCount)
+{
+	std::lock_guard<std::mutex> submitLock(m_SubmitMutex);
+
+	const uint32_t workerCount = GetWorkerCount();
+	const uint32_t callerIndex = workerCount - 1;
+
+	// Hand out contiguous blocks rather than round robin, neighbouring tasks usually touch
+	// neighbouring memory.  Stealing evens out whatever imbalance this leaves.
+	const uint32_t perWorker = (taskCount + workerCount - 1) / workerCount;
+	for (uint32_t worker = 0; worker < workerCount; ++worker)
+	{
+		uint32_t begin = worker * perWorker;
+		uint32_t end = std::min(taskCount, begin + perWorker);
+		if (begin >= end)
+			break;
+
+		WorkerQueue &queue = *m_Queues[worker];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		// Pushed in reverse so the owner, popping from the back, walks its block front to back.
+		for (uint32_t i = end; i > begin; --i)
+			queue.tasks.push_back({&job, i - 1});
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_WakeMutex);
+		m_QueuedTasks.fetch_add(taskCount);
+	}
+	m_WakeCv.notify_all();
+
+	Task task;
+	while (job.remaining.load(std::memory_order_acquire) != 0)
+	{
+		if (TryPop(callerIndex, task) || TrySteal(callerIndex, task))
+		{
+			Execute(task, callerIndex);
+			continue;
+		}
+
+		// Nothing left to steal, the remaining tasks are already running elsewhere.
+		std::unique_lock<std::mutex> lock(m_DoneMutex);
+		m_DoneCv.wait(lock, [&job]()
+					  { return job.remaining.load(std::memory_order_acquire) == 0; });
+	}
+}
+
+void WorkStealingPool::WorkerThreadFunc(uint32_t workerIndex)
+{
+	Task task;
+	while (true)
+	{
+		if (TryPop(workerIndex, task) || TrySteal(workerIndex, task))
+		{
+			Execute(task, workerIndex);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(m_WakeMutex);
+		m_WakeCv.wait(lock, [this]()
+					  { return m_Stop.load() || m_QueuedTasks.load() != 0; });
+		if (m_Stop.load())
+			return;
+	}
+}
+
+bool WorkStealingPool::TryPop(uint32_t workerIndex, Task &task)
+{
+	WorkerQueue &queue = *m_Queues[workerIndex];
+	std::lock_guard<std::mutex> lock(queue.mutex);
+	if (queue.head == queue.tasks.size())
+		return false;
+
+	task = queue.tasks.back();
+	queue.tasks.pop_back();
+	if (queue.head == queue.tasks.size())
+	{
+		queue.tasks.clear();
+		queue.head = 0;
+	}
+	m_QueuedTasks.fetch_sub(1);
+	return true;
+}
+
+bool WorkStealingPool::TrySteal(uint32_t workerIndex, Task &task)
+{
+	const uint32_t workerCount = GetWorkerCount();
+	for (uint32_t offset = 1; offset < workerCount; ++offset)
+	{
+		WorkerQueue &queue = *m_Queues[(workerIndex + offset) % workerCount];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (queue.head == queue.tasks.size())
+			continue;
+
+		task = queue.tasks[queue.head++];
+		if (queue.head == queue.tasks.size())
+		{
+			queue.tasks.clear();
+			queue.head = 0;
+		}
+		m_QueuedTasks.fetch_sub(1);
+		return true;
+	}
+	return false;
+}
+
+void WorkStealingPool::Execute(const Task &task, uint32_t workerIndex)
+{
+	Job &job = *task.job;
+	job.invoke(job.context, task.index, workerIndex);
+
+	if (job.remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+	{
+		// Take the lock so the notify cannot slip in between the caller's check and its wait.
+		std::lock_guard<std::mutex> lock(m_DoneMutex);
+		m_DoneCv.notify_all();
+	}
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstdint>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Fixed set of worker threads, each with its own task queue.  Workers pop from the back of their
+// own queue and steal from the front of everyone else's, so uneven tiles (flat colour vs. text)
+// still keep every core busy.
+//
+// The thread calling ParallelFor() takes part as the last worker, so a pool created with a
+// threadCount of 1 runs everything inline on the caller.
+class WorkStealingPool
+{
+public:
+	explicit WorkStealingPool(uint32_t threadCount = std::thread::hardware_concurrency());
+	~WorkStealingPool();
+
+	WorkStealingPool(const WorkStealingPool &) = delete;
+	WorkStealingPool &operator=(const WorkStealingPool &) = delete;
+
+	// Number of distinct worker indices passed to tasks, including the calling thread.
+	uint32_t GetWorkerCount() const { return (uint32_t)m_Queues.size(); }
+
+	// Runs fn(taskIndex, workerIndex) for every task and returns when all of them are done.
+	template <typename Fn>
+	void ParallelFor(uint32_t taskCount, Fn &&fn)
+	{
+		if (taskCount == 0)
+			return;
+
+		using FnType = std::remove_reference_t<Fn>;
+		Job job;
+		job.context = (void *)&fn;
+		job.invoke = [](void *context, uint32_t taskIndex, uint32_t workerIndex)
+		{
+			(*static_cast<FnType *>(context))(taskIndex, workerIndex);
+		};
+		job.remaining.store(taskCount);
+		Run(job, taskCount);
+	}
+
+private:
+	struct Job
+	{
+		void (*invoke)(void *context, uint32_t taskIndex, uint32_t workerIndex) = nullptr;
+		void *context = nullptr;
+		std::atomic<uint32_t> remaining = 0;
+	};
+
+	struct Task
+	{
+		Job *job = nullptr;
+		uint32_t index = 0;
+	};
+
+	// Tasks live in [head, tasks.size()).  The owner pops from the back, thieves take from head.
+	// Storage is cleared but never shrunk, so steady state pushes do not allocate.
+	struct WorkerQueue
+	{
+		std::mutex mutex;
+		std::vector<Task> tasks;
+		size_t head = 0;
+	};
+
+	void Run(Job &job, uint32_t taskCount);
+	void WorkerThreadFunc(uint32_t workerIndex);
+
+	bool TryPop(uint32_t workerIndex, Task &task);
+	bool TrySteal(uint32_t workerIndex, Task &task);
+	void Execute(const Task &task, uint32_t workerIndex);
+
+private:
+	std::vector<std::unique_ptr<WorkerQueue>> m_Queues;
+	std::vector<std::thread> m_Threads;
+
+	std::atomic<uint32_t> m_QueuedTasks = 0;
+	std::atomic<bool> m_Stop = false;
+
+	std::mutex m_WakeMutex;
+	std::condition_variable m_WakeCv;
+
+	std::mutex m_DoneMutex;
+	std::condition_variable m_DoneCv;
+
+	// Only one ParallelFor() may be distributing work at a time, it owns the caller worker slot.
+	std::mutex m_SubmitMutex;
+};
@@ -14,6 +14,7 @@
 
 #pragma comment(lib, "d3d11.lib")
 #pragma comment(lib, "dxgi.lib")
+#pragma comment(lib, "dwmapi.lib")
 #pragma comment(lib, "Ws2_32.lib")
 
 #ifdef _MSC_VER
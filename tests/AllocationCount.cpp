@@ -0,0 +1,34 @@
+#include "AllocationCount.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+static std::atomic<uint64_t> s_Allocations = 0;
+
+uint64_t GetAllocationCount()
+{
+	return s_Allocations.load();
+}
+
+void *operator new(size_t size)
+{
+	s_Allocations.fetch_add(1, std::memory_order_relaxed);
+	if (void *p = std::malloc(size ? size : 1))
+		return p;
+	throw std::bad_alloc();
+}
+
+void *operator new(size_t size, std::align_val_t alignment)
+{
+	s_Allocations.fetch_add(1, std::memory_order_relaxed);
+	const size_t align = (size_t)alignment;
+	if (void *p = std::aligned_alloc(align, (size + align - 1) / align * align))
+		return p;
+	throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+void operator delete(void *p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void *p, size_t, std::align_val_t) noexcept { std::free(p); }
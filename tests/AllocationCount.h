@@ -0,0 +1,7 @@
+#pragma once
+
+#include <cstdint>
+
+// Heap allocations of the whole test binary so far, on any thread.  operator new is replaced to
+// count them, see AllocationCount.cpp.
+uint64_t GetAllocationCount();
@@ -0,0 +1,138 @@
+#include "Test.h"
+
+#include <cstring>
+
+#include "Streaming/Fec.h"
+#include "Streaming/SyntheticFrameSource.h"
+#include "Streaming/TileCodec.h"
+
+// Fragments a FecDecoder rebuilt, by index.
+struct RecoveredFragments
+{
+	std::vector<std::vector<uint8_t>> fragments;
+
+	static void OnRecovered(void *context, uint8_t *data, uint32_t size)
+	{
+		RecoveredFragments &self = *static_cast<RecoveredFragments *>(context);
+		FrameUpdateHeader header;
+		std::memcpy(&header, data, sizeof(header));
+		if (header.fragmentIndex < self.fragments.size())
+			self.fragments[header.fragmentIndex].assign(data, data + size);
+		delete[] data;
+	}
+};
+
+// Every tile of a synthetic screen, losslessly, the worst case for fragment count.
+static void EncodeScreen(ParallelTileEncoder &encoder, EncodedFrame &frame)
+{
+	SyntheticWorkloadConfig config;
+	config.workload = SyntheticWorkload::Scrolling;
+	config.width = 640;
+	config.height = 360;
+	SyntheticFrameSource source(config);
+	CapturedFrame captured;
+	source.AcquireFrame(std::chrono::milliseconds(0), captured);
+	const TileGrid grid(config.width, config.height);
+	std::vector<uint32_t> dirtyTiles(grid.GetTileCount());
+	for (uint32_t tile = 0; tile < dirtyTiles.size(); ++tile)
+		dirtyTiles[tile] = tile;
+	encoder.Encode(captured.view, dirtyTiles, k_TileQualityLossless, 1, 0, 0, k_DefaultFragmentSize, frame);
+	source.ReleaseFrame();
+}
+
+// Drops the fragments drop() picks, sends the rest and the parity through a decoder and checks
+// every dropped fragment came back as it was.
+template <typename DropFn>
+static bool CheckRecovery(const EncodedFrame &frame, DropFn drop)
+{
+	RecoveredFragments recovered;
+	recovered.fragments.resize(frame.fragments.size());
+	FecDecoder decoder(&RecoveredFragments::OnRecovered, &recovered);
+	for (uint32_t i = 0; i < frame.fragments.size(); ++i)
+	{
+		if (!drop(i))
+			decoder.AddData(frame.fragments[i].data, frame.fragments[i].size);
+	}
+	for (const EncodedFragment &parity : frame.parity)
+		decoder.AddParity(parity.data, parity.size);
+
+	bool ok = true;
+	for (uint32_t i = 0; i < frame.fragments.size(); ++i)
+	{
+		if (!drop(i))
+			continue;
+		const EncodedFragment &fragment = frame.fragments[i];
+		ok = CHECK(recovered.fragments[i].size() == fragment.size && std::memcmp(recovered.fragments[i].data(), fragment.data, fragment.size) == 0) && ok;
+	}
+	return CHECK(decoder.GetRecoveredFragmentCount() != 0) && ok;
+}
+
+TEST(FecXorRecoversOneLossPerGroup)
+{
+	WorkStealingPool pool(1);
+	ArenaBlockPool blockPool;
+	ParallelTileEncoder encoder(pool, blockPool);
+	FecEncoder fec(blockPool);
+	EncodedFrame frame;
+	EncodeScreen(encoder, frame);
+	if (!CHECK(frame.fragments.size() >= 16))
+		return;
+
+	FecConfig config;
+	config.scheme = FecScheme::Xor;
+	config.redundancy = 0.25f;
+	fec.Protect(frame, config);
+	CHECK(frame.fecGroupSize == 4);
+	CHECK(frame.fecParityCount == 1);
+	CheckRecovery(frame, [](uint32_t i) { return i % 4 == 1; });
+}
+
+TEST(FecReedSolomonRecoversParityCountLossesPerGroup)
+{
+	WorkStealingPool pool(1);
+	ArenaBlockPool blockPool;
+	ParallelTileEncoder encoder(pool, blockPool);
+	FecEncoder fec(blockPool);
+	EncodedFrame frame;
+	EncodeScreen(encoder, frame);
+	if (!CHECK(frame.fragments.size() >= 16))
+		return;
+
+	FecConfig config;
+	config.scheme = FecScheme::ReedSolomon;
+	config.groupSize = 16;
+	config.redundancy = 0.25f;
+	fec.Protect(frame, config);
+	CHECK(frame.fecGroupSize == 16);
+	CHECK(frame.fecParityCount == 4);
+	// Four in a row of every group, the first data fragment of a group included.
+	CheckRecovery(frame, [](uint32_t i) { return i % 16 < 4; });
+}
+
+// What the rate controller is told was sent: data and parity, each once.
+TEST(FecParityCountsOnceInByteCount)
+{
+	WorkStealingPool pool(1);
+	ArenaBlockPool blockPool;
+	ParallelTileEncoder encoder(pool, blockPool);
+	FecEncoder fec(blockPool);
+	EncodedFrame frame;
+	EncodeScreen(encoder, frame);
+
+	FecConfig config;
+	fec.Protect(frame, config);
+	size_t bytes = 0;
+	for (const EncodedFragment &fragment : frame.fragments)
+		bytes += fragment.size;
+	for (const EncodedFragment &parity : frame.parity)
+		bytes += parity.size;
+	CHECK(!frame.parity.empty());
+	CHECK(frame.byteCount == bytes);
+
+	// None takes the parity off again.
+	config.scheme = FecScheme::None;
+	EncodeScreen(encoder, frame);
+	fec.Protect(frame, config);
+	CHECK(frame.parity.empty());
+	CHECK(frame.fecParityCount == 0);
+}
@@ -0,0 +1,241 @@
+#include "Test.h"
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "TestBlocks.h"
+#include "Streaming/FrameReassembler.h"
+#include "Streaming/ParallelTileEncoder.h"
+#include "Streaming/SyntheticFrameSource.h"
+#include "Streaming/TileCodec.h"
+#include "Streaming/TileDiff.h"
+
+// A one tile frame of frameId whose only record is a raw tile, stored in cacheSlot.
+static std::vector<uint8_t> BuildRawTileFragment(uint32_t frameId, uint16_t cacheSlot)
+{
+	FrameUpdateHeader header;
+	header.tileCount = 1;
+	header.frameId = frameId;
+	header.fragmentCount = 1;
+	header.frameWidth = k_TileSize;
+	header.frameHeight = k_TileSize;
+
+	TileRecordHeader record;
+	record.codec = (uint8_t)TileCodecId::Raw;
+	record.cacheSlot = cacheSlot;
+	record.payloadSize = k_TileSize * k_TileSize * k_BytesPerPixel;
+
+	std::vector<uint8_t> fragment(sizeof(header) + sizeof(record) + record.payloadSize, 0x80);
+	std::memcpy(fragment.data(), &header, sizeof(header));
+	std::memcpy(fragment.data() + sizeof(header), &record, sizeof(record));
+	return fragment;
+}
+
+// A reference to cacheSlot in frameId, to what storeFrameId stored there.
+static std::vector<uint8_t> BuildCacheRefFragment(uint32_t frameId, uint16_t cacheSlot, uint32_t storeFrameId)
+{
+	FrameUpdateHeader header;
+	header.tileCount = 1;
+	header.frameId = frameId;
+	header.fragmentCount = 1;
+	header.frameWidth = k_TileSize;
+	header.frameHeight = k_TileSize;
+
+	TileRecordHeader record;
+	record.codec = (uint8_t)TileCodecId::CacheRef;
+	record.cacheSlot = cacheSlot;
+	record.payloadSize = sizeof(storeFrameId);
+
+	std::vector<uint8_t> fragment(sizeof(header) + sizeof(record) + sizeof(storeFrameId));
+	std::memcpy(fragment.data(), &header, sizeof(header));
+	std::memcpy(fragment.data() + sizeof(header), &record, sizeof(record));
+	std::memcpy(fragment.data() + sizeof(header) + sizeof(record), &storeFrameId, sizeof(storeFrameId));
+	return fragment;
+}
+
+TEST(ReassemblerStoresAndReferencesCacheSlots)
+{
+	FrameReassembler reassembler;
+	std::vector<uint8_t> store = BuildRawTileFragment(1, 7);
+	reassembler.AddFragment(store.data(), (uint32_t)store.size(), nullptr, &ReleaseNothing);
+	CHECK(reassembler.GetPaintedTileCount() == 1);
+
+	std::vector<uint8_t> reference = BuildCacheRefFragment(2, 7, 1);
+	reassembler.AddFragment(reference.data(), (uint32_t)reference.size(), nullptr, &ReleaseNothing);
+	CHECK(reassembler.GetCompletedFrameCount() == 2);
+	CHECK(reassembler.GetCacheMisses().empty());
+	CHECK(reassembler.GetLostTiles().empty());
+}
+
+// A slot number past what the sender's cache can have must not grow the receiver's cache to it,
+// 0xFFFE slots of a tile each would be a gigabyte.
+TEST(ReassemblerRejectsCacheSlotsPastTheCache)
+{
+	FrameReassembler reassembler;
+	std::vector<uint8_t> store = BuildRawTileFragment(1, 0xFFFE);
+	reassembler.AddFragment(store.data(), (uint32_t)store.size(), nullptr, &ReleaseNothing);
+	CHECK(reassembler.GetPaintedTileCount() == 0);
+
+	store = BuildRawTileFragment(2, (uint16_t)TileCache::k_DefaultSlotCount);
+	reassembler.AddFragment(store.data(), (uint32_t)store.size(), nullptr, &ReleaseNothing);
+	CHECK(reassembler.GetPaintedTileCount() == 0);
+
+	// A reference to one is lost, but not reported as a slot to invalidate.
+	std::vector<uint8_t> reference = BuildCacheRefFragment(3, 0xFFFE, 1);
+	reassembler.AddFragment(reference.data(), (uint32_t)reference.size(), nullptr, &ReleaseNothing);
+	CHECK(reassembler.GetCacheMisses().empty());
+	CHECK(reassembler.GetLostTiles().size() == 1);
+
+	store = BuildRawTileFragment(4, (uint16_t)(TileCache::k_DefaultSlotCount - 1));
+	reassembler.AddFragment(store.data(), (uint32_t)store.size(), nullptr, &ReleaseNothing);
+	CHECK(reassembler.GetPaintedTileCount() == 1);
+}
+
+// A reference carries the store's 4 byte frame id and nothing else.  Shorter ones, whole or split
+// over two fragments, are lost tiles, and the bytes after them are never read: a fragment that
+// ends right after the record sits at the end of its own allocation here.
+TEST(ReassemblerRejectsShortCacheReferences)
+{
+	for (uint32_t payloadSize = 1; payloadSize < sizeof(uint32_t); ++payloadSize)
+	{
+		FrameReassembler reassembler;
+		std::vector<uint8_t> store = BuildRawTileFragment(1, 7);
+		reassembler.AddFragment(store.data(), (uint32_t)store.size(), nullptr, &ReleaseNothing);
+
+		FrameUpdateHeader header;
+		header.tileCount = 1;
+		header.frameId = 2;
+		header.fragmentCount = 1;
+		header.frameWidth = k_TileSize;
+		header.frameHeight = k_TileSize;
+		TileRecordHeader record;
+		record.codec = (uint8_t)TileCodecId::CacheRef;
+		record.cacheSlot = 7;
+		record.payloadSize = payloadSize;
+		std::unique_ptr<uint8_t[]> whole(new uint8_t[sizeof(header) + sizeof(record) + payloadSize]());
+		std::memcpy(whole.get(), &header, sizeof(header));
+		std::memcpy(whole.get() + sizeof(header), &record, sizeof(record));
+		reassembler.AddFragment(whole.get(), (uint32_t)(sizeof(header) + sizeof(record) + payloadSize), nullptr, &ReleaseNothing);
+		CHECK(reassembler.GetCompletedFrameCount() == 2);
+		CHECK(reassembler.GetLostTiles().size() == 1);
+
+		// The record in the first fragment, its payload in the second.
+		header.frameId = 3;
+		header.fragmentCount = 2;
+		std::unique_ptr<uint8_t[]> first(new uint8_t[sizeof(header) + sizeof(record)]);
+		std::memcpy(first.get(), &header, sizeof(header));
+		std::memcpy(first.get() + sizeof(header), &record, sizeof(record));
+		header.tileCount = 0;
+		header.fragmentIndex = 1;
+		std::unique_ptr<uint8_t[]> second(new uint8_t[sizeof(header) + payloadSize]());
+		std::memcpy(second.get(), &header, sizeof(header));
+		reassembler.AddFragment(first.get(), (uint32_t)(sizeof(header) + sizeof(record)), nullptr, &ReleaseNothing);
+		reassembler.AddFragment(second.get(), (uint32_t)(sizeof(header) + payloadSize), nullptr, &ReleaseNothing);
+		CHECK(reassembler.GetCompletedFrameCount() == 3);
+		CHECK(reassembler.GetLostTiles().size() == 2);
+		CHECK(reassembler.GetPaintedTileCount() == 1);
+	}
+}
+
+TEST(ReassemblerReportsMissedCacheSlots)
+{
+	FrameReassembler reassembler;
+	std::vector<uint8_t> reference = BuildCacheRefFragment(1, 7, 1);
+	reassembler.AddFragment(reference.data(), (uint32_t)reference.size(), nullptr, &ReleaseNothing);
+	CHECK(reassembler.GetCacheMisses().size() == 1 && reassembler.GetCacheMisses()[0] == 7);
+	CHECK(reassembler.GetLostTiles().size() == 1);
+}
+
+// A fragment of its own, counting how often the reassembler let go of it.
+struct CountedFragment
+{
+	std::vector<uint8_t> data;
+	uint32_t releases = 0;
+};
+
+static void ReleaseCountedFragment(void *handle)
+{
+	++static_cast<CountedFragment *>(handle)->releases;
+}
+
+// Frames in small fragments, so records span several, delivered shuffled with duplicates mixed
+// in and stale fragments of the frame before trailing after.  Each frame has to come out on the
+// canvas exactly as captured, and every fragment handed over has to be released exactly once.
+TEST(ReassemblerTakesFragmentsInAnyOrder)
+{
+	SyntheticWorkloadConfig config;
+	config.workload = SyntheticWorkload::Scrolling;
+	config.width = 640;
+	config.height = 360;
+	config.changeRatio = 0.5;
+	SyntheticFrameSource source(config);
+	WorkStealingPool pool(2);
+	ArenaBlockPool blockPool;
+	ParallelTileEncoder encoder(pool, blockPool);
+	TileDiffer differ;
+	std::vector<uint32_t> dirtyTiles;
+	EncodedFrame encoded;
+	std::mt19937 random(1);
+
+	std::vector<std::unique_ptr<CountedFragment>> delivered;
+	std::vector<CountedFragment *> previousFrame;
+	uint32_t frames = 0;
+	{
+		FrameReassembler reassembler;
+		for (uint32_t tick = 0; tick < 60; ++tick)
+		{
+			CapturedFrame captured;
+			if (!source.AcquireFrame(std::chrono::milliseconds(0), captured))
+				continue;
+			differ.Diff(captured.view, captured.dirtyRects, !captured.hasDirtyRects, dirtyTiles);
+			if (!CHECK(encoder.Encode(captured.view, dirtyTiles, k_TileQualityLossless, ++frames, 0, 0, 200, encoded)))
+				break;
+
+			// Every fragment once, a third of them twice, in any order.
+			std::vector<CountedFragment *> fragments;
+			for (const EncodedFragment &fragment : encoded.fragments)
+			{
+				for (uint32_t copy = 0; copy < (random() % 3 == 0 ? 2u : 1u); ++copy)
+				{
+					delivered.push_back(std::make_unique<CountedFragment>());
+					delivered.back()->data.assign(fragment.data, fragment.data + fragment.size);
+					fragments.push_back(delivered.back().get());
+				}
+			}
+			std::shuffle(fragments.begin(), fragments.end(), random);
+			for (CountedFragment *fragment : fragments)
+				reassembler.AddFragment(fragment->data.data(), (uint32_t)fragment->data.size(), fragment, &ReleaseCountedFragment);
+
+			// What was left of the frame before turns up late, as copies the network duplicated.
+			for (size_t i = 0; i < previousFrame.size(); i += 3)
+			{
+				delivered.push_back(std::make_unique<CountedFragment>());
+				delivered.back()->data = previousFrame[i]->data;
+				reassembler.AddFragment(delivered.back()->data.data(), (uint32_t)delivered.back()->data.size(), delivered.back().get(),
+										&ReleaseCountedFragment);
+				CHECK(delivered.back()->releases == 1);
+			}
+			previousFrame = fragments;
+
+			CHECK(!reassembler.HasPendingFrames());
+			const FrameBuffer &canvas = reassembler.GetCanvas();
+			bool same = canvas.width == captured.view.width && canvas.height == captured.view.height;
+			for (uint32_t y = 0; same && y < canvas.height; ++y)
+				same = std::memcmp(canvas.Row(y), captured.view.Row(y), (size_t)canvas.width * k_BytesPerPixel) == 0;
+			if (!CHECK(same))
+				printf("  frame %u differs\n", frames);
+			source.ReleaseFrame();
+		}
+		CHECK(frames > 1 && reassembler.GetCompletedFrameCount() == frames);
+		CHECK(reassembler.GetDroppedFrameCount() == 0 && reassembler.GetLostTiles().empty());
+	}
+
+	uint32_t wrong = 0;
+	for (const std::unique_ptr<CountedFragment> &fragment : delivered)
+		wrong += fragment->releases != 1;
+	if (!CHECK(wrong == 0))
+		printf("  %u of %zu fragments not released exactly once\n", wrong, delivered.size());
+}
@@ -0,0 +1,260 @@
+#include "Test.h"
+
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "Streaming/ReplayFrameSource.h"
+#include "Streaming/SyntheticFrameSource.h"
+
+// Where the tests write their recordings.
+static std::string GetRecordingPath(const char *name)
+{
+	return (std::filesystem::temp_directory_path() / name).string();
+}
+
+static std::vector<uint8_t> ReadRecording(const std::string &path)
+{
+	std::vector<uint8_t> bytes(std::filesystem::file_size(path));
+	FILE *file = std::fopen(path.c_str(), "rb");
+	if (file)
+	{
+		bytes.resize(std::fread(bytes.data(), 1, bytes.size(), file));
+		std::fclose(file);
+	}
+	return bytes;
+}
+
+static void WriteRecording(const std::string &path, const std::vector<uint8_t> &bytes)
+{
+	FILE *file = std::fopen(path.c_str(), "wb");
+	if (!file)
+		return;
+	std::fwrite(bytes.data(), 1, bytes.size(), file);
+	std::fclose(file);
+}
+
+// A recording of a dragged window, a smaller screen in between and back: every change of size
+// starts with a keyframe, the rest are deltas.  What was recorded, frame by frame.
+struct RecordedSession
+{
+	struct Frame
+	{
+		FrameBuffer pixels;
+		bool hasDirtyRects = false;
+		std::vector<TileRect> dirtyRects;
+	};
+
+	std::vector<Frame> frames;
+	uint32_t deltaCount = 0;
+
+	explicit RecordedSession(const std::string &path)
+	{
+		FrameRecorder recorder;
+		if (!CHECK(recorder.Open(path.c_str())))
+			return;
+		SyntheticWorkloadConfig config;
+		config.workload = SyntheticWorkload::WindowDrag;
+		config.width = 320;
+		config.height = 200; // rects on the last tile row are clipped
+		SyntheticFrameSource large(config);
+		config.workload = SyntheticWorkload::Typing;
+		config.width = 256;
+		config.height = 128;
+		SyntheticFrameSource small(config);
+		for (uint32_t i = 0; i < 24; ++i)
+		{
+			SyntheticFrameSource &source = i >= 10 && i < 16 ? small : large;
+			CapturedFrame captured;
+			if (!source.AcquireFrame(std::chrono::milliseconds(0), captured))
+				continue;
+			CHECK(recorder.Write(captured));
+			Frame &frame = frames.emplace_back();
+			frame.pixels.Resize(captured.view.width, captured.view.height);
+			for (uint32_t y = 0; y < captured.view.height; ++y)
+				std::memcpy(frame.pixels.Row(y), captured.view.Row(y), (size_t)captured.view.width * k_BytesPerPixel);
+			frame.hasDirtyRects = captured.hasDirtyRects;
+			for (const TileRect &rect : captured.dirtyRects)
+				frame.dirtyRects.push_back(ClipRecordedRect(rect, captured.view.width, captured.view.height));
+			deltaCount += frames.size() > 1 && captured.hasDirtyRects && frames[frames.size() - 2].pixels.width == captured.view.width &&
+						  frames[frames.size() - 2].pixels.height == captured.view.height;
+			source.ReleaseFrame();
+		}
+		CHECK(recorder.GetFrameCount() == frames.size());
+		CHECK(recorder.Close());
+	}
+};
+
+// The same pixels and dirty rects come back, deltas with opaque alpha.
+TEST(RecordingReplaysWhatWasRecorded)
+{
+	const std::string path = GetRecordingPath("streaming_tests_round_trip.srec");
+	const RecordedSession session(path);
+	if (!CHECK(session.deltaCount > 10))
+		return;
+
+	ReplayFrameSource replay(path.c_str(), ReplaySpeed::Maximum, false);
+	if (!CHECK(replay.IsOpen() && replay.GetFrameCount() == session.frames.size()))
+		return;
+	for (size_t i = 0; i < session.frames.size(); ++i)
+	{
+		const RecordedSession::Frame &recorded = session.frames[i];
+		CapturedFrame frame;
+		if (!CHECK(replay.AcquireFrame(std::chrono::milliseconds(0), frame)))
+			break;
+		if (!CHECK(frame.view.width == recorded.pixels.width && frame.view.height == recorded.pixels.height))
+			break;
+		bool same = true;
+		for (uint32_t y = 0; same && y < frame.view.height; ++y)
+		{
+			for (uint32_t x = 0; same && x < frame.view.width; ++x)
+				same = std::memcmp(frame.view.Row(y) + x * k_BytesPerPixel, recorded.pixels.Row(y) + x * k_BytesPerPixel, 3) == 0;
+		}
+		if (!CHECK(same))
+			printf("  frame %zu differs\n", i);
+		if (frame.hasDirtyRects)
+		{
+			CHECK(frame.dirtyRects.size() == recorded.dirtyRects.size());
+			for (size_t rect = 0; rect < frame.dirtyRects.size() && rect < recorded.dirtyRects.size(); ++rect)
+			{
+				CHECK(frame.dirtyRects[rect].x == recorded.dirtyRects[rect].x && frame.dirtyRects[rect].y == recorded.dirtyRects[rect].y &&
+					  frame.dirtyRects[rect].width == recorded.dirtyRects[rect].width && frame.dirtyRects[rect].height == recorded.dirtyRects[rect].height);
+			}
+		}
+		replay.ReleaseFrame();
+	}
+
+	// Played through, nothing more without loop.
+	CapturedFrame frame;
+	CHECK(!replay.AcquireFrame(std::chrono::milliseconds(0), frame));
+	CHECK(replay.GetPlayedFrameCount() == session.frames.size());
+	std::filesystem::remove(path);
+}
+
+// With loop set the recording starts over at its first keyframe.
+TEST(RecordingReplayLoops)
+{
+	const std::string path = GetRecordingPath("streaming_tests_loop.srec");
+	const RecordedSession session(path);
+	ReplayFrameSource replay(path.c_str(), ReplaySpeed::Maximum, true);
+	if (!CHECK(replay.IsOpen()))
+		return;
+	for (size_t i = 0; i < 2 * session.frames.size() + 1; ++i)
+	{
+		CapturedFrame frame;
+		if (!CHECK(replay.AcquireFrame(std::chrono::milliseconds(0), frame)))
+			break;
+		CHECK(frame.hasDirtyRects == (i % session.frames.size() != 0 && session.frames[i % session.frames.size()].hasDirtyRects &&
+									  frame.view.width == session.frames[i % session.frames.size() - 1].pixels.width &&
+									  frame.view.height == session.frames[i % session.frames.size() - 1].pixels.height));
+		replay.ReleaseFrame();
+	}
+	CHECK(replay.GetPlayedFrameCount() == 2 * session.frames.size() + 1);
+	std::filesystem::remove(path);
+}
+
+// A recording cut short, e.g. by a crash before Close(), or no file at all, never gives a frame.
+TEST(TruncatedRecordingIsRejected)
+{
+	const std::string path = GetRecordingPath("streaming_tests_truncated.srec");
+	const RecordedSession session(path);
+	const std::vector<uint8_t> bytes = ReadRecording(path);
+	if (!CHECK(bytes.size() > sizeof(RecordingHeader)))
+		return;
+
+	for (size_t size : {bytes.size() - 1, bytes.size() - sizeof(uint64_t), bytes.size() / 2, sizeof(RecordingHeader), sizeof(RecordingHeader) - 1, (size_t)0})
+	{
+		WriteRecording(path, std::vector<uint8_t>(bytes.begin(), bytes.begin() + size));
+		ReplayFrameSource replay(path.c_str(), ReplaySpeed::Maximum, true);
+		CapturedFrame frame;
+		if (!CHECK(!replay.IsOpen() && !replay.AcquireFrame(std::chrono::milliseconds(0), frame)))
+			printf("  cut to %zu of %zu bytes\n", size, bytes.size());
+	}
+
+	// Not closed: no index.
+	std::vector<uint8_t> unclosed = bytes;
+	RecordingHeader header;
+	std::memcpy(&header, unclosed.data(), sizeof(header));
+	unclosed.resize(header.indexOffset);
+	header.frameCount = 0;
+	header.indexOffset = 0;
+	std::memcpy(unclosed.data(), &header, sizeof(header));
+	WriteRecording(path, unclosed);
+	CHECK(!ReplayFrameSource(path.c_str(), ReplaySpeed::Maximum, false).IsOpen());
+
+	std::filesystem::remove(path);
+	CHECK(!ReplayFrameSource(path.c_str(), ReplaySpeed::Maximum, false).IsOpen());
+}
+
+// Headers that don't hold together are caught on open, before a frame is painted from them.
+TEST(CorruptRecordingIsRejected)
+{
+	const std::string path = GetRecordingPath("streaming_tests_corrupt.srec");
+	const RecordedSession session(path);
+	const std::vector<uint8_t> bytes = ReadRecording(path);
+	RecordingHeader header;
+	if (!CHECK(bytes.size() > sizeof(header)))
+		return;
+	std::memcpy(&header, bytes.data(), sizeof(header));
+	std::vector<uint64_t> index(header.frameCount);
+	std::memcpy(index.data(), bytes.data() + header.indexOffset, index.size() * sizeof(uint64_t));
+
+	// The record of the first delta, which is the second frame.
+	RecordedFrameHeader delta;
+	std::memcpy(&delta, bytes.data() + index[1], sizeof(delta));
+	if (!CHECK(!delta.keyframe && delta.rectCount != 0))
+		return;
+
+	auto isRejected = [&](auto corrupt)
+	{
+		std::vector<uint8_t> corrupted = bytes;
+		RecordingHeader corruptHeader = header;
+		RecordedFrameHeader corruptDelta = delta;
+		corrupt(corrupted, corruptHeader, corruptDelta);
+		std::memcpy(corrupted.data(), &corruptHeader, sizeof(corruptHeader));
+		std::memcpy(corrupted.data() + index[1], &corruptDelta, sizeof(corruptDelta));
+		WriteRecording(path, corrupted);
+		return !ReplayFrameSource(path.c_str(), ReplaySpeed::Maximum, false).IsOpen();
+	};
+	using Bytes = std::vector<uint8_t>;
+	CHECK(!isRejected([](Bytes &, RecordingHeader &, RecordedFrameHeader &) {}));
+	CHECK(isRejected([](Bytes &, RecordingHeader &corrupt, RecordedFrameHeader &) { corrupt.magic[0] = 'X'; }));
+	CHECK(isRejected([](Bytes &, RecordingHeader &corrupt, RecordedFrameHeader &) { corrupt.version = 2; }));
+	CHECK(isRejected([](Bytes &, RecordingHeader &corrupt, RecordedFrameHeader &) { corrupt.indexOffset += 4; }));
+	CHECK(isRejected([](Bytes &, RecordingHeader &corrupt, RecordedFrameHeader &) { ++corrupt.frameCount; }));
+	// Index entries off the record alignment or past the end.
+	CHECK(isRejected([&](Bytes &corrupted, RecordingHeader &, RecordedFrameHeader &)
+					 {
+						 const uint64_t offset = index[1] + 8;
+						 std::memcpy(corrupted.data() + header.indexOffset + sizeof(uint64_t), &offset, sizeof(offset));
+					 }));
+	CHECK(isRejected([&](Bytes &corrupted, RecordingHeader &, RecordedFrameHeader &)
+					 {
+						 const uint64_t offset = (bytes.size() + k_RecordingAlignment) / k_RecordingAlignment * k_RecordingAlignment;
+						 std::memcpy(corrupted.data() + header.indexOffset + sizeof(uint64_t), &offset, sizeof(offset));
+					 }));
+	// The first frame has to be a keyframe.
+	CHECK(isRejected([&](Bytes &corrupted, RecordingHeader &, RecordedFrameHeader &)
+					 {
+						 RecordedFrameHeader first;
+						 std::memcpy(&first, corrupted.data() + index[0], sizeof(first));
+						 first.keyframe = 0;
+						 std::memcpy(corrupted.data() + index[0], &first, sizeof(first));
+					 }));
+	// A delta's data, rects and size have to match what it holds and the keyframe before it.
+	CHECK(isRejected([](Bytes &, RecordingHeader &, RecordedFrameHeader &corrupt) { corrupt.dataSize -= 1; }));
+	CHECK(isRejected([](Bytes &, RecordingHeader &, RecordedFrameHeader &corrupt) { corrupt.dataSize += 1; }));
+	CHECK(isRejected([](Bytes &, RecordingHeader &, RecordedFrameHeader &corrupt) { corrupt.dataOffset += 4; }));
+	CHECK(isRejected([](Bytes &, RecordingHeader &, RecordedFrameHeader &corrupt) { corrupt.rectCount = 1u << 30; }));
+	CHECK(isRejected([](Bytes &, RecordingHeader &, RecordedFrameHeader &corrupt) { corrupt.width += k_TileSize; }));
+	CHECK(isRejected([](Bytes &, RecordingHeader &, RecordedFrameHeader &corrupt) { corrupt.height -= 1; }));
+	// A keyframe's data is exactly its pixels.
+	CHECK(isRejected([](Bytes &, RecordingHeader &, RecordedFrameHeader &corrupt)
+					 {
+						 corrupt.keyframe = 1;
+						 corrupt.rectCount = 0;
+					 }));
+
+	std::filesystem::remove(path);
+}
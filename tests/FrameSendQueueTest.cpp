@@ -0,0 +1,269 @@
+#include "Test.h"
+
+#include <algorithm>
+#include <cstring>
+#include <deque>
+
+#include "TestBlocks.h"
+#include "Streaming/FrameReassembler.h"
+#include "Streaming/FrameSendQueue.h"
+#include "Streaming/SimulcastEncoder.h"
+#include "Streaming/SyntheticFrameSource.h"
+
+// Tiles of grid the source's dirty rects touch, all of them when it has none.
+static void GetDirtyTiles(const CapturedFrame &captured, const TileGrid &grid, std::vector<uint32_t> &dirtyTiles)
+{
+	dirtyTiles.clear();
+	std::vector<uint8_t> dirty(grid.GetTileCount(), captured.hasDirtyRects ? 0 : 1);
+	for (const TileRect &rect : captured.dirtyRects)
+	{
+		for (uint32_t y = rect.y / k_TileSize; y * k_TileSize < rect.y + rect.height; ++y)
+		{
+			for (uint32_t x = rect.x / k_TileSize; x * k_TileSize < rect.x + rect.width; ++x)
+				dirty[y * grid.GetColumns() + x] = 1;
+		}
+	}
+	for (uint32_t tile = 0; tile < dirty.size(); ++tile)
+	{
+		if (dirty[tile])
+			dirtyTiles.push_back(tile);
+	}
+}
+
+// One peer behind a link of bytesPerSecond, fragments arrive in order and none are lost.  What
+// PeerConnections::SendQueuedFrames() does: frames go to the link while its queue is under 20 ms,
+// and wait in the FrameSendQueue otherwise.
+struct ThrottledPeer
+{
+	static constexpr double k_MaxLinkDelay = 0.020;
+
+	struct InFlight
+	{
+		ArenaBlock *block;
+		const uint8_t *data;
+		uint32_t size;
+		uint32_t bytesLeft;
+	};
+
+	double bytesPerSecond = 0.0;
+	FrameSendQueue sendQueue;
+	std::deque<InFlight> link;
+	uint64_t linkBytes = 0;
+	FrameReassembler reassembler;
+
+	double GetLinkDelay() const { return linkBytes / bytesPerSecond; }
+
+	void Send()
+	{
+		while (!sendQueue.IsEmpty() && GetLinkDelay() < k_MaxLinkDelay)
+		{
+			for (const EncodedFragment &fragment : sendQueue.Front().fragments)
+			{
+				fragment.block->AddRef();
+				link.push_back({fragment.block, fragment.data, fragment.size, fragment.size});
+				linkBytes += fragment.size;
+			}
+			sendQueue.Pop();
+		}
+	}
+
+	// Delivers what the link carries in seconds.
+	void Deliver(double seconds)
+	{
+		uint64_t budget = (uint64_t)(bytesPerSecond * seconds);
+		while (!link.empty() && budget != 0)
+		{
+			InFlight &front = link.front();
+			const uint32_t bytes = (uint32_t)std::min<uint64_t>(budget, front.bytesLeft);
+			front.bytesLeft -= bytes;
+			linkBytes -= bytes;
+			budget -= bytes;
+			if (front.bytesLeft == 0)
+			{
+				reassembler.AddFragment(front.data, front.size, front.block, &ReleaseBlock);
+				link.pop_front();
+			}
+		}
+	}
+};
+
+// A screen that changes faster than the link carries: frames must not pile up, the queue delay
+// stays within a couple of frames' worth of link time.  Once the screen stands still the receiver
+// has to end up with exactly what is on it, tiles of dropped frames included.
+TEST(SendQueueDelayStaysBoundedOnAThrottledLink)
+{
+	static constexpr double k_FrameSeconds = 1.0 / 60.0;
+	static constexpr double k_Step = 0.001;
+	static constexpr uint32_t k_Frames = 240;
+	static const auto k_Start = std::chrono::steady_clock::time_point();
+
+	SyntheticWorkloadConfig config;
+	config.workload = SyntheticWorkload::Video;
+	config.width = 1280;
+	config.height = 720;
+	config.changeRatio = 0.25;
+	SyntheticFrameSource source(config);
+	const TileGrid grid(config.width, config.height);
+
+	WorkStealingPool pool(1);
+	ArenaBlockPool blockPool;
+	SimulcastEncoder encoder(pool, blockPool);
+	const uint8_t quality[k_SimulcastLayerCount] = {k_TileQualityLossless, k_TileQualityLossless, k_TileQualityLossless};
+	encoder.GetRefiner(0).SetChangeQuality(k_TileQualityLossless);
+
+	ThrottledPeer peer;
+	FrameBuffer screen;
+	std::vector<uint32_t> dirtyTiles;
+	std::vector<uint32_t> tiles;
+	uint64_t producedBytes = 0;
+	size_t largestFrame = 0;
+	uint32_t frameId = 0;
+	std::vector<double> delays;
+	double time = 0.0;
+	double nextFrame = 0.0;
+
+	// Encodes and queues what changed, or with screen == nullptr what is left to send.
+	auto encode = [&](const CapturedFrame *captured)
+	{
+		// The receiver's reports, as TileRefreshScheduler would apply them.
+		for (uint16_t slot : peer.reassembler.GetCacheMisses())
+			encoder.GetTileCache(0).Invalidate(slot);
+		peer.reassembler.ClearCacheMisses();
+		encoder.AddDirtyTiles(0, peer.reassembler.GetLostTiles());
+		peer.reassembler.ClearLostTiles();
+		uint32_t width = 0;
+		uint32_t height = 0;
+		if (peer.sendQueue.TakeEvictedTiles(tiles, width, height))
+			encoder.AddDirtyTiles(0, tiles);
+
+		const auto now = k_Start + std::chrono::microseconds((int64_t)(time * 1e6));
+		if (captured)
+			GetDirtyTiles(*captured, grid, dirtyTiles);
+		else
+			dirtyTiles.clear();
+		encoder.Encode(now, now, screen.GetView(), dirtyTiles, 1, quality, ++frameId, k_DefaultFragmentSize);
+		const EncodedFrame &frame = encoder.GetFrame(0);
+		if (frame.tiles.empty())
+			return;
+		producedBytes += frame.byteCount;
+		largestFrame = std::max(largestFrame, frame.byteCount);
+		peer.sendQueue.Push(frame);
+	};
+
+	auto step = [&]()
+	{
+		peer.Send();
+		peer.Deliver(k_Step);
+		for (const FrameReassembler::CompletedFrame &completed : peer.reassembler.GetCompletedFrames())
+			delays.push_back((GetWireTimestamp(k_Start + std::chrono::microseconds((int64_t)(time * 1e6))) - completed.timestamp) / 1e6);
+		peer.reassembler.ClearCompletedFrames();
+		time += k_Step;
+	};
+
+	// A link a quarter of what the screen produces, measured on the first frames.
+	peer.bytesPerSecond = 1e9;
+	for (uint32_t frame = 0; frame < k_Frames; ++frame)
+	{
+		CapturedFrame captured;
+		source.AcquireFrame(std::chrono::milliseconds(0), captured);
+		screen.Resize(captured.view.width, captured.view.height);
+		for (uint32_t y = 0; y < screen.height; ++y)
+			std::memcpy(screen.Row(y), captured.view.Row(y), (size_t)screen.width * k_BytesPerPixel);
+		encode(&captured);
+		source.ReleaseFrame();
+		if (frame == 10)
+		{
+			peer.bytesPerSecond = producedBytes / (11 * k_FrameSeconds) / 4;
+			largestFrame = 0;
+			delays.clear();
+		}
+		for (nextFrame += k_FrameSeconds; time < nextFrame;)
+			step();
+	}
+
+	// Bounded by the frames that may wait and the one on the link, not by how long it ran.
+	std::sort(delays.begin(), delays.end());
+	const double bound = (FrameSendQueue::k_MaxQueuedFrames + 2) * largestFrame / peer.bytesPerSecond + 2 * k_FrameSeconds;
+	if (!CHECK(!delays.empty() && delays.back() < bound))
+		printf("  max delay %.0f ms, bound %.0f ms\n", delays.empty() ? 0.0 : delays.back() * 1000.0, bound * 1000.0);
+	CHECK(peer.sendQueue.GetDroppedFrameCount() + peer.sendQueue.GetEvictedFrameCount() > 0);
+
+	// The screen stands still, what was dropped still has to arrive.
+	for (uint32_t frame = 0; frame < 600; ++frame)
+	{
+		if (encoder.IsIdle(1, quality) && peer.sendQueue.IsEmpty() && peer.link.empty() && peer.reassembler.GetCacheMisses().empty() &&
+			peer.reassembler.GetLostTiles().empty() && !peer.reassembler.HasPendingFrames())
+			break;
+		encode(nullptr);
+		for (nextFrame += k_FrameSeconds; time < nextFrame;)
+			step();
+	}
+	const FrameBuffer &canvas = peer.reassembler.GetCanvas();
+	bool same = canvas.width == screen.width && canvas.height == screen.height;
+	for (uint32_t y = 0; same && y < screen.height; ++y)
+		same = std::memcmp(canvas.Row(y), screen.Row(y), (size_t)screen.width * k_BytesPerPixel) == 0;
+	CHECK(same);
+}
+
+// Frames pushed with nothing popped: a frame all of whose tiles a newer one has is dropped, and
+// past k_MaxQueuedFrames the oldest is evicted, handing back only its tiles no newer frame has.
+// The newest frame always stays.
+TEST(SendQueueKeepsTheLatestTiles)
+{
+	FrameBuffer screen;
+	screen.Resize(640, 360);
+	for (uint32_t y = 0; y < screen.height; ++y)
+	{
+		for (uint32_t x = 0; x < screen.width * k_BytesPerPixel; ++x)
+			screen.Row(y)[x] = (uint8_t)(x * 7 + y * 13);
+	}
+	WorkStealingPool pool(1);
+	ArenaBlockPool blockPool;
+	ParallelTileEncoder encoder(pool, blockPool);
+	EncodedFrame frame;
+	FrameSendQueue sendQueue;
+	uint32_t frameId = 0;
+	auto push = [&](std::vector<uint32_t> tiles)
+	{
+		encoder.Encode(screen.GetView(), tiles, k_TileQualityLossless, ++frameId, 0, 0, k_DefaultFragmentSize, frame);
+		sendQueue.Push(frame);
+	};
+	auto popFrameIds = [&]()
+	{
+		std::vector<uint32_t> ids;
+		while (!sendQueue.IsEmpty())
+		{
+			ids.push_back(sendQueue.Front().frameId);
+			sendQueue.Pop();
+		}
+		return ids;
+	};
+	std::vector<uint32_t> evicted;
+	uint32_t width = 0;
+	uint32_t height = 0;
+
+	// Frame 2 has every tile of frame 1.
+	push({0, 1, 2, 3});
+	push({0, 1, 2, 3, 4});
+	CHECK(sendQueue.GetQueuedCount() == 1 && sendQueue.Front().frameId == 2);
+	CHECK(sendQueue.GetDroppedFrameCount() == 1 && sendQueue.GetQueuedByteCount() == sendQueue.Front().byteCount);
+	CHECK(!sendQueue.TakeEvictedTiles(evicted, width, height));
+
+	// Frame 4 evicts frame 2, whose tile 2 it has itself.  Frame 5 evicts frame 3 and has tile 0.
+	push({5});
+	push({2, 6});
+	CHECK(sendQueue.GetQueuedCount() == FrameSendQueue::k_MaxQueuedFrames && sendQueue.GetEvictedFrameCount() == 1);
+	push({0, 7});
+	CHECK(sendQueue.GetEvictedFrameCount() == 2 && sendQueue.GetDroppedFrameCount() == 1);
+	CHECK(sendQueue.TakeEvictedTiles(evicted, width, height));
+	CHECK((evicted == std::vector<uint32_t>{1, 3, 4, 5}) && width == 640 && height == 360);
+	CHECK(!sendQueue.TakeEvictedTiles(evicted, width, height));
+	CHECK((popFrameIds() == std::vector<uint32_t>{4, 5}));
+	CHECK(sendQueue.IsEmpty() && sendQueue.GetQueuedByteCount() == 0);
+
+	// However many frames of the same tiles pile up, only the newest is left.
+	for (uint32_t i = 0; i < 10; ++i)
+		push({8, 9});
+	CHECK((popFrameIds() == std::vector<uint32_t>{frameId}));
+	CHECK(!sendQueue.TakeEvictedTiles(evicted, width, height));
+}
@@ -0,0 +1,229 @@
+#include "Test.h"
+
+#include <algorithm>
+#include <deque>
+#include <map>
+
+#include "Streaming/Cursor.h"
+#include "Streaming/Input.h"
+#include "Streaming/SimulcastEncoder.h"
+#include "Streaming/SyntheticFrameSource.h"
+
+// One direction of a peer connection: whole messages at bytesPerSecond, the lower lane first as
+// GameNetworkingSockets drains them, what is on the wire goes out first.  Each arrives lag after
+// its last byte went.
+struct LaneLink
+{
+	struct Message
+	{
+		Lane lane;
+		std::vector<uint8_t> data;
+		double arrival = 0.0;
+	};
+
+	double bytesPerSecond = 0.0;
+	double lag = 0.010;
+	std::deque<Message> lanes[(size_t)Lane::Count];
+	uint64_t laneBytes[(size_t)Lane::Count] = {};
+	bool busy = false;
+	Message onWire;
+	uint32_t wireBytesLeft = 0;
+	std::deque<Message> inFlight;
+
+	void Send(Lane lane, const uint8_t *data, uint32_t size)
+	{
+		lanes[(size_t)lane].push_back({lane, std::vector<uint8_t>(data, data + size)});
+		laneBytes[(size_t)lane] += size;
+	}
+
+	// How long what waits on lane takes to go out, as SendQueuedFrames() asks the library.
+	double GetQueueTime(Lane lane) const { return laneBytes[(size_t)lane] / bytesPerSecond; }
+
+	// Advances to time + seconds and hands deliver(message) what arrived by then.
+	template <typename DeliverFn>
+	void Run(double time, double seconds, DeliverFn deliver)
+	{
+		uint64_t budget = (uint64_t)(bytesPerSecond * seconds);
+		while (budget != 0)
+		{
+			if (!busy)
+			{
+				auto lane = std::find_if(std::begin(lanes), std::end(lanes), [](const std::deque<Message> &messages) { return !messages.empty(); });
+				if (lane == std::end(lanes))
+					break;
+				onWire = std::move(lane->front());
+				lane->pop_front();
+				laneBytes[(size_t)onWire.lane] -= onWire.data.size();
+				wireBytesLeft = (uint32_t)onWire.data.size();
+				busy = true;
+			}
+			const uint32_t bytes = (uint32_t)std::min<uint64_t>(budget, wireBytesLeft);
+			wireBytesLeft -= bytes;
+			budget -= bytes;
+			if (wireBytesLeft == 0)
+			{
+				onWire.arrival = time + seconds + lag;
+				inFlight.push_back(std::move(onWire));
+				busy = false;
+			}
+		}
+		while (!inFlight.empty() && inFlight.front().arrival <= time + seconds)
+		{
+			deliver(inFlight.front());
+			inFlight.pop_front();
+		}
+	}
+};
+
+// The viewer moves the pointer while the sharer's screen plays a video that fills the link.  The
+// pointer goes over on the input lane, the sharer moves its cursor there and the cursor comes back
+// on the cursor lane: both lanes go ahead of the video, so the round trip is the link's lag both
+// ways and the cursor's refresh interval, never the video's queue.
+TEST(InputRoundTripStaysLowUnderVideoLoad)
+{
+	static constexpr double k_Step = 0.001;
+	static constexpr double k_FrameSeconds = 1.0 / 60.0;
+	static constexpr double k_MoveSeconds = 0.004;
+	static constexpr double k_Seconds = 2.0;
+	static constexpr double k_MaxVideoQueueTime = 0.020; // PeerConnections::k_usecVideoMaxQueueTime
+	static constexpr int32_t k_MoveStep = 100;
+	static const auto k_Start = std::chrono::steady_clock::time_point();
+
+	SyntheticWorkloadConfig config;
+	config.workload = SyntheticWorkload::Video;
+	config.width = 640;
+	config.height = 360;
+	config.changeRatio = 0.5;
+	SyntheticFrameSource source(config);
+	const TileGrid grid(config.width, config.height);
+
+	WorkStealingPool pool(1);
+	ArenaBlockPool blockPool;
+	SimulcastEncoder encoder(pool, blockPool);
+	encoder.GetRefiner(0).SetChangeQuality(k_TileQualityLossless);
+	const uint8_t quality[k_SimulcastLayerCount] = {k_TileQualityLossless, k_TileQualityLossless, k_TileQualityLossless};
+	std::vector<uint32_t> dirtyTiles;
+	uint32_t frameId = 0;
+
+	// Viewer to sharer carries the input, sharer to viewer the video and the cursor.  The link
+	// carries half of what the video makes of it.
+	LaneLink toSharer;
+	LaneLink toViewer;
+	{
+		CapturedFrame captured;
+		source.AcquireFrame(std::chrono::milliseconds(0), captured);
+		for (uint32_t tile = 0; tile < grid.GetTileCount(); ++tile)
+			dirtyTiles.push_back(tile);
+		encoder.Encode(k_Start, k_Start, captured.view, dirtyTiles, 1, quality, ++frameId, k_DefaultFragmentSize);
+		source.ReleaseFrame();
+		toViewer.bytesPerSecond = encoder.GetFrame(0).byteCount * config.changeRatio / k_FrameSeconds / 2;
+		toSharer.bytesPerSecond = toViewer.bytesPerSecond;
+	}
+
+	InputSender inputSender;
+	std::vector<uint8_t> message;
+	std::vector<InputEvent> events;
+	CursorState cursor;
+	cursor.visible = true;
+	cursor.frameWidth = config.width;
+	cursor.frameHeight = config.height;
+	CursorSender cursorSender;
+	CursorReceiver cursorReceiver;
+
+	std::map<int32_t, double> moved; // cursor x the viewer asked for, when it first did
+	int32_t seen = cursorReceiver.GetCursor().x;
+	std::vector<double> roundTrips;
+	double maxVideoQueueTime = 0.0;
+	uint32_t droppedFrames = 0;
+	double nextFrame = 0.0;
+	double nextMove = 0.0;
+	int32_t moveX = 0;
+	for (double time = 0.0; time < k_Seconds; time += k_Step)
+	{
+		const auto now = k_Start + std::chrono::microseconds((int64_t)(time * 1e6));
+
+		// Sharer: a frame when one is due, held back while the video lane is full.
+		if (time >= nextFrame)
+		{
+			CapturedFrame captured;
+			source.AcquireFrame(std::chrono::milliseconds(0), captured);
+			dirtyTiles.clear();
+			for (const TileRect &rect : captured.dirtyRects)
+			{
+				for (uint32_t y = rect.y / k_TileSize; y * k_TileSize < rect.y + rect.height; ++y)
+				{
+					for (uint32_t x = rect.x / k_TileSize; x * k_TileSize < rect.x + rect.width; ++x)
+						dirtyTiles.push_back(y * grid.GetColumns() + x);
+				}
+			}
+			std::sort(dirtyTiles.begin(), dirtyTiles.end());
+			dirtyTiles.erase(std::unique(dirtyTiles.begin(), dirtyTiles.end()), dirtyTiles.end());
+			if (toViewer.GetQueueTime(Lane::Video) < k_MaxVideoQueueTime)
+			{
+				encoder.Encode(now, now, captured.view, dirtyTiles, 1, quality, ++frameId, k_DefaultFragmentSize);
+				for (const EncodedFragment &fragment : encoder.GetFrame(0).fragments)
+					toViewer.Send(Lane::Video, fragment.data, fragment.size);
+			}
+			else
+			{
+				encoder.AddDirtyTiles(0, dirtyTiles);
+				++droppedFrames;
+			}
+			source.ReleaseFrame();
+			nextFrame += k_FrameSeconds;
+		}
+		maxVideoQueueTime = std::max(maxVideoQueueTime, toViewer.GetQueueTime(Lane::Video));
+
+		// Viewer: the pointer moves, what moved since the last poll goes out.  It stops in time for
+		// the last move to come back.
+		if (time >= nextMove && time < k_Seconds - 0.1 && moveX + k_MoveStep <= 65535)
+		{
+			moveX += k_MoveStep;
+			InputEvent event;
+			event.type = (uint8_t)InputEventType::MouseMove;
+			event.x = moveX;
+			inputSender.Add(event);
+			moved.emplace((int32_t)((int64_t)moveX * config.width / 65535), time);
+			nextMove += k_MoveSeconds;
+		}
+		while (inputSender.BuildMessage(message))
+			toSharer.Send(Lane::Input, message.data(), (uint32_t)message.size());
+
+		// Sharer: input moves the cursor, as applying it and capture would.
+		toSharer.Run(time, k_Step, [&](const LaneLink::Message &input)
+					 {
+						 events.clear();
+						 if (!CHECK(ParseInputEvents(input.data.data(), (uint32_t)input.data.size(), events)))
+							 return;
+						 for (const InputEvent &event : events)
+							 cursor.x = (int32_t)((int64_t)event.x * config.width / 65535);
+					 });
+		if (cursorSender.BuildPosition(now, cursor, CursorSender::k_DefaultRefreshRate, message))
+			toViewer.Send(Lane::Cursor, message.data(), (uint32_t)message.size());
+
+		// Viewer: the cursor shows where the pointer went.
+		toViewer.Run(time, k_Step, [&](const LaneLink::Message &arrived)
+					 {
+						 if (arrived.lane == Lane::Cursor)
+							 cursorReceiver.OnMessage(arrived.data.data(), (uint32_t)arrived.data.size());
+					 });
+		const int32_t x = cursorReceiver.GetCursor().x;
+		if (x != seen)
+		{
+			seen = x;
+			const auto it = moved.find(x);
+			if (CHECK(it != moved.end()))
+				roundTrips.push_back(time + k_Step - it->second);
+		}
+	}
+
+	// Lag both ways, a cursor refresh, a video fragment ahead on the wire each way and the polls.
+	const double fragmentTime = k_DefaultFragmentSize / toViewer.bytesPerSecond;
+	const double bound = toSharer.lag + toViewer.lag + 1.0 / CursorSender::k_DefaultRefreshRate + 2 * fragmentTime + k_MoveSeconds + 3 * k_Step;
+	if (!CHECK(!roundTrips.empty() && *std::max_element(roundTrips.begin(), roundTrips.end()) < bound))
+		printf("  max round trip %.1f ms, bound %.1f ms\n", roundTrips.empty() ? 0.0 : *std::max_element(roundTrips.begin(), roundTrips.end()) * 1000.0, bound * 1000.0);
+	// The video did fill the link.
+	CHECK(droppedFrames != 0);
+	CHECK(maxVideoQueueTime >= k_MaxVideoQueueTime);
+	CHECK(seen == (int32_t)((int64_t)moveX * config.width / 65535));
+}
@@ -0,0 +1,113 @@
+#include "Test.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "AllocationCount.h"
+#include "Streaming/LatencyTrace.h"
+
+// Percentiles of known samples against the exact ones: never below, at most a bucket (about 3%)
+// above, never above the maximum, and exact below 64 microseconds.
+TEST(LatencyPercentilesMatchTheSamples)
+{
+	LatencyHistogram histogram;
+	CHECK(histogram.GetPercentile(0.5).count() == 0);
+
+	for (int64_t latency = 1; latency <= 1000; ++latency)
+		histogram.Record(std::chrono::microseconds(latency));
+	CHECK(histogram.GetCount() == 1000 && histogram.GetMax().count() == 1000);
+	CHECK(histogram.GetPercentile(0.0).count() == 1);
+	CHECK(histogram.GetPercentile(0.05).count() == 50);
+	CHECK(histogram.GetPercentile(0.5).count() == 503);
+	CHECK(histogram.GetPercentile(0.99).count() == 991);
+	CHECK(histogram.GetPercentile(1.0).count() == 1000);
+
+	// Long tailed, as frame latencies are.
+	std::mt19937 random(1);
+	std::lognormal_distribution<double> distribution(9.0, 1.5);
+	std::vector<int64_t> samples(20000);
+	histogram.Reset();
+	for (int64_t &sample : samples)
+	{
+		sample = std::min<int64_t>((int64_t)distribution(random), LatencyHistogram::k_MaxLatency);
+		histogram.Record(std::chrono::microseconds(sample));
+	}
+	std::sort(samples.begin(), samples.end());
+	for (double percentile : {0.01, 0.25, 0.5, 0.9, 0.95, 0.99, 0.999, 1.0})
+	{
+		const size_t rank = std::max<size_t>((size_t)std::ceil(percentile * samples.size()), 1);
+		const int64_t exact = samples[rank - 1];
+		const int64_t measured = histogram.GetPercentile(percentile).count();
+		if (!CHECK(measured >= exact && measured <= exact + exact / 32 && measured <= samples.back()))
+			printf("  p%g: %lld, exactly %lld\n", percentile * 100, (long long)measured, (long long)exact);
+	}
+}
+
+// Each stage counts in its own histogram, and latencies outside the range clamp to its ends
+// instead of wrapping into some other bucket.
+TEST(LatencyStagesStaySeparate)
+{
+	LatencyTrace trace;
+	for (size_t stage = 0; stage < (size_t)LatencyStage::Count; ++stage)
+	{
+		for (uint32_t i = 0; i <= stage; ++i)
+			trace.Record((LatencyStage)stage, std::chrono::microseconds(stage * 1000 + 7));
+	}
+	for (size_t stage = 0; stage < (size_t)LatencyStage::Count; ++stage)
+	{
+		const LatencyHistogram &histogram = trace.GetHistogram((LatencyStage)stage);
+		CHECK(histogram.GetCount() == stage + 1);
+		CHECK(histogram.GetMax().count() == (int64_t)(stage * 1000 + 7));
+		CHECK(std::string(GetLatencyStageName((LatencyStage)stage)) != "Unknown");
+	}
+
+	LatencyTrace clamped;
+	clamped.Record(LatencyStage::Total, std::chrono::microseconds(-5));
+	clamped.Record(LatencyStage::Total, std::chrono::seconds(3600));
+	CHECK(clamped.GetPercentile(LatencyStage::Total, 0.5).count() == 0);
+	CHECK(clamped.GetPercentile(LatencyStage::Total, 1.0).count() == LatencyHistogram::k_MaxLatency);
+
+	// Two sides added together, stage by stage.
+	trace.Add(clamped);
+	CHECK(trace.GetHistogram(LatencyStage::Total).GetCount() == (size_t)LatencyStage::Total + 3);
+	CHECK(trace.GetHistogram(LatencyStage::Diff).GetCount() == 1);
+	trace.Reset();
+	CHECK(trace.GetHistogram(LatencyStage::Total).GetCount() == 0);
+}
+
+// Dump() is read by scripts: a line per stage that has latencies, in stage order.
+TEST(LatencyDumpFormat)
+{
+	LatencyTrace trace;
+	for (int64_t latency = 1; latency <= 1000; ++latency)
+		trace.Record(LatencyStage::Diff, std::chrono::microseconds(latency));
+	trace.Record(LatencyStage::Total, std::chrono::microseconds(40));
+
+	FILE *file = std::tmpfile();
+	if (!CHECK(file != nullptr))
+		return;
+	trace.Dump(file, "viewer");
+	std::string dumped(256, '\0');
+	std::rewind(file);
+	dumped.resize(std::fread(dumped.data(), 1, dumped.size(), file));
+	std::fclose(file);
+	const char *expected = "viewer Diff 1000 503 959 991 1000\n"
+						   "viewer Total 1 40 40 40 40\n";
+	if (!CHECK(dumped == expected))
+		printf("  %s", dumped.c_str());
+}
+
+// Recording runs on the capture and render threads every frame, it must not touch the heap.
+TEST(LatencyRecordDoesNotAllocate)
+{
+	LatencyTrace trace;
+	std::mt19937 random(1);
+	const uint64_t allocations = GetAllocationCount();
+	for (uint32_t i = 0; i < 100000; ++i)
+		trace.Record((LatencyStage)(i % (uint32_t)LatencyStage::Count), std::chrono::microseconds(random() % 100000));
+	CHECK(GetAllocationCount() == allocations);
+	CHECK(trace.GetHistogram(LatencyStage::Diff).GetCount() > 0);
+}
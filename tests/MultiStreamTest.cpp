@@ -0,0 +1,164 @@
+#include "Test.h"
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <thread>
+
+#include "TestBlocks.h"
+#include "Streaming/CaptureStream.h"
+#include "Streaming/FrameReceiver.h"
+#include "Streaming/SyntheticFrameSource.h"
+
+// Every stream has a lane of its own and every lane of a stream leads back to it, the receiver
+// tells streams apart by nothing else.
+TEST(StreamLanesRoundTrip)
+{
+	for (uint32_t stream = 0; stream < k_MaxStreams; ++stream)
+	{
+		CHECK(GetLaneStream((uint16_t)GetStreamLane(stream)) == stream);
+		CHECK((uint32_t)GetStreamLane(stream) < k_LaneCount);
+		for (uint32_t other = 0; other < stream; ++other)
+			CHECK(GetStreamLane(other) != GetStreamLane(stream));
+	}
+	for (Lane lane : {Lane::Control, Lane::Cursor, Lane::Bulk})
+		CHECK(GetLaneStream((uint16_t)lane) == k_MaxStreams);
+	CHECK(GetLaneStream((uint16_t)k_LaneCount) == k_MaxStreams);
+}
+
+// Three synthetic monitors of different sizes shared at once, the viewer subscribed to the first
+// and the last.  The one nobody watches must not capture at all.  The other two go over one
+// connection, told apart by lane as PeerConnections::PollMessages() does, each to a receiver of
+// its own; once they are paused each receiver holds exactly its own monitor's screen.
+TEST(MultipleStreamsShareAConnection)
+{
+	static constexpr uint32_t k_Streams = 3;
+	static constexpr uint32_t k_Sizes[k_Streams][2] = {{640, 360}, {320, 240}, {800, 600}};
+	static constexpr SyntheticWorkload k_Workloads[k_Streams] = {SyntheticWorkload::Scrolling, SyntheticWorkload::Video,
+																  SyntheticWorkload::WindowDrag};
+	static constexpr bool k_Subscribed[k_Streams] = {true, false, true};
+
+	WorkStealingPool pool(2);
+	ArenaBlockPool blockPool;
+	std::vector<std::unique_ptr<CaptureStream>> captures;
+	for (uint32_t stream = 0; stream < k_Streams; ++stream)
+	{
+		SyntheticWorkloadConfig config;
+		config.workload = k_Workloads[stream];
+		config.width = k_Sizes[stream][0];
+		config.height = k_Sizes[stream][1];
+		config.framesPerSecond = 120;
+		config.changeRatio = 0.25;
+		config.seed = stream + 1;
+		captures.push_back(std::make_unique<CaptureStream>(stream, std::make_unique<SyntheticFrameSource>(config), pool, blockPool));
+		captures.back()->GetEncoder().GetRefiner(0).SetChangeQuality(k_TileQualityLossless);
+		captures.back()->SetActive(k_Subscribed[stream]);
+	}
+	const uint8_t quality[k_SimulcastLayerCount] = {k_TileQualityLossless, k_TileQualityLossless, k_TileQualityLossless};
+
+	// One connection: every fragment with the lane it went on.
+	struct LaneMessage
+	{
+		uint16_t lane;
+		const EncodedFragment *fragment;
+	};
+	std::vector<LaneMessage> connection;
+	std::unique_ptr<FrameReceiver> receivers[k_MaxStreams];
+	uint32_t misrouted = 0;
+	auto deliver = [&]()
+	{
+		for (const LaneMessage &message : connection)
+		{
+			const uint32_t stream = GetLaneStream(message.lane);
+			if (stream >= k_MaxStreams)
+			{
+				++misrouted;
+				continue;
+			}
+			if (!receivers[stream])
+				receivers[stream] = std::make_unique<FrameReceiver>(stream);
+			message.fragment->block->AddRef();
+			receivers[stream]->OnMessage(message.fragment->data, message.fragment->size, message.fragment->block, &ReleaseBlock);
+		}
+		connection.clear();
+	};
+
+	// Encodes what changed on each stream that is active, as PeerConnections::SendStream() does,
+	// or with flush what is left to send.  Frames of all streams interleave on the connection.
+	std::vector<uint32_t> dirtyTiles;
+	auto encode = [&](CaptureStream &capture, bool flush)
+	{
+		if (!flush && !capture.IsActive())
+			return false;
+		FrameView frame;
+		std::chrono::steady_clock::time_point captured;
+		std::chrono::steady_clock::time_point diffed;
+		if (!capture.AcquireFrame(frame, dirtyTiles, captured, diffed))
+			return false;
+		SimulcastEncoder &encoder = capture.GetEncoder();
+		const bool idle = dirtyTiles.empty() && encoder.IsIdle(1, quality);
+		if (!idle)
+		{
+			encoder.Encode(captured, diffed, frame, dirtyTiles, 1, quality, capture.NextFrameId(), k_DefaultFragmentSize);
+			for (const EncodedFragment &fragment : encoder.GetFrame(0).fragments)
+				connection.push_back({(uint16_t)GetStreamLane(capture.GetStream()), &fragment});
+		}
+		capture.ReleaseFrame();
+		return !idle;
+	};
+
+	const auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(500);
+	while (std::chrono::steady_clock::now() < end)
+	{
+		for (const std::unique_ptr<CaptureStream> &capture : captures)
+			encode(*capture, false);
+		deliver();
+		std::this_thread::sleep_for(std::chrono::milliseconds(4));
+	}
+
+	// Paused, a frame the capture thread was on may still land, then nothing.
+	for (const std::unique_ptr<CaptureStream> &capture : captures)
+		capture->SetActive(false);
+	std::this_thread::sleep_for(CaptureStream::k_AcquireTimeout * 2);
+	uint64_t capturedFrames[k_Streams];
+	for (uint32_t stream = 0; stream < k_Streams; ++stream)
+		capturedFrames[stream] = captures[stream]->GetCapturedFrameCount();
+	std::this_thread::sleep_for(CaptureStream::k_AcquireTimeout * 2);
+	for (uint32_t stream = 0; stream < k_Streams; ++stream)
+		CHECK(captures[stream]->GetCapturedFrameCount() == capturedFrames[stream]);
+
+	// What the last frames left behind, one stream after the other.
+	for (const std::unique_ptr<CaptureStream> &capture : captures)
+	{
+		for (uint32_t frame = 0; frame < 100 && encode(*capture, true); ++frame)
+			deliver();
+	}
+
+	CHECK(misrouted == 0);
+	for (uint32_t stream = 0; stream < k_Streams; ++stream)
+	{
+		CaptureStream &capture = *captures[stream];
+		if (!k_Subscribed[stream])
+		{
+			CHECK(capture.GetCapturedFrameCount() == 0);
+			CHECK(!receivers[stream]);
+			continue;
+		}
+		if (!CHECK(capture.GetCapturedFrameCount() > 1 && receivers[stream]))
+			continue;
+
+		FrameView frame;
+		std::chrono::steady_clock::time_point captured;
+		std::chrono::steady_clock::time_point diffed;
+		if (!CHECK(capture.AcquireFrame(frame, dirtyTiles, captured, diffed)))
+			continue;
+		const FrameBuffer &canvas = receivers[stream]->GetReassembler().GetCanvas();
+		bool same = canvas.width == frame.width && canvas.height == frame.height && frame.width == k_Sizes[stream][0];
+		for (uint32_t y = 0; same && y < frame.height; ++y)
+			same = std::memcmp(canvas.Row(y), frame.Row(y), (size_t)frame.width * k_BytesPerPixel) == 0;
+		capture.ReleaseFrame();
+		if (!CHECK(same))
+			printf("  stream %u: %ux%u received, %ux%u captured\n", stream, canvas.width, canvas.height, frame.width, frame.height);
+		CHECK(!receivers[stream]->GetReassembler().HasPendingFrames());
+	}
+}
@@ -0,0 +1,79 @@
+#include "Test.h"
+
+#include <cstring>
+
+#include "TestBlocks.h"
+#include "Streaming/FrameReassembler.h"
+#include "Streaming/ParallelTileEncoder.h"
+#include "Streaming/SyntheticFrameSource.h"
+#include "Streaming/TileCodec.h"
+
+// A noisy 1080p screen in fragments of 65 bytes would take about 95000 of them, more than 16 bits
+// number.  The encoder has to make them larger, so the fragments come out numbered right and
+// reassemble to the screen.
+TEST(EncoderRaisesFragmentSizeToNumberFragments)
+{
+	SyntheticWorkloadConfig config;
+	config.workload = SyntheticWorkload::Noise;
+	config.changeRatio = 1.0;
+	SyntheticFrameSource source(config);
+	CapturedFrame captured;
+	source.AcquireFrame(std::chrono::milliseconds(0), captured);
+	const TileGrid grid(config.width, config.height);
+	std::vector<uint32_t> dirtyTiles(grid.GetTileCount());
+	for (uint32_t tile = 0; tile < dirtyTiles.size(); ++tile)
+		dirtyTiles[tile] = tile;
+
+	WorkStealingPool pool(2);
+	ArenaBlockPool blockPool;
+	ParallelTileEncoder encoder(pool, blockPool);
+	EncodedFrame frame;
+	static constexpr uint32_t k_FragmentSize = 65;
+	if (!CHECK(encoder.Encode(captured.view, dirtyTiles, k_TileQualityLossless, 1, 0, 0, k_FragmentSize, frame)))
+		return;
+	if (!CHECK(frame.byteCount / k_FragmentSize > ParallelTileEncoder::k_MaxFragments && frame.fragments.size() <= ParallelTileEncoder::k_MaxFragments))
+		printf("  %zu bytes in %zu fragments\n", frame.byteCount, frame.fragments.size());
+
+	FrameReassembler reassembler;
+	for (size_t i = 0; i < frame.fragments.size(); ++i)
+	{
+		FrameUpdateHeader header;
+		std::memcpy(&header, frame.fragments[i].data, sizeof(header));
+		CHECK(header.fragmentIndex == i && header.fragmentCount == frame.fragments.size());
+		CHECK(frame.fragments[i].size <= sizeof(header) + ParallelTileEncoder::GetMaxFragmentSize());
+		reassembler.AddFragment(frame.fragments[i].data, frame.fragments[i].size, nullptr, &ReleaseNothing);
+	}
+	CHECK(reassembler.GetCompletedFrameCount() == 1);
+	const FrameBuffer &canvas = reassembler.GetCanvas();
+	bool same = canvas.width == captured.view.width && canvas.height == captured.view.height;
+	for (uint32_t y = 0; same && y < canvas.height; ++y)
+		same = std::memcmp(canvas.Row(y), captured.view.Row(y), (size_t)canvas.width * k_BytesPerPixel) == 0;
+	CHECK(same);
+	source.ReleaseFrame();
+}
+
+// A frame with so many dirty tiles that even the largest fragments could run out of numbers is
+// refused whole, nothing half numbered goes out.  The rows all alias one, 16K x 16K of it would
+// be a gigabyte.
+TEST(EncoderRefusesFramesItCannotNumber)
+{
+	static constexpr uint32_t k_Size = 16384;
+	std::vector<uint8_t> row((size_t)k_Size * k_BytesPerPixel, 0x40);
+	const FrameView view = {row.data(), k_Size, k_Size, 0};
+	const TileGrid grid(k_Size, k_Size);
+	std::vector<uint32_t> dirtyTiles(grid.GetTileCount());
+	for (uint32_t tile = 0; tile < dirtyTiles.size(); ++tile)
+		dirtyTiles[tile] = tile;
+
+	WorkStealingPool pool(1);
+	ArenaBlockPool blockPool;
+	ParallelTileEncoder encoder(pool, blockPool);
+	EncodedFrame frame;
+	CHECK(!encoder.Encode(view, dirtyTiles, k_TileQualityLossless, 1, 0, 0, k_DefaultFragmentSize, frame));
+	CHECK(frame.fragments.empty() && frame.tiles.empty() && frame.byteCount == 0);
+
+	// The same screen in fewer tiles at a time goes out.
+	dirtyTiles.resize(dirtyTiles.size() / 4);
+	CHECK(encoder.Encode(view, dirtyTiles, k_TileQualityLossless, 2, 0, 0, k_DefaultFragmentSize, frame));
+	CHECK(frame.tiles.size() == dirtyTiles.size() && frame.fragments.size() <= ParallelTileEncoder::k_MaxFragments);
+}
@@ -0,0 +1,183 @@
+#include "Test.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "Streaming/Playout.h"
+
+// Frames captured 60 times a second on the sender's clock, arriving over a path that takes 20 ms
+// plus up to 30 ms of jitter and now and then a 100 ms stall, on a receiver clock with an offset
+// of its own.  Arrivals stay in order, as frames on one lane do.
+struct JitterTrace
+{
+	struct Frame
+	{
+		std::chrono::steady_clock::time_point arrived;
+		uint32_t timestamp;
+		double captured; // seconds, for comparing with what was shown
+	};
+
+	std::vector<Frame> frames;
+
+	explicit JitterTrace(uint32_t count)
+	{
+		static const auto k_SenderStart = std::chrono::steady_clock::time_point() + std::chrono::seconds(1000);
+		static const auto k_ReceiverStart = std::chrono::steady_clock::time_point() + std::chrono::seconds(5);
+		std::mt19937 random(1);
+		std::uniform_real_distribution<double> jitter(0.0, 0.030);
+		std::bernoulli_distribution stall(0.01);
+		double last = 0.0;
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			const double captured = i / 60.0;
+			const double arrived = std::max(last, captured + 0.020 + jitter(random) + (stall(random) ? 0.100 : 0.0));
+			last = arrived;
+			frames.push_back({k_ReceiverStart + std::chrono::microseconds((int64_t)(arrived * 1e6)),
+							  GetWireTimestamp(k_SenderStart + std::chrono::microseconds((int64_t)(captured * 1e6))), captured});
+		}
+	}
+};
+
+// Capture to release, in seconds, up to the unknown clock offset, of every frame of trace.
+static std::vector<double> Play(const JitterTrace &trace, PlayoutMode mode, PlayoutScheduler &scheduler)
+{
+	scheduler.SetMode(mode);
+	std::vector<double> delays;
+	for (const JitterTrace::Frame &frame : trace.frames)
+	{
+		const auto release = scheduler.Schedule(frame.arrived, frame.timestamp);
+		if (!CHECK(release >= frame.arrived))
+			break;
+		delays.push_back(std::chrono::duration<double>(release.time_since_epoch()).count() - frame.captured);
+	}
+	return delays;
+}
+
+// Smooth shows nearly every frame as long after it was captured as the one before, so they keep
+// the pace they were captured at; only the stalls come late.  Low latency passes the jitter on.
+TEST(SmoothPlayoutEvensOutJitter)
+{
+	const JitterTrace trace(1200);
+	// Frames, once the history is full, shown within 2 ms of the pace they were captured at.
+	auto countPaced = [&](const std::vector<double> &delays)
+	{
+		size_t paced = 0;
+		for (size_t i = PlayoutScheduler::k_HistoryFrames + 1; i < delays.size(); ++i)
+			paced += std::abs(delays[i] - delays[i - 1]) < 0.002;
+		return paced;
+	};
+	const size_t frames = trace.frames.size() - PlayoutScheduler::k_HistoryFrames - 1;
+
+	PlayoutScheduler scheduler;
+	const size_t smooth = countPaced(Play(trace, PlayoutMode::Smooth, scheduler));
+	CHECK(scheduler.GetJitter() > std::chrono::milliseconds(5));
+	CHECK(scheduler.GetLateFrameCount() < trace.frames.size() / 10);
+	CHECK(scheduler.GetTargetDelay() <= PlayoutScheduler::k_MaxDelay);
+
+	PlayoutScheduler lowLatencyScheduler;
+	const size_t lowLatency = countPaced(Play(trace, PlayoutMode::LowLatency, lowLatencyScheduler));
+	if (!CHECK(smooth >= frames * 9 / 10 && lowLatency < frames / 2))
+		printf("  paced frames of %zu: smooth %zu, low latency %zu\n", frames, smooth, lowLatency);
+}
+
+// Low latency shows every frame as it arrives, which is sooner than smooth on average but as
+// uneven as the path.
+TEST(LowLatencyPlayoutShowsFramesOnArrival)
+{
+	const JitterTrace trace(1200);
+	PlayoutScheduler smoothScheduler;
+	const std::vector<double> smooth = Play(trace, PlayoutMode::Smooth, smoothScheduler);
+	PlayoutScheduler scheduler;
+	const std::vector<double> lowLatency = Play(trace, PlayoutMode::LowLatency, scheduler);
+	if (!CHECK(lowLatency.size() == trace.frames.size() && smooth.size() == lowLatency.size()))
+		return;
+
+	double smoothSum = 0.0;
+	double lowLatencySum = 0.0;
+	for (size_t i = 0; i < trace.frames.size(); ++i)
+	{
+		CHECK(lowLatency[i] == std::chrono::duration<double>(trace.frames[i].arrived.time_since_epoch()).count() - trace.frames[i].captured);
+		smoothSum += smooth[i];
+		lowLatencySum += lowLatency[i];
+	}
+	CHECK(lowLatencySum < smoothSum);
+	CHECK(scheduler.GetLateFrameCount() == 0);
+}
+
+// The viewer's toggle takes effect with the next frame, without starting the history over.
+TEST(PlayoutModeSwitchesMidStream)
+{
+	const JitterTrace trace(600);
+	PlayoutScheduler scheduler;
+	scheduler.SetMode(PlayoutMode::Smooth);
+	bool held = false;
+	for (size_t i = 0; i < trace.frames.size(); ++i)
+	{
+		if (i == 300)
+			scheduler.SetMode(PlayoutMode::LowLatency);
+		const auto release = scheduler.Schedule(trace.frames[i].arrived, trace.frames[i].timestamp);
+		if (i < 300)
+			held |= release > trace.frames[i].arrived;
+		// After the switch only what is already scheduled can hold a frame back, at most once.
+		else if (i > 300)
+			CHECK(release == trace.frames[i].arrived);
+	}
+	CHECK(held);
+	CHECK(scheduler.GetTargetDelay() > std::chrono::microseconds(0));
+}
+
+// A steady path needs no delay at all.  A late frame, and those that complete right behind it,
+// are counted late and shown on arrival.  Once a quarter of the frames come 30 ms late, the
+// target delay rises to that and every frame is shown exactly 30 ms after the fastest path would
+// have brought it, late ones included.  Nothing is shown before it arrived or before the frame
+// ahead of it, across the wrap of the sender's 32 bit clock too.
+TEST(PlayoutSchedulerPacesFrames)
+{
+	static constexpr int64_t k_FrameMicroseconds = 16667;
+	static constexpr int64_t k_Transit = 20000;
+	static constexpr uint32_t k_SenderStart = 0xFFFFFFFFu - 1000000; // wraps a second in
+	const auto receiverStart = std::chrono::steady_clock::time_point() + std::chrono::seconds(7);
+
+	PlayoutScheduler scheduler;
+	scheduler.SetMode(PlayoutMode::Smooth);
+	std::chrono::steady_clock::time_point lastArrival;
+	std::chrono::steady_clock::time_point lastRelease;
+	uint32_t frame = 0;
+	// Release less the time the frame would have arrived on the fastest path.  Frames complete in
+	// order, one held up holds up those behind it.
+	auto schedule = [&](int64_t lateness)
+	{
+		const int64_t onTime = frame * k_FrameMicroseconds + k_Transit;
+		const auto arrived = std::max(lastArrival, receiverStart + std::chrono::microseconds(onTime + lateness));
+		const auto release = scheduler.Schedule(arrived, k_SenderStart + (uint32_t)(frame * k_FrameMicroseconds));
+		CHECK(release >= arrived && release >= lastRelease);
+		lastArrival = arrived;
+		lastRelease = release;
+		++frame;
+		return std::chrono::duration_cast<std::chrono::microseconds>(release - receiverStart).count() - onTime;
+	};
+
+	bool steady = true;
+	for (uint32_t i = 0; i < PlayoutScheduler::k_HistoryFrames * 2; ++i)
+		steady &= schedule(0) == 0;
+	CHECK(steady);
+	CHECK(scheduler.GetTargetDelay().count() == 0 && scheduler.GetJitter().count() == 0 && scheduler.GetLateFrameCount() == 0);
+
+	CHECK(schedule(50000) == 50000);
+	CHECK(schedule(0) == 50000 - k_FrameMicroseconds);
+	CHECK(schedule(0) == 50000 - 2 * k_FrameMicroseconds);
+	CHECK(schedule(0) == 0);
+	CHECK(scheduler.GetLateFrameCount() == 3 && scheduler.GetTargetDelay().count() == 0);
+
+	for (uint32_t i = 0; i < PlayoutScheduler::k_HistoryFrames; ++i)
+		schedule(i % 4 == 0 ? 30000 : 0);
+	const uint64_t lateFrames = scheduler.GetLateFrameCount();
+	bool paced = true;
+	for (uint32_t i = 0; i < PlayoutScheduler::k_HistoryFrames; ++i)
+		paced &= schedule(i % 4 == 0 ? 30000 : 0) == 30000;
+	CHECK(paced);
+	CHECK(scheduler.GetTargetDelay().count() == 30000 && scheduler.GetLateFrameCount() == lateFrames);
+	CHECK(scheduler.GetJitter() > std::chrono::milliseconds(5));
+}
@@ -0,0 +1,159 @@
+#include "Test.h"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "Streaming/RateController.h"
+
+// A sender feeding one bottleneck link, what GameNetworkingSockets' FakePacketLag and
+// FakePacketLoss settings and a SendRateMax make of a localhost connection.  Frames of a screen
+// that changes everywhere are encoded at the controller's rate and quality.  While the link's
+// queue is over PeerConnections' k_usecVideoMaxQueueTime a frame waits on our side and the next
+// one replaces it, as FrameSendQueue drops frames newer ones made obsolete.
+struct LinkModel
+{
+	static constexpr double k_FrameBytes = 150000.0; // lossless full resolution
+	static constexpr double k_MaxHoldSeconds = 0.020;
+
+	double bytesPerSecond = 20e6;
+	int lagMs = 20;
+	float lossRate = 0.0f;
+
+	RateController controller;
+	double time = 0.0;
+	double linkBytes = 0.0; // in the library's queue
+	double heldBytes = 0.0; // waiting on our side, 0 when no frame is
+	double heldCaptured = 0.0;
+	double nextFrame = 0.0;
+	// Of the last Run(): how long each frame queued, captured until its first byte went out, and
+	// the level at every poll.
+	std::vector<double> queueDelays;
+	std::vector<uint32_t> levels;
+
+	static double GetQualityShare(uint8_t quality)
+	{
+		static constexpr double k_Share[] = {0.1, 0.12, 0.15, 0.2, 0.25, 0.35, 0.45, 0.6, 1.0};
+		return k_Share[std::min<uint32_t>(quality, k_TileQualityLossless)];
+	}
+
+	double GetLinkDelay() const { return linkBytes / bytesPerSecond; }
+
+	// Polls every millisecond for seconds, as PeerConnections does.
+	void Run(double seconds, std::mt19937 &random)
+	{
+		static constexpr double k_Poll = 0.001;
+		static const auto k_Start = std::chrono::steady_clock::time_point();
+		std::uniform_int_distribution<int> jitter(0, 3);
+		queueDelays.clear();
+		levels.clear();
+		for (double end = time + seconds; time < end; time += k_Poll)
+		{
+			linkBytes = std::max(0.0, linkBytes - bytesPerSecond * k_Poll);
+
+			const RateTarget &target = controller.GetTarget();
+			if (time >= nextFrame)
+			{
+				heldBytes = k_FrameBytes * GetQualityShare(target.quality) / (double)(1u << (2 * target.layer));
+				heldCaptured = time;
+				nextFrame = time + 1.0 / target.framesPerSecond;
+			}
+			if (heldBytes > 0.0 && GetLinkDelay() < k_MaxHoldSeconds)
+			{
+				queueDelays.push_back(time - heldCaptured + GetLinkDelay());
+				linkBytes += heldBytes;
+				controller.OnFrameSent((uint32_t)heldBytes);
+				heldBytes = 0.0;
+			}
+
+			RateSample sample;
+			sample.pingMs = 2 * lagMs + (int)(GetLinkDelay() * 1000.0) + jitter(random);
+			sample.deliveryRate = 1.0f - lossRate;
+			sample.sendRateBytesPerSecond = (int)bytesPerSecond;
+			sample.pendingBytes = (int)(linkBytes + heldBytes);
+			sample.queueTimeUs = (int64_t)(GetLinkDelay() * 1e6);
+			controller.Update(k_Start + std::chrono::microseconds((int64_t)(time * 1e6)), sample);
+			levels.push_back(controller.GetLevel());
+		}
+	}
+
+	// Of the frames of the last Run() from the fraction from on.
+	double GetQueueDelayPercentile(double percentile, double from) const
+	{
+		std::vector<double> delays(queueDelays.begin() + (size_t)(from * queueDelays.size()), queueDelays.end());
+		std::sort(delays.begin(), delays.end());
+		return delays[std::min(delays.size() - 1, (size_t)(percentile * delays.size()))];
+	}
+};
+
+// The link drops to less than what the sender needs, recovers, and drops further.  Each time the
+// controller has to settle where the queue stays short, within a few seconds.
+TEST(RateControllerConvergesWithoutQueueDelay)
+{
+	static constexpr double k_Rates[] = {20e6, 3e6, 10e6, 1.5e6};
+	static constexpr double k_PhaseSeconds = 10.0;
+
+	std::mt19937 random(1);
+	LinkModel link;
+	for (double rate : k_Rates)
+	{
+		link.bytesPerSecond = rate;
+		link.Run(k_PhaseSeconds, random);
+
+		// Settled after the first half: a short queue, and a level it no longer leaves.
+		const double p95 = link.GetQueueDelayPercentile(0.95, 0.5);
+		if (!CHECK(p95 < 2.0 * std::chrono::duration<double>(RateController::k_MaxQueueDelay).count()))
+			printf("  %.1f MB/s: p95 queue delay %.0f ms\n", rate / 1e6, p95 * 1000.0);
+		const size_t half = link.levels.size() / 2;
+		const auto [lowest, highest] = std::minmax_element(link.levels.begin() + half, link.levels.end());
+		if (!CHECK(*highest - *lowest <= 1))
+			printf("  %.1f MB/s: level %u to %u\n", rate / 1e6, *lowest, *highest);
+	}
+	// 1.5 MB/s doesn't carry full quality.
+	CHECK(link.controller.GetLevel() > 0);
+}
+
+// 150 KB at 60 frames a second fits, the controller stays at the top.
+TEST(RateControllerKeepsFullRateOnAFastLink)
+{
+	std::mt19937 random(1);
+	LinkModel link;
+	link.bytesPerSecond = 20e6;
+	link.Run(10.0, random);
+	CHECK(*std::max_element(link.levels.begin(), link.levels.end()) == 0);
+	CHECK(link.GetQueueDelayPercentile(1.0, 0.0) < LinkModel::k_MaxHoldSeconds);
+}
+
+// Random loss is FEC's and the NACKs' to deal with, and a long but steady ping is just distance.
+// Neither may cost the peer its frame rate.
+TEST(RateControllerIgnoresLossAndSteadyLag)
+{
+	std::mt19937 random(1);
+	LinkModel link;
+	link.bytesPerSecond = 20e6;
+	link.lagMs = 150;
+	link.lossRate = 0.05f;
+	link.Run(10.0, random);
+	CHECK(*std::max_element(link.levels.begin(), link.levels.end()) == 0);
+}
+
+// A loss rate past what FEC is there for holds the peer where it is: after a drop it doesn't
+// probe back up while losing.
+TEST(RateControllerDoesNotStepUpWhileLosing)
+{
+	std::mt19937 random(1);
+	LinkModel link;
+	link.bytesPerSecond = 1.5e6;
+	link.Run(5.0, random);
+	const uint32_t level = link.controller.GetLevel();
+	CHECK(level > 0);
+
+	link.bytesPerSecond = 20e6;
+	link.lossRate = 0.2f;
+	link.Run(10.0, random);
+	CHECK(link.controller.GetLevel() == level);
+
+	link.lossRate = 0.0f;
+	link.Run(20.0, random);
+	CHECK(link.controller.GetLevel() < level);
+}
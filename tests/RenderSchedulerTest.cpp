@@ -0,0 +1,94 @@
+#include "Test.h"
+
+#include "Streaming/RenderScheduler.h"
+
+static const auto k_SchedulerStart = std::chrono::steady_clock::time_point() + std::chrono::seconds(1);
+
+// The first frame is drawn, after that an idle app only wakes to poll.
+TEST(RenderSchedulerIdlesAfterTheFirstFrame)
+{
+	RenderScheduler scheduler;
+	const auto now = k_SchedulerStart;
+	CHECK(scheduler.GetWaitTime(now) == std::chrono::steady_clock::duration::zero());
+	CHECK(scheduler.ShouldRender(now));
+	for (int frame = 0; frame < 10; ++frame)
+		CHECK(!scheduler.ShouldRender(now));
+	CHECK(scheduler.GetWaitTime(now) == RenderScheduler::k_DefaultPollInterval);
+	CHECK(scheduler.GetRenderedFrameCount() == 1);
+
+	scheduler.SetPollInterval(std::chrono::milliseconds(100));
+	CHECK(scheduler.GetWaitTime(now) == std::chrono::milliseconds(100));
+}
+
+// Input draws a few frames for ImGui to settle, a change one, and they don't add up.
+TEST(RenderSchedulerDrawsForInputAndChanges)
+{
+	RenderScheduler scheduler;
+	const auto now = k_SchedulerStart;
+	scheduler.ShouldRender(now);
+
+	scheduler.OnInput();
+	scheduler.OnInput();
+	for (uint32_t frame = 0; frame < RenderScheduler::k_FramesAfterInput; ++frame)
+		CHECK(scheduler.ShouldRender(now));
+	CHECK(!scheduler.ShouldRender(now));
+
+	scheduler.Invalidate();
+	scheduler.Invalidate();
+	CHECK(scheduler.ShouldRender(now));
+	CHECK(!scheduler.ShouldRender(now));
+
+	// A change during input's frames doesn't cut them short.
+	scheduler.OnInput();
+	scheduler.ShouldRender(now);
+	scheduler.Invalidate();
+	for (uint32_t frame = 1; frame < RenderScheduler::k_FramesAfterInput; ++frame)
+		CHECK(scheduler.ShouldRender(now));
+	CHECK(!scheduler.ShouldRender(now));
+	CHECK(scheduler.GetRenderedFrameCount() == 1 + 2 * RenderScheduler::k_FramesAfterInput + 1);
+}
+
+// A frame asked for in advance is drawn once it is due, the soonest of several first, and the
+// loop sleeps until then rather than a whole poll interval.
+TEST(RenderSchedulerDrawsAtRequestedTimes)
+{
+	RenderScheduler scheduler;
+	const auto now = k_SchedulerStart;
+	scheduler.ShouldRender(now);
+
+	scheduler.RenderAt(now + std::chrono::milliseconds(10));
+	scheduler.RenderAt(now + std::chrono::milliseconds(5));
+	scheduler.RenderAt(std::chrono::steady_clock::time_point::max());
+	CHECK(scheduler.GetWaitTime(now) == std::chrono::milliseconds(5));
+	CHECK(!scheduler.ShouldRender(now + std::chrono::milliseconds(4)));
+	CHECK(scheduler.ShouldRender(now + std::chrono::milliseconds(5)));
+	// Drawn, what was asked for later has been drawn with it.
+	CHECK(!scheduler.ShouldRender(now + std::chrono::milliseconds(10)));
+
+	// Later than the poll interval, the loop still wakes to poll.
+	scheduler.RenderAt(now + std::chrono::seconds(1));
+	CHECK(scheduler.GetWaitTime(now) == RenderScheduler::k_DefaultPollInterval);
+	CHECK(scheduler.GetWaitTime(now + std::chrono::seconds(2)) == std::chrono::steady_clock::duration::zero());
+}
+
+// While something animates every frame is drawn and the loop doesn't sleep; after that it idles
+// again.
+TEST(RenderSchedulerDrawsEveryFrameWhileAnimating)
+{
+	RenderScheduler scheduler;
+	auto now = k_SchedulerStart;
+	scheduler.ShouldRender(now);
+
+	scheduler.SetAnimating(true);
+	for (int frame = 0; frame < 60; ++frame)
+	{
+		CHECK(scheduler.GetWaitTime(now) == std::chrono::steady_clock::duration::zero());
+		CHECK(scheduler.ShouldRender(now));
+		now += std::chrono::milliseconds(16);
+	}
+	CHECK(scheduler.GetRenderedFrameCount() == 61);
+
+	scheduler.SetAnimating(false);
+	CHECK(!scheduler.ShouldRender(now));
+	CHECK(scheduler.GetWaitTime(now) == RenderScheduler::k_DefaultPollInterval);
+}
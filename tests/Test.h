@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+
+// Tests register themselves with TEST(Name) { ... } and check with CHECK(condition), which logs a
+// failure and carries on; it is an expression, so if (!CHECK(...)) return; stops the test.
+// streaming_tests runs all of them, or those whose name contains one of its arguments, and
+// fails when any check did.
+void RegisterTest(const char *name, void (*fn)());
+bool FailCheck(const char *file, int line, const char *expression);
+
+#define TEST(name)                                                         \
+	static void name();                                                    \
+	static const bool name##Registered = (RegisterTest(#name, &name), true); \
+	static void name()
+
+#define CHECK(expression) ((expression) ? true : FailCheck(__FILE__, __LINE__, #expression))
@@ -0,0 +1,17 @@
+#pragma once
+
+#include "Streaming/EncodeArena.h"
+
+// Release callbacks for FrameReassembler::AddFragment() and FrameReceiver's messages, shared by
+// the tests and the benchmarks.
+
+// The handle is an ArenaBlock the caller took a reference on for the message.
+inline void ReleaseBlock(void *handle)
+{
+	static_cast<ArenaBlock *>(handle)->Release();
+}
+
+// The message is the caller's and outlives the receiver, nothing to free.
+inline void ReleaseNothing(void *)
+{
+}
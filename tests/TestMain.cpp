@@ -0,0 +1,53 @@
+#include "Test.h"
+
+#include <cstring>
+#include <vector>
+
+struct TestCase
+{
+	const char *name;
+	void (*fn)();
+};
+
+static std::vector<TestCase> &GetTests()
+{
+	static std::vector<TestCase> tests;
+	return tests;
+}
+
+static uint32_t s_Failures = 0;
+
+void RegisterTest(const char *name, void (*fn)())
+{
+	GetTests().push_back({name, fn});
+}
+
+bool FailCheck(const char *file, int line, const char *expression)
+{
+	printf("%s:%d: CHECK(%s) failed\n", file, line, expression);
+	++s_Failures;
+	return false;
+}
+
+int main(int argc, char **argv)
+{
+	uint32_t run = 0;
+	uint32_t failed = 0;
+	for (const TestCase &test : GetTests())
+	{
+		bool selected = argc == 1;
+		for (int i = 1; i < argc && !selected; ++i)
+			selected = std::strstr(test.name, argv[i]) != nullptr;
+		if (!selected)
+			continue;
+		const uint32_t failures = s_Failures;
+		test.fn();
+		++run;
+		const bool passed = s_Failures == failures;
+		failed += !passed;
+		printf("%s %s\n", passed ? "[ OK ]" : "[FAIL]", test.name);
+		fflush(stdout);
+	}
+	printf("%u of %u tests passed\n", run - failed, run);
+	return failed == 0 ? 0 : 1;
+}
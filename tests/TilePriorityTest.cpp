@@ -0,0 +1,110 @@
+#include "Test.h"
+
+#include <algorithm>
+#include <memory>
+#include <thread>
+
+#include "Streaming/CaptureStream.h"
+#include "Streaming/SyntheticFrameSource.h"
+
+// The first frame of a synthetic desktop and then a screen that stands still, with a cursor and
+// a foreground window where DesktopDuplicationSource would report them.
+class FocusedFrameSource : public IFrameSource
+{
+public:
+	FocusedFrameSource(const SyntheticWorkloadConfig &config, const FrameFocus &focus)
+		: m_Source(config), m_Focus(focus)
+	{
+	}
+
+	bool AcquireFrame(std::chrono::milliseconds timeout, CapturedFrame &frame) override
+	{
+		if (m_Delivered || !m_Source.AcquireFrame(timeout, frame))
+		{
+			std::this_thread::sleep_for(timeout);
+			return false;
+		}
+		m_Delivered = true;
+		frame.focus = m_Focus;
+		return true;
+	}
+
+	void ReleaseFrame() override { m_Source.ReleaseFrame(); }
+
+private:
+	SyntheticFrameSource m_Source;
+	FrameFocus m_Focus;
+	bool m_Delivered = false;
+};
+
+// A link that carries six tiles a frame and a whole screen to send: the tiles under the cursor
+// have to go in the first frame, the foreground window's right after, and the rest of the screen
+// once those are through.
+TEST(FocusedTilesArriveFirstOnAThrottledLink)
+{
+	static constexpr uint32_t k_TilesPerFrame = 6;
+
+	SyntheticWorkloadConfig config;
+	config.workload = SyntheticWorkload::Caret;
+	config.width = 640;
+	config.height = 360;
+	FrameFocus focus;
+	focus.hasCursor = true;
+	focus.cursorX = 32;
+	focus.cursorY = 32;
+	focus.window = {320, 128, 192, 128};
+
+	WorkStealingPool pool(1);
+	ArenaBlockPool blockPool;
+	CaptureStream capture(0, std::make_unique<FocusedFrameSource>(config, focus), pool, blockPool);
+	capture.SetActive(true);
+
+	SimulcastEncoder &encoder = capture.GetEncoder();
+	encoder.GetRefiner(0).SetChangeQuality(k_TileQualityLossless);
+	encoder.SetByteBudget(0, k_TilesPerFrame * k_TileSize * k_TileSize * 3);
+	const uint8_t quality[k_SimulcastLayerCount] = {k_TileQualityLossless, k_TileQualityLossless, k_TileQualityLossless};
+
+	const TileGrid grid(config.width, config.height);
+	std::vector<uint8_t> priorities;
+	BuildTilePriorities(grid, 0, focus, priorities);
+	std::vector<uint32_t> arrived(grid.GetTileCount(), UINT32_MAX); // the frame each tile first went out in
+
+	// Encoded as PeerConnections::SendStream() does, one frame per link frame time.
+	FrameView frame;
+	std::vector<uint32_t> dirtyTiles;
+	std::chrono::steady_clock::time_point captured;
+	std::chrono::steady_clock::time_point diffed;
+	for (uint32_t wait = 0; wait < 5000 && !capture.AcquireFrame(frame, dirtyTiles, captured, diffed); ++wait)
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	if (!CHECK(frame.width == config.width))
+		return;
+	for (uint32_t frameId = 0; frameId < 60; ++frameId)
+	{
+		if (frameId != 0)
+			capture.AcquireFrame(frame, dirtyTiles, captured, diffed);
+		encoder.SetFocus(capture.GetFocus());
+		encoder.Encode(captured, diffed, frame, dirtyTiles, 1, quality, frameId, k_DefaultFragmentSize);
+		capture.ReleaseFrame();
+		for (uint32_t tile : encoder.GetFrame(0).tiles)
+			arrived[tile] = std::min(arrived[tile], frameId);
+		if (encoder.IsIdle(1, quality))
+			break;
+	}
+
+	uint32_t lastWindow = 0;
+	uint32_t firstNormal = UINT32_MAX;
+	for (uint32_t tile = 0; tile < grid.GetTileCount(); ++tile)
+	{
+		if (priorities[tile] == k_TilePriorityCursor)
+			CHECK(arrived[tile] == 0);
+		else if (priorities[tile] == k_TilePriorityWindow)
+			lastWindow = std::max(lastWindow, arrived[tile]);
+		else
+			firstNormal = std::min(firstNormal, arrived[tile]);
+	}
+	if (!CHECK(lastWindow <= firstNormal))
+		printf("  window tiles until frame %u, other tiles from frame %u\n", lastWindow, firstNormal);
+	// Throttled, and still all of it arrived.
+	CHECK(encoder.GetDeferredTileCount(0) != 0);
+	CHECK(std::find(arrived.begin(), arrived.end(), UINT32_MAX) == arrived.end());
+}
@@ -0,0 +1,109 @@
+#include "Test.h"
+
+#include <thread>
+
+#include "AllocationCount.h"
+#include "Streaming/CaptureStream.h"
+#include "Streaming/FrameSendQueue.h"
+#include "Streaming/SyntheticFrameSource.h"
+
+// Stands in for FrameMessageBuilder and the library: a message per fragment holding a reference
+// on its block, freed once "sent".
+struct FakeConnection
+{
+	std::vector<ArenaBlock *> inFlight;
+
+	void Send(const EncodedFrame &frame)
+	{
+		for (const EncodedFragment &fragment : frame.fragments)
+		{
+			fragment.block->AddRef();
+			inFlight.push_back(fragment.block);
+		}
+		for (const EncodedFragment &fragment : frame.parity)
+		{
+			fragment.block->AddRef();
+			inFlight.push_back(fragment.block);
+		}
+	}
+
+	void Complete()
+	{
+		for (ArenaBlock *block : inFlight)
+			block->Release();
+		inFlight.clear();
+	}
+};
+
+// Capture, diff, encode, queue and send of a screen that changes every frame, the path
+// PeerConnections::SendStream() takes, with the connection faked.  After warm-up it must not touch
+// the heap.
+TEST(SteadyStateStreamingDoesNotAllocate)
+{
+	static constexpr uint32_t k_WarmupFrames = 60;
+	static constexpr uint32_t k_MeasuredFrames = 120;
+
+	WorkStealingPool pool(2);
+	ArenaBlockPool blockPool;
+	SyntheticWorkloadConfig config;
+	config.workload = SyntheticWorkload::SlidingBlock;
+	config.width = 1280;
+	config.height = 720;
+	config.framesPerSecond = 240;
+	CaptureStream capture(0, std::make_unique<SyntheticFrameSource>(config), pool, blockPool);
+	FrameSendQueue sendQueue;
+	FakeConnection connection;
+	connection.inFlight.reserve(4096);
+	std::vector<uint32_t> dirtyTiles;
+	dirtyTiles.reserve(TileGrid(config.width, config.height).GetTileCount());
+	std::vector<uint32_t> evictedTiles;
+	const uint8_t quality[k_SimulcastLayerCount] = {k_TileQualityLossless, k_TileQualityLossless, k_TileQualityLossless};
+	// Parity as PeerConnections sends it by default.
+	capture.GetEncoder().SetFecConfig(0, FecConfig());
+	capture.SetActive(true);
+
+	uint64_t allocations = 0;
+	uint32_t frames = 0;
+	const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(20);
+	while (frames < k_WarmupFrames + k_MeasuredFrames && std::chrono::steady_clock::now() < deadline)
+	{
+		FrameView frame;
+		std::chrono::steady_clock::time_point captured;
+		std::chrono::steady_clock::time_point diffed;
+		if (!capture.AcquireFrame(frame, dirtyTiles, captured, diffed))
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			continue;
+		}
+		if (dirtyTiles.empty())
+		{
+			capture.ReleaseFrame();
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			continue;
+		}
+		if (frames == k_WarmupFrames)
+			allocations = GetAllocationCount();
+
+		SimulcastEncoder &encoder = capture.GetEncoder();
+		encoder.Encode(captured, diffed, frame, dirtyTiles, 1, quality, capture.NextFrameId(), k_DefaultFragmentSize);
+		capture.ReleaseFrame();
+		sendQueue.Push(encoder.GetFrame(0));
+		uint32_t width = 0;
+		uint32_t height = 0;
+		sendQueue.TakeEvictedTiles(evictedTiles, width, height);
+		while (!sendQueue.IsEmpty())
+		{
+			connection.Send(sendQueue.Front());
+			sendQueue.Pop();
+		}
+		connection.Complete();
+		++frames;
+	}
+	const uint64_t measured = GetAllocationCount() - allocations;
+	capture.SetActive(false);
+
+	CHECK(frames == k_WarmupFrames + k_MeasuredFrames);
+	if (measured != 0)
+		printf("  %llu allocations in %u frames\n", (unsigned long long)measured, k_MeasuredFrames);
+	CHECK(measured == 0);
+}
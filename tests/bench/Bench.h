@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <chrono>
+
+// Benchmarks register themselves with BENCHMARK(Name) { ... } and print their own table to stdout.
+// streaming_bench runs all of them, or those whose name contains one of its arguments.
+void RegisterBenchmark(const char *name, void (*fn)());
+
+#define BENCHMARK(name)                                                              \
+	static void name();                                                              \
+	static const bool name##Registered = (RegisterBenchmark(#name, &name), true); \
+	static void name()
+
+// Seconds since start, for timing a loop.
+inline double GetSecondsSince(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
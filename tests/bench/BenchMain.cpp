@@ -0,0 +1,39 @@
+#include "Bench.h"
+
+#include <cstring>
+#include <thread>
+#include <vector>
+
+struct Benchmark
+{
+	const char *name;
+	void (*fn)();
+};
+
+static std::vector<Benchmark> &GetBenchmarks()
+{
+	static std::vector<Benchmark> benchmarks;
+	return benchmarks;
+}
+
+void RegisterBenchmark(const char *name, void (*fn)())
+{
+	GetBenchmarks().push_back({name, fn});
+}
+
+int main(int argc, char **argv)
+{
+	printf("%u hardware threads\n", std::thread::hardware_concurrency());
+	for (const Benchmark &benchmark : GetBenchmarks())
+	{
+		bool selected = argc == 1;
+		for (int i = 1; i < argc && !selected; ++i)
+			selected = std::strstr(benchmark.name, argv[i]) != nullptr;
+		if (!selected)
+			continue;
+		printf("\n== %s\n", benchmark.name);
+		benchmark.fn();
+		fflush(stdout);
+	}
+	return 0;
+}
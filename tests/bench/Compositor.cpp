@@ -0,0 +1,273 @@
+#include "Bench.h"
+
+#include <algorithm>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define COMPOSITOR_SSE2 1
+#endif
+
+#include "../TestBlocks.h"
+#include "Streaming/Blit.h"
+#include "Streaming/DirtyRegion.h"
+#include "Streaming/ParallelTileEncoder.h"
+#include "Streaming/Playout.h"
+#include "Streaming/SyntheticFrameSource.h"
+#include "Streaming/TileCodec.h"
+#include "Streaming/TileDiff.h"
+
+// The receiver's side of a frame after the decoder: tiles blitted onto canvases, the changed part
+// of the canvas merged into rectangles, and the playout buffer handing frames to the renderer.
+// streaming_bench Compositor runs them all.
+
+#if COMPOSITOR_SSE2
+// The hand written row kernel BlitRect() was measured against, 16 bytes at a time.
+static void BlitRectSse2(const uint8_t *src, size_t srcStride, uint8_t *dst, size_t dstStride, uint32_t width, uint32_t height)
+{
+	const size_t rowBytes = (size_t)width * k_BytesPerPixel;
+	for (uint32_t y = 0; y < height; ++y, src += srcStride, dst += dstStride)
+	{
+		size_t x = 0;
+		for (; x + 64 <= rowBytes; x += 64)
+		{
+			const __m128i a = _mm_loadu_si128((const __m128i *)(src + x));
+			const __m128i b = _mm_loadu_si128((const __m128i *)(src + x + 16));
+			const __m128i c = _mm_loadu_si128((const __m128i *)(src + x + 32));
+			const __m128i d = _mm_loadu_si128((const __m128i *)(src + x + 48));
+			_mm_storeu_si128((__m128i *)(dst + x), a);
+			_mm_storeu_si128((__m128i *)(dst + x + 16), b);
+			_mm_storeu_si128((__m128i *)(dst + x + 32), c);
+			_mm_storeu_si128((__m128i *)(dst + x + 48), d);
+		}
+		for (; x + 16 <= rowBytes; x += 16)
+			_mm_storeu_si128((__m128i *)(dst + x), _mm_loadu_si128((const __m128i *)(src + x)));
+		std::memcpy(dst + x, src + x, rowBytes - x);
+	}
+}
+#endif
+
+using BlitFn = void (*)(const uint8_t *src, size_t srcStride, uint8_t *dst, size_t dstStride, uint32_t width, uint32_t height);
+
+// BlitRect() against the SSE2 kernel: one cache slot onto the canvas over and over, tiles of a
+// frame scattered over a 1080p canvas as the playout queue applies them, and a whole packed canvas.
+BENCHMARK(CompositorBlit)
+{
+	static constexpr uint32_t k_Width = 1920;
+	static constexpr uint32_t k_Height = 1080;
+	struct Kernel
+	{
+		const char *name;
+		BlitFn blit;
+	};
+	static const Kernel k_Kernels[] = {
+		{"BlitRect", &BlitRect},
+#if COMPOSITOR_SSE2
+		{"sse2", &BlitRectSse2},
+#endif
+	};
+
+	FrameBuffer canvas;
+	canvas.Resize(k_Width, k_Height);
+	FrameBuffer source;
+	source.Resize(k_Width, k_Height);
+	std::mt19937 random(1);
+	for (uint32_t y = 0; y < k_Height; ++y)
+	{
+		for (uint32_t x = 0; x < k_Width * k_BytesPerPixel; ++x)
+			source.Row(y)[x] = (uint8_t)random();
+	}
+	const TileGrid grid(k_Width, k_Height);
+	std::vector<uint32_t> scattered(grid.GetTileCount());
+	for (uint32_t tile = 0; tile < scattered.size(); ++tile)
+		scattered[tile] = tile;
+	std::shuffle(scattered.begin(), scattered.end(), random);
+	scattered.resize(500);
+	std::vector<uint8_t> slot((size_t)k_TileSize * k_TileSize * k_BytesPerPixel, 0x55);
+
+	printf("%-22s %-10s %10s %10s\n", "case", "kernel", "us", "GB/s");
+	for (const Kernel &kernel : k_Kernels)
+	{
+		// One tile, cache hot.
+		static constexpr uint32_t k_SlotCopies = 100000;
+		auto start = std::chrono::steady_clock::now();
+		for (uint32_t i = 0; i < k_SlotCopies; ++i)
+		{
+			const TileRect rect = grid.GetTileRect(i % 4);
+			kernel.blit(slot.data(), k_TileSize * k_BytesPerPixel, canvas.Row(rect.y) + (size_t)rect.x * k_BytesPerPixel, canvas.stride, rect.width, rect.height);
+		}
+		double seconds = GetSecondsSince(start);
+		printf("%-22s %-10s %10.3f %10.1f\n", "cache slot, hot", kernel.name, seconds * 1e6 / k_SlotCopies, slot.size() * (double)k_SlotCopies / seconds / 1e9);
+
+		// 500 tiles, strided on both sides.
+		static constexpr uint32_t k_Frames = 200;
+		start = std::chrono::steady_clock::now();
+		for (uint32_t frame = 0; frame < k_Frames; ++frame)
+		{
+			for (uint32_t tile : scattered)
+			{
+				const TileRect rect = grid.GetTileRect(tile);
+				const size_t offset = (size_t)rect.x * k_BytesPerPixel;
+				kernel.blit(source.Row(rect.y) + offset, source.stride, canvas.Row(rect.y) + offset, canvas.stride, rect.width, rect.height);
+			}
+		}
+		seconds = GetSecondsSince(start);
+		const double tileBytes = (double)k_TileSize * k_TileSize * k_BytesPerPixel * scattered.size();
+		printf("%-22s %-10s %10.1f %10.1f\n", "500 tiles of 1080p", kernel.name, seconds * 1e6 / k_Frames, tileBytes * k_Frames / seconds / 1e9);
+
+		// The whole canvas, packed.
+		start = std::chrono::steady_clock::now();
+		for (uint32_t frame = 0; frame < k_Frames; ++frame)
+			kernel.blit(source.Row(0), source.stride, canvas.Row(0), canvas.stride, k_Width, k_Height);
+		seconds = GetSecondsSince(start);
+		printf("%-22s %-10s %10.1f %10.1f\n", "whole 1080p canvas", kernel.name, seconds * 1e6 / k_Frames, (double)canvas.pixels.size() * k_Frames / seconds / 1e9);
+	}
+}
+
+// What DirtyRegion makes of each corpus workload's dirty tiles: how long GetRects() takes, how
+// many rectangles, and how much of the canvas they upload.  Then random tiles, the worst case
+// for merging.
+BENCHMARK(CompositorDirtyRegion)
+{
+	static constexpr uint32_t k_Ticks = 300;
+	printf("%-15s %8s %8s %12s %12s\n", "workload", "rects us", "rects", "upload KB", "canvas KB");
+	for (const SyntheticWorkloadConfig &config : GetSyntheticCorpus(1920, 1080))
+	{
+		SyntheticFrameSource source(config);
+		TileDiffer differ;
+		DirtyRegion region;
+		region.Reset(config.width, config.height);
+		std::vector<uint32_t> dirtyTiles;
+		double seconds = 0.0;
+		uint64_t rects = 0;
+		uint64_t uploaded = 0;
+		uint32_t frames = 0;
+		for (uint32_t tick = 0; tick < k_Ticks; ++tick)
+		{
+			CapturedFrame captured;
+			if (!source.AcquireFrame(std::chrono::milliseconds(0), captured))
+				continue;
+			differ.Diff(captured.view, captured.dirtyRects, !captured.hasDirtyRects, dirtyTiles);
+			source.ReleaseFrame();
+			if (frames++ == 0)
+				continue;
+			const auto start = std::chrono::steady_clock::now();
+			for (uint32_t tile : dirtyTiles)
+				region.AddTile(tile);
+			const std::vector<TileRect> &merged = region.GetRects();
+			seconds += GetSecondsSince(start);
+			rects += merged.size();
+			for (const TileRect &rect : merged)
+				uploaded += (uint64_t)rect.width * rect.height * k_BytesPerPixel;
+			region.Clear();
+		}
+		const uint32_t counted = frames > 1 ? frames - 1 : 1;
+		printf("%-15s %8.2f %8.1f %12.1f %12.1f\n", GetSyntheticWorkloadName(config.workload), seconds * 1e6 / counted, (double)rects / counted,
+			   uploaded / 1024.0 / counted, config.width * config.height * k_BytesPerPixel / 1024.0);
+	}
+
+	const TileGrid grid(1920, 1080);
+	std::mt19937 random(1);
+	DirtyRegion region;
+	region.Reset(1920, 1080);
+	for (uint32_t tiles : {8u, 64u, 256u})
+	{
+		static constexpr uint32_t k_Grids = 2000;
+		std::uniform_int_distribution<uint32_t> pick(0, grid.GetTileCount() - 1);
+		double seconds = 0.0;
+		uint64_t rects = 0;
+		uint64_t uploaded = 0;
+		for (uint32_t i = 0; i < k_Grids; ++i)
+		{
+			const auto start = std::chrono::steady_clock::now();
+			for (uint32_t tile = 0; tile < tiles; ++tile)
+				region.AddTile(pick(random));
+			const std::vector<TileRect> &merged = region.GetRects();
+			seconds += GetSecondsSince(start);
+			rects += merged.size();
+			for (const TileRect &rect : merged)
+				uploaded += (uint64_t)rect.width * rect.height * k_BytesPerPixel;
+			region.Clear();
+		}
+		printf("random %-3u tiles %8.2f %8.1f %12.1f %12.1f\n", tiles, seconds * 1e6 / k_Grids, (double)rects / k_Grids, uploaded / 1024.0 / k_Grids,
+			   1920 * 1080 * k_BytesPerPixel / 1024.0);
+	}
+}
+
+// The corpus through the receiver after the network: fragments into the reassembler, completed
+// frames captured and released by a LowLatency PlayoutBuffer, and the rectangles the renderer
+// would upload, as FrameReceiver and App::UpdateRemoteTexture() do it.
+BENCHMARK(CompositorPlayout)
+{
+	static constexpr uint32_t k_Ticks = 300;
+	printf("%-15s %10s %10s %10s %8s %8s %12s\n", "workload", "paint us", "capture us", "release us", "rects us", "rects", "upload KB");
+	WorkStealingPool pool(1);
+	for (const SyntheticWorkloadConfig &config : GetSyntheticCorpus(1920, 1080))
+	{
+		// The fragments of every frame, copied out of the encoder's arenas.
+		ArenaBlockPool blockPool;
+		ParallelTileEncoder encoder(pool, blockPool);
+		SyntheticFrameSource source(config);
+		TileDiffer differ;
+		std::vector<uint32_t> dirtyTiles;
+		std::vector<std::vector<std::vector<uint8_t>>> frames;
+		EncodedFrame encoded;
+		for (uint32_t tick = 0; tick < k_Ticks; ++tick)
+		{
+			CapturedFrame captured;
+			if (!source.AcquireFrame(std::chrono::milliseconds(0), captured))
+				continue;
+			differ.Diff(captured.view, captured.dirtyRects, !captured.hasDirtyRects, dirtyTiles);
+			encoder.Encode(captured.view, dirtyTiles, k_TileQualityLossless, (uint32_t)frames.size() + 1, (uint32_t)frames.size() * 16667, 0,
+						   k_DefaultFragmentSize, encoded);
+			source.ReleaseFrame();
+			std::vector<std::vector<uint8_t>> &fragments = frames.emplace_back();
+			for (const EncodedFragment &fragment : encoded.fragments)
+				fragments.emplace_back(fragment.data, fragment.data + fragment.size);
+		}
+
+		FrameReassembler reassembler;
+		PlayoutBuffer playout;
+		playout.SetMode(PlayoutMode::LowLatency);
+		double paint = 0.0;
+		double capture = 0.0;
+		double release = 0.0;
+		double merge = 0.0;
+		uint64_t rects = 0;
+		uint64_t uploaded = 0;
+		for (size_t frame = 0; frame < frames.size(); ++frame)
+		{
+			for (const std::vector<uint8_t> &fragment : frames[frame])
+			{
+				const auto start = std::chrono::steady_clock::now();
+				reassembler.AddFragment(fragment.data(), (uint32_t)fragment.size(), nullptr, &ReleaseNothing);
+				const auto painted = std::chrono::steady_clock::now();
+				playout.Capture(painted, reassembler);
+				if (frame != 0)
+				{
+					paint += std::chrono::duration<double>(painted - start).count();
+					capture += GetSecondsSince(painted);
+				}
+			}
+			const auto start = std::chrono::steady_clock::now();
+			playout.Release(start);
+			const auto released = std::chrono::steady_clock::now();
+			const std::vector<TileRect> &merged = playout.GetDirtyRegion().GetRects();
+			const double merging = GetSecondsSince(released);
+			if (frame != 0)
+			{
+				release += std::chrono::duration<double>(released - start).count();
+				merge += merging;
+				rects += merged.size();
+				for (const TileRect &rect : merged)
+					uploaded += (uint64_t)rect.width * rect.height * k_BytesPerPixel;
+			}
+			playout.GetDirtyRegion().Clear();
+		}
+		const size_t counted = frames.size() > 1 ? frames.size() - 1 : 1;
+		printf("%-15s %10.1f %10.1f %10.1f %8.2f %8.1f %12.1f\n", GetSyntheticWorkloadName(config.workload), paint * 1e6 / counted, capture * 1e6 / counted,
+			   release * 1e6 / counted, merge * 1e6 / counted, (double)rects / counted, uploaded / 1024.0 / counted);
+	}
+}
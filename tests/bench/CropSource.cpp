@@ -0,0 +1,65 @@
+#include "Bench.h"
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "Streaming/CropFrameSource.h"
+#include "Streaming/ParallelTileEncoder.h"
+#include "Streaming/SyntheticFrameSource.h"
+#include "Streaming/TileCodec.h"
+#include "Streaming/TileDiff.h"
+
+// The corpus at 1080p shared through CropFrameSource, from the whole screen down to a small
+// window in its middle: what diff and encode cost per frame when only the rectangle is looked at.
+// Averages are per frame after the first.
+BENCHMARK(CropSizes)
+{
+	static constexpr uint32_t k_Ticks = 300;
+	static constexpr uint32_t k_Crops[][2] = {{1920, 1080}, {1280, 720}, {800, 600}, {400, 300}, {128, 128}};
+
+	printf("%-15s %-10s %7s %10s %10s %10s %10s\n", "workload", "crop", "frames", "tiles", "diff us", "encode us", "KB");
+	WorkStealingPool pool(std::thread::hardware_concurrency());
+	for (const SyntheticWorkloadConfig &config : GetSyntheticCorpus(1920, 1080))
+	{
+		for (const uint32_t(&crop)[2] : k_Crops)
+		{
+			const TileRect rect = {(config.width - crop[0]) / 2, (config.height - crop[1]) / 2, crop[0], crop[1]};
+			CropFrameSource source(std::make_unique<SyntheticFrameSource>(config), std::make_unique<FixedCropRegion>(rect));
+			ArenaBlockPool blockPool;
+			ParallelTileEncoder encoder(pool, blockPool);
+			EncodedFrame encodedFrame;
+			TileDiffer differ;
+			std::vector<uint32_t> dirtyTiles;
+			double diff = 0.0;
+			double encode = 0.0;
+			uint64_t tiles = 0;
+			uint64_t bytes = 0;
+			uint32_t frames = 0;
+			for (uint32_t tick = 0; tick < k_Ticks; ++tick)
+			{
+				CapturedFrame captured;
+				if (!source.AcquireFrame(std::chrono::milliseconds(0), captured))
+					continue;
+				auto start = std::chrono::steady_clock::now();
+				differ.Diff(captured.view, captured.dirtyRects, !captured.hasDirtyRects, dirtyTiles);
+				const double diffed = GetSecondsSince(start);
+				start = std::chrono::steady_clock::now();
+				encoder.Encode(captured.view, dirtyTiles, k_TileQualityLossless, frames + 1, 0, 0, k_DefaultFragmentSize, encodedFrame);
+				const double encoded = GetSecondsSince(start);
+				source.ReleaseFrame();
+				if (frames++ == 0)
+					continue;
+				diff += diffed;
+				encode += encoded;
+				tiles += dirtyTiles.size();
+				bytes += encodedFrame.byteCount;
+			}
+			const uint32_t counted = frames > 1 ? frames - 1 : 1;
+			char size[16];
+			snprintf(size, sizeof(size), "%ux%u", crop[0], crop[1]);
+			printf("%-15s %-10s %7u %10.1f %10.1f %10.1f %10.1f\n", GetSyntheticWorkloadName(config.workload), size, frames, (double)tiles / counted,
+				   diff * 1e6 / counted, encode * 1e6 / counted, bytes / 1024.0 / counted);
+		}
+	}
+}
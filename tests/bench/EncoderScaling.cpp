@@ -0,0 +1,169 @@
+#include "Bench.h"
+
+#include <algorithm>
+
+#include <thread>
+
+#include "Streaming/Downscale.h"
+#include "Streaming/ParallelTileEncoder.h"
+#include "Streaming/SimulcastEncoder.h"
+#include "Streaming/SyntheticFrameSource.h"
+#include "Streaming/TileCodec.h"
+
+// count frames of config's workload, copied out of the source so every run encodes the same ones.
+static std::vector<FrameBuffer> CaptureFrames(const SyntheticWorkloadConfig &config, uint32_t count)
+{
+	SyntheticFrameSource source(config);
+	std::vector<FrameBuffer> frames(count);
+	CapturedFrame captured;
+	for (FrameBuffer &frame : frames)
+	{
+		source.AcquireFrame(std::chrono::milliseconds(0), captured);
+		frame.Resize(captured.view.width, captured.view.height);
+		for (uint32_t y = 0; y < frame.height; ++y)
+			std::copy_n(captured.view.Row(y), (size_t)frame.width * k_BytesPerPixel, frame.Row(y));
+		source.ReleaseFrame();
+	}
+	return frames;
+}
+
+// Every tile of a width x height grid.
+static std::vector<uint32_t> GetAllTiles(uint32_t width, uint32_t height)
+{
+	const TileGrid grid(width, height);
+	std::vector<uint32_t> tiles(grid.GetTileCount());
+	for (uint32_t tile = 0; tile < tiles.size(); ++tile)
+		tiles[tile] = tile;
+	return tiles;
+}
+
+// Encode time of a frame whose every tile changed, against the encoder pool's thread count.
+BENCHMARK(EncoderScaling)
+{
+	static constexpr uint32_t k_Frames = 16;
+	static constexpr uint32_t k_ThreadCounts[] = {1, 2, 4, 8, 12, 16};
+	static constexpr SyntheticWorkload k_Workloads[] = {SyntheticWorkload::Scrolling, SyntheticWorkload::Video};
+
+	printf("%-15s %-9s %7s %10s %10s %8s\n", "workload", "size", "threads", "ms/frame", "MB/frame", "speedup");
+	for (SyntheticWorkload workload : k_Workloads)
+	{
+		for (uint32_t height : {1080u, 2160u})
+		{
+			SyntheticWorkloadConfig config;
+			config.workload = workload;
+			config.width = height * 16 / 9;
+			config.height = height;
+			config.changeRatio = 1.0;
+			const std::vector<FrameBuffer> frames = CaptureFrames(config, k_Frames);
+			const std::vector<uint32_t> dirtyTiles = GetAllTiles(config.width, config.height);
+
+			double single = 0.0;
+			for (uint32_t threads : k_ThreadCounts)
+			{
+				WorkStealingPool pool(threads);
+				ArenaBlockPool blockPool;
+				ParallelTileEncoder encoder(pool, blockPool);
+				EncodedFrame out;
+				encoder.Encode(frames[0].GetView(), dirtyTiles, k_TileQualityLossless, 0, 0, 0, k_DefaultFragmentSize, out);
+
+				size_t bytes = 0;
+				const auto start = std::chrono::steady_clock::now();
+				for (uint32_t i = 0; i < k_Frames; ++i)
+				{
+					encoder.Encode(frames[i].GetView(), dirtyTiles, k_TileQualityLossless, i + 1, 0, 0, k_DefaultFragmentSize, out);
+					bytes += out.byteCount;
+				}
+				const double ms = GetSecondsSince(start) * 1000.0 / k_Frames;
+				if (threads == 1)
+					single = ms;
+				printf("%-15s %4ux%-4u %7u %10.2f %10.2f %7.2fx\n", GetSyntheticWorkloadName(workload), config.width, config.height, threads, ms,
+					   bytes / (1024.0 * 1024.0) / k_Frames, single / ms);
+			}
+		}
+	}
+}
+
+// Box filtering a whole frame down to each simulcast layer, tile by tile as SimulcastEncoder does,
+// in megapixels of the source frame per second.
+BENCHMARK(DownscaleThroughput)
+{
+	static constexpr uint32_t k_Frames = 16;
+
+	printf("%-9s %-6s %10s %10s\n", "size", "layer", "ms/frame", "MPix/s");
+	for (uint32_t height : {1080u, 2160u})
+	{
+		SyntheticWorkloadConfig config;
+		config.workload = SyntheticWorkload::Video;
+		config.width = height * 16 / 9;
+		config.height = height;
+		config.changeRatio = 1.0;
+		const std::vector<FrameBuffer> frames = CaptureFrames(config, k_Frames);
+		for (uint32_t layer = 1; layer < k_SimulcastLayerCount; ++layer)
+		{
+			const TileGrid grid(GetScaledSize(config.width, layer), GetScaledSize(config.height, layer));
+			FrameBuffer buffer;
+			buffer.Resize(grid.GetWidth(), grid.GetHeight());
+			const auto start = std::chrono::steady_clock::now();
+			for (const FrameBuffer &frame : frames)
+			{
+				for (uint32_t tile = 0; tile < grid.GetTileCount(); ++tile)
+					Downscale(frame.GetView(), layer, grid.GetTileRect(tile), buffer);
+			}
+			const double seconds = GetSecondsSince(start);
+			printf("%4ux%-4u %6u %10.3f %10.0f\n", config.width, config.height, layer, seconds * 1000.0 / k_Frames,
+				   (double)config.width * config.height * k_Frames / seconds / 1e6);
+		}
+	}
+}
+
+// SimulcastEncoder::Encode() of frames whose every tile changed, for every combination of layers
+// viewers subscribe to: what a half or quarter resolution viewer adds to a full resolution one.
+BENCHMARK(SimulcastSubscribers)
+{
+	static constexpr uint32_t k_Frames = 16;
+	static constexpr SyntheticWorkload k_Workloads[] = {SyntheticWorkload::Scrolling, SyntheticWorkload::Video};
+	const uint8_t quality[k_SimulcastLayerCount] = {k_TileQualityLossless, k_TileQualityLossless, k_TileQualityLossless};
+
+	printf("%-15s %-9s %-8s %10s %10s\n", "workload", "size", "layers", "ms/frame", "MB/frame");
+	WorkStealingPool pool(std::thread::hardware_concurrency());
+	for (SyntheticWorkload workload : k_Workloads)
+	{
+		for (uint32_t height : {1080u, 2160u})
+		{
+			SyntheticWorkloadConfig config;
+			config.workload = workload;
+			config.width = height * 16 / 9;
+			config.height = height;
+			config.changeRatio = 1.0;
+			const std::vector<FrameBuffer> frames = CaptureFrames(config, k_Frames + 1);
+			const std::vector<uint32_t> dirtyTiles = GetAllTiles(config.width, config.height);
+			for (uint32_t layerMask = 1; layerMask < (1u << k_SimulcastLayerCount); ++layerMask)
+			{
+				ArenaBlockPool blockPool;
+				SimulcastEncoder encoder(pool, blockPool);
+				for (uint32_t layer = 0; layer < k_SimulcastLayerCount; ++layer)
+					encoder.GetRefiner(layer).SetChangeQuality(k_TileQualityLossless);
+				auto now = std::chrono::steady_clock::now();
+				encoder.Encode(now, now, frames[0].GetView(), dirtyTiles, layerMask, quality, 1, k_DefaultFragmentSize);
+
+				size_t bytes = 0;
+				const auto start = std::chrono::steady_clock::now();
+				for (uint32_t i = 1; i <= k_Frames; ++i)
+				{
+					now = std::chrono::steady_clock::now();
+					encoder.Encode(now, now, frames[i].GetView(), dirtyTiles, layerMask, quality, i + 1, k_DefaultFragmentSize);
+					for (uint32_t layer = 0; layer < k_SimulcastLayerCount; ++layer)
+					{
+						if (layerMask & (1u << layer))
+							bytes += encoder.GetFrame(layer).byteCount;
+					}
+				}
+				const double ms = GetSecondsSince(start) * 1000.0 / k_Frames;
+				char layers[8];
+				snprintf(layers, sizeof(layers), "%s%s%s", layerMask & 1 ? "F" : "-", layerMask & 2 ? "H" : "-", layerMask & 4 ? "Q" : "-");
+				printf("%-15s %4ux%-4u %-8s %10.2f %10.2f\n", GetSyntheticWorkloadName(workload), config.width, config.height, layers, ms,
+					   bytes / (1024.0 * 1024.0) / k_Frames);
+			}
+		}
+	}
+}
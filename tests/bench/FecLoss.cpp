@@ -0,0 +1,106 @@
+#include "Bench.h"
+
+#include <random>
+
+#include "Streaming/Fec.h"
+#include "Streaming/SyntheticFrameSource.h"
+#include "Streaming/TileCodec.h"
+
+static void CountRecovered(void *context, uint8_t *data, uint32_t)
+{
+	++*static_cast<uint32_t *>(context);
+	delete[] data;
+}
+
+// What FEC costs and what it saves: a 1080p frame of every tile, its fragments and parity dropped
+// at random as FakePacketLoss_Send would, and the share of data fragments still missing after the
+// decoder is done, i.e. the ones that need a TileNack round trip.
+BENCHMARK(FecLoss)
+{
+	static constexpr uint32_t k_Trials = 50;
+	static constexpr float k_LossRates[] = {0.01f, 0.05f, 0.10f};
+	struct Scheme
+	{
+		const char *name;
+		FecScheme scheme;
+		float redundancy;
+		uint32_t groupSize;
+	};
+	static constexpr Scheme k_Schemes[] = {
+		{"none", FecScheme::None, 0.0f, 0},
+		{"xor 1/10", FecScheme::Xor, 0.1f, 0},
+		{"xor 1/5", FecScheme::Xor, 0.2f, 0},
+		{"rs 16+2", FecScheme::ReedSolomon, 0.125f, 16},
+		{"rs 16+4", FecScheme::ReedSolomon, 0.25f, 16},
+	};
+
+	SyntheticWorkloadConfig config;
+	config.workload = SyntheticWorkload::Scrolling;
+	SyntheticFrameSource source(config);
+	CapturedFrame captured;
+	source.AcquireFrame(std::chrono::milliseconds(0), captured);
+	const TileGrid grid(config.width, config.height);
+	std::vector<uint32_t> dirtyTiles(grid.GetTileCount());
+	for (uint32_t tile = 0; tile < dirtyTiles.size(); ++tile)
+		dirtyTiles[tile] = tile;
+	WorkStealingPool pool(1);
+	ArenaBlockPool blockPool;
+	ParallelTileEncoder encoder(pool, blockPool);
+	EncodedFrame frame;
+	encoder.Encode(captured.view, dirtyTiles, k_TileQualityLossless, 1, 0, 0, k_DefaultFragmentSize, frame);
+	source.ReleaseFrame();
+	const size_t dataBytes = frame.byteCount;
+	const uint32_t fragmentCount = (uint32_t)frame.fragments.size();
+
+	printf("%u fragments, %.2f MB\n", fragmentCount, dataBytes / (1024.0 * 1024.0));
+	printf("%-9s %8s %10s %10s   %-26s\n", "scheme", "overhead", "protect ms", "decode ms", "fragments lost 1% / 5% / 10%");
+	FecEncoder fec(blockPool);
+	std::mt19937 random(1);
+	for (const Scheme &scheme : k_Schemes)
+	{
+		FecConfig fecConfig;
+		fecConfig.scheme = scheme.scheme;
+		fecConfig.redundancy = scheme.redundancy;
+		fecConfig.groupSize = scheme.groupSize;
+
+		// Once to size the arena, then timed.
+		frame.byteCount = dataBytes;
+		fec.Protect(frame, fecConfig);
+		frame.byteCount = dataBytes;
+		auto start = std::chrono::steady_clock::now();
+		fec.Protect(frame, fecConfig);
+		const double protectMs = GetSecondsSince(start) * 1000.0;
+
+		double decodeSeconds = 0.0;
+		double lost[std::size(k_LossRates)] = {};
+		for (size_t rate = 0; rate < std::size(k_LossRates); ++rate)
+		{
+			std::bernoulli_distribution drop(k_LossRates[rate]);
+			uint32_t missing = 0;
+			for (uint32_t trial = 0; trial < k_Trials; ++trial)
+			{
+				uint32_t recovered = 0;
+				FecDecoder decoder(&CountRecovered, &recovered);
+				uint32_t received = 0;
+				start = std::chrono::steady_clock::now();
+				for (const EncodedFragment &fragment : frame.fragments)
+				{
+					if (drop(random))
+						continue;
+					decoder.AddData(fragment.data, fragment.size);
+					++received;
+				}
+				for (const EncodedFragment &parity : frame.parity)
+				{
+					if (!drop(random))
+						decoder.AddParity(parity.data, parity.size);
+				}
+				decodeSeconds += GetSecondsSince(start);
+				missing += fragmentCount - received - recovered;
+			}
+			lost[rate] = 100.0 * missing / ((double)fragmentCount * k_Trials);
+		}
+		printf("%-9s %7.1f%% %10.2f %10.2f   %5.2f / %5.2f / %5.2f %%\n", scheme.name, 100.0 * (frame.byteCount - dataBytes) / dataBytes, protectMs,
+			   decodeSeconds * 1000.0 / (k_Trials * std::size(k_LossRates)), lost[0], lost[1], lost[2]);
+	}
+}
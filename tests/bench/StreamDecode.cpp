@@ -0,0 +1,77 @@
+#include "Bench.h"
+
+#include <algorithm>
+#include <memory>
+#include <thread>
+
+#include "../TestBlocks.h"
+#include "Streaming/ParallelTileEncoder.h"
+#include "Streaming/StreamDecodePool.h"
+#include "Streaming/SyntheticFrameSource.h"
+#include "Streaming/TileCodec.h"
+
+// Aggregate decode rate of 1 to 8 peers' screens arriving at once, every tile of every frame
+// changed, decoded by one thread and by a StreamDecodePool of every core.  Each stream gets the
+// same frames and a receiver of its own, as PeerConnections::PollMessages() queues them.
+BENCHMARK(StreamDecode)
+{
+	static constexpr uint32_t k_Frames = 30;
+	static constexpr uint32_t k_StreamCounts[] = {1, 2, 4, 8};
+
+	SyntheticWorkloadConfig config;
+	config.workload = SyntheticWorkload::Scrolling;
+	config.changeRatio = 1.0;
+	SyntheticFrameSource source(config);
+	const TileGrid grid(config.width, config.height);
+	std::vector<uint32_t> dirtyTiles(grid.GetTileCount());
+	for (uint32_t tile = 0; tile < dirtyTiles.size(); ++tile)
+		dirtyTiles[tile] = tile;
+
+	// The fragments of every frame, copied out of the encoder's arenas.
+	WorkStealingPool pool(std::thread::hardware_concurrency());
+	ArenaBlockPool blockPool;
+	ParallelTileEncoder encoder(pool, blockPool);
+	EncodedFrame frame;
+	std::vector<std::vector<uint8_t>> messages;
+	size_t bytes = 0;
+	CapturedFrame captured;
+	for (uint32_t i = 0; i < k_Frames; ++i)
+	{
+		source.AcquireFrame(std::chrono::milliseconds(0), captured);
+		encoder.Encode(captured.view, dirtyTiles, k_TileQualityLossless, i + 1, i * 16667, 0, k_DefaultFragmentSize, frame);
+		source.ReleaseFrame();
+		for (const EncodedFragment &fragment : frame.fragments)
+			messages.emplace_back(fragment.data, fragment.data + fragment.size);
+		bytes += frame.byteCount;
+	}
+	const double pixels = (double)config.width * config.height * k_Frames;
+
+	printf("%u frames of %ux%u, %.2f MB per stream\n", k_Frames, config.width, config.height, bytes / (1024.0 * 1024.0));
+	printf("%-8s %7s %8s %12s %10s\n", "threads", "streams", "ms", "Mpixels/s", "rounds");
+	std::vector<uint32_t> threadCounts = {1};
+	if (std::thread::hardware_concurrency() > 1)
+		threadCounts.push_back(std::thread::hardware_concurrency());
+	for (uint32_t threads : threadCounts)
+	{
+		StreamDecodePool decodePool(threads);
+		for (uint32_t streamCount : k_StreamCounts)
+		{
+			std::vector<std::unique_ptr<FrameReceiver>> receivers;
+			std::vector<FrameReceiver *> streams;
+			for (uint32_t stream = 0; stream < streamCount; ++stream)
+			{
+				receivers.push_back(std::make_unique<FrameReceiver>());
+				streams.push_back(receivers.back().get());
+				for (const std::vector<uint8_t> &message : messages)
+					receivers.back()->QueueMessage(message.data(), (uint32_t)message.size(), nullptr, &ReleaseNothing);
+			}
+
+			const uint64_t rounds = decodePool.GetRoundCount();
+			const auto start = std::chrono::steady_clock::now();
+			decodePool.Run(streams, std::chrono::steady_clock::time_point::max());
+			const double seconds = GetSecondsSince(start);
+			printf("%-8u %7u %8.1f %12.1f %10llu\n", decodePool.GetWorkerCount(), streamCount, seconds * 1000.0, pixels * streamCount / seconds / 1e6,
+				   (unsigned long long)(decodePool.GetRoundCount() - rounds));
+		}
+	}
+}
@@ -0,0 +1,216 @@
+#include "Bench.h"
+
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "../TestBlocks.h"
+#include "Streaming/FrameReassembler.h"
+#include "Streaming/SimulcastEncoder.h"
+#include "Streaming/SyntheticFrameSource.h"
+#include "Streaming/TileCodec.h"
+#include "Streaming/TileDiff.h"
+#include "Streaming/TileHash.h"
+
+// Every stage on the standard corpus at 1080p, see GetSyntheticCorpus(): streaming_bench Corpus
+// runs them all.  Averages are per frame after the first, which has every tile dirty.
+static constexpr uint32_t k_CorpusTicks = 300;
+static constexpr uint32_t k_CorpusWidth = 1920;
+static constexpr uint32_t k_CorpusHeight = 1080;
+
+// Calls frameFn(captured, frameIndex) for every frame of config's workload over k_CorpusTicks,
+// ticks where nothing changed have none.  Returns the frames after the first.
+template <typename FrameFn>
+static uint32_t PlayCorpus(const SyntheticWorkloadConfig &config, FrameFn frameFn)
+{
+	SyntheticFrameSource source(config);
+	uint32_t frames = 0;
+	for (uint32_t tick = 0; tick < k_CorpusTicks; ++tick)
+	{
+		CapturedFrame captured;
+		if (!source.AcquireFrame(std::chrono::milliseconds(0), captured))
+			continue;
+		frameFn(captured, frames++);
+		source.ReleaseFrame();
+	}
+	return frames > 1 ? frames - 1 : 1;
+}
+
+// What it takes to draw a frame, and to find its dirty tiles from the source's rects.
+BENCHMARK(CorpusDiff)
+{
+	printf("%-15s %7s %10s %10s %12s %12s\n", "workload", "frames", "gen us", "diff us", "dirty tiles", "hashed tiles");
+	for (const SyntheticWorkloadConfig &config : GetSyntheticCorpus(k_CorpusWidth, k_CorpusHeight))
+	{
+		SyntheticFrameSource source(config);
+		TileDiffer differ;
+		std::vector<uint32_t> dirtyTiles;
+		double generate = 0.0;
+		double diff = 0.0;
+		uint64_t dirty = 0;
+		uint64_t hashed = 0;
+		uint32_t frames = 0;
+		for (uint32_t tick = 0; tick < k_CorpusTicks; ++tick)
+		{
+			CapturedFrame captured;
+			auto start = std::chrono::steady_clock::now();
+			if (!source.AcquireFrame(std::chrono::milliseconds(0), captured))
+				continue;
+			const double generated = GetSecondsSince(start);
+			const uint64_t hashedBefore = differ.GetHashedTileCount();
+			start = std::chrono::steady_clock::now();
+			differ.Diff(captured.view, captured.dirtyRects, !captured.hasDirtyRects, dirtyTiles);
+			const double diffed = GetSecondsSince(start);
+			source.ReleaseFrame();
+			if (frames++ == 0)
+				continue;
+			generate += generated;
+			diff += diffed;
+			dirty += dirtyTiles.size();
+			hashed += differ.GetHashedTileCount() - hashedBefore;
+		}
+		const uint32_t counted = frames > 1 ? frames - 1 : 1;
+		printf("%-15s %7u %10.1f %10.1f %12.1f %12.1f\n", GetSyntheticWorkloadName(config.workload), frames, generate * 1e6 / counted, diff * 1e6 / counted,
+			   (double)dirty / counted, (double)hashed / counted);
+	}
+}
+
+// The dirty tiles through TileCodec on their own, lossless and at the lowest quality, and back.
+BENCHMARK(CorpusCodec)
+{
+	printf("%-15s %11s %13s %13s %13s %10s\n", "workload", "tiles", "lossless KB", "encode MB/s", "decode MB/s", "min KB");
+	for (const SyntheticWorkloadConfig &config : GetSyntheticCorpus(k_CorpusWidth, k_CorpusHeight))
+	{
+		TileDiffer differ;
+		std::vector<uint32_t> dirtyTiles;
+		const TileGrid grid(config.width, config.height);
+		std::vector<uint8_t> record(TileCodec::GetMaxRecordSize(grid.GetTileRect(0)));
+		FrameBuffer canvas;
+		canvas.Resize(config.width, config.height);
+		double encode = 0.0;
+		double decode = 0.0;
+		uint64_t tiles = 0;
+		uint64_t pixelBytes = 0;
+		uint64_t losslessBytes = 0;
+		uint64_t minBytes = 0;
+		const uint32_t frames = PlayCorpus(config, [&](const CapturedFrame &captured, uint32_t frame)
+										   {
+											   differ.Diff(captured.view, captured.dirtyRects, !captured.hasDirtyRects, dirtyTiles);
+											   if (frame == 0)
+												   return;
+											   for (uint32_t tile : dirtyTiles)
+											   {
+												   const TileRect rect = grid.GetTileRect(tile);
+												   auto start = std::chrono::steady_clock::now();
+												   const size_t size = TileCodec::Encode(captured.view, rect, tile, k_TileQualityLossless, record.data());
+												   encode += GetSecondsSince(start);
+
+												   TileRecordHeader header;
+												   std::memcpy(&header, record.data(), sizeof(header));
+												   start = std::chrono::steady_clock::now();
+												   TileCodec::Decode(header, record.data() + sizeof(header), rect, canvas.Row(rect.y) + (size_t)rect.x * k_BytesPerPixel, canvas.stride);
+												   decode += GetSecondsSince(start);
+
+												   losslessBytes += size;
+												   minBytes += TileCodec::Encode(captured.view, rect, tile, k_TileQualityMin, record.data());
+												   pixelBytes += (uint64_t)rect.width * rect.height * k_BytesPerPixel;
+											   }
+											   tiles += dirtyTiles.size();
+										   });
+		printf("%-15s %11.1f %13.1f %13.0f %13.0f %10.1f\n", GetSyntheticWorkloadName(config.workload), (double)tiles / frames,
+			   losslessBytes / 1024.0 / frames, encode > 0.0 ? pixelBytes / encode / 1e6 : 0.0, decode > 0.0 ? pixelBytes / decode / 1e6 : 0.0,
+			   minBytes / 1024.0 / frames);
+	}
+}
+
+// How many dirty tiles the sender's TileCache turns into references, and what hashing them costs.
+BENCHMARK(CorpusCache)
+{
+	printf("%-15s %11s %10s %11s %11s\n", "workload", "tiles", "hash us", "references", "cache hits");
+	for (const SyntheticWorkloadConfig &config : GetSyntheticCorpus(k_CorpusWidth, k_CorpusHeight))
+	{
+		TileDiffer differ;
+		std::vector<uint32_t> dirtyTiles;
+		const TileGrid grid(config.width, config.height);
+		TileCache cache;
+		std::vector<uint64_t> hashes;
+		double hash = 0.0;
+		uint64_t tiles = 0;
+		uint64_t references = 0;
+		const uint32_t frames = PlayCorpus(config, [&](const CapturedFrame &captured, uint32_t frame)
+										   {
+											   differ.Diff(captured.view, captured.dirtyRects, !captured.hasDirtyRects, dirtyTiles);
+											   const auto start = std::chrono::steady_clock::now();
+											   hashes.resize(dirtyTiles.size());
+											   for (size_t i = 0; i < dirtyTiles.size(); ++i)
+												   hashes[i] = HashTile(captured.view, grid.GetTileRect(dirtyTiles[i]), 0);
+											   const double hashed = GetSecondsSince(start);
+											   uint64_t referenced = 0;
+											   for (uint64_t tileHash : hashes)
+												   referenced += cache.Use(tileHash, frame + 1).reference;
+											   if (frame == 0)
+												   return;
+											   hash += hashed;
+											   tiles += dirtyTiles.size();
+											   references += referenced;
+										   });
+		printf("%-15s %11.1f %10.1f %11.1f %10.1f%%\n", GetSyntheticWorkloadName(config.workload), (double)tiles / frames, hash * 1e6 / frames,
+			   (double)references / frames, tiles != 0 ? 100.0 * references / tiles : 0.0);
+	}
+}
+
+// Diff, encode with the cache, fragments into a reassembler, as a stream runs it lossless on a
+// link that takes everything.  The receiver's canvas has to match every frame.
+BENCHMARK(CorpusEndToEnd)
+{
+	printf("%-15s %10s %10s %13s %10s %10s\n", "workload", "diff us", "encode us", "reassemble us", "KB", "matched");
+	WorkStealingPool pool(std::thread::hardware_concurrency());
+	for (const SyntheticWorkloadConfig &config : GetSyntheticCorpus(k_CorpusWidth, k_CorpusHeight))
+	{
+		ArenaBlockPool blockPool;
+		SimulcastEncoder encoder(pool, blockPool);
+		encoder.GetRefiner(0).SetChangeQuality(k_TileQualityLossless);
+		const uint8_t quality[k_SimulcastLayerCount] = {k_TileQualityLossless, k_TileQualityLossless, k_TileQualityLossless};
+		FrameReassembler reassembler;
+		TileDiffer differ;
+		std::vector<uint32_t> dirtyTiles;
+		double diff = 0.0;
+		double encode = 0.0;
+		double reassemble = 0.0;
+		uint64_t bytes = 0;
+		uint32_t matched = 0;
+		const uint32_t frames = PlayCorpus(config, [&](const CapturedFrame &captured, uint32_t frame)
+										   {
+											   auto start = std::chrono::steady_clock::now();
+											   differ.Diff(captured.view, captured.dirtyRects, !captured.hasDirtyRects, dirtyTiles);
+											   const double diffed = GetSecondsSince(start);
+											   start = std::chrono::steady_clock::now();
+											   encoder.Encode(start, start, captured.view, dirtyTiles, 1, quality, frame + 1, k_DefaultFragmentSize);
+											   const double encoded = GetSecondsSince(start);
+											   const EncodedFrame &encodedFrame = encoder.GetFrame(0);
+											   start = std::chrono::steady_clock::now();
+											   for (const EncodedFragment &fragment : encodedFrame.fragments)
+											   {
+												   fragment.block->AddRef();
+												   reassembler.AddFragment(fragment.data, fragment.size, fragment.block, &ReleaseBlock);
+											   }
+											   const double reassembled = GetSecondsSince(start);
+											   reassembler.ClearCompletedFrames();
+											   reassembler.ClearUpdatedTiles();
+
+											   const FrameBuffer &canvas = reassembler.GetCanvas();
+											   bool same = canvas.width == captured.view.width && canvas.height == captured.view.height;
+											   for (uint32_t y = 0; same && y < canvas.height; ++y)
+												   same = std::memcmp(canvas.Row(y), captured.view.Row(y), (size_t)canvas.width * k_BytesPerPixel) == 0;
+											   if (frame == 0)
+												   return;
+											   diff += diffed;
+											   encode += encoded;
+											   reassemble += reassembled;
+											   bytes += encodedFrame.byteCount;
+											   matched += same;
+										   });
+		printf("%-15s %10.1f %10.1f %13.1f %10.1f %6u/%-3u\n", GetSyntheticWorkloadName(config.workload), diff * 1e6 / frames, encode * 1e6 / frames,
+			   reassemble * 1e6 / frames, bytes / 1024.0 / frames, matched, frames);
+	}
+}